@@ -0,0 +1,339 @@
+// op25-gateway-bench - microbenchmarks for the per-frame hot path
+//
+// Run with --benchmark_format=json (or `make bench`) and compare against
+// bench/baseline.json with bench/compare.py.
+
+#include "P25Utils.h"
+#include "CallManager.h"
+#include "VoiceSink.h"
+#include "StreamFramer.h"
+#include "FNEClient.h"
+#include "Logger.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+using namespace op25gateway;
+
+namespace {
+
+constexpr uint32_t BENCH_SRC_ID = 1234567;
+constexpr uint32_t BENCH_DST_ID = 9001;
+constexpr uint32_t BENCH_PEER_ID = 9000999;
+constexpr uint32_t BENCH_WACN = 0x92C19;
+constexpr uint16_t BENCH_SYS_ID = 0x50E;
+
+void fillIMBE(uint8_t imbe[9][IMBE_FRAME_SIZE]) {
+    for (int i = 0; i < 9; i++) {
+        for (size_t j = 0; j < IMBE_FRAME_SIZE; j++) {
+            imbe[i][j] = static_cast<uint8_t>(i * 31 + j * 7);
+        }
+    }
+}
+
+void buildOP25Datagram(uint8_t* data, uint32_t tg, uint32_t src, uint8_t frameType, uint8_t index) {
+    std::memset(data, 0, OP25_PACKET_SIZE);
+    data[0] = OP25_MAGIC >> 8;
+    data[1] = OP25_MAGIC & 0xFF;
+    data[2] = 0x02;
+    data[3] = 0x93;
+    data[4] = (tg >> 24) & 0xFF;
+    data[5] = (tg >> 16) & 0xFF;
+    data[6] = (tg >> 8) & 0xFF;
+    data[7] = tg & 0xFF;
+    data[8] = (src >> 24) & 0xFF;
+    data[9] = (src >> 16) & 0xFF;
+    data[10] = (src >> 8) & 0xFF;
+    data[11] = src & 0xFF;
+    data[12] = frameType;
+    data[13] = index;
+    for (size_t i = 0; i < IMBE_FRAME_SIZE; i++) {
+        data[16 + i] = static_cast<uint8_t>(index + i);
+    }
+}
+
+// Stand-in for FNEClient: frames each LDU exactly as it would for the
+// wire (P25 payload, DVM header, CRC) but never touches a socket
+class StubFNESink : public VoiceSink {
+public:
+    StubFNESink()
+        : m_framer(BENCH_PEER_ID, BENCH_WACN, BENCH_SYS_ID)
+    {
+    }
+
+    void startStream(uint32_t, uint32_t srcId, uint32_t dstId) override {
+        m_framer.newStream();
+        emit(m_framer.frameTDU(m_packet, srcId, dstId, true));
+    }
+
+    void endStream(uint32_t, uint32_t srcId, uint32_t dstId) override {
+        emit(m_framer.frameTDU(m_packet, srcId, dstId, false));
+    }
+
+    void sendLDU1(uint32_t, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                  uint32_t srcId, uint32_t dstId, bool firstLDU) override {
+        emit(m_framer.frameLDU1(m_packet, imbe, srcId, dstId, firstLDU));
+    }
+
+    void sendLDU2(uint32_t, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                  uint32_t srcId, uint32_t dstId) override {
+        emit(m_framer.frameLDU2(m_packet, imbe, srcId, dstId));
+    }
+
+    uint64_t frames() const { return m_frames; }
+
+private:
+    void emit(size_t len) {
+        benchmark::DoNotOptimize(m_packet);
+        benchmark::DoNotOptimize(len);
+        m_frames++;
+    }
+
+    StreamFramer m_framer;
+    uint8_t m_packet[DVM_MAX_VOICE_FRAME] = {};
+    uint64_t m_frames = 0;
+};
+
+} // namespace
+
+static void BM_crc16_ccitt(benchmark::State& state) {
+    std::vector<uint8_t> data(state.range(0));
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i * 13);
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(P25Utils::crc16_ccitt(data.data(), data.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_crc16_ccitt)->Arg(P25_TDU_LENGTH)->Arg(P25_LDU2_LENGTH)->Arg(P25_LDU1_LENGTH);
+
+static void BM_buildDVMHeader(benchmark::State& state) {
+    uint8_t buffer[32];
+    uint16_t seq = 0;
+    uint32_t timestamp = 0;
+
+    for (auto _ : state) {
+        P25Utils::buildDVMHeader(buffer, NET_FUNC_PROTOCOL, NET_SUBFUNC_P25, 0x12345679,
+                                  BENCH_PEER_ID, seq, timestamp, P25_LDU1_LENGTH);
+        benchmark::DoNotOptimize(buffer);
+    }
+}
+BENCHMARK(BM_buildDVMHeader);
+
+static void BM_buildLDU1(benchmark::State& state) {
+    uint8_t imbe[9][IMBE_FRAME_SIZE];
+    uint8_t buffer[P25_LDU1_LENGTH];
+    fillIMBE(imbe);
+
+    for (auto _ : state) {
+        P25Utils::buildLDU1(buffer, imbe, BENCH_SRC_ID, BENCH_DST_ID, BENCH_WACN, BENCH_SYS_ID, false);
+        benchmark::DoNotOptimize(buffer);
+    }
+}
+BENCHMARK(BM_buildLDU1);
+
+static void BM_buildLDU2(benchmark::State& state) {
+    uint8_t imbe[9][IMBE_FRAME_SIZE];
+    uint8_t buffer[P25_LDU2_LENGTH];
+    fillIMBE(imbe);
+
+    for (auto _ : state) {
+        P25Utils::buildLDU2(buffer, imbe, BENCH_SRC_ID, BENCH_DST_ID, BENCH_WACN, BENCH_SYS_ID);
+        benchmark::DoNotOptimize(buffer);
+    }
+}
+BENCHMARK(BM_buildLDU2);
+
+static void BM_buildTDU(benchmark::State& state) {
+    uint8_t buffer[P25_TDU_LENGTH];
+
+    for (auto _ : state) {
+        P25Utils::buildTDU(buffer, BENCH_SRC_ID, BENCH_DST_ID, BENCH_WACN, BENCH_SYS_ID, true);
+        benchmark::DoNotOptimize(buffer);
+    }
+}
+BENCHMARK(BM_buildTDU);
+
+static void BM_encodeLC(benchmark::State& state) {
+    uint8_t rsEncoded[24];
+
+    for (auto _ : state) {
+        P25Utils::encodeLC(rsEncoded, BENCH_SRC_ID, BENCH_DST_ID);
+        benchmark::DoNotOptimize(rsEncoded);
+    }
+}
+BENCHMARK(BM_encodeLC);
+
+static void BM_parseOP25Packet(benchmark::State& state) {
+    uint8_t data[OP25_PACKET_SIZE];
+    buildOP25Datagram(data, BENCH_DST_ID, BENCH_SRC_ID, OP25_FRAME_LDU1, 4);
+    OP25Packet packet;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(P25Utils::parseOP25Packet(data, sizeof(data), packet));
+        benchmark::DoNotOptimize(packet);
+    }
+}
+BENCHMARK(BM_parseOP25Packet);
+
+static void BM_parseOP25Packet_Reject(benchmark::State& state) {
+    uint8_t data[OP25_PACKET_SIZE];
+    buildOP25Datagram(data, BENCH_DST_ID, BENCH_SRC_ID, OP25_FRAME_LDU1, 4);
+    data[0] = 0x00;
+    OP25Packet packet;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(P25Utils::parseOP25Packet(data, sizeof(data), packet));
+    }
+}
+BENCHMARK(BM_parseOP25Packet_Reject);
+
+// One IMBE frame through CallManager, cycling voice indexes so every
+// ninth frame completes an LDU and goes through the stub FNE sink
+static void BM_processIMBEFrame(benchmark::State& state) {
+    Logger::instance().setLevel(LogLevel::ERROR);
+
+    StubFNESink sink;
+    CallManager callManager(sink);
+
+    OP25Packet packets[18];
+    for (int i = 0; i < 18; i++) {
+        uint8_t data[OP25_PACKET_SIZE];
+        buildOP25Datagram(data, BENCH_DST_ID, BENCH_SRC_ID,
+                          i < 9 ? OP25_FRAME_LDU1 : OP25_FRAME_LDU2, i % 9);
+        P25Utils::parseOP25Packet(data, sizeof(data), packets[i]);
+    }
+
+    size_t next = 0;
+    for (auto _ : state) {
+        callManager.processIMBEFrame(packets[next]);
+        next = (next + 1) % 18;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.counters["ldus"] = benchmark::Counter(static_cast<double>(sink.frames()));
+}
+BENCHMARK(BM_processIMBEFrame);
+
+// Datagram to LDU: parse plus CallManager for every frame
+static void BM_parseAndProcess(benchmark::State& state) {
+    Logger::instance().setLevel(LogLevel::ERROR);
+
+    StubFNESink sink;
+    CallManager callManager(sink);
+
+    uint8_t datagrams[18][OP25_PACKET_SIZE];
+    for (int i = 0; i < 18; i++) {
+        buildOP25Datagram(datagrams[i], BENCH_DST_ID, BENCH_SRC_ID,
+                          i < 9 ? OP25_FRAME_LDU1 : OP25_FRAME_LDU2, i % 9);
+    }
+
+    size_t next = 0;
+    OP25Packet packet;
+    for (auto _ : state) {
+        if (P25Utils::parseOP25Packet(datagrams[next], OP25_PACKET_SIZE, packet)) {
+            callManager.processIMBEFrame(packet);
+        }
+        next = (next + 1) % 18;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_parseAndProcess);
+
+// LDUs sent through one FNE session by several call workers at once, each
+// with a call of its own on a lane of its own. The session is a connected
+// one handed over to adopt() with a loopback UDP socket standing in for
+// the FNE. Workers hold back while more than half a lane's queue is
+// still waiting for the network thread, so items_per_second is the rate
+// LDUs reach the socket, not how fast they pile up in full queues.
+namespace {
+
+struct SendBenchSession {
+    int fne = -1;
+    std::unique_ptr<FNEClient> client;
+    std::atomic<uint64_t> queued{0};
+};
+
+SendBenchSession* g_sendSession = nullptr;
+
+}
+
+static void BM_FNEClientSendLDU(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        Logger::instance().setLevel(LogLevel::ERROR);
+        g_sendSession = new SendBenchSession();
+
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrLen = sizeof(addr);
+        g_sendSession->fne = socket(AF_INET, SOCK_DGRAM, 0);
+        bind(g_sendSession->fne, (struct sockaddr*)&addr, sizeof(addr));
+        getsockname(g_sendSession->fne, (struct sockaddr*)&addr, &addrLen);
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+
+        std::unique_ptr<FNESessionHandoff> handoff(new FNESessionHandoff());
+        std::memset(handoff.get(), 0, sizeof(*handoff));
+        handoff->connected = 1;
+        handoff->fneAddr = addr;
+
+        g_sendSession->client.reset(new FNEClient("127.0.0.1", ntohs(addr.sin_port), BENCH_PEER_ID, "x"));
+        g_sendSession->client->setPingInterval(std::chrono::hours(1));
+        g_sendSession->client->adopt(*handoff, fd);
+        for (int i = 0; i < state.threads(); i++) {
+            g_sendSession->client->lane(static_cast<uint32_t>(i));
+        }
+        g_sendSession->client->start();
+
+        // The resumed session's first ping shows its network thread is up
+        uint8_t ping[64];
+        recv(g_sendSession->fne, ping, sizeof(ping), 0);
+    }
+
+    uint8_t imbe[9][IMBE_FRAME_SIZE];
+    fillIMBE(imbe);
+    uint32_t call = static_cast<uint32_t>(state.thread_index()) + 1;
+    VoiceSink* sink = nullptr;
+    bool ldu2 = false;
+    for (auto _ : state) {
+        // Thread 0 has set the session up by the time any thread gets here
+        if (!sink) {
+            sink = &g_sendSession->client->lane(static_cast<uint32_t>(state.thread_index()));
+        }
+        uint64_t queued = g_sendSession->queued.fetch_add(1, std::memory_order_relaxed) + 1;
+        while (queued > g_sendSession->client->getFramesSent() + FNEClient::EGRESS_CAPACITY / 2) {
+            std::this_thread::yield();
+        }
+        if (ldu2) {
+            sink->sendLDU2(call, imbe, BENCH_SRC_ID, BENCH_DST_ID + call);
+        } else {
+            sink->sendLDU1(call, imbe, BENCH_SRC_ID, BENCH_DST_ID + call, false);
+        }
+        ldu2 = !ldu2;
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        g_sendSession->client->stop();
+        close(g_sendSession->fne);
+        delete g_sendSession;
+        g_sendSession = nullptr;
+    }
+}
+BENCHMARK(BM_FNEClientSendLDU)->ThreadRange(1, 4)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""Compare op25-gateway-bench JSON results against a baseline.
+
+Usage: compare.py <baseline.json> <results.json> [--threshold PCT] [--min-delta NS]
+
+Prints the per-benchmark change in CPU time and exits non-zero if any
+benchmark got slower than the threshold (default 15%) by more than
+--min-delta nanoseconds (default 2 ns, to ignore timer noise on the
+few-nanosecond benchmarks).
+"""
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        doc = json.load(f)
+    # Prefer the median when the run used --benchmark_repetitions
+    results = {}
+    medians = {}
+    for bench in doc.get("benchmarks", []):
+        name = bench.get("run_name", bench["name"])
+        if bench.get("run_type", "iteration") == "aggregate":
+            if bench.get("aggregate_name") == "median":
+                medians[name] = bench["cpu_time"]
+        else:
+            results.setdefault(name, bench["cpu_time"])
+    results.update(medians)
+    return results
+
+
+def main(argv):
+    threshold = 15.0
+    min_delta = 2.0
+    args = []
+    i = 1
+    while i < len(argv):
+        if argv[i] == "--threshold" and i + 1 < len(argv):
+            threshold = float(argv[i + 1])
+            i += 2
+        elif argv[i] == "--min-delta" and i + 1 < len(argv):
+            min_delta = float(argv[i + 1])
+            i += 2
+        else:
+            args.append(argv[i])
+            i += 1
+
+    if len(args) != 2:
+        print(__doc__.strip())
+        return 2
+
+    baseline = load(args[0])
+    results = load(args[1])
+    regressions = 0
+
+    print("%-36s %12s %12s %9s" % ("Benchmark", "Baseline ns", "Current ns", "Change"))
+    for name, cpu in results.items():
+        base = baseline.get(name)
+        if base is None or base == 0:
+            print("%-36s %12s %12.1f %9s" % (name, "-", cpu, "new"))
+            continue
+
+        change = (cpu - base) / base * 100.0
+        flag = ""
+        if change > threshold and cpu - base > min_delta:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("%-36s %12.1f %12.1f %+8.1f%%%s" % (name, base, cpu, change, flag))
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
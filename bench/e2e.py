@@ -0,0 +1,317 @@
+#!/usr/bin/env python3
+"""End-to-end latency benchmark over loopback.
+
+Usage: e2e.py --bindir DIR [--calls 1,10,50,200] [--duration SEC] [--call-workers N]
+              [--io-backend epoll|io_uring] [--out FILE] [--baseline FILE] [--threshold PCT]
+
+For each concurrent-call count, starts mock-fne, op25-gateway and
+op25-loadgen --stamp on loopback and drives traffic for --duration seconds.
+The gateway runs with --call-workers call workers (default 2), so each
+concurrent call is its own FNE stream; a point fails if the FNE saw a
+stream count far from the number of calls. It records:
+
+  - gateway-added latency percentiles, from the OP25 send of each LDU's
+    last IMBE frame to the LDU's arrival at the FNE
+  - gateway CPU, as percent of one core and as ms per call-second
+  - system calls per OP25 frame made by the pipeline's event loops, as
+    they count them (gateway.ioBackend selects epoll or io_uring)
+  - gateway RSS and peak RSS
+  - drop rates: OP25 datagrams the gateway never received, and LDUs that
+    never reached the FNE
+
+Writes a JSON report. With --baseline it compares each point's tail
+latency and CPU per call against the baseline. Tail latency is p99 when
+both runs have at least MIN_P99_SAMPLES LDUs, and p90 otherwise, since a
+p99 of a few dozen samples is just the slowest one or two. It exits non-zero if
+either got worse than --threshold percent (default 50) and by more than
+an absolute margin, which keeps scheduler noise from failing the run.
+"""
+
+import argparse
+import json
+import os
+import platform
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+# Ignore regressions smaller than these, whatever the percentage
+MIN_LATENCY_DELTA_US = 200.0
+MIN_CPU_DELTA_MS = 0.05
+
+CALL_TIMEOUT_MS = 1000
+
+# Fewer LDUs than this and the comparison uses p90 instead of p99
+MIN_P99_SAMPLES = 1000
+
+# A point fails if the FNE saw more than this fraction (at least one)
+# more or fewer streams than the load generator started calls
+STREAM_TOLERANCE = 0.1
+
+
+def free_udp_port():
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def cpu_seconds(pid):
+    with open("/proc/%d/stat" % pid) as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    # utime and stime are fields 14 and 15; fields[0] here is field 3
+    ticks = int(fields[11]) + int(fields[12])
+    return ticks / os.sysconf("SC_CLK_TCK")
+
+
+def memory_kb(pid):
+    result = {}
+    with open("/proc/%d/status" % pid) as f:
+        for line in f:
+            key, _, value = line.partition(":")
+            if key in ("VmRSS", "VmHWM"):
+                result[key] = int(value.split()[0])
+    return result.get("VmRSS", 0), result.get("VmHWM", 0)
+
+
+def gateway_stats(bindir, peer_id):
+    out = subprocess.run([os.path.join(bindir, "op25-gateway-top"), "-j", "-p", str(peer_id)],
+                         capture_output=True, text=True)
+    if out.returncode != 0:
+        return None
+    return json.loads(out.stdout)
+
+
+def thread_syscalls(stats):
+    return sum(t.get("syscalls", 0) for t in (stats or {}).get("threads", []))
+
+
+def stop(proc, timeout=10):
+    if proc.poll() is None:
+        proc.send_signal(signal.SIGTERM)
+        try:
+            proc.wait(timeout=timeout)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+            proc.wait()
+
+
+def run_point(bindir, calls, duration, workdir, call_workers, io_backend):
+    fne_port = free_udp_port()
+    op25_port = free_udp_port()
+    peer_id = 9100000 + calls
+    point_dir = os.path.join(workdir, "calls-%d" % calls)
+    os.makedirs(point_dir, exist_ok=True)
+
+    config = os.path.join(point_dir, "gateway.yml")
+    with open(config, "w") as f:
+        f.write("op25:\n  listenPort: %d\n" % op25_port)
+        f.write("fne:\n  host: 127.0.0.1\n  port: %d\n  password: PASSWORD\n  peerId: %d\n"
+                % (fne_port, peer_id))
+        f.write("gateway:\n  callTimeout: %d\n  callWorkers: %d\n  ioBackend: %s\n"
+                % (CALL_TIMEOUT_MS, call_workers, io_backend))
+        f.write("logging:\n  level: WARN\n  file: %s\n" % os.path.join(point_dir, "gateway.log"))
+        f.write("stats:\n  sharedMemory: true\n")
+
+    fne_report = os.path.join(point_dir, "mock-fne.json")
+    loadgen_report = os.path.join(point_dir, "loadgen.json")
+    devnull = subprocess.DEVNULL
+
+    fne = subprocess.Popen([os.path.join(bindir, "mock-fne"), "-p", str(fne_port),
+                            "-o", fne_report, "-l", os.path.join(point_dir, "mock-fne.log")],
+                           stdout=devnull, stderr=devnull)
+    gateway = None
+    try:
+        time.sleep(0.2)
+        gateway = subprocess.Popen([os.path.join(bindir, "op25-gateway"), "-c", config],
+                                   stdout=devnull, stderr=devnull)
+
+        deadline = time.time() + 15
+        while True:
+            stats = gateway_stats(bindir, peer_id)
+            if stats and stats["fneState"] == "CONNECTED":
+                break
+            if time.time() > deadline or gateway.poll() is not None:
+                raise RuntimeError("gateway did not log in to mock-fne")
+            time.sleep(0.1)
+
+        cpu_start = cpu_seconds(gateway.pid)
+        syscalls_start = thread_syscalls(stats)
+        wall_start = time.monotonic()
+
+        subprocess.run([os.path.join(bindir, "op25-loadgen"), "-H", "127.0.0.1",
+                        "-p", str(op25_port), "-n", str(calls), "-d", str(duration),
+                        "--call", "fixed:%d" % (duration + 60), "--gap", "fixed:0.1",
+                        "--stamp", "-o", loadgen_report],
+                       stdout=devnull, check=True)
+
+        # Let every call time out and its TDU reach the FNE
+        time.sleep(CALL_TIMEOUT_MS / 1000.0 + 1.5)
+
+        cpu = cpu_seconds(gateway.pid) - cpu_start
+        wall = time.monotonic() - wall_start
+        rss_kb, rss_peak_kb = memory_kb(gateway.pid)
+        stats = gateway_stats(bindir, peer_id) or {}
+    finally:
+        if gateway:
+            stop(gateway)
+        stop(fne)
+
+    with open(fne_report) as f:
+        fne_doc = json.load(f)
+    with open(loadgen_report) as f:
+        loadgen = json.load(f)
+
+    # A call's last, partial LDU is padded with silence and sent when the
+    # call times out, so every LDU that was started should arrive
+    ldus_expected = loadgen["startedLDUs"]
+    ldus_received = sum(s["ldu1"] + s["ldu2"] for s in fne_doc["streams"])
+    frames_sent = loadgen["framesSent"]
+    frames_received = stats.get("op25PacketsReceived", 0)
+    latency = fne_doc["latency"]
+    syscalls = thread_syscalls(stats) - syscalls_start
+
+    return {
+        "calls": calls,
+        "durationSec": duration,
+        "latencyUs": {
+            "samples": latency["samples"],
+            "p50": latency["p50Us"],
+            "p90": latency["p90Us"],
+            "p99": latency["p99Us"],
+            "p999": latency["p999Us"],
+            "max": latency["maxUs"],
+        },
+        "cpuPercent": round(100.0 * cpu / wall, 2),
+        "cpuMsPerCallSec": round(1000.0 * cpu / (calls * duration), 4),
+        "syscallsPerFrame": round(syscalls / frames_received, 3) if frames_received else 0.0,
+        "rssKb": rss_kb,
+        "rssPeakKb": rss_peak_kb,
+        "op25FramesSent": frames_sent,
+        "op25FramesReceived": frames_received,
+        "op25KernelDrops": stats.get("op25KernelDrops", 0),
+        "op25DropRate": round(1.0 - frames_received / frames_sent, 6) if frames_sent else 0.0,
+        "callsStarted": loadgen["calls"],
+        "streams": len(fne_doc["streams"]),
+        "ldusExpected": ldus_expected,
+        "ldusReceived": ldus_received,
+        "lduDropRate": round(1.0 - ldus_received / ldus_expected, 6) if ldus_expected else 0.0,
+        "fneSeqGaps": sum(s["seqGaps"] for s in fne_doc["streams"]),
+    }
+
+
+def streams_ok(point):
+    expected = point["callsStarted"]
+    return abs(point["streams"] - expected) <= max(1, STREAM_TOLERANCE * expected)
+
+
+def tail_latency(base, point):
+    if min(base["latencyUs"]["samples"], point["latencyUs"]["samples"]) >= MIN_P99_SAMPLES:
+        return "p99", base["latencyUs"]["p99"], point["latencyUs"]["p99"]
+    return "p90", base["latencyUs"]["p90"], point["latencyUs"]["p90"]
+
+
+def compare(baseline_path, results, threshold):
+    with open(baseline_path) as f:
+        baseline = {p["calls"]: p for p in json.load(f)["results"]}
+
+    failed = False
+    print("\n%-6s %4s %14s %14s %9s   %14s %14s %9s" %
+          ("calls", "tail", "base (us)", "now (us)", "change",
+           "cpu base", "cpu now", "change"))
+    for point in results:
+        base = baseline.get(point["calls"])
+        if not base:
+            continue
+
+        stat, old_tail, new_tail = tail_latency(base, point)
+        row = []
+        # CPU time is counted in clock ticks; a one-tick difference is noise
+        tick_ms = 1000.0 / os.sysconf("SC_CLK_TCK") / (point["calls"] * point["durationSec"])
+        for old, new, margin in ((old_tail, new_tail, MIN_LATENCY_DELTA_US),
+                                 (base["cpuMsPerCallSec"], point["cpuMsPerCallSec"],
+                                  max(MIN_CPU_DELTA_MS, tick_ms))):
+            change = (new - old) / old * 100.0 if old > 0 else 0.0
+            regressed = change > threshold and new - old > margin
+            failed = failed or regressed
+            row.append((old, new, change, regressed))
+
+        print("%-6d %4s %14.1f %14.1f %+8.1f%%%s %14.4f %14.4f %+8.1f%%%s" %
+              (point["calls"], stat,
+               row[0][0], row[0][1], row[0][2], "!" if row[0][3] else " ",
+               row[1][0], row[1][1], row[1][2], "!" if row[1][3] else " "))
+
+    return not failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="End-to-end gateway latency sweep over loopback")
+    parser.add_argument("--bindir", required=True, help="directory with the built binaries")
+    parser.add_argument("--calls", default="1,10,50,200", help="concurrent-call counts to sweep")
+    parser.add_argument("--call-workers", type=int, default=2,
+                        help="gateway.callWorkers for the gateway under test (default 2)")
+    parser.add_argument("--io-backend", choices=("epoll", "io_uring"), default="epoll",
+                        help="gateway.ioBackend for the gateway under test (default epoll)")
+    parser.add_argument("--duration", type=int, default=10, help="seconds of traffic per point")
+    parser.add_argument("--out", default="bench_e2e.json", help="JSON report to write")
+    parser.add_argument("--baseline", help="report to compare against")
+    parser.add_argument("--threshold", type=float, default=50.0,
+                        help="allowed regression in percent (default 50)")
+    args = parser.parse_args()
+    if args.call_workers < 1:
+        # With no workers the gateway carries one call at a time, and every
+        # frame for another talkgroup starts a new stream
+        parser.error("--call-workers must be at least 1 for concurrent calls")
+
+    results = []
+    bad_points = []
+    with tempfile.TemporaryDirectory(prefix="op25-e2e-") as workdir:
+        for calls in [int(c) for c in args.calls.split(",")]:
+            print("e2e: %d concurrent calls for %d s..." % (calls, args.duration), flush=True)
+            point = run_point(args.bindir, calls, args.duration, workdir, args.call_workers,
+                              args.io_backend)
+            results.append(point)
+
+            lat = point["latencyUs"]
+            print("  latency p50=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus (%d LDUs)"
+                  % (lat["p50"], lat["p99"], lat["p999"], lat["max"], lat["samples"]))
+            print("  cpu=%.1f%% (%.4f ms/call-s) syscalls/frame=%.2f rss=%d kB peak=%d kB"
+                  % (point["cpuPercent"], point["cpuMsPerCallSec"], point["syscallsPerFrame"],
+                     point["rssKb"], point["rssPeakKb"]))
+            print("  op25 drops=%.4f%% (kernel %d)  LDU drops=%.4f%%  streams=%d (calls %d)"
+                  % (100 * point["op25DropRate"], point["op25KernelDrops"],
+                     100 * point["lduDropRate"], point["streams"], point["callsStarted"]))
+            if not streams_ok(point):
+                bad_points.append(point["calls"])
+
+    report = {
+        "host": platform.node(),
+        "cpus": os.cpu_count(),
+        "callWorkers": args.call_workers,
+        "ioBackend": args.io_backend,
+        "results": results,
+    }
+    with open(args.out, "w") as f:
+        json.dump(report, f, indent=2)
+        f.write("\n")
+    print("\nReport written to %s" % args.out)
+
+    if bad_points:
+        print("\nFAIL: FNE stream count far from the number of calls at %s calls"
+              % ",".join(str(c) for c in bad_points))
+        return 1
+
+    if args.baseline:
+        if not os.path.exists(args.baseline):
+            print("No baseline at %s, skipping comparison" % args.baseline)
+        elif not compare(args.baseline, results, args.threshold):
+            print("\nFAIL: end-to-end regression beyond %.0f%%" % args.threshold)
+            return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""FNE outage check with concurrent calls, over loopback.
+
+Usage: outage.py --bindir DIR [--calls 20] [--call-workers 2] [--duration SEC]
+                 [--disconnect-every SEC] [--blackout MS] [--outage-buffer MS]
+
+Starts mock-fne with --disconnect-every and --blackout, so the FNE drops
+the gateway's session and ignores it for a while, again and again. Runs
+op25-gateway and op25-loadgen with --calls concurrent calls against it
+twice: once with fne.outageBuffer set to --outage-buffer and once with 0.
+
+It prints the LDUs the FNE received out of those the load generator
+started for each run. It exits non-zero if the buffered run lost more
+than MAX_BUFFERED_LOSS of them, or did no better than the unbuffered run,
+since each blackout fits in the buffer and every held LDU should be
+replayed.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+from e2e import free_udp_port, gateway_stats, stop
+
+# Largest fraction of LDUs the buffered run may lose
+MAX_BUFFERED_LOSS = 0.01
+
+CALL_TIMEOUT_MS = 1000
+
+
+def run(bindir, args, outage_buffer, workdir):
+    fne_port = free_udp_port()
+    op25_port = free_udp_port()
+    peer_id = 9200000 + outage_buffer
+    run_dir = os.path.join(workdir, "buffer-%d" % outage_buffer)
+    os.makedirs(run_dir, exist_ok=True)
+
+    # Quick liveness and retry, so each outage is noticed and ended within
+    # a few hundred ms of the blackout
+    config = os.path.join(run_dir, "gateway.yml")
+    with open(config, "w") as f:
+        f.write("op25:\n  listenPort: %d\n" % op25_port)
+        f.write("fne:\n  host: 127.0.0.1\n  port: %d\n  password: PASSWORD\n  peerId: %d\n"
+                % (fne_port, peer_id))
+        f.write("  outageBuffer: %d\n  pingInterval: 300\n  loginTimeout: 400\n"
+                "  backoffInitial: 200\n  backoffMax: 400\n" % outage_buffer)
+        f.write("gateway:\n  callTimeout: %d\n  callWorkers: %d\n"
+                % (CALL_TIMEOUT_MS, args.call_workers))
+        f.write("logging:\n  level: WARN\n  file: %s\n" % os.path.join(run_dir, "gateway.log"))
+        f.write("stats:\n  sharedMemory: true\n")
+
+    fne_report = os.path.join(run_dir, "mock-fne.json")
+    loadgen_report = os.path.join(run_dir, "loadgen.json")
+    devnull = subprocess.DEVNULL
+
+    fne = subprocess.Popen([os.path.join(bindir, "mock-fne"), "-p", str(fne_port),
+                            "-o", fne_report, "-l", os.path.join(run_dir, "mock-fne.log"),
+                            "--disconnect-every", str(args.disconnect_every),
+                            "--blackout", str(args.blackout)],
+                           stdout=devnull, stderr=devnull)
+    gateway = None
+    try:
+        time.sleep(0.2)
+        gateway = subprocess.Popen([os.path.join(bindir, "op25-gateway"), "-c", config],
+                                   stdout=devnull, stderr=devnull)
+
+        deadline = time.time() + 15
+        while True:
+            stats = gateway_stats(bindir, peer_id)
+            if stats and stats["fneState"] == "CONNECTED":
+                break
+            if time.time() > deadline or gateway.poll() is not None:
+                raise RuntimeError("gateway did not log in to mock-fne")
+            time.sleep(0.1)
+
+        subprocess.run([os.path.join(bindir, "op25-loadgen"), "-H", "127.0.0.1",
+                        "-p", str(op25_port), "-n", str(args.calls), "-d", str(args.duration),
+                        "--call", "fixed:%d" % (args.duration + 60), "--gap", "fixed:0.1",
+                        "-o", loadgen_report],
+                       stdout=devnull, check=True)
+
+        # Let the last outage's backlog replay and every call time out
+        time.sleep((args.outage_buffer + CALL_TIMEOUT_MS) / 1000.0 + 1.5)
+        stats = gateway_stats(bindir, peer_id) or {}
+    finally:
+        if gateway:
+            stop(gateway)
+        stop(fne)
+
+    with open(fne_report) as f:
+        fne_doc = json.load(f)
+    with open(loadgen_report) as f:
+        loadgen = json.load(f)
+
+    expected = loadgen["startedLDUs"]
+    received = sum(s["ldu1"] + s["ldu2"] for s in fne_doc["streams"])
+    return {
+        "outageBuffer": outage_buffer,
+        "ldusExpected": expected,
+        "ldusReceived": received,
+        "lossRate": round(1.0 - received / expected, 6) if expected else 0.0,
+        "linkLosses": stats.get("fneLinkLosses", 0),
+        "ldusReplayed": stats.get("fneLdusReplayed", 0),
+        "ldusDiscarded": stats.get("fneLdusDiscarded", 0),
+        "streams": len(fne_doc["streams"]),
+        "fneSeqGaps": sum(s["seqGaps"] for s in fne_doc["streams"]),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="FNE outage check with concurrent calls")
+    parser.add_argument("--bindir", required=True, help="directory with the built binaries")
+    parser.add_argument("--calls", type=int, default=20, help="concurrent calls (default 20)")
+    parser.add_argument("--call-workers", type=int, default=2,
+                        help="gateway.callWorkers for the gateway under test (default 2)")
+    parser.add_argument("--duration", type=int, default=12, help="seconds of traffic per run")
+    parser.add_argument("--disconnect-every", type=int, default=4,
+                        help="mock-fne drops the session every this many seconds (default 4)")
+    parser.add_argument("--blackout", type=int, default=1000,
+                        help="ms mock-fne ignores the gateway after each drop (default 1000)")
+    parser.add_argument("--outage-buffer", type=int, default=3000,
+                        help="fne.outageBuffer for the buffered run (default 3000)")
+    args = parser.parse_args()
+    if args.call_workers < 1:
+        parser.error("--call-workers must be at least 1 for concurrent calls")
+    if args.outage_buffer <= 0:
+        parser.error("--outage-buffer must be positive")
+
+    results = []
+    with tempfile.TemporaryDirectory(prefix="op25-outage-") as workdir:
+        for outage_buffer in (args.outage_buffer, 0):
+            print("outage: %d calls, outageBuffer %d ms, drop every %d s for %d ms..."
+                  % (args.calls, outage_buffer, args.disconnect_every, args.blackout), flush=True)
+            result = run(args.bindir, args, outage_buffer, workdir)
+            results.append(result)
+            print("  LDUs %d of %d (loss %.2f%%)  link losses=%d replayed=%d discarded=%d"
+                  "  streams=%d seqGaps=%d"
+                  % (result["ldusReceived"], result["ldusExpected"], 100 * result["lossRate"],
+                     result["linkLosses"], result["ldusReplayed"], result["ldusDiscarded"],
+                     result["streams"], result["fneSeqGaps"]))
+
+    buffered, unbuffered = results
+    if buffered["linkLosses"] == 0:
+        print("\nFAIL: the FNE session was never lost")
+        return 1
+    if buffered["lossRate"] > MAX_BUFFERED_LOSS or buffered["ldusReceived"] <= unbuffered["ldusReceived"]:
+        print("\nFAIL: the outage buffer lost %.2f%% of LDUs (%.2f%% without it)"
+              % (100 * buffered["lossRate"], 100 * unbuffered["lossRate"]))
+        return 1
+
+    print("\nOK: the outage buffer lost %.2f%% of LDUs (%.2f%% without it)"
+          % (100 * buffered["lossRate"], 100 * unbuffered["lossRate"]))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
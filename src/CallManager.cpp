@@ -1,19 +1,22 @@
 #include "CallManager.h"
 #include "Logger.h"
+#include "Trace.h"
 
 #include <sstream>
 #include <cstring>
+#include <algorithm>
 
 namespace op25gateway {
 
-CallManager::CallManager(FNEClient& fneClient)
-    : m_fneClient(fneClient)
-    , m_state(CallState::IDLE)
-    , m_currentSrcId(0)
-    , m_currentDstId(0)
-    , m_firstLDU(true)
-    , m_imbeCount(0)
-    , m_expectingLDU2(false)
+CallManager::CallManager(VoiceSink& sink, Clock& clock)
+    : m_sink(sink)
+    , m_clock(clock)
+    , m_logName("CallManager")
+    , m_loop(nullptr)
+    , m_timeoutTimer(0)
+    , m_concurrentCalls(false)
+    , m_nextCallId(1)
+    , m_callIdStride(1)
     , m_talkgroupOverride(0)
     , m_sourceIdOverride(0)
     , m_callTimeout(1000)
@@ -21,177 +24,469 @@ CallManager::CallManager(FNEClient& fneClient)
     , m_callCount(0)
     , m_ldu1Count(0)
     , m_ldu2Count(0)
+    , m_framesMissing(0)
 {
-    std::memset(m_imbeBuffer, 0, sizeof(m_imbeBuffer));
 }
 
 CallManager::~CallManager() {
     stop();
 }
 
+void CallManager::setCallIds(uint32_t first, uint32_t stride) {
+    m_nextCallId = first > 0 ? first : 1;
+    m_callIdStride = stride > 0 ? stride : 1;
+}
+
 void CallManager::start() {
     if (m_running) return;
 
     m_running = true;
-    m_timeoutThread = std::thread(&CallManager::timeoutThread, this);
+    if (m_loop) {
+        m_loop->invoke([this]() { scheduleTimeoutCheck(); });
+    } else {
+        m_timeoutThread = std::thread(&CallManager::timeoutThread, this);
+    }
 
-    LOG_INFO("CallManager: Started");
+    LOG_INFO(m_logName + ": Started");
 }
 
 void CallManager::stop() {
     if (!m_running) return;
 
+    stopTimeoutCheck();
+
+    // End any active calls, sending what has arrived of the last LDU
+    // first so the end of each transmission is not lost
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& entry : m_calls) {
+            flushLDU(entry.second);
+        }
+        endAllCalls();
+    }
+
+    LOG_INFO(m_logName + ": Stopped");
+}
+
+void CallManager::handOff(std::vector<CallHandoff>& calls, CallTotals& totals) {
+    // The timeout check must not end a call behind the new owner
+    stopTimeoutCheck();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const auto& entry : m_calls) {
+        const Call& call = entry.second;
+
+        CallHandoff handoff;
+        std::memset(&handoff, 0, sizeof(handoff));
+        handoff.call = call.id;
+        handoff.talkgroup = call.talkgroup;
+        handoff.srcId = call.srcId;
+        handoff.dstId = call.dstId;
+        handoff.talkgroupOverride = call.talkgroupOverride;
+        handoff.sourceIdOverride = call.sourceIdOverride;
+        handoff.nac = call.nac;
+        handoff.imbeCount = static_cast<uint16_t>(call.imbeCount);
+        handoff.firstLDU = call.firstLDU;
+        handoff.expectingLDU2 = call.expectingLDU2;
+        handoff.received = call.received;
+        std::memcpy(handoff.imbe, call.imbe, sizeof(handoff.imbe));
+        handoff.idleMs = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            m_clock.now() - call.lastPacketTime).count());
+        handoff.startTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            call.startTime.time_since_epoch()).count();
+        handoff.lastFrameTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            call.lastFrameTime.time_since_epoch()).count();
+        handoff.frames = call.frames;
+        handoff.framesMissing = call.framesMissing;
+        handoff.kernelDrops = call.kernelDrops;
+        handoff.ldu1 = call.ldu1;
+        handoff.ldu2 = call.ldu2;
+        calls.push_back(handoff);
+
+        std::stringstream ss;
+        ss << m_logName << ": Handing off call src=" << call.srcId << " dst=" << call.dstId
+           << " (" << call.imbeCount << "/9 frames of " << (call.expectingLDU2 ? "LDU2" : "LDU1") << ")";
+        LOG_INFO(ss.str());
+    }
+
+    totals.callCount = m_callCount;
+    totals.ldu1Count = m_ldu1Count;
+    totals.ldu2Count = m_ldu2Count;
+    totals.framesMissing = m_framesMissing;
+
+    // Idle without terminators: the streams stay open for the new owner
+    m_calls.clear();
+}
+
+void CallManager::adopt(const std::vector<CallHandoff>& calls, const CallTotals& totals) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_callCount = totals.callCount;
+    m_ldu1Count = totals.ldu1Count;
+    m_ldu2Count = totals.ldu2Count;
+    m_framesMissing = totals.framesMissing;
+
+    for (const CallHandoff& handoff : calls) {
+        uint64_t key = m_concurrentCalls ? callKey(handoff.nac, handoff.talkgroup) : 0;
+        if (m_calls.count(key) > 0) {
+            // More calls than a single voice channel carries (the previous
+            // process had concurrent calls); keep the first
+            std::stringstream ss;
+            ss << m_logName << ": Ending handed over call src=" << handoff.srcId
+               << " dst=" << handoff.dstId << ", one call at a time here";
+            LOG_INFO(ss.str());
+            m_sink.endStream(handoff.call, handoff.srcId, handoff.dstId);
+            continue;
+        }
+
+        Call& call = m_calls[key];
+        call.id = handoff.call;
+        call.talkgroup = handoff.talkgroup;
+        call.srcId = handoff.srcId;
+        call.dstId = handoff.dstId;
+        call.talkgroupOverride = handoff.talkgroupOverride;
+        call.sourceIdOverride = handoff.sourceIdOverride;
+        call.nac = handoff.nac;
+        call.firstLDU = handoff.firstLDU;
+        call.expectingLDU2 = handoff.expectingLDU2;
+        call.imbeCount = handoff.imbeCount;
+        call.received = handoff.received;
+        std::memcpy(call.imbe, handoff.imbe, sizeof(call.imbe));
+        call.lastPacketTime = m_clock.now() - std::chrono::milliseconds(handoff.idleMs);
+        call.startTime = std::chrono::system_clock::time_point(std::chrono::milliseconds(handoff.startTimeMs));
+        call.lastFrameTime = std::chrono::system_clock::time_point(std::chrono::milliseconds(handoff.lastFrameTimeMs));
+        call.frames = handoff.frames;
+        call.framesMissing = handoff.framesMissing;
+        call.kernelDrops = handoff.kernelDrops;
+        call.ldu1 = handoff.ldu1;
+        call.ldu2 = handoff.ldu2;
+
+        std::stringstream ss;
+        ss << m_logName << ": Resuming call src=" << call.srcId << " dst=" << call.dstId
+           << " at frame " << call.imbeCount << " of " << (call.expectingLDU2 ? "LDU2" : "LDU1");
+        LOG_INFO(ss.str());
+    }
+}
+
+void CallManager::stopTimeoutCheck() {
     m_running = false;
 
-    if (m_timeoutThread.joinable()) {
-        m_timeoutThread.join();
+    if (m_loop) {
+        m_loop->invoke([this]() { m_loop->cancelTimer(m_timeoutTimer); });
+        return;
     }
 
-    // End any active call
-    if (m_state == CallState::ACTIVE) {
-        endCall();
+    m_clock.wake();
+    if (m_timeoutThread.joinable()) {
+        m_timeoutThread.join();
     }
+}
 
-    LOG_INFO("CallManager: Stopped");
+void CallManager::scheduleTimeoutCheck() {
+    m_timeoutTimer = m_loop->addTimer(TIMEOUT_CHECK_INTERVAL, [this]() {
+        checkTimeout();
+        scheduleTimeoutCheck();
+    });
 }
 
 void CallManager::timeoutThread() {
+    auto next = m_clock.now() + TIMEOUT_CHECK_INTERVAL;
+
     while (m_running) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        m_clock.sleepUntil(next);
+        if (m_clock.now() < next) continue;     // Woken early
 
-        std::lock_guard<std::mutex> lock(m_mutex);
+        next += TIMEOUT_CHECK_INTERVAL;
+        checkTimeout();
+    }
+}
 
-        if (m_state == CallState::ACTIVE) {
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now - m_lastPacketTime).count();
+void CallManager::checkTimeout() {
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-            if (elapsed > m_callTimeout) {
-                LOG_INFO("CallManager: Call timeout, ending call");
-                endCall();
-            }
+    Clock::TimePoint now = m_clock.now();
+    for (auto it = m_calls.begin(); it != m_calls.end(); ) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - it->second.lastPacketTime).count();
+
+        if (elapsed > m_callTimeout) {
+            LOG_INFO(m_logName + ": Call timeout, ending call");
+            flushLDU(it->second);
+            endCall(it->second);
+            noteTeardown(m_timedOut, it->second);
+            it = m_calls.erase(it);
+        } else {
+            ++it;
         }
     }
 }
 
 void CallManager::processIMBEFrame(const OP25Packet& packet) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    if (packet.frameType == OP25_FRAME_TDU) {
+        processTerminator(packet);
+        return;
+    }
 
-    // Get source and destination IDs (with optional overrides)
-    uint32_t srcId = m_sourceIdOverride > 0 ? m_sourceIdOverride : packet.sourceId;
-    uint32_t dstId = m_talkgroupOverride > 0 ? m_talkgroupOverride : packet.talkgroup;
+    GW_TRACE3(imbe_frame_start, packet.talkgroup, packet.sourceId, packet.voiceIndex);
 
-    // Check for call start (transition from IDLE to ACTIVE)
-    if (m_state == CallState::IDLE) {
-        startCall(srcId, dstId);
-    }
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-    // Update last packet time
-    m_lastPacketTime = std::chrono::steady_clock::now();
+    // A single voice channel carries one call at a time
+    uint64_t key = m_concurrentCalls ? callKey(packet.nac, packet.talkgroup) : 0;
+    auto it = m_calls.find(key);
+
+    // Get source and destination IDs (with optional overrides)
+    // A call keeps the overrides it started with, so a reload does not
+    // cut it in two
+    bool active = it != m_calls.end();
+    uint32_t srcOverride = active ? it->second.sourceIdOverride : m_sourceIdOverride.load(std::memory_order_relaxed);
+    uint32_t tgOverride = active ? it->second.talkgroupOverride : m_talkgroupOverride.load(std::memory_order_relaxed);
+    uint32_t srcId = srcOverride > 0 ? srcOverride : packet.sourceId;
+    uint32_t dstId = tgOverride > 0 ? tgOverride : packet.talkgroup;
 
     // Check if source/dest changed (new call within existing)
-    if (m_state == CallState::ACTIVE &&
-        (srcId != m_currentSrcId || dstId != m_currentDstId)) {
+    if (active && (srcId != it->second.srcId || dstId != it->second.dstId)) {
         std::stringstream ss;
-        ss << "CallManager: Call parameters changed (src=" << srcId
+        ss << m_logName << ": Call parameters changed (src=" << srcId
            << " dst=" << dstId << "), restarting";
         LOG_INFO(ss.str());
 
-        endCall();
-        startCall(srcId, dstId);
+        endCall(it->second);
+        m_calls.erase(it);
+        active = false;
     }
 
+    // Check for call start
+    if (!active) {
+        it = startCall(key, srcId, dstId, packet.nac, packet.talkgroup);
+    }
+    Call& call = it->second;
+
+    // Update last packet time
+    call.lastPacketTime = m_clock.now();
+    call.lastFrameTime = m_clock.wallNow();
+
     // Validate frame index
     if (packet.voiceIndex > 8) {
-        LOG_WARN("CallManager: Invalid voice index " + std::to_string(packet.voiceIndex));
+        LOG_WARN(m_logName + ": Invalid voice index " + std::to_string(packet.voiceIndex));
+        GW_TRACE3(imbe_frame_done, packet.talkgroup, packet.voiceIndex, 0);
         return;
     }
 
     // Store IMBE frame in buffer
-    std::memcpy(m_imbeBuffer[packet.voiceIndex], packet.imbe, IMBE_FRAME_SIZE);
+    std::memcpy(call.imbe[packet.voiceIndex], packet.imbe, IMBE_FRAME_SIZE);
 
     // Track which frames we've received
-    m_imbeCount++;
+    call.imbeCount++;
+    call.received |= 1u << packet.voiceIndex;
+    call.frames++;
 
     // Log frame reception
     {
         std::stringstream ss;
-        ss << "CallManager: Frame " << (int)packet.voiceIndex
+        ss << m_logName << ": Frame " << (int)packet.voiceIndex
            << " (type=" << (int)packet.frameType << ")"
-           << " count=" << m_imbeCount;
+           << " count=" << call.imbeCount;
         LOG_DEBUG(ss.str());
     }
 
     // Check if we have a complete LDU (9 frames)
     // The voiceIndex goes 0-8 for each LDU
     if (packet.voiceIndex == 8) {
-        sendLDU();
-        m_imbeCount = 0;
+        if (call.imbeCount < 9) {
+            call.framesMissing += 9 - call.imbeCount;
+            m_framesMissing += 9 - call.imbeCount;
+        }
+        sendLDU(call);
+        call.imbeCount = 0;
+        call.received = 0;
+    }
+
+    GW_TRACE3(imbe_frame_done, packet.talkgroup, packet.voiceIndex, 1);
+}
+
+void CallManager::processTerminator(const OP25Packet& packet) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Only the call it belongs to: on a single voice channel a stray
+    // terminator must not cut off the next talkgroup's call
+    uint64_t key = m_concurrentCalls ? callKey(packet.nac, packet.talkgroup) : 0;
+    auto it = m_calls.find(key);
+    if (it == m_calls.end() || it->second.nac != packet.nac || it->second.talkgroup != packet.talkgroup) {
+        return;
+    }
+
+    // The rest of the last LDU is not coming; send what there is of it
+    LOG_INFO(m_logName + ": Call terminator, ending call");
+    flushLDU(it->second);
+    endCall(it->second);
+    noteTeardown(m_terminated, it->second);
+    m_calls.erase(it);
+}
+
+void CallManager::noteTeardown(Teardowns& teardowns, const Call& call) {
+    uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        m_clock.now() - call.lastPacketTime).count());
+
+    teardowns.calls++;
+    teardowns.totalUs += us;
+    if (us > teardowns.maxUs) {
+        teardowns.maxUs = static_cast<uint32_t>(std::min<uint64_t>(us, UINT32_MAX));
     }
 }
 
-void CallManager::startCall(uint32_t srcId, uint32_t dstId) {
-    m_state = CallState::ACTIVE;
-    m_currentSrcId = srcId;
-    m_currentDstId = dstId;
-    m_firstLDU = true;
-    m_imbeCount = 0;
-    m_expectingLDU2 = false;
-    m_lastPacketTime = std::chrono::steady_clock::now();
+CallEndStats CallManager::getEndStats() const {
+    CallEndStats stats;
+    stats.terminated = m_terminated.calls;
+    stats.terminatedTotalUs = m_terminated.totalUs;
+    stats.terminatedMaxUs = m_terminated.maxUs;
+    stats.timedOut = m_timedOut.calls;
+    stats.timedOutTotalUs = m_timedOut.totalUs;
+    stats.timedOutMaxUs = m_timedOut.maxUs;
+    return stats;
+}
+
+void CallManager::noteKernelDrops(uint32_t dropped) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto& entry : m_calls) {
+        entry.second.kernelDrops += dropped;
+    }
+}
+
+std::vector<CallInfo> CallManager::getActiveCalls() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<CallInfo> calls;
+    calls.reserve(m_calls.size());
+    for (const auto& entry : m_calls) {
+        const Call& call = entry.second;
+
+        CallInfo info;
+        info.srcId = call.srcId;
+        info.dstId = call.dstId;
+        info.nac = call.nac;
+        info.frames = call.frames;
+        info.startTime = call.startTime;
+        info.lastFrameTime = call.lastFrameTime;
+        info.ldu1 = call.ldu1;
+        info.ldu2 = call.ldu2;
+        info.framesMissing = call.framesMissing;
+        info.kernelDrops = call.kernelDrops;
+        calls.push_back(info);
+    }
+    return calls;
+}
+
+size_t CallManager::getActiveCallCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_calls.size();
+}
+
+CallManager::CallTable::iterator CallManager::startCall(uint64_t key, uint32_t srcId, uint32_t dstId,
+                                                        uint16_t nac, uint32_t talkgroup) {
+    Call& call = m_calls[key];
+    call.id = m_nextCallId;
+    call.talkgroupOverride = m_talkgroupOverride;
+    call.sourceIdOverride = m_sourceIdOverride;
+    call.srcId = srcId;
+    call.dstId = dstId;
+    call.nac = nac;
+    call.talkgroup = talkgroup;
+    call.firstLDU = true;
+    call.imbeCount = 0;
+    call.received = 0;
+    call.expectingLDU2 = false;
+    std::memset(call.imbe, 0, sizeof(call.imbe));
+    call.lastPacketTime = m_clock.now();
+    call.startTime = m_clock.wallNow();
+    call.lastFrameTime = call.startTime;
+    call.frames = 0;
+    call.ldu1 = 0;
+    call.ldu2 = 0;
+    call.framesMissing = 0;
+    call.kernelDrops = 0;
+    m_nextCallId += m_callIdStride;
     m_callCount++;
 
+    GW_TRACE4(call_start, srcId, dstId, nac, m_callCount.load());
+
     std::stringstream ss;
-    ss << "CallManager: Call started - src=" << srcId << " dst=" << dstId
+    ss << m_logName << ": Call started - src=" << srcId << " dst=" << dstId
        << " (call #" << m_callCount << ")";
     LOG_INFO(ss.str());
 
-    // Notify FNE of new stream
-    m_fneClient.startStream(srcId, dstId);
+    // Notify sink of new stream
+    m_sink.startStream(call.id, srcId, dstId);
+    return m_calls.find(key);
 }
 
-void CallManager::endCall() {
-    if (m_state == CallState::IDLE) return;
+void CallManager::endCall(Call& call) {
+    GW_TRACE5(call_end, call.srcId, call.dstId, call.ldu1, call.ldu2, call.frames);
 
     std::stringstream ss;
-    ss << "CallManager: Call ended - src=" << m_currentSrcId
-       << " dst=" << m_currentDstId
-       << " (LDU1=" << m_ldu1Count << " LDU2=" << m_ldu2Count << ")";
+    ss << m_logName << ": Call ended - src=" << call.srcId
+       << " dst=" << call.dstId
+       << " (LDU1=" << call.ldu1 << " LDU2=" << call.ldu2 << ")";
+    if (call.framesMissing > 0 || call.kernelDrops > 0) {
+        ss << " loss: missing frames=" << call.framesMissing
+           << " kernel drops=" << call.kernelDrops;
+    }
     LOG_INFO(ss.str());
 
     // Send TDU to FNE
-    m_fneClient.endStream(m_currentSrcId, m_currentDstId);
+    m_sink.endStream(call.id, call.srcId, call.dstId);
+}
 
-    m_state = CallState::IDLE;
-    m_currentSrcId = 0;
-    m_currentDstId = 0;
-    m_imbeCount = 0;
-    m_expectingLDU2 = false;
-    m_firstLDU = true;
+void CallManager::endAllCalls() {
+    for (auto& entry : m_calls) {
+        endCall(entry.second);
+    }
+    m_calls.clear();
 }
 
-void CallManager::sendLDU() {
-    if (m_state != CallState::ACTIVE) return;
+void CallManager::flushLDU(Call& call) {
+    if (call.imbeCount == 0) return;
+
+    // Send what there is of the LDU, with silence where frames are missing
+    for (int i = 0; i < 9; i++) {
+        if (!(call.received & (1u << i))) {
+            std::memcpy(call.imbe[i], IMBE_SILENCE, IMBE_FRAME_SIZE);
+        }
+    }
+    if (call.imbeCount < 9) {
+        call.framesMissing += 9 - call.imbeCount;
+        m_framesMissing += 9 - call.imbeCount;
+    }
+    sendLDU(call);
+    call.imbeCount = 0;
+    call.received = 0;
+}
 
+void CallManager::sendLDU(Call& call) {
     // Alternate between LDU1 and LDU2
-    if (!m_expectingLDU2) {
+    if (!call.expectingLDU2) {
         // Send LDU1
-        m_fneClient.sendLDU1(m_imbeBuffer, m_currentSrcId, m_currentDstId, m_firstLDU);
+        m_sink.sendLDU1(call.id, call.imbe, call.srcId, call.dstId, call.firstLDU);
         m_ldu1Count++;
-        m_firstLDU = false;
-        m_expectingLDU2 = true;
+        call.ldu1++;
+        call.firstLDU = false;
+        call.expectingLDU2 = true;
 
-        LOG_DEBUG("CallManager: Sent LDU1 #" + std::to_string(m_ldu1Count));
+        LOG_DEBUG(m_logName + ": Sent LDU1 #" + std::to_string(m_ldu1Count));
     } else {
         // Send LDU2
-        m_fneClient.sendLDU2(m_imbeBuffer, m_currentSrcId, m_currentDstId);
+        m_sink.sendLDU2(call.id, call.imbe, call.srcId, call.dstId);
         m_ldu2Count++;
-        m_expectingLDU2 = false;
+        call.ldu2++;
+        call.expectingLDU2 = false;
 
-        LOG_DEBUG("CallManager: Sent LDU2 #" + std::to_string(m_ldu2Count));
+        LOG_DEBUG(m_logName + ": Sent LDU2 #" + std::to_string(m_ldu2Count));
     }
 
     // Clear buffer for next LDU
-    std::memset(m_imbeBuffer, 0, sizeof(m_imbeBuffer));
+    std::memset(call.imbe, 0, sizeof(call.imbe));
 }
 
 } // namespace op25gateway
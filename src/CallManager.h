@@ -2,36 +2,142 @@
 #define CALLMANAGER_H
 
 #include "P25Utils.h"
-#include "FNEClient.h"
+#include "VoiceSink.h"
+#include "Clock.h"
+#include "Reactor.h"
 
 #include <cstdint>
 #include <chrono>
+#include <string>
 #include <mutex>
 #include <atomic>
 #include <thread>
+#include <vector>
+#include <unordered_map>
 
 namespace op25gateway {
 
-enum class CallState {
-    IDLE,
-    ACTIVE
+// Key of the call table: NAC and talkgroup as received from OP25
+inline uint64_t callKey(uint16_t nac, uint32_t talkgroup) {
+    return (static_cast<uint64_t>(nac) << 32) | talkgroup;
+}
+
+// Snapshot of an active call for monitoring
+struct CallInfo {
+    uint32_t srcId;
+    uint32_t dstId;
+    uint16_t nac;
+    uint32_t frames;
+    std::chrono::system_clock::time_point startTime;
+    std::chrono::system_clock::time_point lastFrameTime;
+    uint64_t ldu1;
+    uint64_t ldu2;
+    uint32_t framesMissing;     // IMBE frames absent from sent LDUs
+    uint32_t kernelDrops;       // OP25 datagrams dropped by the kernel during the call
 };
 
+// A call in progress carried across a hot restart (plain data, sent as bytes)
+struct CallHandoff {
+    uint32_t call;              // Call ID, as the FNE session knows the stream
+    uint32_t talkgroup;         // As received, before any override
+    uint32_t srcId;
+    uint32_t dstId;
+    uint32_t talkgroupOverride; // Overrides the call started with
+    uint32_t sourceIdOverride;
+    uint16_t nac;
+    uint16_t imbeCount;         // Frames collected towards the current LDU
+    uint8_t firstLDU;
+    uint8_t expectingLDU2;      // LDU phase: the frames being collected are an LDU2
+    uint16_t received;          // Bit per voice index collected so far
+    uint8_t imbe[9][IMBE_FRAME_SIZE];
+    uint32_t idleMs;            // Since the last frame, for the call timeout
+    int64_t startTimeMs;
+    int64_t lastFrameTimeMs;
+    uint32_t frames;
+    uint32_t framesMissing;
+    uint32_t kernelDrops;
+    uint32_t reserved2;
+    uint64_t ldu1;
+    uint64_t ldu2;
+};
+
+// Running totals, carried across a hot restart
+struct CallTotals {
+    uint64_t callCount;
+    uint64_t ldu1Count;
+    uint64_t ldu2Count;
+    uint64_t framesMissing;
+};
+
+// How calls ended, with the teardown time of each: last voice frame to
+// TDU sent
+struct CallEndStats {
+    uint64_t terminated;        // By a terminator from OP25
+    uint64_t terminatedTotalUs;
+    uint32_t terminatedMaxUs;
+    uint64_t timedOut;          // By the call timeout
+    uint64_t timedOutTotalUs;
+    uint32_t timedOutMaxUs;
+};
+
+// Assembles OP25 IMBE frames into LDUs for a VoiceSink
+//
+// Calls are tracked in a table keyed by NAC and talkgroup. By default the
+// source is taken to be a single voice channel: one call at a time, and a
+// frame for another talkgroup ends the call in progress. With concurrent
+// calls (a multi-channel OP25), each NAC and talkgroup is a call of its
+// own, and overlapping calls go to the sink as separate streams.
+//
+// A call ends when OP25 reports its terminator (TDU or TDULC), or failing
+// that after the call timeout without frames.
 class CallManager {
 public:
-    CallManager(FNEClient& fneClient);
+    CallManager(VoiceSink& sink, Clock& clock = Clock::system());
     ~CallManager();
 
     CallManager(const CallManager&) = delete;
     CallManager& operator=(const CallManager&) = delete;
 
+    // Run the call timeout on an event loop instead of a thread of its
+    // own (before start())
+    void attach(Reactor& loop) { m_loop = &loop; }
+
+    // Prefix for log lines (default "CallManager")
+    void setLogName(const std::string& name) { m_logName = name; }
+
     void start();
     void stop();
 
-    // Process incoming IMBE frame from OP25
+    // Track a call per NAC and talkgroup instead of one at a time
+    // (before start())
+    void setConcurrentCalls(bool concurrent) { m_concurrentCalls = concurrent; }
+
+    // IDs given to new calls: first, then every stride after, so managers
+    // sharing a sink never hand it the same ID (before start())
+    void setCallIds(uint32_t first, uint32_t stride);
+
+    // Hot restart: stop and hand over the calls in progress as they stand,
+    // partial LDUs included, without ending them; the manager is left idle
+    void handOff(std::vector<CallHandoff>& calls, CallTotals& totals);
+
+    // Carry on calls handed over by another process (before start())
+    void adopt(const std::vector<CallHandoff>& calls, const CallTotals& totals);
+
+    // Process incoming IMBE frame from OP25, or the terminator of a call
     void processIMBEFrame(const OP25Packet& packet);
 
-    // Configuration
+    // Attribute datagrams dropped by the kernel to the calls in progress
+    void noteKernelDrops(uint32_t dropped);
+
+    // End calls that have been idle longer than the call timeout. Run
+    // every TIMEOUT_CHECK_INTERVAL by the timeout thread (or loop timer);
+    // simulations that do not start() the manager call it themselves.
+    void checkTimeout();
+
+    static constexpr std::chrono::milliseconds TIMEOUT_CHECK_INTERVAL{100};
+
+    // Configuration (may change while running; new overrides apply from
+    // the next call)
     void setTalkgroupOverride(uint32_t tg) { m_talkgroupOverride = tg; }
     void setSourceIdOverride(uint32_t srcId) { m_sourceIdOverride = srcId; }
     void setCallTimeout(uint32_t timeoutMs) { m_callTimeout = timeoutMs; }
@@ -40,31 +146,82 @@ public:
     uint64_t getCallCount() const { return m_callCount; }
     uint64_t getLDU1Count() const { return m_ldu1Count; }
     uint64_t getLDU2Count() const { return m_ldu2Count; }
+    uint64_t getFramesMissing() const { return m_framesMissing; }
+    CallEndStats getEndStats() const;
 
-private:
-    void timeoutThread();
-    void startCall(uint32_t srcId, uint32_t dstId);
-    void endCall();
-    void sendLDU();
-
-    FNEClient& m_fneClient;
+    // Active call table (empty when idle)
+    std::vector<CallInfo> getActiveCalls();
+    size_t getActiveCallCount();
 
-    // Call state
-    CallState m_state;
-    uint32_t m_currentSrcId;
-    uint32_t m_currentDstId;
-    std::chrono::steady_clock::time_point m_lastPacketTime;
-    bool m_firstLDU;
+private:
+    struct Call {
+        uint32_t id;
+        uint32_t srcId;
+        uint32_t dstId;
+        uint16_t nac;
+        uint32_t talkgroup;     // As received
+        Clock::TimePoint lastPacketTime;
+        bool firstLDU;
+
+        // IMBE frame buffer (accumulate 9 frames for each LDU)
+        uint8_t imbe[9][IMBE_FRAME_SIZE];
+        int imbeCount;
+        uint16_t received;      // Bit per voice index filled in this LDU
+        bool expectingLDU2;     // true = next 9 frames are LDU2, false = LDU1
+
+        // Overrides the call started with
+        uint32_t talkgroupOverride;
+        uint32_t sourceIdOverride;
+
+        // Per-call statistics
+        std::chrono::system_clock::time_point startTime;
+        std::chrono::system_clock::time_point lastFrameTime;
+        uint32_t frames;
+        uint64_t ldu1;
+        uint64_t ldu2;
+        uint32_t framesMissing;
+        uint32_t kernelDrops;
+    };
+
+    using CallTable = std::unordered_map<uint64_t, Call>;
+
+    // Calls ended one way, and their teardown times
+    struct Teardowns {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> totalUs{0};
+        std::atomic<uint32_t> maxUs{0};
+    };
 
-    // IMBE frame buffer (accumulate 9 frames for each LDU)
-    uint8_t m_imbeBuffer[9][IMBE_FRAME_SIZE];
-    int m_imbeCount;
-    bool m_expectingLDU2;  // true = next 9 frames are LDU2, false = LDU1
+    void timeoutThread();
+    void stopTimeoutCheck();
+    void scheduleTimeoutCheck();
+    CallTable::iterator startCall(uint64_t key, uint32_t srcId, uint32_t dstId,
+                                  uint16_t nac, uint32_t talkgroup);
+    void endCall(Call& call);
+    void endAllCalls();
+    void processTerminator(const OP25Packet& packet);
+    void noteTeardown(Teardowns& teardowns, const Call& call);
+    void flushLDU(Call& call);
+    void sendLDU(Call& call);
+
+    VoiceSink& m_sink;
+    Clock& m_clock;
+    std::string m_logName;
+    Reactor* m_loop;
+    Reactor::TimerId m_timeoutTimer;
+
+    // Call table, by NAC and talkgroup (one entry under key 0 unless
+    // concurrent)
+    CallTable m_calls;
+    bool m_concurrentCalls;
+    uint32_t m_nextCallId;
+    uint32_t m_callIdStride;
 
     // Configuration
-    uint32_t m_talkgroupOverride;
-    uint32_t m_sourceIdOverride;
-    uint32_t m_callTimeout;
+    // Atomic so a config reload can change them under a running call
+    std::atomic<uint32_t> m_talkgroupOverride;
+    std::atomic<uint32_t> m_sourceIdOverride;
+    std::atomic<uint32_t> m_callTimeout;
 
     // Threading
     std::mutex m_mutex;
@@ -75,6 +232,9 @@ private:
     std::atomic<uint64_t> m_callCount;
     std::atomic<uint64_t> m_ldu1Count;
     std::atomic<uint64_t> m_ldu2Count;
+    std::atomic<uint64_t> m_framesMissing;
+    Teardowns m_terminated;
+    Teardowns m_timedOut;
 };
 
 } // namespace op25gateway
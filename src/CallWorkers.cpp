@@ -0,0 +1,375 @@
+#include "CallWorkers.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace op25gateway {
+
+CallWorkers::Worker::Worker(VoiceSink& sink, Clock& clock)
+    : sink(sink)
+    , manager(sink, clock)
+    , loop(clock)
+    , doorbell(-1)
+    , pendingDrops(0)
+    , queueDrops(0)
+    , queuePeak(0)
+{
+}
+
+CallWorkers::CallWorkers(VoiceSink& sink, uint32_t workers, Clock& clock)
+    : m_logName("CallManager")
+    , m_threadName("op25-call")
+    , m_backend(IoBackend::EPOLL)
+    , m_threaded(workers > 0)
+    , m_running(false)
+{
+    uint32_t count = std::max<uint32_t>(workers, 1);
+    for (uint32_t i = 0; i < count; i++) {
+        m_workers.emplace_back(new Worker(sink.lane(i), clock));
+        Worker& worker = *m_workers.back();
+
+        // IDs interleave, so no two workers ever open the same stream
+        worker.manager.setCallIds(i + 1, count);
+        if (m_threaded) {
+            worker.manager.setConcurrentCalls(true);
+            worker.queue.reset(QUEUE_CAPACITY);
+        }
+    }
+}
+
+CallWorkers::~CallWorkers() {
+    stop();
+}
+
+void CallWorkers::attach(Reactor& loop) {
+    if (!m_threaded) {
+        m_workers[0]->manager.attach(loop);
+    }
+}
+
+void CallWorkers::setLogName(const std::string& name) {
+    m_logName = name;
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        m_workers[i]->manager.setLogName(m_threaded ? name + "#" + std::to_string(i) : name);
+    }
+}
+
+void CallWorkers::setThreadTuning(const std::string& name, const ThreadTuning& tuning) {
+    m_threadName = name;
+    m_tuning = tuning;
+}
+
+uint32_t CallWorkers::shardOf(uint64_t key, uint32_t workers) {
+    // Talkgroups are often numbered in runs; mix them first (splitmix64)
+    key += 0x9E3779B97F4A7C15ULL;
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    key ^= key >> 31;
+
+    // Jump consistent hash (Lamping and Veach): a change in the worker
+    // count moves only the talkgroups the new workers take
+    int64_t bucket = -1;
+    int64_t next = 0;
+    while (next < static_cast<int64_t>(workers)) {
+        bucket = next;
+        key = key * 2862933555777941757ULL + 1;
+        next = static_cast<int64_t>((bucket + 1) * (static_cast<double>(1LL << 31) /
+                                                    static_cast<double>((key >> 33) + 1)));
+    }
+    return static_cast<uint32_t>(bucket);
+}
+
+VoiceSink& CallWorkers::sinkFor(uint16_t nac, uint32_t talkgroup) {
+    uint32_t index = m_threaded ? shardOf(callKey(nac, talkgroup), static_cast<uint32_t>(m_workers.size())) : 0;
+    return m_workers[index]->sink;
+}
+
+bool CallWorkers::start() {
+    if (m_running) return true;
+
+    if (!m_threaded) {
+        m_workers[0]->manager.start();
+        m_running = true;
+        return true;
+    }
+
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        if (!startWorker(*m_workers[i], m_threadName + std::to_string(i))) {
+            LOG_ERROR(m_logName + ": Cannot start worker: " + std::string(strerror(errno)));
+            m_running = true;
+            stop();
+            return false;
+        }
+    }
+
+    m_running = true;
+    LOG_INFO(m_logName + ": " + std::to_string(m_workers.size()) + " worker thread(s)" + describeTuning(m_tuning) +
+             ", calls sharded by talkgroup");
+    return true;
+}
+
+bool CallWorkers::startWorker(Worker& worker, const std::string& threadName) {
+    worker.doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    worker.loop.setIoBackend(m_backend);
+    if (worker.doorbell < 0 || !worker.loop.open()) {
+        return false;
+    }
+
+    Worker* w = &worker;
+    worker.loop.addFd(worker.doorbell, EPOLLIN, [this, w](uint32_t) {
+        uint64_t count;
+        ssize_t ignored = read(w->doorbell, &count, sizeof(count));
+        (void)ignored;
+        Reactor::noteSyscall();
+        drain(*w);
+    });
+
+    // The timeout timer goes on the loop before it runs
+    worker.manager.attach(worker.loop);
+    worker.manager.start();
+    ThreadTuning tuning = m_tuning;
+    worker.thread = std::thread([w, threadName, tuning]() {
+        tuneThread(threadName, tuning);
+        w->loop.run();
+    });
+    return true;
+}
+
+void CallWorkers::stopWorker(Worker& worker) {
+    if (worker.thread.joinable()) {
+        worker.loop.stop();
+        worker.thread.join();
+    }
+}
+
+void CallWorkers::stop() {
+    if (!m_running) return;
+
+    for (auto& worker : m_workers) {
+        // With the thread gone the manager's loop calls run here, and
+        // what the receiver queued last still goes out with its call
+        stopWorker(*worker);
+        if (m_threaded) {
+            drain(*worker);
+        }
+        worker->manager.stop();
+        if (m_threaded) {
+            worker->loop.close();
+            if (worker->doorbell >= 0) {
+                close(worker->doorbell);
+                worker->doorbell = -1;
+            }
+        }
+    }
+    m_running = false;
+}
+
+void CallWorkers::handOff(std::vector<CallHandoff>& calls, CallTotals& totals) {
+    std::memset(&totals, 0, sizeof(totals));
+
+    for (auto& worker : m_workers) {
+        stopWorker(*worker);
+
+        // The receiver has stopped; what it queued still belongs to the
+        // calls being handed over
+        if (m_threaded) {
+            drain(*worker);
+        }
+
+        CallTotals workerTotals;
+        worker->manager.handOff(calls, workerTotals);
+        totals.callCount += workerTotals.callCount;
+        totals.ldu1Count += workerTotals.ldu1Count;
+        totals.ldu2Count += workerTotals.ldu2Count;
+        totals.framesMissing += workerTotals.framesMissing;
+
+        if (m_threaded) {
+            worker->loop.close();
+            if (worker->doorbell >= 0) {
+                close(worker->doorbell);
+                worker->doorbell = -1;
+            }
+        }
+    }
+    m_running = false;
+}
+
+void CallWorkers::adopt(const std::vector<CallHandoff>& calls, const CallTotals& totals) {
+    uint32_t count = static_cast<uint32_t>(m_workers.size());
+    std::vector<std::vector<CallHandoff>> shares(count);
+    uint32_t lastId = 0;
+
+    for (const CallHandoff& call : calls) {
+        uint32_t index = m_threaded ? shardOf(callKey(call.nac, call.talkgroup), count) : 0;
+        shares[index].push_back(call);
+        lastId = std::max(lastId, call.call);
+    }
+
+    CallTotals none;
+    std::memset(&none, 0, sizeof(none));
+
+    // New calls must not reuse an ID the FNE session still has open
+    uint32_t base = (lastId / count + 1) * count;
+    for (uint32_t i = 0; i < count; i++) {
+        m_workers[i]->manager.adopt(shares[i], i == 0 ? totals : none);
+        m_workers[i]->manager.setCallIds(base + i + 1, count);
+    }
+}
+
+void CallWorkers::submit(const OP25Packet& packet) {
+    if (!m_threaded) {
+        m_workers[0]->manager.processIMBEFrame(packet);
+        return;
+    }
+
+    Worker& worker = *m_workers[shardOf(callKey(packet.nac, packet.talkgroup),
+                                        static_cast<uint32_t>(m_workers.size()))];
+
+    bool wake;
+    if (!worker.queue.push(packet, wake)) {
+        worker.queueDrops.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t depth = static_cast<uint32_t>(worker.queue.size());
+    if (depth > worker.queuePeak.load(std::memory_order_relaxed)) {
+        worker.queuePeak.store(depth, std::memory_order_relaxed);
+    }
+
+    if (wake) {
+        uint64_t one = 1;
+        ssize_t ignored = write(worker.doorbell, &one, sizeof(one));
+        (void)ignored;
+        Reactor::noteSyscall();
+    }
+}
+
+void CallWorkers::noteKernelDrops(uint32_t dropped) {
+    if (!m_threaded) {
+        m_workers[0]->manager.noteKernelDrops(dropped);
+        return;
+    }
+
+    // Picked up with the worker's next frames
+    for (auto& worker : m_workers) {
+        worker->pendingDrops.fetch_add(dropped, std::memory_order_relaxed);
+    }
+}
+
+void CallWorkers::drain(Worker& worker) {
+    uint32_t dropped = worker.pendingDrops.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        worker.manager.noteKernelDrops(dropped);
+    }
+
+    OP25Packet packet;
+    while (worker.queue.pop(packet)) {
+        worker.manager.processIMBEFrame(packet);
+    }
+}
+
+void CallWorkers::setTalkgroupOverride(uint32_t tg) {
+    for (auto& worker : m_workers) {
+        worker->manager.setTalkgroupOverride(tg);
+    }
+}
+
+void CallWorkers::setSourceIdOverride(uint32_t srcId) {
+    for (auto& worker : m_workers) {
+        worker->manager.setSourceIdOverride(srcId);
+    }
+}
+
+void CallWorkers::setCallTimeout(uint32_t timeoutMs) {
+    for (auto& worker : m_workers) {
+        worker->manager.setCallTimeout(timeoutMs);
+    }
+}
+
+uint64_t CallWorkers::getCallCount() const {
+    uint64_t total = 0;
+    for (const auto& worker : m_workers) total += worker->manager.getCallCount();
+    return total;
+}
+
+uint64_t CallWorkers::getLDU1Count() const {
+    uint64_t total = 0;
+    for (const auto& worker : m_workers) total += worker->manager.getLDU1Count();
+    return total;
+}
+
+uint64_t CallWorkers::getLDU2Count() const {
+    uint64_t total = 0;
+    for (const auto& worker : m_workers) total += worker->manager.getLDU2Count();
+    return total;
+}
+
+uint64_t CallWorkers::getFramesMissing() const {
+    uint64_t total = 0;
+    for (const auto& worker : m_workers) total += worker->manager.getFramesMissing();
+    return total;
+}
+
+CallEndStats CallWorkers::getEndStats() const {
+    CallEndStats total = {};
+    for (const auto& worker : m_workers) {
+        CallEndStats stats = worker->manager.getEndStats();
+        total.terminated += stats.terminated;
+        total.terminatedTotalUs += stats.terminatedTotalUs;
+        total.terminatedMaxUs = std::max(total.terminatedMaxUs, stats.terminatedMaxUs);
+        total.timedOut += stats.timedOut;
+        total.timedOutTotalUs += stats.timedOutTotalUs;
+        total.timedOutMaxUs = std::max(total.timedOutMaxUs, stats.timedOutMaxUs);
+    }
+    return total;
+}
+
+std::vector<CallInfo> CallWorkers::getActiveCalls() {
+    std::vector<CallInfo> calls;
+    for (auto& worker : m_workers) {
+        std::vector<CallInfo> share = worker->manager.getActiveCalls();
+        calls.insert(calls.end(), share.begin(), share.end());
+    }
+
+    // Oldest first, whichever worker has them
+    std::sort(calls.begin(), calls.end(), [](const CallInfo& a, const CallInfo& b) {
+        return a.startTime < b.startTime;
+    });
+    return calls;
+}
+
+size_t CallWorkers::getActiveCallCount() {
+    size_t total = 0;
+    for (auto& worker : m_workers) total += worker->manager.getActiveCallCount();
+    return total;
+}
+
+uint64_t CallWorkers::getQueueDrops() const {
+    uint64_t total = 0;
+    for (const auto& worker : m_workers) total += worker->queueDrops.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint32_t CallWorkers::getQueuePeak() const {
+    uint32_t peak = 0;
+    for (const auto& worker : m_workers) {
+        peak = std::max(peak, worker->queuePeak.load(std::memory_order_relaxed));
+    }
+    return peak;
+}
+
+std::vector<const Reactor*> CallWorkers::getLoops() const {
+    std::vector<const Reactor*> loops;
+    if (m_threaded) {
+        for (const auto& worker : m_workers) loops.push_back(&worker->loop);
+    }
+    return loops;
+}
+
+} // namespace op25gateway
@@ -0,0 +1,134 @@
+#ifndef CALLWORKERS_H
+#define CALLWORKERS_H
+
+#include "CallManager.h"
+#include "SpscQueue.h"
+#include "Reactor.h"
+#include "Clock.h"
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace op25gateway {
+
+// Call processing for one pipeline, optionally sharded across threads
+//
+// With workers, every NAC and talkgroup belongs to one worker (jump
+// consistent hash), which owns its calls outright: call table, LDU
+// assembly and call timeout all run on an event loop thread of its own.
+// The receiver hands each frame to its worker through a lock-free
+// single-producer queue, ringing an eventfd only when the worker has
+// caught up. Each worker sends through a voice sink lane of its own, and
+// with an FNE session that lane frames the worker's streams and queues
+// them for the network thread without locking out the other workers, so
+// call processing scales across cores, and all frames of a call stay in
+// order on one worker.
+//
+// With no workers, calls are handled inline on the receiver's event loop,
+// one at a time, as a single voice channel.
+class CallWorkers {
+public:
+    CallWorkers(VoiceSink& sink, uint32_t workers, Clock& clock = Clock::system());
+    ~CallWorkers();
+
+    CallWorkers(const CallWorkers&) = delete;
+    CallWorkers& operator=(const CallWorkers&) = delete;
+
+    // Event loop for inline processing (before start())
+    void attach(Reactor& loop);
+
+    // Prefix for log lines (default "CallManager"; workers add their index)
+    void setLogName(const std::string& name);
+
+    // Thread names (name plus worker index), CPU affinity and priority
+    // for the workers (before start())
+    void setThreadTuning(const std::string& name, const ThreadTuning& tuning);
+
+    // Socket I/O for the workers' loops (before start())
+    void setIoBackend(IoBackend backend) { m_backend = backend; }
+
+    bool start();
+    void stop();
+
+    // Hot restart: finish the frames already queued, then hand over the
+    // calls in progress as they stand; the workers are left stopped
+    void handOff(std::vector<CallHandoff>& calls, CallTotals& totals);
+
+    // Carry on calls handed over by another process, each on the worker
+    // its talkgroup belongs to here (before start())
+    void adopt(const std::vector<CallHandoff>& calls, const CallTotals& totals);
+
+    // Receiver thread only: route a frame to its worker
+    void submit(const OP25Packet& packet);
+
+    // Receiver thread only: attribute kernel socket drops to the calls in
+    // progress on every worker
+    void noteKernelDrops(uint32_t dropped);
+
+    // Configuration (any thread; new overrides apply from the next call)
+    void setTalkgroupOverride(uint32_t tg);
+    void setSourceIdOverride(uint32_t srcId);
+    void setCallTimeout(uint32_t timeoutMs);
+
+    // Worker for a NAC/talkgroup key
+    static uint32_t shardOf(uint64_t key, uint32_t workers);
+
+    // Voice sink lane of the worker a NAC and talkgroup belong to, for
+    // ending a call handed back by handOff() on the stream it was using
+    VoiceSink& sinkFor(uint16_t nac, uint32_t talkgroup);
+
+    static constexpr size_t QUEUE_CAPACITY = 4096;  // Frames per worker
+
+    // Statistics, summed over workers
+    uint32_t getWorkers() const { return m_threaded ? static_cast<uint32_t>(m_workers.size()) : 0; }
+    uint64_t getCallCount() const;
+    uint64_t getLDU1Count() const;
+    uint64_t getLDU2Count() const;
+    uint64_t getFramesMissing() const;
+    CallEndStats getEndStats() const;
+    std::vector<CallInfo> getActiveCalls();
+    size_t getActiveCallCount();
+
+    // Frames dropped because a worker's queue was full, and the deepest
+    // any queue has been
+    uint64_t getQueueDrops() const;
+    uint32_t getQueuePeak() const;
+
+    // The workers' event loops, for scheduling reports (none inline)
+    std::vector<const Reactor*> getLoops() const;
+
+private:
+    struct Worker {
+        Worker(VoiceSink& sink, Clock& clock);
+
+        VoiceSink& sink;            // This worker's lane
+        CallManager manager;
+        Reactor loop;
+        std::thread thread;
+        SpscQueue<OP25Packet> queue;
+        int doorbell;
+        std::atomic<uint32_t> pendingDrops;     // Kernel drops not yet attributed
+        std::atomic<uint64_t> queueDrops;
+        std::atomic<uint32_t> queuePeak;
+    };
+
+    bool startWorker(Worker& worker, const std::string& threadName);
+    void stopWorker(Worker& worker);
+    void drain(Worker& worker);
+
+    std::string m_logName;
+    std::string m_threadName;
+    ThreadTuning m_tuning;
+    IoBackend m_backend;
+    bool m_threaded;
+    bool m_running;
+    std::vector<std::unique_ptr<Worker>> m_workers;  // One, run inline, without threads
+};
+
+} // namespace op25gateway
+
+#endif // CALLWORKERS_H
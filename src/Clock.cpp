@@ -0,0 +1,76 @@
+#include "Clock.h"
+
+namespace op25gateway {
+
+Clock& Clock::system() {
+    static SystemClock clock;
+    return clock;
+}
+
+Clock::TimePoint SystemClock::now() const {
+    return std::chrono::steady_clock::now();
+}
+
+std::chrono::system_clock::time_point SystemClock::wallNow() const {
+    return std::chrono::system_clock::now();
+}
+
+void SystemClock::sleepUntil(TimePoint deadline) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t generation = m_generation;
+    m_cond.wait_until(lock, deadline, [&]() { return m_generation != generation; });
+}
+
+void SystemClock::wake() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_generation++;
+    }
+    m_cond.notify_all();
+}
+
+VirtualClock::VirtualClock(std::chrono::system_clock::time_point wallStart)
+    : m_wallStart(wallStart)
+    , m_nowNs(0)
+    , m_generation(0)
+{
+}
+
+Clock::TimePoint VirtualClock::now() const {
+    return TimePoint(std::chrono::nanoseconds(m_nowNs.load(std::memory_order_acquire)));
+}
+
+std::chrono::system_clock::time_point VirtualClock::wallNow() const {
+    return m_wallStart + std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::nanoseconds(m_nowNs.load(std::memory_order_acquire)));
+}
+
+void VirtualClock::sleepUntil(TimePoint deadline) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t generation = m_generation;
+    m_cond.wait(lock, [&]() { return now() >= deadline || m_generation != generation; });
+}
+
+void VirtualClock::wake() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_generation++;
+    }
+    m_cond.notify_all();
+}
+
+void VirtualClock::advance(Duration duration) {
+    advanceTo(now() + duration);
+}
+
+void VirtualClock::advanceTo(TimePoint time) {
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (ns <= m_nowNs.load(std::memory_order_relaxed)) return;
+        m_nowNs.store(ns, std::memory_order_release);
+    }
+    m_cond.notify_all();
+}
+
+} // namespace op25gateway
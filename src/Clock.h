@@ -0,0 +1,84 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+namespace op25gateway {
+
+// Time source and sleep primitive for components with timers
+//
+// Production code uses Clock::system(). Simulations inject a VirtualClock
+// so hours of traffic can be pushed through CallManager/FNEClient in
+// seconds while their timeout logic still sees realistic time.
+class Clock {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+    using Duration = std::chrono::steady_clock::duration;
+
+    virtual ~Clock() = default;
+
+    // Monotonic time for intervals and timeouts
+    virtual TimePoint now() const = 0;
+
+    // Wall-clock time for display and logging
+    virtual std::chrono::system_clock::time_point wallNow() const = 0;
+
+    // Block until deadline; may return early after wake()
+    virtual void sleepUntil(TimePoint deadline) = 0;
+    void sleepFor(Duration duration) { sleepUntil(now() + duration); }
+
+    // Release threads blocked in sleepUntil so they can observe a stop flag
+    virtual void wake() = 0;
+
+    // Process-wide real clock
+    static Clock& system();
+};
+
+// Real time, backed by steady_clock/system_clock
+class SystemClock : public Clock {
+public:
+    TimePoint now() const override;
+    std::chrono::system_clock::time_point wallNow() const override;
+    void sleepUntil(TimePoint deadline) override;
+    void wake() override;
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    uint64_t m_generation = 0;
+};
+
+// Manually advanced time for simulation
+//
+// Time only moves when advance()/advanceTo() is called. Threads sleeping
+// on the clock wake when time passes their deadline, but a simulation is
+// deterministic only if it drives timers directly instead of starting them.
+class VirtualClock : public Clock {
+public:
+    explicit VirtualClock(std::chrono::system_clock::time_point wallStart =
+                              std::chrono::system_clock::time_point());
+
+    TimePoint now() const override;
+    std::chrono::system_clock::time_point wallNow() const override;
+    void sleepUntil(TimePoint deadline) override;
+    void wake() override;
+
+    void advance(Duration duration);
+    void advanceTo(TimePoint time);
+
+private:
+    std::chrono::system_clock::time_point m_wallStart;
+    std::atomic<int64_t> m_nowNs;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    uint64_t m_generation;
+};
+
+} // namespace op25gateway
+
+#endif // CLOCK_H
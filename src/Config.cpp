@@ -2,20 +2,155 @@
 #include <yaml-cpp/yaml.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <functional>
 
 namespace op25gateway {
 
-Config::Config()
+PipelineConfig::PipelineConfig()
     : m_op25ListenPort(9999)
+    , m_op25ReceiveBuffer(0)
+    , m_op25ShmRing(0)
+    , m_op25VoteWindow(0)
     , m_fneHost("127.0.0.1")
     , m_fnePort(62031)
     , m_fnePassword("PASSWORD")
     , m_fnePeerId(9000999)
+    , m_fneLoginTimeout(5000)
+    , m_fneBackoffInitial(1000)
+    , m_fneBackoffMax(10000)
+    , m_fnePingInterval(2000)
+    , m_fneMaxMissedPongs(3)
+    , m_fneOutageBuffer(3000)
+    , m_fneReplaySpeed(4.0)
+    , m_fneSecondaryPort(0)
     , m_gatewayTalkgroup(0)
     , m_gatewaySourceId(9000999)
     , m_callTimeout(1000)
+    , m_callWorkers(0)
+{
+}
+
+void PipelineConfig::load(const YAML::Node& config) {
+    // OP25 settings
+    if (config["op25"]) {
+        if (config["op25"]["listenPort"]) {
+            m_op25ListenPort = config["op25"]["listenPort"].as<uint16_t>();
+        }
+        if (config["op25"]["receiveBuffer"]) {
+            m_op25ReceiveBuffer = config["op25"]["receiveBuffer"].as<uint32_t>();
+        }
+        if (config["op25"]["shmRing"]) {
+            m_op25ShmRing = config["op25"]["shmRing"].as<uint32_t>();
+        }
+        if (config["op25"]["voteWindow"]) {
+            m_op25VoteWindow = config["op25"]["voteWindow"].as<uint32_t>();
+        }
+    }
+
+    // FNE settings
+    if (config["fne"]) {
+        if (config["fne"]["host"]) {
+            m_fneHost = config["fne"]["host"].as<std::string>();
+        }
+        if (config["fne"]["port"]) {
+            m_fnePort = config["fne"]["port"].as<uint16_t>();
+        }
+        if (config["fne"]["password"]) {
+            m_fnePassword = config["fne"]["password"].as<std::string>();
+        }
+        if (config["fne"]["peerId"]) {
+            m_fnePeerId = config["fne"]["peerId"].as<uint32_t>();
+        }
+        if (config["fne"]["loginTimeout"]) {
+            m_fneLoginTimeout = config["fne"]["loginTimeout"].as<uint32_t>();
+        }
+        if (config["fne"]["backoffInitial"]) {
+            m_fneBackoffInitial = config["fne"]["backoffInitial"].as<uint32_t>();
+        }
+        if (config["fne"]["backoffMax"]) {
+            m_fneBackoffMax = config["fne"]["backoffMax"].as<uint32_t>();
+        }
+        if (config["fne"]["pingInterval"]) {
+            m_fnePingInterval = config["fne"]["pingInterval"].as<uint32_t>();
+        }
+        if (config["fne"]["maxMissedPongs"]) {
+            m_fneMaxMissedPongs = config["fne"]["maxMissedPongs"].as<uint32_t>();
+        }
+        if (config["fne"]["outageBuffer"]) {
+            m_fneOutageBuffer = config["fne"]["outageBuffer"].as<uint32_t>();
+        }
+        if (config["fne"]["replaySpeed"]) {
+            m_fneReplaySpeed = config["fne"]["replaySpeed"].as<double>();
+        }
+        if (config["fne"]["secondaryHost"]) {
+            m_fneSecondaryHost = config["fne"]["secondaryHost"].as<std::string>();
+        }
+        if (config["fne"]["secondaryPort"]) {
+            m_fneSecondaryPort = config["fne"]["secondaryPort"].as<uint16_t>();
+        }
+    }
+
+    // Gateway settings
+    if (config["gateway"]) {
+        if (config["gateway"]["talkgroup"]) {
+            m_gatewayTalkgroup = config["gateway"]["talkgroup"].as<uint32_t>();
+        }
+        if (config["gateway"]["sourceId"]) {
+            m_gatewaySourceId = config["gateway"]["sourceId"].as<uint32_t>();
+        }
+        if (config["gateway"]["callTimeout"]) {
+            m_callTimeout = config["gateway"]["callTimeout"].as<uint32_t>();
+        }
+        if (config["gateway"]["callWorkers"]) {
+            m_callWorkers = config["gateway"]["callWorkers"].as<uint32_t>();
+        }
+    }
+}
+
+bool PipelineConfig::validate(const std::string& prefix, std::string& error) const {
+    if (m_op25ListenPort == 0) {
+        error = prefix + "op25.listenPort must be set";
+    } else if (m_op25ShmRing > 65536) {
+        error = prefix + "op25.shmRing must be 65536 frames or fewer";
+    } else if (m_op25VoteWindow > 100) {
+        error = prefix + "op25.voteWindow must be 100 ms or less";
+    } else if (m_fneHost.empty()) {
+        error = prefix + "fne.host must be set";
+    } else if (m_fnePort == 0) {
+        error = prefix + "fne.port must be set";
+    } else if (m_fnePeerId == 0) {
+        error = prefix + "fne.peerId must be set";
+    } else if (m_fneLoginTimeout == 0) {
+        error = prefix + "fne.loginTimeout must be positive";
+    } else if (m_fneBackoffInitial == 0 || m_fneBackoffMax < m_fneBackoffInitial) {
+        error = prefix + "fne.backoffInitial must be positive and not above fne.backoffMax";
+    } else if (m_fnePingInterval < 100) {
+        error = prefix + "fne.pingInterval must be at least 100 ms";
+    } else if (m_fneMaxMissedPongs == 0) {
+        error = prefix + "fne.maxMissedPongs must be at least 1";
+    } else if (!(m_fneReplaySpeed > 0)) {
+        error = prefix + "fne.replaySpeed must be positive";
+    } else if (m_callTimeout == 0) {
+        error = prefix + "gateway.callTimeout must be positive";
+    } else if (m_callWorkers > 64) {
+        error = prefix + "gateway.callWorkers must be 64 or fewer";
+    } else {
+        return true;
+    }
+    return false;
+}
+
+Config::Config()
+    : m_pipelines(1)
+    , m_workerThreads(0)
+    , m_ioBackendName("epoll")
+    , m_watchConfig(true)
     , m_logLevel(1)
+    , m_logLevelName("INFO")
     , m_logFile("gateway.log")
+    , m_statsSharedMemory(true)
+    , m_realtimeLockMemory(false)
 {
 }
 
@@ -30,39 +165,36 @@ bool Config::load(const std::string& filename) {
 
         YAML::Node config = YAML::LoadFile(filename);
 
-        // OP25 settings
-        if (config["op25"]) {
-            if (config["op25"]["listenPort"]) {
-                m_op25ListenPort = config["op25"]["listenPort"].as<uint16_t>();
-            }
-        }
+        // The top-level op25, fne and gateway sections are the single
+        // pipeline, or the defaults for each entry of a pipelines list
+        PipelineConfig defaults;
+        defaults.load(config);
 
-        // FNE settings
-        if (config["fne"]) {
-            if (config["fne"]["host"]) {
-                m_fneHost = config["fne"]["host"].as<std::string>();
-            }
-            if (config["fne"]["port"]) {
-                m_fnePort = config["fne"]["port"].as<uint16_t>();
-            }
-            if (config["fne"]["password"]) {
-                m_fnePassword = config["fne"]["password"].as<std::string>();
-            }
-            if (config["fne"]["peerId"]) {
-                m_fnePeerId = config["fne"]["peerId"].as<uint32_t>();
+        m_pipelines.clear();
+        if (config["pipelines"]) {
+            size_t index = 0;
+            for (const YAML::Node& node : config["pipelines"]) {
+                PipelineConfig pipeline = defaults;
+                pipeline.load(node);
+                pipeline.m_name = node["name"] ? node["name"].as<std::string>()
+                                               : "pipeline" + std::to_string(index + 1);
+                m_pipelines.push_back(pipeline);
+                index++;
             }
+        } else {
+            m_pipelines.push_back(defaults);
         }
 
         // Gateway settings
         if (config["gateway"]) {
-            if (config["gateway"]["talkgroup"]) {
-                m_gatewayTalkgroup = config["gateway"]["talkgroup"].as<uint32_t>();
+            if (config["gateway"]["workerThreads"]) {
+                m_workerThreads = config["gateway"]["workerThreads"].as<uint32_t>();
             }
-            if (config["gateway"]["sourceId"]) {
-                m_gatewaySourceId = config["gateway"]["sourceId"].as<uint32_t>();
+            if (config["gateway"]["watchConfig"]) {
+                m_watchConfig = config["gateway"]["watchConfig"].as<bool>();
             }
-            if (config["gateway"]["callTimeout"]) {
-                m_callTimeout = config["gateway"]["callTimeout"].as<uint32_t>();
+            if (config["gateway"]["ioBackend"]) {
+                m_ioBackendName = config["gateway"]["ioBackend"].as<std::string>();
             }
         }
 
@@ -70,6 +202,7 @@ bool Config::load(const std::string& filename) {
         if (config["logging"]) {
             if (config["logging"]["level"]) {
                 std::string levelStr = config["logging"]["level"].as<std::string>();
+                m_logLevelName = levelStr;
                 if (levelStr == "DEBUG") m_logLevel = 0;
                 else if (levelStr == "INFO") m_logLevel = 1;
                 else if (levelStr == "WARN") m_logLevel = 2;
@@ -80,6 +213,23 @@ bool Config::load(const std::string& filename) {
             }
         }
 
+        // Stats settings
+        if (config["stats"]) {
+            if (config["stats"]["sharedMemory"]) {
+                m_statsSharedMemory = config["stats"]["sharedMemory"].as<bool>();
+            }
+        }
+
+        // Realtime settings
+        if (config["realtime"]) {
+            const YAML::Node& realtime = config["realtime"];
+            if (realtime["lockMemory"]) {
+                m_realtimeLockMemory = realtime["lockMemory"].as<bool>();
+            }
+            loadThreadTuning(realtime["eventLoops"], m_eventLoopCpus, m_eventLoopTuning);
+            loadThreadTuning(realtime["callWorkers"], m_callWorkerCpus, m_callWorkerTuning);
+        }
+
         std::cout << "Configuration loaded from " << filename << std::endl;
         return true;
 
@@ -89,4 +239,205 @@ bool Config::load(const std::string& filename) {
     }
 }
 
+void Config::loadThreadTuning(const YAML::Node& node, std::string& cpus, ThreadTuning& tuning) {
+    if (!node) return;
+
+    if (node["cpus"]) {
+        cpus = node["cpus"].as<std::string>();
+        parseCpuList(cpus, tuning.cpus);
+    }
+    if (node["priority"]) {
+        tuning.priority = node["priority"].as<int>();
+    }
+}
+
+const PipelineConfig* Config::findPipeline(const std::string& name) const {
+    for (const PipelineConfig& pipeline : m_pipelines) {
+        if (pipeline.getName() == name) return &pipeline;
+    }
+    return nullptr;
+}
+
+namespace {
+
+std::string formatDouble(double value) {
+    std::ostringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+std::string logLevelName(int level) {
+    static const char* names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+    return level >= 0 && level <= 3 ? names[level] : std::to_string(level);
+}
+
+// Every reloadable setting, in file order, with how a change applies
+template <typename T>
+struct SettingInfo {
+    const char* key;
+    ConfigApply apply;
+    std::function<std::string(const T&)> value;
+};
+
+// Per pipeline
+const std::vector<SettingInfo<PipelineConfig>>& pipelineSettingTable() {
+    using P = PipelineConfig;
+    static const std::vector<SettingInfo<P>> table = {
+        { "op25.listenPort", ConfigApply::RESTART, [](const P& c) { return std::to_string(c.getOP25ListenPort()); } },
+        { "op25.receiveBuffer", ConfigApply::RESTART, [](const P& c) { return std::to_string(c.getOP25ReceiveBuffer()); } },
+        { "op25.shmRing", ConfigApply::RESTART, [](const P& c) { return std::to_string(c.getOP25ShmRing()); } },
+        { "op25.voteWindow", ConfigApply::RESTART, [](const P& c) { return std::to_string(c.getOP25VoteWindow()); } },
+        { "fne.host", ConfigApply::RELOGIN, [](const P& c) { return c.getFneHost(); } },
+        { "fne.port", ConfigApply::RELOGIN, [](const P& c) { return std::to_string(c.getFnePort()); } },
+        { "fne.password", ConfigApply::RELOGIN, [](const P& c) { return c.getFnePassword(); } },
+        { "fne.peerId", ConfigApply::RESTART, [](const P& c) { return std::to_string(c.getFnePeerId()); } },
+        { "fne.loginTimeout", ConfigApply::LIVE, [](const P& c) { return std::to_string(c.getFneLoginTimeout()); } },
+        { "fne.backoffInitial", ConfigApply::LIVE, [](const P& c) { return std::to_string(c.getFneBackoffInitial()); } },
+        { "fne.backoffMax", ConfigApply::LIVE, [](const P& c) { return std::to_string(c.getFneBackoffMax()); } },
+        { "fne.pingInterval", ConfigApply::LIVE, [](const P& c) { return std::to_string(c.getFnePingInterval()); } },
+        { "fne.maxMissedPongs", ConfigApply::LIVE, [](const P& c) { return std::to_string(c.getFneMaxMissedPongs()); } },
+        { "fne.outageBuffer", ConfigApply::LIVE, [](const P& c) { return std::to_string(c.getFneOutageBuffer()); } },
+        { "fne.replaySpeed", ConfigApply::LIVE, [](const P& c) { return formatDouble(c.getFneReplaySpeed()); } },
+        { "fne.secondaryHost", ConfigApply::RESTART, [](const P& c) { return c.getFneSecondaryHost(); } },
+        { "fne.secondaryPort", ConfigApply::RESTART, [](const P& c) { return std::to_string(c.getFneSecondaryPort()); } },
+        { "gateway.talkgroup", ConfigApply::LIVE, [](const P& c) { return std::to_string(c.getGatewayTalkgroup()); } },
+        { "gateway.sourceId", ConfigApply::LIVE, [](const P& c) { return std::to_string(c.getGatewaySourceId()); } },
+        { "gateway.callTimeout", ConfigApply::LIVE, [](const P& c) { return std::to_string(c.getCallTimeout()); } },
+        { "gateway.callWorkers", ConfigApply::RESTART, [](const P& c) { return std::to_string(c.getCallWorkers()); } },
+    };
+    return table;
+}
+
+// Process-wide
+const std::vector<SettingInfo<Config>>& settingTable() {
+    static const std::vector<SettingInfo<Config>> table = {
+        { "gateway.workerThreads", ConfigApply::RESTART, [](const Config& c) { return std::to_string(c.getWorkerThreads()); } },
+        { "gateway.watchConfig", ConfigApply::RESTART, [](const Config& c) { return c.getWatchConfig() ? "true" : "false"; } },
+        { "gateway.ioBackend", ConfigApply::RESTART, [](const Config& c) { return c.getIoBackendName(); } },
+        { "logging.level", ConfigApply::LIVE, [](const Config& c) { return logLevelName(c.getLogLevel()); } },
+        { "logging.file", ConfigApply::LIVE, [](const Config& c) { return c.getLogFile(); } },
+        { "stats.sharedMemory", ConfigApply::RESTART, [](const Config& c) { return c.getStatsSharedMemory() ? "true" : "false"; } },
+        { "realtime.lockMemory", ConfigApply::RESTART, [](const Config& c) { return c.getRealtimeLockMemory() ? "true" : "false"; } },
+        { "realtime.eventLoops.cpus", ConfigApply::RESTART, [](const Config& c) { return formatCpuList(c.getEventLoopTuning().cpus); } },
+        { "realtime.eventLoops.priority", ConfigApply::RESTART, [](const Config& c) { return std::to_string(c.getEventLoopTuning().priority); } },
+        { "realtime.callWorkers.cpus", ConfigApply::RESTART, [](const Config& c) { return formatCpuList(c.getCallWorkerTuning().cpus); } },
+        { "realtime.callWorkers.priority", ConfigApply::RESTART, [](const Config& c) { return std::to_string(c.getCallWorkerTuning().priority); } },
+    };
+    return table;
+}
+
+// Settings of a listed pipeline are named after it
+std::string pipelineKey(const PipelineConfig& pipeline) {
+    return pipeline.getName().empty() ? "pipelines" : "pipelines." + pipeline.getName();
+}
+
+std::string pipelinePrefix(const PipelineConfig& pipeline) {
+    return pipeline.getName().empty() ? "" : pipelineKey(pipeline) + ".";
+}
+
+} // namespace
+
+bool Config::validate(std::string& error) const {
+    if (m_logLevelName != "DEBUG" && m_logLevelName != "INFO" &&
+        m_logLevelName != "WARN" && m_logLevelName != "ERROR") {
+        error = "logging.level must be DEBUG, INFO, WARN or ERROR (got " + m_logLevelName + ")";
+        return false;
+    }
+    if (m_pipelines.empty()) {
+        error = "pipelines must list at least one pipeline";
+        return false;
+    }
+    if (m_ioBackendName != "epoll" && m_ioBackendName != "io_uring") {
+        error = "gateway.ioBackend must be epoll or io_uring (got " + m_ioBackendName + ")";
+        return false;
+    }
+
+    std::vector<int> cpus;
+    if (!parseCpuList(m_eventLoopCpus, cpus)) {
+        error = "realtime.eventLoops.cpus must be a CPU list such as 2,3 or 2-3 (got " + m_eventLoopCpus + ")";
+        return false;
+    }
+    if (!parseCpuList(m_callWorkerCpus, cpus)) {
+        error = "realtime.callWorkers.cpus must be a CPU list such as 2,3 or 2-3 (got " + m_callWorkerCpus + ")";
+        return false;
+    }
+    if (m_eventLoopTuning.priority < 0 || m_eventLoopTuning.priority > 99) {
+        error = "realtime.eventLoops.priority must be 0 to 99";
+        return false;
+    }
+    if (m_callWorkerTuning.priority < 0 || m_callWorkerTuning.priority > 99) {
+        error = "realtime.callWorkers.priority must be 0 to 99";
+        return false;
+    }
+
+    for (size_t i = 0; i < m_pipelines.size(); i++) {
+        const PipelineConfig& pipeline = m_pipelines[i];
+        if (!pipeline.validate(pipelinePrefix(pipeline), error)) {
+            return false;
+        }
+
+        // Pipelines are told apart by name, and each needs its own OP25
+        // port and peer ID (which also names its stats page)
+        for (size_t j = 0; j < i; j++) {
+            const PipelineConfig& other = m_pipelines[j];
+            if (other.getName() == pipeline.getName()) {
+                error = "pipelines: name " + pipeline.getName() + " is used twice";
+            } else if (other.getOP25ListenPort() == pipeline.getOP25ListenPort()) {
+                error = pipelinePrefix(pipeline) + "op25.listenPort " +
+                        std::to_string(pipeline.getOP25ListenPort()) + " is also used by " + other.getName();
+            } else if (other.getFnePeerId() == pipeline.getFnePeerId()) {
+                error = pipelinePrefix(pipeline) + "fne.peerId " +
+                        std::to_string(pipeline.getFnePeerId()) + " is also used by " + other.getName();
+            } else {
+                continue;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<ConfigChange> Config::diff(const Config& newer) const {
+    std::vector<ConfigChange> changes;
+
+    for (size_t i = 0; i < newer.m_pipelines.size(); i++) {
+        const PipelineConfig& next = newer.m_pipelines[i];
+        const PipelineConfig* current = findPipeline(next.getName());
+        std::string prefix = pipelinePrefix(next);
+        int index = static_cast<int>(i);
+
+        if (!current) {
+            changes.push_back({ pipelineKey(next), "(none)", "added", ConfigApply::RESTART, index });
+            continue;
+        }
+
+        for (const SettingInfo<PipelineConfig>& setting : pipelineSettingTable()) {
+            std::string oldValue = setting.value(*current);
+            std::string newValue = setting.value(next);
+            if (oldValue == newValue) continue;
+
+            // Never write the password to the log
+            if (std::string(setting.key) == "fne.password") {
+                oldValue = newValue = "***";
+            }
+            changes.push_back({ prefix + setting.key, oldValue, newValue, setting.apply, index });
+        }
+    }
+
+    for (const PipelineConfig& pipeline : m_pipelines) {
+        if (!newer.findPipeline(pipeline.getName())) {
+            changes.push_back({ pipelineKey(pipeline), "present", "removed", ConfigApply::RESTART, -1 });
+        }
+    }
+
+    for (const SettingInfo<Config>& setting : settingTable()) {
+        std::string oldValue = setting.value(*this);
+        std::string newValue = setting.value(newer);
+        if (oldValue == newValue) continue;
+
+        changes.push_back({ setting.key, oldValue, newValue, setting.apply, -1 });
+    }
+    return changes;
+}
+
 } // namespace op25gateway
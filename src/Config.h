@@ -1,53 +1,179 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include "Realtime.h"
+#include "Reactor.h"
+
 #include <string>
 #include <cstdint>
+#include <vector>
+
+namespace YAML {
+class Node;
+}
 
 namespace op25gateway {
 
-class Config {
+// How a changed setting takes effect on reload
+enum class ConfigApply {
+    LIVE,       // Applied at once, calls carry on
+    RELOGIN,    // FNE session logs in again (after the call in progress)
+    RESTART     // Only read at startup
+};
+
+// One setting that differs between two configurations
+struct ConfigChange {
+    std::string key;
+    std::string oldValue;
+    std::string newValue;
+    ConfigApply apply;
+    int pipeline;       // Index in the newer config, -1 for process-wide settings
+};
+
+// One OP25 source and the FNE it feeds. Settings not given for a pipeline
+// come from the top-level op25, fne and gateway sections.
+class PipelineConfig {
 public:
-    Config();
+    PipelineConfig();
 
-    bool load(const std::string& filename = "config.yml");
+    // Names the pipeline in logs and settings ("" for the single
+    // pipeline of a config without a pipelines list)
+    const std::string& getName() const { return m_name; }
 
     // OP25 receiver settings
     uint16_t getOP25ListenPort() const { return m_op25ListenPort; }
+    uint32_t getOP25ReceiveBuffer() const { return m_op25ReceiveBuffer; }
+    uint32_t getOP25ShmRing() const { return m_op25ShmRing; }
+    uint32_t getOP25VoteWindow() const { return m_op25VoteWindow; }     // ms, 0 = no voting
 
     // FNE settings
     std::string getFneHost() const { return m_fneHost; }
     uint16_t getFnePort() const { return m_fnePort; }
     std::string getFnePassword() const { return m_fnePassword; }
     uint32_t getFnePeerId() const { return m_fnePeerId; }
+    uint32_t getFneLoginTimeout() const { return m_fneLoginTimeout; }
+    uint32_t getFneBackoffInitial() const { return m_fneBackoffInitial; }
+    uint32_t getFneBackoffMax() const { return m_fneBackoffMax; }
+    uint32_t getFnePingInterval() const { return m_fnePingInterval; }
+    uint32_t getFneMaxMissedPongs() const { return m_fneMaxMissedPongs; }
+    uint32_t getFneOutageBuffer() const { return m_fneOutageBuffer; }
+    double getFneReplaySpeed() const { return m_fneReplaySpeed; }
+    std::string getFneSecondaryHost() const { return m_fneSecondaryHost; }
+    uint16_t getFneSecondaryPort() const { return m_fneSecondaryPort ? m_fneSecondaryPort : m_fnePort; }
 
     // Gateway settings
     uint32_t getGatewayTalkgroup() const { return m_gatewayTalkgroup; }
     uint32_t getGatewaySourceId() const { return m_gatewaySourceId; }
     uint32_t getCallTimeout() const { return m_callTimeout; }
 
-    // Logging settings
-    int getLogLevel() const { return m_logLevel; }
-    std::string getLogFile() const { return m_logFile; }
+    // Threads calls are sharded across by talkgroup, for an OP25 sending
+    // several voice channels (0 = one call at a time, on the event loop)
+    uint32_t getCallWorkers() const { return m_callWorkers; }
 
 private:
+    friend class Config;
+
+    void load(const YAML::Node& node);
+    bool validate(const std::string& prefix, std::string& error) const;
+
+    std::string m_name;
+
     // OP25
     uint16_t m_op25ListenPort;
+    uint32_t m_op25ReceiveBuffer;
+    uint32_t m_op25ShmRing;
+    uint32_t m_op25VoteWindow;
 
     // FNE
     std::string m_fneHost;
     uint16_t m_fnePort;
     std::string m_fnePassword;
     uint32_t m_fnePeerId;
+    uint32_t m_fneLoginTimeout;
+    uint32_t m_fneBackoffInitial;
+    uint32_t m_fneBackoffMax;
+    uint32_t m_fnePingInterval;
+    uint32_t m_fneMaxMissedPongs;
+    uint32_t m_fneOutageBuffer;
+    double m_fneReplaySpeed;
+    std::string m_fneSecondaryHost;
+    uint16_t m_fneSecondaryPort;
 
     // Gateway
     uint32_t m_gatewayTalkgroup;
     uint32_t m_gatewaySourceId;
     uint32_t m_callTimeout;
+    uint32_t m_callWorkers;
+};
+
+class Config {
+public:
+    Config();
+
+    bool load(const std::string& filename = "config.yml");
+
+    // Checks values against their allowed ranges; error names the first
+    // offending setting
+    bool validate(std::string& error) const;
+
+    // Settings that differ in newer, in file order
+    std::vector<ConfigChange> diff(const Config& newer) const;
+
+    // Pipelines, in file order; always at least one
+    const std::vector<PipelineConfig>& getPipelines() const { return m_pipelines; }
+
+    // Pipeline by name (nullptr if there is none)
+    const PipelineConfig* findPipeline(const std::string& name) const;
+
+    // Event loop threads shared by the pipelines (0 = one per CPU, at
+    // most one per pipeline)
+    uint32_t getWorkerThreads() const { return m_workerThreads; }
+
+    // Socket I/O for the event loops and call workers: epoll (default)
+    // or io_uring
+    IoBackend getIoBackend() const { return m_ioBackendName == "io_uring" ? IoBackend::IO_URING : IoBackend::EPOLL; }
+    const std::string& getIoBackendName() const { return m_ioBackendName; }
+
+    // Logging settings
+    int getLogLevel() const { return m_logLevel; }
+    std::string getLogFile() const { return m_logFile; }
+
+    bool getWatchConfig() const { return m_watchConfig; }
+
+    // Stats settings
+    bool getStatsSharedMemory() const { return m_statsSharedMemory; }
+
+    // Realtime settings: memory locking, and CPU affinity and SCHED_FIFO
+    // priority for the event loops (OP25 receive, FNE sessions) and the
+    // call worker threads
+    bool getRealtimeLockMemory() const { return m_realtimeLockMemory; }
+    const ThreadTuning& getEventLoopTuning() const { return m_eventLoopTuning; }
+    const ThreadTuning& getCallWorkerTuning() const { return m_callWorkerTuning; }
+
+private:
+    static void loadThreadTuning(const YAML::Node& node, std::string& cpus, ThreadTuning& tuning);
+
+    std::vector<PipelineConfig> m_pipelines;
+
+    // Gateway
+    uint32_t m_workerThreads;
+    std::string m_ioBackendName;    // As written, so a typo fails validation
+    bool m_watchConfig;
 
     // Logging
     int m_logLevel;
+    std::string m_logLevelName;     // As written, so a typo fails validation
     std::string m_logFile;
+
+    // Stats
+    bool m_statsSharedMemory;
+
+    // Realtime
+    bool m_realtimeLockMemory;
+    std::string m_eventLoopCpus;    // As written, so a malformed list fails validation
+    std::string m_callWorkerCpus;
+    ThreadTuning m_eventLoopTuning;
+    ThreadTuning m_callWorkerTuning;
 };
 
 } // namespace op25gateway
@@ -0,0 +1,210 @@
+#include "ConfigReloader.h"
+#include "Logger.h"
+
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+namespace op25gateway {
+
+namespace {
+
+// Editors write a file in several steps; reload once it has settled
+constexpr std::chrono::milliseconds FILE_SETTLE_TIME(250);
+
+const char* applyName(ConfigApply apply) {
+    switch (apply) {
+        case ConfigApply::LIVE:    return "applied";
+        case ConfigApply::RELOGIN: return "FNE re-login";
+        default:                   return "needs restart";
+    }
+}
+
+} // namespace
+
+ConfigReloader::ConfigReloader(const std::string& path, std::shared_ptr<const Config> initial, Clock& clock)
+    : m_clock(clock)
+    , m_reactor(clock)
+    , m_path(path)
+    , m_watchFile(true)
+    , m_current(initial)
+    , m_startup(initial)
+    , m_requestFd(-1)
+    , m_inotifyFd(-1)
+    , m_settleTimer(0)
+    , m_reloads(0)
+    , m_rejected(0)
+    , m_lastReloadMs(0)
+    , m_pendingRestart(0)
+{
+    size_t slash = path.rfind('/');
+    m_dir = slash == std::string::npos ? "." : path.substr(0, slash == 0 ? 1 : slash);
+    m_file = slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+ConfigReloader::~ConfigReloader() {
+    stop();
+}
+
+bool ConfigReloader::start() {
+    if (m_thread.joinable()) return true;
+
+    m_requestFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_requestFd < 0 || !m_reactor.open()) {
+        LOG_ERROR("Config: Cannot start reloader");
+        stop();
+        return false;
+    }
+
+    m_reactor.addFd(m_requestFd, EPOLLIN, [this](uint32_t) { onRequest(); });
+    if (m_watchFile && watchFile()) {
+        LOG_INFO("Config: Watching " + m_path + " for changes (SIGHUP also reloads)");
+    } else {
+        LOG_INFO("Config: Reload with SIGHUP");
+    }
+
+    m_thread = std::thread(&ConfigReloader::reloaderThread, this);
+    return true;
+}
+
+void ConfigReloader::stop() {
+    if (m_thread.joinable()) {
+        m_reactor.stop();
+        m_thread.join();
+    }
+    m_reactor.close();
+
+    if (m_inotifyFd >= 0) {
+        close(m_inotifyFd);
+        m_inotifyFd = -1;
+    }
+    if (m_requestFd >= 0) {
+        close(m_requestFd);
+        m_requestFd = -1;
+    }
+}
+
+void ConfigReloader::requestReload() {
+    uint64_t one = 1;
+    if (m_requestFd >= 0) {
+        ssize_t ignored = write(m_requestFd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void ConfigReloader::reloaderThread() {
+    m_reactor.run();
+    m_reactor.cancelTimer(m_settleTimer);
+}
+
+bool ConfigReloader::watchFile() {
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0) {
+        LOG_WARN("Config: inotify unavailable: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    // Watch the directory: editors and config management usually replace
+    // the file rather than rewrite it in place
+    if (inotify_add_watch(m_inotifyFd, m_dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        LOG_WARN("Config: Cannot watch " + m_dir + ": " + strerror(errno));
+        close(m_inotifyFd);
+        m_inotifyFd = -1;
+        return false;
+    }
+
+    m_reactor.addFd(m_inotifyFd, EPOLLIN, [this](uint32_t) { onFileEvent(); });
+    return true;
+}
+
+void ConfigReloader::onFileEvent() {
+    alignas(struct inotify_event) char buffer[4096];
+    bool ours = false;
+
+    ssize_t len;
+    while ((len = read(m_inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + len; ) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            if (event->len > 0 && m_file == event->name) {
+                ours = true;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    if (!ours) return;
+
+    m_reactor.cancelTimer(m_settleTimer);
+    m_settleTimer = m_reactor.addTimer(FILE_SETTLE_TIME, [this]() {
+        m_settleTimer = 0;
+        reload("file changed");
+    });
+}
+
+void ConfigReloader::onRequest() {
+    uint64_t count;
+    if (read(m_requestFd, &count, sizeof(count)) == (ssize_t)sizeof(count)) {
+        reload("SIGHUP");
+    }
+}
+
+void ConfigReloader::reload(const char* trigger) {
+    std::shared_ptr<Config> next = std::make_shared<Config>();
+    std::string error;
+
+    if (!next->load(m_path)) {
+        m_rejected++;
+        LOG_ERROR("Config: Reload (" + std::string(trigger) + ") failed to read " + m_path +
+                  ", keeping current settings");
+        return;
+    }
+    if (!next->validate(error)) {
+        m_rejected++;
+        LOG_ERROR("Config: Reload (" + std::string(trigger) + ") rejected: " + error +
+                  ", keeping current settings");
+        return;
+    }
+
+    std::shared_ptr<const Config> previous = current();
+    std::vector<ConfigChange> changes = previous->diff(*next);
+    if (changes.empty()) {
+        LOG_INFO("Config: Reload (" + std::string(trigger) + "), no changes");
+        return;
+    }
+
+    LOG_INFO("Config: Reload (" + std::string(trigger) + "), " + std::to_string(changes.size()) +
+             " setting(s) changed");
+    for (const ConfigChange& change : changes) {
+        std::stringstream ss;
+        ss << "Config:   " << change.key << ": " << change.oldValue << " -> " << change.newValue
+           << " (" << applyName(change.apply) << ")";
+        if (change.apply == ConfigApply::RESTART) {
+            LOG_WARN(ss.str());
+        } else {
+            LOG_INFO(ss.str());
+        }
+    }
+
+    std::atomic_store(&m_current, std::shared_ptr<const Config>(next));
+    m_reloads++;
+    m_lastReloadMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        m_clock.wallNow().time_since_epoch()).count();
+
+    // Counted against startup, so reverting a setting clears it again
+    uint32_t pending = 0;
+    for (const ConfigChange& change : m_startup->diff(*next)) {
+        if (change.apply == ConfigApply::RESTART) pending++;
+    }
+    m_pendingRestart = pending;
+
+    if (m_applyCallback) {
+        m_applyCallback(*previous, *next, changes);
+    }
+}
+
+} // namespace op25gateway
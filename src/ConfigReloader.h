@@ -0,0 +1,94 @@
+#ifndef CONFIGRELOADER_H
+#define CONFIGRELOADER_H
+
+#include "Config.h"
+#include "Reactor.h"
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+
+namespace op25gateway {
+
+// Applies a validated reload; runs on the reloader thread with the
+// snapshot already published
+using ConfigApplyCallback = std::function<void(const Config& previous, const Config& current,
+                                               const std::vector<ConfigChange>& changes)>;
+
+// Reloads config.yml on SIGHUP or when the file changes
+//
+// Each reload is parsed and validated on the reloader's own thread into a
+// new immutable Config, which replaces the current one with an atomic
+// pointer swap. Readers take a snapshot with current() and keep it for as
+// long as they need; they never see a half-applied reload. A file that
+// fails to parse or validate is logged and the running settings stay.
+class ConfigReloader {
+public:
+    ConfigReloader(const std::string& path, std::shared_ptr<const Config> initial,
+                   Clock& clock = Clock::system());
+    ~ConfigReloader();
+
+    ConfigReloader(const ConfigReloader&) = delete;
+    ConfigReloader& operator=(const ConfigReloader&) = delete;
+
+    void setApplyCallback(ConfigApplyCallback callback) { m_applyCallback = callback; }
+
+    // Watch the file with inotify as well as reloading on request
+    // (before start())
+    void setWatchFile(bool watch) { m_watchFile = watch; }
+
+    bool start();
+    void stop();
+
+    // Reload now; async-signal-safe, for the SIGHUP handler
+    void requestReload();
+
+    // The configuration in effect
+    std::shared_ptr<const Config> current() const { return std::atomic_load(&m_current); }
+
+    // Statistics
+    uint64_t getReloads() const { return m_reloads; }
+    uint64_t getRejected() const { return m_rejected; }
+    uint64_t getLastReloadMs() const { return m_lastReloadMs; }
+
+    // Changed settings that only take effect after a restart
+    uint32_t getPendingRestart() const { return m_pendingRestart; }
+
+private:
+    void reloaderThread();
+    bool watchFile();
+    void onFileEvent();
+    void onRequest();
+    void reload(const char* trigger);
+
+    Clock& m_clock;
+    Reactor m_reactor;
+    std::string m_path;
+    std::string m_dir;
+    std::string m_file;
+    bool m_watchFile;
+
+    std::shared_ptr<const Config> m_current;
+    std::shared_ptr<const Config> m_startup;    // What the restart-only settings still are
+
+    int m_requestFd;
+    int m_inotifyFd;
+    Reactor::TimerId m_settleTimer;
+
+    ConfigApplyCallback m_applyCallback;
+    std::thread m_thread;
+
+    // Statistics
+    std::atomic<uint64_t> m_reloads;
+    std::atomic<uint64_t> m_rejected;
+    std::atomic<uint64_t> m_lastReloadMs;
+    std::atomic<uint32_t> m_pendingRestart;
+};
+
+} // namespace op25gateway
+
+#endif // CONFIGRELOADER_H
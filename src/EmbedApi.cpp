@@ -0,0 +1,170 @@
+#include "op25gateway.h"
+#include "Gateway.h"
+#include "Logger.h"
+#include "StopToken.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <thread>
+
+using namespace op25gateway;
+
+struct gw_handle {
+    std::unique_ptr<Gateway> gateway;
+    StopToken stop;
+    std::thread housekeeping;   // Stats pages, once a second
+};
+
+namespace {
+
+void housekeepingLoop(gw_handle* handle) {
+    Clock& clock = Clock::system();
+    auto next = clock.now();
+    int statCounter = 0;
+
+    while (!handle->stop.isRequested()) {
+        next += std::chrono::seconds(1);
+        if (handle->stop.waitUntil(next)) {
+            break;
+        }
+
+        bool logStats = ++statCounter >= 60;
+        if (logStats) {
+            statCounter = 0;
+        }
+        handle->gateway->update(logStats);
+    }
+}
+
+int push(gw_handle* handle, unsigned pipeline, uint16_t nac, uint32_t tg, uint32_t src,
+         uint8_t type, uint8_t idx, uint8_t flags, const uint8_t* imbe) {
+    bool terminator = type == OP25_FRAME_TDU;
+    if (!handle || (!imbe && !terminator) || pipeline >= handle->gateway->getPipelineCount() ||
+        (type != OP25_FRAME_LDU1 && type != OP25_FRAME_LDU2 && !terminator) || idx > 8) {
+        return GW_ERR_INVALID;
+    }
+
+    Pipeline& target = handle->gateway->getPipeline(pipeline);
+    if (!target.isRunning()) {
+        return GW_ERR_STOPPED;
+    }
+
+    OP25Packet packet;
+    packet.magic = OP25_MAGIC;
+    packet.nac = nac;
+    packet.talkgroup = tg;
+    packet.sourceId = src;
+    packet.frameType = type;
+    packet.voiceIndex = idx;
+    packet.flags = flags;
+    packet.errors = 0;
+    if (imbe) {
+        std::memcpy(packet.imbe, imbe, IMBE_FRAME_SIZE);
+    } else {
+        std::memset(packet.imbe, 0, IMBE_FRAME_SIZE);
+    }
+
+    return target.inject(packet) ? GW_OK : GW_ERR_FULL;
+}
+
+} // namespace
+
+extern "C" {
+
+int gw_abi_version(void) {
+    return GW_ABI_VERSION;
+}
+
+gw_handle* gw_open(const char* config_path, unsigned flags) {
+    if (!config_path) return nullptr;
+
+    // Nothing may unwind into C callers
+    try {
+        Config config;
+        if (!config.load(config_path)) {
+            return nullptr;
+        }
+
+        Logger::instance().setLevel(static_cast<LogLevel>(config.getLogLevel()));
+        if (!config.getLogFile().empty()) {
+            Logger::instance().setLogFile(config.getLogFile());
+        }
+        std::string configError;
+        if (!config.validate(configError)) {
+            LOG_ERROR("Config: " + configError);
+            return nullptr;
+        }
+
+        std::unique_ptr<gw_handle> handle(new gw_handle());
+        handle->gateway.reset(new Gateway(config_path, config, Clock::system().now()));
+        handle->gateway->enableInjection((flags & GW_OPEN_LISTEN_UDP) != 0);
+        if (!handle->gateway->setup() || !handle->gateway->startPipelines(false)) {
+            return nullptr;
+        }
+        handle->gateway->openStats();
+
+        gw_handle* raw = handle.get();
+        handle->housekeeping = std::thread(housekeepingLoop, raw);
+
+        LOG_INFO("Embedded gateway running " + std::to_string(handle->gateway->getRunningCount()) + " of " +
+                 std::to_string(handle->gateway->getPipelineCount()) + " pipeline(s)");
+        return handle.release();
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string("Embedded gateway failed to start: ") + e.what());
+        return nullptr;
+    }
+}
+
+void gw_close(gw_handle* handle) {
+    if (!handle) return;
+
+    handle->stop.request();
+    if (handle->housekeeping.joinable()) {
+        handle->housekeeping.join();
+    }
+    handle->gateway->stop();
+    delete handle;
+}
+
+unsigned gw_pipeline_count(const gw_handle* handle) {
+    return handle ? static_cast<unsigned>(handle->gateway->getPipelineCount()) : 0;
+}
+
+int gw_push_imbe(gw_handle* handle, uint16_t nac, uint32_t tg, uint32_t src,
+                 uint8_t type, uint8_t idx, uint8_t flags, const uint8_t* imbe) {
+    return push(handle, 0, nac, tg, src, type, idx, flags, imbe);
+}
+
+int gw_push_imbe_to(gw_handle* handle, unsigned pipeline, uint16_t nac, uint32_t tg,
+                    uint32_t src, uint8_t type, uint8_t idx, uint8_t flags,
+                    const uint8_t* imbe) {
+    return push(handle, pipeline, nac, tg, src, type, idx, flags, imbe);
+}
+
+int gw_get_stats(gw_handle* handle, unsigned pipeline, gw_stats* stats) {
+    if (!handle || !stats || stats->struct_size < sizeof(stats->struct_size) ||
+        pipeline >= handle->gateway->getPipelineCount()) {
+        return GW_ERR_INVALID;
+    }
+
+    PipelineCounters counters = handle->gateway->getPipeline(pipeline).getCounters();
+    gw_stats full = {};
+    full.struct_size = stats->struct_size;
+    full.frames_received = counters.framesReceived;
+    full.frames_invalid = counters.framesInvalid;
+    full.frames_refused = counters.injectDrops;
+    full.calls = counters.calls;
+    full.active_calls = counters.activeCalls;
+    full.ldu1 = counters.ldu1;
+    full.ldu2 = counters.ldu2;
+    full.frames_missing = counters.framesMissing;
+    full.fne_connected = counters.fneConnected ? 1 : 0;
+
+    // Write no more than the caller's struct holds
+    std::memcpy(stats, &full, std::min(stats->struct_size, sizeof(full)));
+    return GW_OK;
+}
+
+} // extern "C"
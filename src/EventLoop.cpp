@@ -0,0 +1,65 @@
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <future>
+
+namespace op25gateway {
+
+EventLoopPool::EventLoopPool(Clock& clock)
+    : m_clock(clock)
+    , m_backend(IoBackend::EPOLL)
+{
+}
+
+EventLoopPool::~EventLoopPool() {
+    stop();
+}
+
+bool EventLoopPool::start(size_t threads) {
+    if (!m_loops.empty()) return true;
+
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); i++) {
+        std::unique_ptr<Loop> loop(new Loop(m_clock));
+        loop->reactor.setIoBackend(m_backend);
+        if (!loop->reactor.open()) {
+            LOG_ERROR("EventLoop: Cannot open event loop " + std::to_string(i));
+            stop();
+            return false;
+        }
+        m_loops.push_back(std::move(loop));
+    }
+
+    // Wait until every loop is running, so that from here on work handed
+    // to a loop with invoke() always runs on its thread
+    for (size_t i = 0; i < m_loops.size(); i++) {
+        Reactor* reactor = &m_loops[i]->reactor;
+        std::string name = "op25-loop" + std::to_string(i);
+        ThreadTuning tuning = m_tuning;
+        std::promise<void> running;
+        std::future<void> started = running.get_future();
+        reactor->post([&running]() { running.set_value(); });
+        m_loops[i]->thread = std::thread([reactor, name, tuning]() {
+            tuneThread(name, tuning);
+            reactor->run();
+        });
+        started.wait();
+    }
+
+    LOG_INFO("EventLoop: " + std::to_string(m_loops.size()) + " thread(s)" + describeTuning(m_tuning) +
+             (m_loops[0]->reactor.getIoUring() ? ", io_uring" : ""));
+    return true;
+}
+
+void EventLoopPool::stop() {
+    for (auto& loop : m_loops) {
+        if (loop->thread.joinable()) {
+            loop->reactor.stop();
+            loop->thread.join();
+        }
+        loop->reactor.close();
+    }
+    m_loops.clear();
+}
+
+} // namespace op25gateway
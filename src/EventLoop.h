@@ -0,0 +1,56 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include "Reactor.h"
+
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace op25gateway {
+
+// A fixed set of reactor threads shared by the gateway's pipelines
+//
+// Each pipeline is pinned to one loop, which runs its OP25 socket, call
+// timeout and FNE sessions, so a pipeline's work never crosses threads and
+// the thread count follows the loop count rather than the site count.
+class EventLoopPool {
+public:
+    explicit EventLoopPool(Clock& clock = Clock::system());
+    ~EventLoopPool();
+
+    EventLoopPool(const EventLoopPool&) = delete;
+    EventLoopPool& operator=(const EventLoopPool&) = delete;
+
+    // CPU affinity and priority for the loop threads (before start())
+    void setThreadTuning(const ThreadTuning& tuning) { m_tuning = tuning; }
+
+    // Socket I/O for the loops (before start())
+    void setIoBackend(IoBackend backend) { m_backend = backend; }
+
+    bool start(size_t threads);
+    void stop();
+
+    size_t size() const { return m_loops.size(); }
+
+    // Loop for the index'th pipeline (round robin)
+    Reactor& get(size_t index) { return m_loops[index % m_loops.size()]->reactor; }
+
+private:
+    struct Loop {
+        explicit Loop(Clock& clock) : reactor(clock) {}
+
+        Reactor reactor;
+        std::thread thread;
+    };
+
+    Clock& m_clock;
+    ThreadTuning m_tuning;
+    IoBackend m_backend;
+    std::vector<std::unique_ptr<Loop>> m_loops;
+};
+
+} // namespace op25gateway
+
+#endif // EVENTLOOP_H
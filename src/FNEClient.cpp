@@ -1,183 +1,641 @@
 #include "FNEClient.h"
 #include "Logger.h"
+#include "Trace.h"
 
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <cstring>
+#include <cerrno>
 #include <vector>
 
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
-#include <netdb.h>
 #include <arpa/inet.h>
 #include <openssl/sha.h>
 
 namespace op25gateway {
 
+namespace {
+
+constexpr std::chrono::milliseconds DEFAULT_LOGIN_TIMEOUT(5000);
+constexpr std::chrono::milliseconds DEFAULT_BACKOFF_INITIAL(1000);
+constexpr std::chrono::milliseconds DEFAULT_BACKOFF_MAX(10000);
+constexpr std::chrono::milliseconds DEFAULT_PING_INTERVAL(2000);
+constexpr uint32_t DEFAULT_MAX_MISSED_PONGS = 3;
+constexpr std::chrono::milliseconds DEFAULT_OUTAGE_BUFFER(3000);
+constexpr double DEFAULT_REPLAY_SPEED = 4.0;
+
+uint32_t elapsedMs(Clock::TimePoint from, Clock::TimePoint to) {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count());
+}
+
+} // namespace
+
 FNEClient::FNEClient(const std::string& host, uint16_t port,
-                     uint32_t peerId, const std::string& password)
-    : m_host(host)
+                     uint32_t peerId, const std::string& password, Clock& clock)
+    : m_clock(clock)
+    , m_ownReactor(clock)
+    , m_ownResolver(clock)
+    , m_loop(&m_ownReactor)
+    , m_resolver(&m_ownResolver)
+    , m_host(host)
     , m_port(port)
     , m_peerId(peerId)
     , m_password(password)
     , m_identity("OP25-Gateway")
-    , m_wacn(0x92C19)
-    , m_sysId(0x50E)
+    , m_logName("FNE")
+    , m_loginTimeout(DEFAULT_LOGIN_TIMEOUT)
+    , m_backoffInitial(DEFAULT_BACKOFF_INITIAL)
+    , m_backoffMax(DEFAULT_BACKOFF_MAX)
+    , m_pingInterval(DEFAULT_PING_INTERVAL)
+    , m_maxMissedPongs(DEFAULT_MAX_MISSED_PONGS)
     , m_socket(-1)
     , m_connected(false)
-    , m_running(false)
-    , m_streamId(0)
+    , m_state(FNEState::DISCONNECTED)
+    , m_connectedSinceMs(0)
+    , m_step(LoginStep::IDLE)
+    , m_loginStreamId(0)
+    , m_stepTimer(0)
+    , m_retryTimer(0)
+    , m_pingTimer(0)
+    , m_backoff(DEFAULT_BACKOFF_INITIAL)
+    , m_rng(std::random_device{}())
+    , m_recovering(false)
+    , m_pingStreamId(0)
+    , m_pongPending(false)
     , m_seq(0)
     , m_timestamp(0)
-    , m_reconnectEnabled(false)
-    , m_reconnectInterval(10)
+    , m_framer(peerId, 0x92C19, 0x50E)
+    , m_session(0)
+    , m_openStreams(0)
+    , m_egressDoorbell(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    , m_egressBatch(EGRESS_BATCH)
+    , m_hasAdopted(false)
+    , m_heldGeneration(0)
+    , m_bufferBudget(std::chrono::milliseconds(0))
+    , m_replayInterval(std::chrono::microseconds(0))
+    , m_running(false)
+    , m_handingOff(false)
+    , m_reloginPending(false)
+    , m_framesSent(0)
+    , m_sendErrors(0)
+    , m_queuedSends(std::make_shared<IoSendStatus>())
+    , m_loginCount(0)
+    , m_loginAttempts(0)
+    , m_loginFailures(0)
+    , m_lastLoginMs(0)
+    , m_timeToAuthMs(0)
+    , m_linkLosses(0)
+    , m_naksReceived(0)
+    , m_missedPongs(0)
+    , m_lastRttUs(0)
+    , m_srttUs(0)
+    , m_lastRecoveryMs(0)
+    , m_firstVoiceAt(Clock::Duration::zero())
+    , m_bufferLDUs(0)
+    , m_bufferPeakLDUs(0)
+    , m_bufferCapacity(0)
+    , m_ldusBuffered(0)
+    , m_ldusReplayed(0)
+    , m_ldusDiscarded(0)
 {
     std::memset(&m_fneAddr, 0, sizeof(m_fneAddr));
+    setOutageBuffer(DEFAULT_OUTAGE_BUFFER, DEFAULT_REPLAY_SPEED);
+    m_lanes.emplace_back(new Lane(*this));
 }
 
 FNEClient::~FNEClient() {
-    m_reconnectEnabled = false;
-    if (m_reconnectThread.joinable()) {
-        m_reconnectThread.join();
+    stop();
+    if (m_egressDoorbell >= 0) {
+        close(m_egressDoorbell);
     }
-    disconnect();
 }
 
-bool FNEClient::connect() {
-    std::lock_guard<std::mutex> lock(m_reconnectMutex);
-
-    if (m_connected) return true;
+FNEClient::Lane::Lane(FNEClient& client)
+    : client(client)
+    , session(client.m_session)
+    , heldGeneration(client.m_heldGeneration)
+    , holding(false)
+    , replayTimer(0)
+    , loop(nullptr)
+    , egress(EGRESS_CAPACITY)
+{
+}
 
-    // Cleanup existing state
-    if (m_running) {
-        m_running = false;
-        if (m_pingThread.joinable()) m_pingThread.join();
-        if (m_receiveThread.joinable()) m_receiveThread.join();
+VoiceSink& FNEClient::lane(uint32_t index) {
+    while (m_lanes.size() <= index) {
+        m_lanes.emplace_back(new Lane(*this));
     }
+    return *m_lanes[index];
+}
 
-    if (m_socket >= 0) {
-        shutdown(m_socket, SHUT_RDWR);
-        close(m_socket);
-        m_socket = -1;
-    }
+void FNEClient::setBackoff(std::chrono::milliseconds initial, std::chrono::milliseconds max) {
+    m_backoffInitial = std::max(initial, std::chrono::milliseconds(1));
+    m_backoffMax = std::max(max, m_backoffInitial);
+    m_backoff = m_backoffInitial;
+}
 
-    LOG_INFO("FNE: Connecting to " + m_host + ":" + std::to_string(m_port));
+void FNEClient::setOutageBuffer(std::chrono::milliseconds budget, double replaySpeed) {
+    // Each stream gets room for the budget's worth of its LDUs plus the
+    // stream start and end around them
+    size_t ldus = budget.count() > 0 ? budget / LDU_DURATION + 1 : 0;
+    size_t capacity = ldus > 0 ? ldus + 2 : 0;
 
-    // Create UDP socket
-    m_socket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (m_socket < 0) {
-        LOG_ERROR("FNE: Failed to create socket");
-        return false;
-    }
+    m_bufferBudget = std::max(budget, std::chrono::milliseconds(0));
+    m_bufferCapacity = static_cast<uint32_t>(capacity);
 
-    // Resolve FNE address
-    struct hostent* host = gethostbyname(m_host.c_str());
-    if (!host) {
-        LOG_ERROR("FNE: Failed to resolve address");
-        close(m_socket);
-        m_socket = -1;
-        return false;
-    }
+    // Replay must outrun each stream's live voice, or its backlog never
+    // drains
+    replaySpeed = std::max(replaySpeed, 1.25);
+    m_replayInterval = std::chrono::microseconds(
+        static_cast<int64_t>(std::chrono::microseconds(LDU_DURATION).count() / replaySpeed));
 
-    m_fneAddr.sin_family = AF_INET;
-    m_fneAddr.sin_port = htons(m_port);
-    std::memcpy(&m_fneAddr.sin_addr, host->h_addr, host->h_length);
+    // Voice held under the old settings is dropped
+    m_heldGeneration++;
+}
 
-    // Connect UDP socket
-    if (::connect(m_socket, (struct sockaddr*)&m_fneAddr, sizeof(m_fneAddr)) < 0) {
-        LOG_ERROR("FNE: Failed to connect socket");
-        close(m_socket);
-        m_socket = -1;
-        return false;
+void FNEClient::discardBuffered() {
+    // Each lane drops its held voice before it next sends or replays
+    m_heldGeneration++;
+}
+
+void FNEClient::reconfigure(std::chrono::milliseconds loginTimeout,
+                            std::chrono::milliseconds backoffInitial, std::chrono::milliseconds backoffMax,
+                            std::chrono::milliseconds pingInterval, uint32_t maxMissedPongs) {
+    post([=]() {
+        setLoginTimeout(loginTimeout);
+        setBackoff(backoffInitial, backoffMax);
+        setPingInterval(pingInterval);
+        setMaxMissedPongs(maxMissedPongs);
+    });
+}
+
+void FNEClient::changeLogin(const std::string& host, uint16_t port, const std::string& password) {
+    post([=]() {
+        m_host = host;
+        m_port = port;
+        m_password = password;
+
+        if (m_step == LoginStep::CONNECTED && m_openStreams > 0) {
+            LOG_INFO(m_logName + ": New login settings, logging in again once no call is up");
+            m_reloginPending = true;
+        } else {
+            relogin();
+        }
+    });
+}
+
+void FNEClient::attach(Reactor& loop, Resolver& resolver) {
+    if (m_running) return;
+
+    m_loop = &loop;
+    m_resolver = &resolver;
+}
+
+bool FNEClient::start() {
+    if (m_running) return true;
+    if (m_egressDoorbell < 0) return false;
+
+    m_outageStart = m_clock.now();
+
+    if (m_loop != &m_ownReactor) {
+        m_running = true;
+        m_loop->post([this]() { networkStart(); });
+        return true;
     }
 
-    // Authenticate
-    if (!authenticate()) {
-        LOG_ERROR("FNE: Authentication failed");
-        close(m_socket);
-        m_socket = -1;
+    if (!m_loop->open()) {
         return false;
     }
 
-    m_connected = true;
     m_running = true;
+    m_networkThread = std::thread(&FNEClient::networkThread, this);
+    return true;
+}
+
+void FNEClient::shutdownLoop() {
+    if (m_networkThread.joinable()) {
+        m_loop->stop();
+        m_networkThread.join();
+        m_loop->close();
+    } else {
+        // Shared loop: only this session's socket and timers go
+        m_loop->invoke([this]() { networkStop(); });
+    }
+    m_running = false;
+}
 
-    // Start threads
-    m_pingThread = std::thread(&FNEClient::pingThread, this);
-    m_receiveThread = std::thread(&FNEClient::receiveThread, this);
+void FNEClient::stop() {
+    if (!m_running) return;
 
-    LOG_INFO("FNE: Connected successfully");
+    shutdownLoop();
 
-    if (m_connectionCallback) {
-        m_connectionCallback(true);
+    LOG_INFO(m_logName + ": Disconnected");
+}
+
+bool FNEClient::handOff(FNESessionHandoff& handoff, int& fd) {
+    std::memset(&handoff, 0, sizeof(handoff));
+    fd = -1;
+    if (!m_running) return false;
+
+    m_handingOff = true;
+    shutdownLoop();
+    m_handingOff = false;
+
+    // The sending threads have stopped by now, so their lanes are read and
+    // cleared from here
+    uint32_t heldLDUs = m_bufferLDUs;
+    for (auto& lane : m_lanes) {
+        discardAllHeld(*lane);
+        lane->replayTimer = 0;
+    }
+    if (heldLDUs > 0) {
+        LOG_WARN(m_logName + ": Dropping " + std::to_string(heldLDUs) + " held LDUs at handoff");
+    }
+
+    handoff.connected = m_step == LoginStep::CONNECTED && m_socket >= 0;
+    if (handoff.connected) {
+        fd = m_socket;
+    } else if (m_socket >= 0) {
+        Reactor::closeSocket(m_socket);
+    }
+    m_socket = -1;
+    handoff.fneAddr = m_fneAddr;
+
+    handoff.connectedSinceMs = m_connectedSinceMs;
+    handoff.controlSeq = m_seq;
+    handoff.controlTimestamp = m_timestamp;
+
+    uint32_t unsent = 0;
+    auto handOver = [&](uint32_t call, const StreamFramer& framer) {
+        if (handoff.streamCount == HANDOFF_MAX_STREAMS) {
+            unsent++;
+            return;
+        }
+        FNEStreamHandoff& stream = handoff.streams[handoff.streamCount++];
+        stream.call = call;
+        stream.streamId = framer.getStreamId();
+        stream.timestamp = framer.getTimestamp();
+        stream.seq = framer.getSeq();
+    };
+
+    uint64_t session = m_session;
+    for (auto& lane : m_lanes) {
+        std::lock_guard<std::mutex> lock(lane->tableMutex);
+        if (handoff.connected && lane->session == session) {
+            for (const auto& entry : lane->streams) {
+                handOver(entry.first, entry.second);
+            }
+        }
+        lane->streams.clear();
+        lane->session = session + 1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_adoptedMutex);
+        if (handoff.connected) {
+            for (const auto& entry : m_adopted) {
+                handOver(entry.first, entry.second);
+            }
+        }
+        m_adopted.clear();
+        m_hasAdopted = false;
+    }
+    m_session = session + 1;
+    m_openStreams = 0;
+    if (unsent > 0) {
+        LOG_WARN(m_logName + ": " + std::to_string(unsent) +
+                 " stream(s) not handed off, reopened at their next LDU");
     }
 
+    handoff.srttUs = m_srttUs;
+    handoff.loginCount = m_loginCount;
+    handoff.loginAttempts = m_loginAttempts;
+    handoff.framesSent = getFramesSent();
+    handoff.linkLosses = m_linkLosses;
+
+    m_step = LoginStep::IDLE;
+    m_state = FNEState::DISCONNECTED;
+    m_connectedSinceMs = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_connected = false;
+    }
+
+    LOG_INFO(m_logName + (handoff.connected ? ": Session handed off" : ": Handed off while not logged in"));
     return true;
 }
 
-void FNEClient::disconnect() {
-    if (!m_connected && !m_running) return;
+void FNEClient::adopt(const FNESessionHandoff& handoff, int fd) {
+    if (m_running) return;
+
+    m_seq = handoff.controlSeq;
+    m_timestamp = handoff.controlTimestamp;
+    m_srttUs = handoff.srttUs;
+    m_loginCount = handoff.loginCount;
+    m_loginAttempts = handoff.loginAttempts;
+    m_framesSent = handoff.framesSent;
+    m_linkLosses = handoff.linkLosses;
+
+    if (!handoff.connected || fd < 0) {
+        // Logs in afresh; the next LDU of each call reopens its stream
+        // with a grant
+        if (fd >= 0) close(fd);
+        return;
+    }
 
-    m_reconnectEnabled = false;
-    m_running = false;
+    m_socket = fd;
+    m_fneAddr = handoff.fneAddr;
+
+    // Connected from here on, so voice goes straight out on the open streams
+    // and a hot standby sees both sessions up before either thread starts.
+    // Each stream is taken by the lane its call's next voice comes through.
+    uint32_t streamCount = std::min<uint32_t>(handoff.streamCount, HANDOFF_MAX_STREAMS);
+    {
+        std::lock_guard<std::mutex> lock(m_adoptedMutex);
+        for (uint32_t i = 0; i < streamCount; i++) {
+            const FNEStreamHandoff& stream = handoff.streams[i];
+            m_adopted.emplace(stream.call, m_framer).first->second.resumeStream(
+                stream.streamId, stream.seq, stream.timestamp);
+        }
+        m_openStreams = static_cast<uint32_t>(m_adopted.size());
+        m_hasAdopted = !m_adopted.empty();
+    }
+    m_connectedSinceMs = handoff.connectedSinceMs;
+    m_step = LoginStep::CONNECTED;
+    m_state = FNEState::CONNECTED;
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_connected = true;
+    }
+}
+
+bool FNEClient::waitForConnection(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_stateMutex);
+    return m_stateCond.wait_for(lock, timeout, [this]() { return m_connected.load(); });
+}
+
+void FNEClient::networkThread() {
+    networkStart();
+    m_loop->run();
+    networkStop();
+}
+
+void FNEClient::networkStart() {
+    m_loop->addFd(m_egressDoorbell, EPOLLIN, [this](uint32_t) { drainEgress(); });
+
+    if (m_step == LoginStep::CONNECTED) {
+        resumeSession();
+    } else {
+        beginLogin();
+    }
+}
+
+void FNEClient::networkStop() {
+    // What the lanes queued last still goes out on this session
+    drainEgress();
+    m_loop->removeFd(m_egressDoorbell);
+
+    // Shutting down
+    bool wasConnected = m_connected;
+    m_loop->cancelTimer(m_stepTimer);
+    m_loop->cancelTimer(m_retryTimer);
+    m_loop->cancelTimer(m_pingTimer);
+
+    if (m_handingOff) {
+        // The socket and session carry on in another process
+        if (m_socket >= 0) {
+            m_loop->removeFd(m_socket);
+        }
+        return;
+    }
+
+    // Leave the session rather than let the FNE time the peer out
+    if (wasConnected) {
+        sendRPTDisc();
+    }
+    closeSocket();
+
+    m_step = LoginStep::IDLE;
     m_connected = false;
+    m_state = FNEState::DISCONNECTED;
+    m_connectedSinceMs = 0;
 
-    if (m_socket >= 0) {
-        shutdown(m_socket, SHUT_RDWR);
-        close(m_socket);
-        m_socket = -1;
+    if (wasConnected) {
+        notifyConnection(false);
     }
+}
 
-    if (m_pingThread.joinable()) m_pingThread.join();
-    if (m_receiveThread.joinable()) m_receiveThread.join();
-    if (m_reconnectThread.joinable()) m_reconnectThread.join();
+void FNEClient::post(Reactor::Callback callback) {
+    // On a shared loop the session may have stopped by the time it runs
+    m_loop->post([this, callback]() {
+        if (m_running) callback();
+    });
+}
 
-    if (m_connectionCallback) {
-        m_connectionCallback(false);
+void FNEClient::beginLogin() {
+    m_loginAttempts++;
+    m_loginStart = m_clock.now();
+    m_state = FNEState::CONNECTING;
+
+    LOG_INFO(m_logName + ": Connecting to " + m_host + ":" + std::to_string(m_port));
+    enterStep(LoginStep::RESOLVING);
+
+    // The resolver may answer inline or from its worker; either way the
+    // result is handled on the network thread. A lookup for an address
+    // replaced by a config reload in the meantime is ignored.
+    std::string host = m_host;
+    uint16_t port = m_port;
+    m_resolver->resolve(host, port, [this, host, port](bool ok, const struct sockaddr_in& addr) {
+        post([this, host, port, ok, addr]() {
+            if (host == m_host && port == m_port) {
+                onResolved(ok, addr);
+            }
+        });
+    });
+}
+
+void FNEClient::onResolved(bool ok, const struct sockaddr_in& addr) {
+    if (m_step != LoginStep::RESOLVING) return;     // Attempt already timed out
+
+    if (!ok) {
+        loginFailed("Failed to resolve address", 0);
+        return;
     }
 
-    LOG_INFO("FNE: Disconnected");
+    if (!openSocket(addr)) {
+        loginFailed("Failed to open socket", 0);
+        return;
+    }
+
+    GW_TRACE1(auth_start, m_peerId);
+    m_loginStreamId = rand();
+    sendRPTL();
+    enterStep(LoginStep::RPTL_SENT);
 }
 
-void FNEClient::enableAutoReconnect(bool enable) {
-    m_reconnectEnabled = enable;
+bool FNEClient::openSocket(const struct sockaddr_in& addr) {
+    closeSocket();
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return false;
+    }
 
-    if (enable && !m_reconnectThread.joinable()) {
-        m_reconnectThread = std::thread(&FNEClient::reconnectThread, this);
+    // Connected UDP socket: the kernel filters other senders and reports
+    // ICMP unreachable as ECONNREFUSED
+    if (::connect(sock, (const struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return false;
     }
+
+    m_socket = sock;
+    m_fneAddr = addr;
+
+    m_loop->addFd(sock, EPOLLIN, [this](uint32_t) { onReadable(); });
+    return true;
 }
 
-void FNEClient::reconnectThread() {
-    LOG_INFO("FNE: Reconnection thread started");
+void FNEClient::closeSocket() {
+    if (m_socket < 0) return;
 
-    while (m_reconnectEnabled) {
-        if (!m_connected) {
-            LOG_INFO("FNE: Attempting connection...");
+    m_loop->removeFd(m_socket);
+    Reactor::closeSocket(m_socket);
+    m_socket = -1;
+}
 
-            if (connect()) {
-                LOG_INFO("FNE: Reconnection successful");
-            } else {
-                std::stringstream ss;
-                ss << "FNE: Connection failed, retrying in " << m_reconnectInterval << " seconds...";
-                LOG_WARN(ss.str());
+void FNEClient::onReadable() {
+    uint8_t buffer[1024];
+
+    while (m_socket >= 0) {
+        ssize_t len = recv(m_socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+        Reactor::noteSyscall();
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return;
+            }
+
+            if (m_step == LoginStep::CONNECTED) {
+                connectionLost("Connection lost (" + std::string(strerror(errno)) + ")");
+            } else if (m_step != LoginStep::BACKOFF && m_step != LoginStep::IDLE) {
+                loginFailed("FNE unreachable (" + std::string(strerror(errno)) + ")",
+                            m_step == LoginStep::RPTK_SENT ? 2 : m_step == LoginStep::RPTC_SENT ? 3 : 1);
             }
+            return;
         }
 
-        for (int i = 0; i < m_reconnectInterval && m_reconnectEnabled; i++) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+        handleMessage(buffer, len);
+    }
+}
+
+void FNEClient::handleMessage(const uint8_t* data, size_t len) {
+    if (len < 32) return;
+
+    switch (data[18]) {
+        case NET_FUNC_ACK:
+            handleAck(data, len);
+            break;
+        case NET_FUNC_NAK:
+            handleNak(data, len);
+            break;
+        case NET_FUNC_PONG:
+            handlePong(data);
+            break;
+        case NET_FUNC_RPT_DISC:
+            if (m_step == LoginStep::CONNECTED) {
+                connectionLost("Session closed by FNE (RPT_DISC)");
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void FNEClient::handleAck(const uint8_t* data, size_t len) {
+    switch (m_step) {
+        case LoginStep::RPTL_SENT: {
+            if (len < 42) {
+                loginFailed("Login rejected (short challenge)", 1);
+                return;
+            }
+            uint32_t salt = ((uint32_t)data[38] << 24) | ((uint32_t)data[39] << 16) |
+                            ((uint32_t)data[40] << 8) | (uint32_t)data[41];
+            GW_TRACE1(auth_challenge, salt);
+            sendRPTK(salt);
+            enterStep(LoginStep::RPTK_SENT);
+            break;
         }
+        case LoginStep::RPTK_SENT:
+            LOG_INFO(m_logName + ": Auth successful, sending config");
+            sendRPTC();
+            enterStep(LoginStep::RPTC_SENT);
+            break;
+        case LoginStep::RPTC_SENT:
+            GW_TRACE1(auth_done, m_peerId);
+            onConnected();
+            break;
+        default:
+            break;
+    }
+}
+
+void FNEClient::handleNak(const uint8_t* data, size_t len) {
+    m_naksReceived++;
+
+    uint16_t reason = NET_CONN_NAK_GENERAL_FAILURE;
+    if (len >= 38) {
+        reason = ((uint16_t)data[36] << 8) | data[37];
     }
 
-    LOG_INFO("FNE: Reconnection thread stopped");
+    switch (m_step) {
+        case LoginStep::RPTL_SENT: loginFailed("Login rejected", 1); break;
+        case LoginStep::RPTK_SENT: loginFailed("Auth rejected", 2); break;
+        case LoginStep::RPTC_SENT: loginFailed("Config rejected", 3); break;
+        case LoginStep::CONNECTED:
+            // These mean the FNE no longer knows this peer (it restarted or
+            // dropped us); anything else rejects a single frame
+            if (reason == NET_CONN_NAK_FNE_UNAUTHORIZED ||
+                reason == NET_CONN_NAK_BAD_CONN_STATE ||
+                reason == NET_CONN_NAK_PEER_RESET) {
+                connectionLost("Session rejected by FNE (NAK reason " + std::to_string(reason) + ")");
+            } else {
+                LOG_WARN(m_logName + ": NAK reason " + std::to_string(reason));
+            }
+            break;
+        default:
+            break;
+    }
 }
 
-bool FNEClient::authenticate() {
-    uint32_t loginStreamId = rand();
+void FNEClient::handlePong(const uint8_t* data) {
+    uint32_t streamId = ((uint32_t)data[20] << 24) | ((uint32_t)data[21] << 16) |
+                        ((uint32_t)data[22] << 8) | (uint32_t)data[23];
+    if (!m_pongPending || streamId != m_pingStreamId) {
+        LOG_DEBUG(m_logName + ": Received stale PONG");
+        return;
+    }
+
+    m_pongPending = false;
+    m_missedPongs = 0;
+
+    auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(m_clock.now() - m_pingSentAt).count();
+    uint32_t rttUs = static_cast<uint32_t>(std::max<int64_t>(rtt, 0));
+    m_lastRttUs = rttUs;
+
+    // Smoothed like TCP's SRTT, gain 1/8
+    uint32_t srtt = m_srttUs;
+    m_srttUs = srtt == 0 ? rttUs : srtt - srtt / 8 + rttUs / 8;
+
+    GW_TRACE1(fne_pong, rttUs);
+    LOG_DEBUG(m_logName + ": PONG rtt=" + std::to_string(rttUs) + "us");
+}
 
-    // Build RPTL (login request)
+void FNEClient::sendRPTL() {
     uint8_t rptl[40];
     std::memset(rptl, 0, sizeof(rptl));
-    P25Utils::buildDVMHeader(rptl, NET_FUNC_RPTL, NET_SUBFUNC_NOP, loginStreamId,
+    P25Utils::buildDVMHeader(rptl, NET_FUNC_RPTL, NET_SUBFUNC_NOP, m_loginStreamId,
                               m_peerId, m_seq, m_timestamp, 8);
 
     rptl[32] = 'R';
@@ -191,33 +649,11 @@ bool FNEClient::authenticate() {
 
     P25Utils::insertDVMCrc(rptl, 40);
 
-    if (!sendToFNE(rptl, 40)) return false;
-
-    // Wait for challenge
-    uint8_t response[256];
-    fd_set fds;
-    struct timeval tv;
-
-    FD_ZERO(&fds);
-    FD_SET(m_socket, &fds);
-    tv.tv_sec = 5;
-    tv.tv_usec = 0;
-
-    if (select(m_socket + 1, &fds, nullptr, nullptr, &tv) <= 0) {
-        LOG_ERROR("FNE: Timeout waiting for challenge");
-        return false;
-    }
-
-    ssize_t respLen = recv(m_socket, response, sizeof(response), 0);
-    if (respLen <= 0 || response[18] != NET_FUNC_ACK) {
-        LOG_ERROR("FNE: Login rejected");
-        return false;
-    }
-
-    // Extract salt from response
-    uint32_t salt = ((uint32_t)response[38] << 24) | ((uint32_t)response[39] << 16) |
-                    ((uint32_t)response[40] << 8) | (uint32_t)response[41];
+    sendToFNE(rptl, 40);
+    GW_TRACE1(auth_rptl_sent, m_peerId);
+}
 
+void FNEClient::sendRPTK(uint32_t salt) {
     // Compute hash: SHA256(salt + password)
     std::vector<uint8_t> hashData;
     hashData.push_back((salt >> 24) & 0xFF);
@@ -229,10 +665,9 @@ bool FNEClient::authenticate() {
     uint8_t hash[32];
     SHA256(hashData.data(), hashData.size(), hash);
 
-    // Build RPTK (auth response)
     uint8_t rptk[72];
     std::memset(rptk, 0, sizeof(rptk));
-    P25Utils::buildDVMHeader(rptk, NET_FUNC_RPTK, NET_SUBFUNC_NOP, loginStreamId,
+    P25Utils::buildDVMHeader(rptk, NET_FUNC_RPTK, NET_SUBFUNC_NOP, m_loginStreamId,
                               m_peerId, m_seq, m_timestamp, 40);
 
     rptk[32] = 'R';
@@ -247,28 +682,11 @@ bool FNEClient::authenticate() {
 
     P25Utils::insertDVMCrc(rptk, 72);
 
-    if (!sendToFNE(rptk, 72)) return false;
-
-    // Wait for ACK
-    FD_ZERO(&fds);
-    FD_SET(m_socket, &fds);
-    tv.tv_sec = 5;
-    tv.tv_usec = 0;
-
-    if (select(m_socket + 1, &fds, nullptr, nullptr, &tv) <= 0) {
-        LOG_ERROR("FNE: Timeout waiting for auth ACK");
-        return false;
-    }
-
-    respLen = recv(m_socket, response, sizeof(response), 0);
-    if (respLen <= 0 || response[18] != NET_FUNC_ACK) {
-        LOG_ERROR("FNE: Auth rejected");
-        return false;
-    }
-
-    LOG_INFO("FNE: Auth successful, sending config");
+    sendToFNE(rptk, 72);
+    GW_TRACE1(auth_rptk_sent, m_peerId);
+}
 
-    // Build RPTC (configuration)
+void FNEClient::sendRPTC() {
     std::stringstream configJson;
     configJson << "{\"identity\":\"" << m_identity << "\","
                << "\"rxFrequency\":449000000,"
@@ -281,7 +699,7 @@ bool FNEClient::authenticate() {
     size_t rptcLen = 32 + 8 + config.length();
     std::vector<uint8_t> rptc(rptcLen);
 
-    P25Utils::buildDVMHeader(rptc.data(), NET_FUNC_RPTC, NET_SUBFUNC_NOP, loginStreamId,
+    P25Utils::buildDVMHeader(rptc.data(), NET_FUNC_RPTC, NET_SUBFUNC_NOP, m_loginStreamId,
                               m_peerId, m_seq, m_timestamp, 8 + config.length());
 
     rptc[32] = 'R';
@@ -296,186 +714,684 @@ bool FNEClient::authenticate() {
 
     P25Utils::insertDVMCrc(rptc.data(), rptcLen);
 
-    if (!sendToFNE(rptc.data(), rptcLen)) return false;
+    sendToFNE(rptc.data(), rptcLen);
+    GW_TRACE1(auth_rptc_sent, m_peerId);
+}
 
-    // Wait for final ACK
-    FD_ZERO(&fds);
-    FD_SET(m_socket, &fds);
-    tv.tv_sec = 5;
-    tv.tv_usec = 0;
+void FNEClient::enterStep(LoginStep step) {
+    m_step = step;
+    m_loop->cancelTimer(m_stepTimer);
+
+    const char* waitingFor = nullptr;
+    int stage = 0;
+    switch (step) {
+        case LoginStep::RESOLVING: waitingFor = "address resolution"; stage = 0; break;
+        case LoginStep::RPTL_SENT: waitingFor = "challenge"; stage = 1; break;
+        case LoginStep::RPTK_SENT: waitingFor = "auth ACK"; stage = 2; break;
+        case LoginStep::RPTC_SENT: waitingFor = "config ACK"; stage = 3; break;
+        default: return;
+    }
 
-    if (select(m_socket + 1, &fds, nullptr, nullptr, &tv) <= 0) {
-        LOG_ERROR("FNE: Timeout waiting for config ACK");
-        return false;
+    m_stepTimer = m_loop->addTimer(m_loginTimeout, [this, waitingFor, stage]() {
+        m_stepTimer = 0;
+        loginFailed(std::string("Timeout waiting for ") + waitingFor, stage);
+    });
+}
+
+void FNEClient::loginFailed(const std::string& reason, int stage) {
+    LOG_ERROR(m_logName + ": " + reason);
+    GW_TRACE1(auth_fail, stage);
+
+    m_loginFailures++;
+    closeSocket();
+    m_state = FNEState::DISCONNECTED;
+    scheduleRetry();
+}
+
+void FNEClient::scheduleRetry() {
+    enterStep(LoginStep::BACKOFF);
+
+    // Equal jitter: half the backoff plus a random share of the other half,
+    // so peers that lost the FNE together do not retry in lockstep
+    auto half = m_backoff / 2;
+    auto delay = half + std::chrono::milliseconds(
+        std::uniform_int_distribution<int64_t>(0, (m_backoff - half).count())(m_rng));
+    m_backoff = std::min(m_backoff * 2, m_backoffMax);
+
+    LOG_WARN(m_logName + ": Retrying in " + std::to_string(delay.count()) + " ms");
+
+    m_loop->cancelTimer(m_retryTimer);
+    m_retryTimer = m_loop->addTimer(delay, [this]() {
+        m_retryTimer = 0;
+        beginLogin();
+    });
+}
+
+void FNEClient::onConnected() {
+    Clock::TimePoint now = m_clock.now();
+
+    enterStep(LoginStep::CONNECTED);
+    m_backoff = m_backoffInitial;
+    m_lastLoginMs = elapsedMs(m_loginStart, now);
+    m_timeToAuthMs = elapsedMs(m_outageStart, now);
+    if (m_recovering) {
+        m_lastRecoveryMs = m_timeToAuthMs.load();
+        m_recovering = false;
     }
+    m_missedPongs = 0;
+    m_pongPending = false;
+    m_connectedSinceMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        m_clock.wallNow().time_since_epoch()).count();
+    m_loginCount++;
+    m_state = FNEState::CONNECTED;
 
-    respLen = recv(m_socket, response, sizeof(response), 0);
-    if (respLen <= 0 || response[18] != NET_FUNC_ACK) {
-        LOG_ERROR("FNE: Config rejected");
-        return false;
+    std::stringstream ss;
+    ss << m_logName << ": Connected successfully (login " << m_lastLoginMs << " ms, time to auth "
+       << m_timeToAuthMs << " ms, attempts " << m_loginAttempts << ")";
+    LOG_INFO(ss.str());
+
+    notifyConnection(true);
+    sendPing();
+
+    // Hand back whatever was held during the outage, each lane on its own
+    // sending thread
+    if (m_bufferLDUs > 0) {
+        LOG_INFO(m_logName + ": Replaying " + std::to_string(m_bufferLDUs) + " held LDUs");
     }
+    for (auto& lane : m_lanes) {
+        Reactor* loop = lane->loop;
+        if (lane->holding && loop) {
+            Lane* held = lane.get();
+            loop->post([this, held]() { startReplay(*held); });
+        }
+    }
+}
 
-    return true;
+void FNEClient::resumeSession() {
+    m_loop->addFd(m_socket, EPOLLIN, [this](uint32_t) { onReadable(); });
+    m_backoff = m_backoffInitial;
+    m_missedPongs = 0;
+    m_pongPending = false;
+
+    LOG_INFO(m_logName + ": Resumed session handed over by the previous process");
+
+    notifyConnection(true);
+    sendPing();
+}
+
+void FNEClient::connectionLost(const std::string& reason) {
+    LOG_ERROR(m_logName + ": " + reason + ", logging in again");
+    GW_TRACE1(fne_link_lost, m_peerId);
+
+    m_linkLosses++;
+    m_outageStart = m_clock.now();
+    m_recovering = true;
+    dropSession();
+
+    // The first attempt goes out at once; backoff only applies if it fails
+    beginLogin();
 }
 
-void FNEClient::pingThread() {
-    while (m_running) {
-        if (m_connected) {
-            uint8_t ping[43];
-            std::memset(ping, 0, sizeof(ping));
+void FNEClient::relogin() {
+    m_reloginPending = false;
+    if (m_step == LoginStep::IDLE) return;  // Not started, or handed off
 
-            uint32_t pingStreamId = (rand() & 0x7FFFFFFF) | 0x00000001;
-            P25Utils::buildDVMHeader(ping, NET_FUNC_PING, NET_SUBFUNC_NOP, pingStreamId,
-                                      m_peerId, m_seq, m_timestamp, 11);
+    LOG_INFO(m_logName + ": Logging in again with new settings");
+    m_outageStart = m_clock.now();
+    dropSession();
+    beginLogin();
+}
+
+void FNEClient::dropSession() {
+    bool wasConnected = m_connected;
+
+    m_loop->cancelTimer(m_stepTimer);
+    m_loop->cancelTimer(m_retryTimer);
+    m_loop->cancelTimer(m_pingTimer);
+    m_pongPending = false;
+    closeSocket();
+    m_connectedSinceMs = 0;
+    m_state = FNEState::DISCONNECTED;
+    m_backoff = m_backoffInitial;
+    if (wasConnected) {
+        notifyConnection(false);
+    }
+
+    // The FNE may have lost the streams with the session; each lane drops
+    // its own before it next sends, and the next LDU of each call reopens
+    // its stream with a fresh grant
+    m_session++;
+
+    std::lock_guard<std::mutex> lock(m_adoptedMutex);
+    m_openStreams -= static_cast<uint32_t>(m_adopted.size());
+    m_adopted.clear();
+    m_hasAdopted = false;
+}
+
+void FNEClient::notifyConnection(bool connected) {
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_connected = connected;
+    }
+    m_stateCond.notify_all();
+
+    if (m_connectionCallback) {
+        m_connectionCallback(connected);
+    }
+}
+
+void FNEClient::sendRPTDisc() {
+    uint8_t disc[33];
+    std::memset(disc, 0, sizeof(disc));
+    P25Utils::buildDVMHeader(disc, NET_FUNC_RPT_DISC, NET_SUBFUNC_NOP, m_loginStreamId,
+                              m_peerId, m_seq, m_timestamp, 1);
+
+    P25Utils::insertDVMCrc(disc, 33);
+    sendToFNE(disc, 33);
+    LOG_INFO(m_logName + ": Sent RPT_DISC");
+}
 
-            ping[39] = (m_peerId >> 24) & 0xFF;
-            ping[40] = (m_peerId >> 16) & 0xFF;
-            ping[41] = (m_peerId >> 8) & 0xFF;
-            ping[42] = m_peerId & 0xFF;
+void FNEClient::sendPing() {
+    m_pingTimer = 0;
+    if (!m_connected) return;
 
-            P25Utils::insertDVMCrc(ping, 43);
-            sendToFNE(ping, 43);
+    if (m_pongPending) {
+        uint32_t missed = ++m_missedPongs;
+        LOG_WARN(m_logName + ": No PONG (" + std::to_string(missed) + "/" + std::to_string(m_maxMissedPongs) + ")");
+        if (missed >= m_maxMissedPongs) {
+            connectionLost("No PONG for " + std::to_string(missed) + " pings");
+            return;
         }
+    }
+
+    uint8_t ping[43];
+    std::memset(ping, 0, sizeof(ping));
+
+    m_pingStreamId = (rand() & 0x7FFFFFFF) | 0x00000001;
+    P25Utils::buildDVMHeader(ping, NET_FUNC_PING, NET_SUBFUNC_NOP, m_pingStreamId,
+                              m_peerId, m_seq, m_timestamp, 11);
+
+    ping[39] = (m_peerId >> 24) & 0xFF;
+    ping[40] = (m_peerId >> 16) & 0xFF;
+    ping[41] = (m_peerId >> 8) & 0xFF;
+    ping[42] = m_peerId & 0xFF;
 
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+    P25Utils::insertDVMCrc(ping, 43);
+    m_pingSentAt = m_clock.now();
+    m_pongPending = true;
+    sendToFNE(ping, 43);
+
+    m_pingTimer = m_loop->addTimer(m_pingInterval, [this]() { sendPing(); });
+}
+
+bool FNEClient::sendToFNE(const uint8_t* data, size_t len, uint32_t dstId) {
+    if (m_socket < 0) return false;
+
+    GW_TRACE2(fne_send_start, data[18], len);
+
+    // On an io_uring loop the frame goes out with the rest of the loop's
+    // batch, and its result is counted when it completes
+    IoUring* uring = Reactor::current() ? Reactor::current()->getIoUring() : nullptr;
+    if (uring && uring->queueSend(m_socket, data, len, m_queuedSends)) {
+        GW_TRACE5(fne_send, data[18], data[19], len, len, dstId);
+        return true;
+    }
+
+    ssize_t sent = send(m_socket, data, len, 0);
+    Reactor::noteSyscall();
+    GW_TRACE5(fne_send, data[18], data[19], len, sent, dstId);
+    if (sent != (ssize_t)len) {
+        m_sendErrors++;
+        return false;
     }
+
+    m_framesSent++;
+    return true;
 }
 
-void FNEClient::receiveThread() {
-    uint8_t buffer[1024];
+std::chrono::system_clock::time_point FNEClient::getConnectedSince() const {
+    return std::chrono::system_clock::time_point(std::chrono::milliseconds(m_connectedSinceMs.load()));
+}
 
-    while (m_running) {
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(m_socket, &fds);
-
-        struct timeval tv;
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-
-        int selectResult = select(m_socket + 1, &fds, nullptr, nullptr, &tv);
-        if (selectResult < 0) {
-            if (m_connected) {
-                LOG_ERROR("FNE: Select error, connection lost");
-                m_connected = false;
-                m_running = false;
-
-                if (m_connectionCallback) {
-                    m_connectionCallback(false);
-                }
+void FNEClient::drainEgress() {
+    uint64_t rings;
+    ssize_t ignored = read(m_egressDoorbell, &rings, sizeof(rings));
+    (void)ignored;
+    Reactor::noteSyscall();
+
+    uint64_t session = m_session;
+    size_t count = 0;
+    for (auto& lane : m_lanes) {
+        while (lane->egress.pop(m_egressBatch[count])) {
+            // A frame for a session since dropped belongs to a stream the
+            // FNE no longer has open
+            if (m_egressBatch[count].session != session) continue;
+
+            if (++count == m_egressBatch.size()) {
+                sendBatch(count);
+                count = 0;
             }
-            break;
         }
+    }
+    sendBatch(count);
+}
+
+void FNEClient::sendBatch(size_t count) {
+    if (count == 0 || m_socket < 0) return;
+
+    bool voiceSent = false;
+
+    // An io_uring loop batches the frames itself
+    IoUring* uring = Reactor::current() ? Reactor::current()->getIoUring() : nullptr;
+    if (uring) {
+        for (size_t i = 0; i < count; i++) {
+            const VoicePacket& packet = m_egressBatch[i];
+            voiceSent |= sendToFNE(packet.data, packet.length, packet.dstId) && packet.ldu;
+        }
+        if (voiceSent) noteVoiceSent();
+        return;
+    }
+
+    struct mmsghdr messages[EGRESS_BATCH];
+    struct iovec iov[EGRESS_BATCH];
+    std::memset(messages, 0, sizeof(messages));
+    for (size_t i = 0; i < count; i++) {
+        VoicePacket& packet = m_egressBatch[i];
+        iov[i].iov_base = packet.data;
+        iov[i].iov_len = packet.length;
+        messages[i].msg_hdr.msg_iov = &iov[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        GW_TRACE2(fne_send_start, packet.data[18], packet.length);
+    }
+
+    int sent = sendmmsg(m_socket, messages, static_cast<unsigned int>(count), 0);
+    Reactor::noteSyscall();
+    if (sent < 0) sent = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const VoicePacket& packet = m_egressBatch[i];
+        ssize_t result = i < static_cast<size_t>(sent) ? static_cast<ssize_t>(messages[i].msg_len) : -1;
+        GW_TRACE5(fne_send, packet.data[18], packet.data[19], packet.length, result, packet.dstId);
+        voiceSent |= i < static_cast<size_t>(sent) && packet.ldu;
+    }
+
+    // Whatever sendmmsg() did not take failed as send() would have
+    m_framesSent += sent;
+    m_sendErrors += count - sent;
+    if (voiceSent) noteVoiceSent();
+}
+
+void FNEClient::startReplay(Lane& lane) {
+    // Already replaying since an earlier reconnect
+    if (lane.replayTimer != 0) return;
 
-        if (selectResult == 0) continue;
+    replayNext(lane);
+}
+
+void FNEClient::replayNext(Lane& lane) {
+    lane.replayTimer = 0;
 
-        ssize_t len = recv(m_socket, buffer, sizeof(buffer), 0);
-        if (len <= 0) {
-            if (m_connected && len < 0) {
-                LOG_ERROR("FNE: Connection lost");
-                m_connected = false;
+    syncLane(lane);
+    if (!m_connected) return;
 
-                if (m_connectionCallback) {
-                    m_connectionCallback(false);
-                }
+    // Every held stream moves on by one LDU per tick, so each is replayed
+    // at the replay speed however many were held. Stream starts and ends
+    // go straight out.
+    Clock::TimePoint now = m_clock.now();
+    for (auto held = lane.held.begin(); held != lane.held.end();) {
+        VoiceBuffer& events = held->second;
+        expireHeld(events, now);
+
+        while (!events.empty()) {
+            VoiceEvent& event = events.front();
+            bool isLDU = event.type == VoiceEvent::Type::LDU1 || event.type == VoiceEvent::Type::LDU2;
+
+            deliver(lane, event);
+            events.pop();
+
+            if (isLDU) {
+                m_bufferLDUs--;
+                m_ldusReplayed++;
+                break;
             }
-            continue;
         }
 
-        // Handle PONG responses
-        if (len >= 32 && buffer[18] == NET_FUNC_PONG) {
-            LOG_DEBUG("FNE: Received PONG");
-            continue;
+        if (events.empty()) {
+            // Live voice for the stream goes straight out from here on
+            lane.spareHeld.push_back(std::move(events));
+            held = lane.held.erase(held);
+        } else {
+            ++held;
         }
     }
+
+    if (lane.held.empty()) {
+        lane.holding = false;
+        LOG_INFO(m_logName + ": Held voice replayed (" + std::to_string(m_ldusReplayed) +
+                 " LDUs replayed, " + std::to_string(m_ldusDiscarded) + " discarded in total)");
+        return;
+    }
+
+    lane.replayTimer = lane.loop.load()->addTimer(m_replayInterval.load(), [this, &lane]() { replayNext(lane); });
 }
 
-bool FNEClient::sendToFNE(const uint8_t* data, size_t len) {
-    std::lock_guard<std::mutex> lock(m_sendMutex);
-    if (m_socket < 0) return false;
+void FNEClient::syncLane(Lane& lane) {
+    // The session was dropped since this lane last sent
+    uint64_t session = m_session;
+    if (lane.session != session) {
+        std::lock_guard<std::mutex> lock(lane.tableMutex);
+        m_openStreams -= static_cast<uint32_t>(lane.streams.size());
+        lane.streams.clear();
+        lane.session = session;
+    }
 
-    ssize_t sent = send(m_socket, data, len, 0);
-    return sent == (ssize_t)len;
+    // Held voice was given up (another session took over the call) or the
+    // outage buffer changed
+    uint64_t generation = m_heldGeneration;
+    if (lane.heldGeneration != generation) {
+        discardAllHeld(lane);
+        lane.heldGeneration = generation;
+    }
+
+    Reactor* loop = Reactor::current();
+    if (loop && loop != lane.loop.load(std::memory_order_relaxed)) {
+        lane.loop = loop;
+    }
 }
 
-void FNEClient::startStream(uint32_t srcId, uint32_t dstId) {
-    m_streamId = (rand() & 0x7FFFFFFF) | 0x00000001;
+void FNEClient::submit(Lane& lane, const VoiceEvent& event) {
+    syncLane(lane);
 
-    std::stringstream ss;
-    ss << "FNE: Starting voice stream - src=" << srcId << " dst=" << dstId
-       << " streamId=0x" << std::hex << m_streamId;
-    LOG_INFO(ss.str());
+    // Live voice queues behind its own stream's backlog, so the FNE sees
+    // each call in order; other streams are not held up
+    if (m_connected && (lane.held.empty() || lane.held.find(event.stream) == lane.held.end())) {
+        deliver(lane, event);
+    } else {
+        enqueue(lane, event);
+    }
+}
 
-    // Send TDU with grant demand to trigger CC announcement
-    sendTDU(srcId, dstId, true);
+void FNEClient::enqueue(Lane& lane, const VoiceEvent& event) {
+    bool isLDU = event.type == VoiceEvent::Type::LDU1 || event.type == VoiceEvent::Type::LDU2;
+
+    size_t capacity = m_bufferCapacity;
+    if (capacity == 0) {
+        if (isLDU) m_ldusDiscarded++;
+        return;
+    }
+
+    auto held = lane.held.find(event.stream);
+    if (held == lane.held.end()) {
+        // Rings are kept once emptied, so an outage only allocates when it
+        // holds more streams at once than any before it
+        while (!lane.spareHeld.empty() && lane.spareHeld.back().capacity() != capacity) {
+            lane.spareHeld.pop_back();
+        }
+        if (lane.spareHeld.empty()) {
+            held = lane.held.emplace(event.stream, VoiceBuffer(capacity)).first;
+        } else {
+            held = lane.held.emplace(event.stream, std::move(lane.spareHeld.back())).first;
+            lane.spareHeld.pop_back();
+        }
+        lane.holding = true;
+    }
+
+    VoiceBuffer& events = held->second;
+    expireHeld(events, event.queuedAt);
+    if (events.size() == events.capacity()) {
+        discardFront(events);
+    }
+
+    events.push() = event;
+
+    if (isLDU) {
+        m_ldusBuffered++;
+        uint32_t occupancy = ++m_bufferLDUs;
+        if (occupancy > m_bufferPeakLDUs) {
+            m_bufferPeakLDUs = occupancy;
+        }
+    }
 }
 
-void FNEClient::endStream(uint32_t srcId, uint32_t dstId) {
-    LOG_INFO("FNE: Ending voice stream");
-    sendTDU(srcId, dstId, false);
+void FNEClient::expireHeld(VoiceBuffer& held, Clock::TimePoint now) {
+    std::chrono::milliseconds budget = m_bufferBudget;
+    while (!held.empty() && now - held.front().queuedAt > budget) {
+        discardFront(held);
+    }
 }
 
-void FNEClient::sendLDU1(const uint8_t imbe[9][IMBE_FRAME_SIZE],
-                          uint32_t srcId, uint32_t dstId, bool firstLDU) {
-    if (!m_connected) return;
+void FNEClient::discardFront(VoiceBuffer& held) {
+    const VoiceEvent& event = held.front();
+    if (event.type == VoiceEvent::Type::LDU1 || event.type == VoiceEvent::Type::LDU2) {
+        m_bufferLDUs--;
+        m_ldusDiscarded++;
+    }
+    held.pop();
+}
+
+void FNEClient::discardAllHeld(Lane& lane) {
+    for (auto& held : lane.held) {
+        while (!held.second.empty()) {
+            discardFront(held.second);
+        }
+        lane.spareHeld.push_back(std::move(held.second));
+    }
+    lane.held.clear();
+    lane.holding = false;
+}
+
+void FNEClient::deliver(Lane& lane, const VoiceEvent& event) {
+    VoicePacket packet;
+    packet.session = lane.session;
+    packet.dstId = event.dstId;
+    packet.ldu = 1;
 
-    uint8_t ldu[P25_LDU1_LENGTH];
-    P25Utils::buildLDU1(ldu, imbe, srcId, dstId, m_wacn, m_sysId, firstLDU);
+    StreamFramer* framer = findStream(lane, event.stream);
 
-    size_t totalLen = 32 + P25_LDU1_LENGTH;
-    std::vector<uint8_t> packet(totalLen);
+    switch (event.type) {
+        case VoiceEvent::Type::START:
+            openStream(lane, event.stream, event.srcId, event.dstId);
+            break;
 
-    P25Utils::buildDVMHeader(packet.data(), NET_FUNC_PROTOCOL, NET_SUBFUNC_P25,
-                              m_streamId, m_peerId, m_seq, m_timestamp, P25_LDU1_LENGTH);
-    std::memcpy(packet.data() + 32, ldu, P25_LDU1_LENGTH);
-    P25Utils::insertDVMCrc(packet.data(), totalLen);
+        case VoiceEvent::Type::LDU1: {
+            bool firstLDU = event.firstLDU;
+            if (!framer) {
+                // Stream start was discarded or the session was replaced
+                framer = &openStream(lane, event.stream, event.srcId, event.dstId);
+                firstLDU = true;
+            }
+            packet.length = static_cast<uint16_t>(
+                framer->frameLDU1(packet.data, event.imbe, event.srcId, event.dstId, firstLDU));
+            sendVoice(lane, packet);
+            LOG_DEBUG(m_logName + ": Sent LDU1");
+            break;
+        }
 
-    sendToFNE(packet.data(), totalLen);
+        case VoiceEvent::Type::LDU2:
+            if (!framer) {
+                framer = &openStream(lane, event.stream, event.srcId, event.dstId);
+            }
+            packet.length = static_cast<uint16_t>(
+                framer->frameLDU2(packet.data, event.imbe, event.srcId, event.dstId));
+            sendVoice(lane, packet);
+            LOG_DEBUG(m_logName + ": Sent LDU2");
+            break;
 
-    LOG_DEBUG("FNE: Sent LDU1");
+        case VoiceEvent::Type::END:
+            // Nothing to terminate if none of the stream reached the FNE
+            if (framer) {
+                std::stringstream ss;
+                ss << m_logName << ": Ending voice stream 0x" << std::hex << framer->getStreamId();
+                LOG_INFO(ss.str());
+                sendTDU(lane, *framer, event.srcId, event.dstId, false);
+                closeStream(lane, event.stream);
+            }
+            if (m_reloginPending && m_openStreams == 0) {
+                post([this]() { if (m_reloginPending) relogin(); });
+            }
+            break;
+    }
 }
 
-void FNEClient::sendLDU2(const uint8_t imbe[9][IMBE_FRAME_SIZE],
-                          uint32_t srcId, uint32_t dstId) {
-    if (!m_connected) return;
+void FNEClient::sendVoice(Lane& lane, const VoicePacket& packet) {
+    // Calls handled inline on the network thread's own loop have no one to
+    // hand their frames to
+    if (Reactor::current() == m_loop) {
+        if (packet.session == m_session && sendToFNE(packet.data, packet.length, packet.dstId) &&
+            packet.ldu) {
+            noteVoiceSent();
+        }
+        return;
+    }
+
+    // A frame the network thread has no room for is lost as a failed send
+    // would be
+    bool wake;
+    if (!lane.egress.push(packet, wake)) {
+        m_sendErrors++;
+        return;
+    }
+
+    if (wake) {
+        uint64_t one = 1;
+        ssize_t ignored = write(m_egressDoorbell, &one, sizeof(one));
+        (void)ignored;
+        Reactor::noteSyscall();
+    }
+}
 
-    uint8_t ldu[P25_LDU2_LENGTH];
-    P25Utils::buildLDU2(ldu, imbe, srcId, dstId, m_wacn, m_sysId);
+void FNEClient::noteVoiceSent() {
+    if (m_firstVoiceAt.load(std::memory_order_relaxed) == Clock::Duration::zero()) {
+        m_firstVoiceAt = m_clock.now().time_since_epoch();
+    }
+}
 
-    size_t totalLen = 32 + P25_LDU2_LENGTH;
-    std::vector<uint8_t> packet(totalLen);
+StreamFramer* FNEClient::findStream(Lane& lane, uint32_t call) {
+    auto stream = lane.streams.find(call);
+    if (stream != lane.streams.end()) {
+        return &stream->second;
+    }
 
-    P25Utils::buildDVMHeader(packet.data(), NET_FUNC_PROTOCOL, NET_SUBFUNC_P25,
-                              m_streamId, m_peerId, m_seq, m_timestamp, P25_LDU2_LENGTH);
-    std::memcpy(packet.data() + 32, ldu, P25_LDU2_LENGTH);
-    P25Utils::insertDVMCrc(packet.data(), totalLen);
+    // A stream handed over by the previous process goes to the lane its
+    // call comes through here
+    if (!m_hasAdopted) return nullptr;
 
-    sendToFNE(packet.data(), totalLen);
+    std::lock_guard<std::mutex> adoptedLock(m_adoptedMutex);
+    auto adopted = m_adopted.find(call);
+    if (adopted == m_adopted.end()) return nullptr;
 
-    LOG_DEBUG("FNE: Sent LDU2");
+    std::lock_guard<std::mutex> tableLock(lane.tableMutex);
+    StreamFramer& framer = lane.streams.emplace(call, adopted->second).first->second;
+    m_adopted.erase(adopted);
+    m_hasAdopted = !m_adopted.empty();
+    return &framer;
 }
 
-void FNEClient::sendTDU(uint32_t srcId, uint32_t dstId, bool grantDemand) {
-    if (!m_connected) return;
+StreamFramer& FNEClient::openStream(Lane& lane, uint32_t call, uint32_t srcId, uint32_t dstId) {
+    StreamFramer* framer;
+    {
+        std::lock_guard<std::mutex> lock(lane.tableMutex);
+        auto opened = lane.streams.emplace(call, m_framer);
+        if (opened.second) m_openStreams++;
+        framer = &opened.first->second;
+    }
+    uint32_t streamId = framer->newStream();
 
-    uint8_t tdu[P25_TDU_LENGTH];
-    P25Utils::buildTDU(tdu, srcId, dstId, m_wacn, m_sysId, grantDemand);
+    std::stringstream ss;
+    ss << m_logName << ": Starting voice stream - src=" << srcId << " dst=" << dstId
+       << " streamId=0x" << std::hex << streamId;
+    LOG_INFO(ss.str());
 
-    size_t totalLen = 32 + P25_TDU_LENGTH;
-    std::vector<uint8_t> packet(totalLen);
+    // Send TDU with grant demand to trigger CC announcement
+    sendTDU(lane, *framer, srcId, dstId, true);
+    return *framer;
+}
 
-    bool endOfCall = !grantDemand;
-    P25Utils::buildDVMHeader(packet.data(), NET_FUNC_PROTOCOL, NET_SUBFUNC_P25,
-                              m_streamId, m_peerId, m_seq, m_timestamp, P25_TDU_LENGTH, endOfCall);
-    std::memcpy(packet.data() + 32, tdu, P25_TDU_LENGTH);
-    P25Utils::insertDVMCrc(packet.data(), totalLen);
+void FNEClient::closeStream(Lane& lane, uint32_t call) {
+    std::lock_guard<std::mutex> lock(lane.tableMutex);
+    if (lane.streams.erase(call) > 0) {
+        m_openStreams--;
+    }
+}
+
+void FNEClient::startStream(uint32_t call, uint32_t srcId, uint32_t dstId) {
+    m_lanes[0]->startStream(call, srcId, dstId);
+}
+
+void FNEClient::endStream(uint32_t call, uint32_t srcId, uint32_t dstId) {
+    m_lanes[0]->endStream(call, srcId, dstId);
+}
+
+void FNEClient::sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                          uint32_t srcId, uint32_t dstId, bool firstLDU) {
+    m_lanes[0]->sendLDU1(call, imbe, srcId, dstId, firstLDU);
+}
+
+void FNEClient::sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                          uint32_t srcId, uint32_t dstId) {
+    m_lanes[0]->sendLDU2(call, imbe, srcId, dstId);
+}
+
+void FNEClient::Lane::startStream(uint32_t call, uint32_t srcId, uint32_t dstId) {
+    VoiceEvent event;
+    event.type = VoiceEvent::Type::START;
+    event.firstLDU = false;
+    event.stream = call;
+    event.srcId = srcId;
+    event.dstId = dstId;
+    event.queuedAt = client.m_clock.now();
+    client.submit(*this, event);
+}
+
+void FNEClient::Lane::endStream(uint32_t call, uint32_t srcId, uint32_t dstId) {
+    VoiceEvent event;
+    event.type = VoiceEvent::Type::END;
+    event.firstLDU = false;
+    event.stream = call;
+    event.srcId = srcId;
+    event.dstId = dstId;
+    event.queuedAt = client.m_clock.now();
+    client.submit(*this, event);
+}
+
+void FNEClient::Lane::sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                               uint32_t srcId, uint32_t dstId, bool firstLDU) {
+    VoiceEvent event;
+    event.type = VoiceEvent::Type::LDU1;
+    event.firstLDU = firstLDU;
+    event.stream = call;
+    event.srcId = srcId;
+    event.dstId = dstId;
+    event.queuedAt = client.m_clock.now();
+    std::memcpy(event.imbe, imbe, sizeof(event.imbe));
+    client.submit(*this, event);
+}
+
+void FNEClient::Lane::sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                               uint32_t srcId, uint32_t dstId) {
+    VoiceEvent event;
+    event.type = VoiceEvent::Type::LDU2;
+    event.firstLDU = false;
+    event.stream = call;
+    event.srcId = srcId;
+    event.dstId = dstId;
+    event.queuedAt = client.m_clock.now();
+    std::memcpy(event.imbe, imbe, sizeof(event.imbe));
+    client.submit(*this, event);
+}
 
-    sendToFNE(packet.data(), totalLen);
+void FNEClient::sendTDU(Lane& lane, StreamFramer& framer, uint32_t srcId, uint32_t dstId, bool grantDemand) {
+    VoicePacket packet;
+    packet.session = lane.session;
+    packet.dstId = dstId;
+    packet.ldu = 0;
+    packet.length = static_cast<uint16_t>(framer.frameTDU(packet.data, srcId, dstId, grantDemand));
+    sendVoice(lane, packet);
 
     if (grantDemand) {
-        LOG_DEBUG("FNE: Sent TDU with grant demand");
+        LOG_DEBUG(m_logName + ": Sent TDU with grant demand");
     } else {
-        LOG_DEBUG("FNE: Sent TDU (call termination)");
+        LOG_DEBUG(m_logName + ": Sent TDU (call termination)");
     }
 }
 
@@ -2,6 +2,14 @@
 #define FNECLIENT_H
 
 #include "P25Utils.h"
+#include "VoiceSink.h"
+#include "StreamFramer.h"
+#include "VoiceBuffer.h"
+#include "Clock.h"
+#include "Reactor.h"
+#include "Resolver.h"
+#include "IoUring.h"
+#include "SpscQueue.h"
 
 #include <cstdint>
 #include <string>
@@ -9,60 +17,323 @@
 #include <thread>
 #include <mutex>
 #include <functional>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+#include <random>
+#include <unordered_map>
+#include <vector>
 #include <netinet/in.h>
 
 namespace op25gateway {
 
-// Connection state callback
+// FNE session state
+enum class FNEState {
+    DISCONNECTED,
+    CONNECTING,
+    CONNECTED
+};
+
+// Position in the RPTL -> RPTK -> RPTC login handshake
+enum class LoginStep {
+    IDLE,
+    RESOLVING,      // Waiting for DNS
+    RPTL_SENT,      // Waiting for the challenge salt
+    RPTK_SENT,      // Waiting for the auth ACK
+    RPTC_SENT,      // Waiting for the config ACK
+    CONNECTED,
+    BACKOFF         // Waiting to retry after a failure
+};
+
+// Voice streams carried across a hot restart; any more are dropped and
+// their calls reopened with a grant at the next LDU
+constexpr int HANDOFF_MAX_STREAMS = 256;
+
+// A voice stream open on the FNE session
+struct FNEStreamHandoff {
+    uint32_t call;              // Caller's call ID
+    uint32_t streamId;
+    uint32_t timestamp;
+    uint16_t seq;
+    uint16_t reserved;
+};
+
+// FNE session state carried across a hot restart (plain data, sent as
+// bytes next to the socket itself)
+struct FNESessionHandoff {
+    uint8_t connected;
+    uint8_t reserved[3];
+    struct sockaddr_in fneAddr;
+    int64_t connectedSinceMs;
+
+    // Control message sequence
+    uint16_t controlSeq;
+    uint16_t reserved2;
+    uint32_t controlTimestamp;
+
+    // Voice streams open on the session
+    uint32_t streamCount;
+    FNEStreamHandoff streams[HANDOFF_MAX_STREAMS];
+
+    // Statistics worth keeping
+    uint32_t srttUs;
+    uint64_t loginCount;
+    uint64_t loginAttempts;
+    uint64_t framesSent;
+    uint64_t linkLosses;
+};
+
+// Connection state callback (runs on the FNE network thread)
 using FNEConnectionCallback = std::function<void(bool connected)>;
 
-class FNEClient {
+// Peer connection to a DVM FNE
+//
+// All protocol work (DNS, login, pings, replies) runs as an event-driven
+// state machine on one network thread, its own or an event loop shared
+// with other pipelines, so no caller ever blocks on the FNE. Each thread
+// that sends voice (a call worker) has a lane of its own, which owns the
+// framers of its streams, one per call: frames are built on the sending
+// thread under no lock shared with other lanes, and reach the network
+// thread through the lane's lock-free queue, so overlapping calls go out
+// side by side. While the session is down each stream's voice is held in
+// a bounded store-and-forward ring of its own and replayed, paced, once
+// it is back.
+class FNEClient : public VoiceSink {
 public:
     FNEClient(const std::string& host, uint16_t port,
-              uint32_t peerId, const std::string& password);
+              uint32_t peerId, const std::string& password,
+              Clock& clock = Clock::system());
     ~FNEClient();
 
     FNEClient(const FNEClient&) = delete;
     FNEClient& operator=(const FNEClient&) = delete;
 
-    bool connect();
-    void disconnect();
-    bool isConnected() const { return m_connected; }
+    // Run on a shared event loop and resolver instead of a network thread
+    // of its own (before start())
+    void attach(Reactor& loop, Resolver& resolver);
+
+    // Start the network thread (or join the shared loop); it logs in and
+    // keeps the session up, retrying with backoff, until stop()
+    bool start();
+    void stop();
 
-    void enableAutoReconnect(bool enable = true);
-    void setReconnectInterval(int seconds) { m_reconnectInterval = seconds; }
+    // Hot restart: stop without logging out, handing over the connected
+    // socket (fd, -1 if not logged in) and session state. Voice still held
+    // for an outage is dropped. Returns false if not running.
+    bool handOff(FNESessionHandoff& handoff, int& fd);
+
+    // Carry on a session handed over by another process (before start()).
+    // A connected session resumes with no login; otherwise, or without a
+    // socket, start() logs in afresh.
+    void adopt(const FNESessionHandoff& handoff, int fd);
+
+    // Block the caller until logged in or the timeout expires
+    bool waitForConnection(std::chrono::milliseconds timeout);
+
+    bool isConnected() const { return m_connected; }
+    FNEState getState() const { return m_state; }
 
     void setConnectionCallback(FNEConnectionCallback callback) { m_connectionCallback = callback; }
 
-    // Configuration
+    // Configuration (before start())
     void setIdentity(const std::string& identity) { m_identity = identity; }
-    void setWACN(uint32_t wacn) { m_wacn = wacn; }
-    void setSystemId(uint16_t sysId) { m_sysId = sysId; }
+    void setWACN(uint32_t wacn) { m_framer.setWACN(wacn); }
+    void setSystemId(uint16_t sysId) { m_framer.setSystemId(sysId); }
+
+    // Prefix for this session's log lines (default "FNE")
+    void setLogName(const std::string& name) { m_logName = name; }
+
+    // Time allowed for each login step before the attempt is abandoned
+    void setLoginTimeout(std::chrono::milliseconds timeout) { m_loginTimeout = timeout; }
+
+    // Retry delay doubles from initial up to max, with jitter
+    void setBackoff(std::chrono::milliseconds initial, std::chrono::milliseconds max);
+
+    // Liveness: the session is declared dead after maxMissed pings in a
+    // row go unanswered
+    void setPingInterval(std::chrono::milliseconds interval) { m_pingInterval = interval; }
+    void setMaxMissedPongs(uint32_t maxMissed) { m_maxMissedPongs = maxMissed > 0 ? maxMissed : 1; }
+
+    // Store-and-forward: hold up to budget of each stream's voice while
+    // the session is down (0 disables) and replay every held stream at
+    // speed times real time
+    void setOutageBuffer(std::chrono::milliseconds budget, double replaySpeed);
+
+    // Drop held voice (another session took over the call)
+    void discardBuffered();
+
+    // Config reload (any thread). Login timing and liveness settings take
+    // effect on the network thread from the next timer they drive.
+    void reconfigure(std::chrono::milliseconds loginTimeout,
+                     std::chrono::milliseconds backoffInitial, std::chrono::milliseconds backoffMax,
+                     std::chrono::milliseconds pingInterval, uint32_t maxMissedPongs);
+
+    // Config reload (any thread): log in again to a new address or with
+    // new credentials. Streams in progress are finished on the current
+    // session first, so the re-login never cuts a call.
+    void changeLogin(const std::string& host, uint16_t port, const std::string& password);
+
+    // Voice sink for sending thread index, created on first use (before
+    // start()); the session's own voice methods below use lane 0. Held
+    // voice is replayed on the sending thread's event loop.
+    VoiceSink& lane(uint32_t index) override;
 
     // Send LDU1 (9 IMBE frames)
-    void sendLDU1(const uint8_t imbe[9][IMBE_FRAME_SIZE],
-                  uint32_t srcId, uint32_t dstId, bool firstLDU);
+    void sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                  uint32_t srcId, uint32_t dstId, bool firstLDU) override;
 
     // Send LDU2 (9 IMBE frames)
-    void sendLDU2(const uint8_t imbe[9][IMBE_FRAME_SIZE],
-                  uint32_t srcId, uint32_t dstId);
-
-    // Send TDU (terminator)
-    void sendTDU(uint32_t srcId, uint32_t dstId, bool grantDemand = false);
+    void sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                  uint32_t srcId, uint32_t dstId) override;
 
     // Start new voice stream
-    void startStream(uint32_t srcId, uint32_t dstId);
+    void startStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
 
     // End voice stream
-    void endStream(uint32_t srcId, uint32_t dstId);
+    void endStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+
+    // Statistics
+    uint32_t getPeerId() const { return m_peerId; }
+    uint64_t getFramesSent() const { return m_framesSent + m_queuedSends->sent; }
+    uint64_t getSendErrors() const { return m_sendErrors + m_queuedSends->errors; }
+    uint64_t getLoginCount() const { return m_loginCount; }
+    uint64_t getLoginAttempts() const { return m_loginAttempts; }
+    uint64_t getLoginFailures() const { return m_loginFailures; }
+    std::chrono::system_clock::time_point getConnectedSince() const;
+
+    // Duration of the last successful handshake, DNS through config ACK
+    uint32_t getLastLoginMs() const { return m_lastLoginMs; }
+
+    // Time from start() or loss of the session until logged in again,
+    // including failed attempts and backoff
+    uint32_t getTimeToAuthMs() const { return m_timeToAuthMs; }
+
+    // Liveness
+    uint64_t getLinkLosses() const { return m_linkLosses; }
+    uint64_t getNaksReceived() const { return m_naksReceived; }
+    uint32_t getMissedPongs() const { return m_missedPongs; }
+    uint32_t getLastRttUs() const { return m_lastRttUs; }
+    uint32_t getSmoothedRttUs() const { return m_srttUs; }
+
+    // Time from the last detected link loss until logged in again
+    uint32_t getLastRecoveryMs() const { return m_lastRecoveryMs; }
+
+    // When the first LDU went out on this session (epoch if none yet)
+    Clock::TimePoint getFirstVoiceAt() const { return Clock::TimePoint(m_firstVoiceAt.load()); }
+
+    // Store-and-forward: LDUs held over all streams, and slots per stream
+    uint32_t getBufferLDUs() const { return m_bufferLDUs; }
+    uint32_t getBufferPeakLDUs() const { return m_bufferPeakLDUs; }
+    uint32_t getBufferCapacity() const { return m_bufferCapacity; }
+    uint32_t getBufferBudgetMs() const { return static_cast<uint32_t>(m_bufferBudget.load().count()); }
+    uint64_t getLDUsBuffered() const { return m_ldusBuffered; }
+    uint64_t getLDUsReplayed() const { return m_ldusReplayed; }
+
+    // LDUs lost while the session was down: older than the budget, or
+    // buffering disabled
+    uint64_t getLDUsDiscarded() const { return m_ldusDiscarded; }
+
+    static constexpr size_t EGRESS_CAPACITY = 256;     // Frames queued per lane
+    static constexpr size_t EGRESS_BATCH = 32;         // Frames per sendmmsg()
 
 private:
-    bool authenticate();
-    void pingThread();
-    void receiveThread();
-    void reconnectThread();
+    // A finished frame on its way from a lane to the network thread
+    struct VoicePacket {
+        uint64_t session;           // m_session it was framed for
+        uint32_t dstId;             // For the fne_send probe
+        uint16_t length;
+        uint8_t ldu;                // LDU rather than TDU
+        uint8_t data[DVM_MAX_VOICE_FRAME];
+    };
+
+    // One sending thread's voice. Only that thread touches it, except as
+    // noted.
+    struct Lane : public VoiceSink {
+        explicit Lane(FNEClient& client);
+
+        void startStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+        void endStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+        void sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                      uint32_t srcId, uint32_t dstId, bool firstLDU) override;
+        void sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                      uint32_t srcId, uint32_t dstId) override;
+
+        FNEClient& client;
+
+        // Streams open on the session, by call. Added and removed under
+        // tableMutex, which other threads take to read the table.
+        std::mutex tableMutex;
+        std::unordered_map<uint32_t, StreamFramer> streams;
+        uint64_t session;           // m_session the streams belong to
 
-    bool sendToFNE(const uint8_t* data, size_t len);
+        // Voice held for an outage, by call, and emptied rings for reuse
+        std::unordered_map<uint32_t, VoiceBuffer> held;
+        std::vector<VoiceBuffer> spareHeld;
+        uint64_t heldGeneration;    // m_heldGeneration the rings were filled under
+        std::atomic<bool> holding;  // held is not empty (read by the network thread)
+        Reactor::TimerId replayTimer;
+
+        std::atomic<Reactor*> loop; // Sending thread's event loop, for the replay
+        SpscQueue<VoicePacket> egress;  // Consumed by the network thread
+    };
+
+    // Network thread
+    void networkThread();
+    void networkStart();
+    void networkStop();
+    void shutdownLoop();
+    void post(Reactor::Callback callback);
+    void beginLogin();
+    void onResolved(bool ok, const struct sockaddr_in& addr);
+    bool openSocket(const struct sockaddr_in& addr);
+    void closeSocket();
+    void onReadable();
+    void handleMessage(const uint8_t* data, size_t len);
+    void handleAck(const uint8_t* data, size_t len);
+    void handleNak(const uint8_t* data, size_t len);
+    void handlePong(const uint8_t* data);
+    void sendRPTL();
+    void sendRPTK(uint32_t salt);
+    void sendRPTC();
+    void enterStep(LoginStep step);
+    void loginFailed(const std::string& reason, int stage);
+    void scheduleRetry();
+    void onConnected();
+    void resumeSession();
+    void connectionLost(const std::string& reason);
+    void relogin();
+    void dropSession();
+    void sendRPTDisc();
+    void sendPing();
+    void notifyConnection(bool connected);
+    void drainEgress();
+    void sendBatch(size_t count);
+
+    // Voice path (on the lane's thread)
+    void submit(Lane& lane, const VoiceEvent& event);
+    void syncLane(Lane& lane);
+    void deliver(Lane& lane, const VoiceEvent& event);
+    void enqueue(Lane& lane, const VoiceEvent& event);
+    void startReplay(Lane& lane);
+    void replayNext(Lane& lane);
+    void expireHeld(VoiceBuffer& held, Clock::TimePoint now);
+    void discardFront(VoiceBuffer& held);
+    void discardAllHeld(Lane& lane);
+    StreamFramer* findStream(Lane& lane, uint32_t call);
+    StreamFramer& openStream(Lane& lane, uint32_t call, uint32_t srcId, uint32_t dstId);
+    void closeStream(Lane& lane, uint32_t call);
+    void sendTDU(Lane& lane, StreamFramer& framer, uint32_t srcId, uint32_t dstId, bool grantDemand);
+    void sendVoice(Lane& lane, const VoicePacket& packet);
+    void noteVoiceSent();
+
+    // dstId is only passed to the fne_send probe; 0 for non-voice frames
+    bool sendToFNE(const uint8_t* data, size_t len, uint32_t dstId = 0);
+
+    Clock& m_clock;
+    Reactor m_ownReactor;
+    Resolver m_ownResolver;
+    Reactor* m_loop;            // m_ownReactor unless attached to a shared loop
+    Resolver* m_resolver;
 
     // Configuration
     std::string m_host;
@@ -70,35 +341,93 @@ private:
     uint32_t m_peerId;
     std::string m_password;
     std::string m_identity;
-    uint32_t m_wacn;
-    uint16_t m_sysId;
+    std::string m_logName;
+    std::chrono::milliseconds m_loginTimeout;
+    std::chrono::milliseconds m_backoffInitial;
+    std::chrono::milliseconds m_backoffMax;
+    std::chrono::milliseconds m_pingInterval;
+    uint32_t m_maxMissedPongs;
 
-    // Socket
+    // Socket (network thread only)
     int m_socket;
     struct sockaddr_in m_fneAddr;
 
     // State
     std::atomic<bool> m_connected;
-    std::atomic<bool> m_running;
+    std::atomic<FNEState> m_state;
+    std::atomic<int64_t> m_connectedSinceMs;
+    std::mutex m_stateMutex;
+    std::condition_variable m_stateCond;
+
+    // Login state machine (network thread only)
+    LoginStep m_step;
+    uint32_t m_loginStreamId;
+    Reactor::TimerId m_stepTimer;
+    Reactor::TimerId m_retryTimer;
+    Reactor::TimerId m_pingTimer;
+    std::chrono::milliseconds m_backoff;
+    std::mt19937 m_rng;
+    Clock::TimePoint m_loginStart;
+    Clock::TimePoint m_outageStart;
+    bool m_recovering;
 
-    // Stream state
-    uint32_t m_streamId;
+    // Liveness (network thread only, except the exported counters)
+    uint32_t m_pingStreamId;
+    Clock::TimePoint m_pingSentAt;
+    bool m_pongPending;
+
+    // Control message state (login, ping)
     uint16_t m_seq;
     uint32_t m_timestamp;
 
-    // Threads
-    std::thread m_pingThread;
-    std::thread m_receiveThread;
-    std::thread m_reconnectThread;
-    std::mutex m_sendMutex;
-    std::mutex m_reconnectMutex;
+    // Voice streams
+    StreamFramer m_framer;      // Identity each new stream starts from
+    std::vector<std::unique_ptr<Lane>> m_lanes;
+    std::atomic<uint64_t> m_session;        // Bumped when the FNE may have lost the open streams
+    std::atomic<uint32_t> m_openStreams;    // Over all lanes
+    int m_egressDoorbell;                   // Rung when a lane's queue was empty
+    std::vector<VoicePacket> m_egressBatch; // Network thread only
+    std::mutex m_adoptedMutex;
+    std::unordered_map<uint32_t, StreamFramer> m_adopted;  // Handed over, not yet taken by a lane
+    std::atomic<bool> m_hasAdopted;
+
+    // Store-and-forward settings (any thread); lanes drop what they hold
+    // when the generation moves on
+    std::atomic<uint64_t> m_heldGeneration;
+    std::atomic<std::chrono::milliseconds> m_bufferBudget;
+    std::atomic<std::chrono::microseconds> m_replayInterval;
 
-    // Reconnection
-    std::atomic<bool> m_reconnectEnabled;
-    int m_reconnectInterval;
+    // Threads
+    std::thread m_networkThread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_handingOff;
+    std::atomic<bool> m_reloginPending;    // New login settings wait for the stream to end
 
     // Callback
     FNEConnectionCallback m_connectionCallback;
+
+    // Statistics
+    std::atomic<uint64_t> m_framesSent;
+    std::atomic<uint64_t> m_sendErrors;
+    std::shared_ptr<IoSendStatus> m_queuedSends;   // Sent through an io_uring, counted as they complete
+    std::atomic<uint64_t> m_loginCount;
+    std::atomic<uint64_t> m_loginAttempts;
+    std::atomic<uint64_t> m_loginFailures;
+    std::atomic<uint32_t> m_lastLoginMs;
+    std::atomic<uint32_t> m_timeToAuthMs;
+    std::atomic<uint64_t> m_linkLosses;
+    std::atomic<uint64_t> m_naksReceived;
+    std::atomic<uint32_t> m_missedPongs;
+    std::atomic<uint32_t> m_lastRttUs;
+    std::atomic<uint32_t> m_srttUs;
+    std::atomic<uint32_t> m_lastRecoveryMs;
+    std::atomic<Clock::Duration> m_firstVoiceAt;
+    std::atomic<uint32_t> m_bufferLDUs;
+    std::atomic<uint32_t> m_bufferPeakLDUs;
+    std::atomic<uint32_t> m_bufferCapacity;  // Slots in each stream's ring
+    std::atomic<uint64_t> m_ldusBuffered;
+    std::atomic<uint64_t> m_ldusReplayed;
+    std::atomic<uint64_t> m_ldusDiscarded;
 };
 
 } // namespace op25gateway
@@ -0,0 +1,242 @@
+#include "FNEFailover.h"
+#include "Logger.h"
+#include "Trace.h"
+
+#include <sstream>
+
+namespace op25gateway {
+
+namespace {
+
+const char* sessionName(int index) {
+    return index == 0 ? "primary" : "secondary";
+}
+
+} // namespace
+
+FNEFailover::FNEFailover(FNEClient& primary, FNEClient& secondary, Clock& clock)
+    : m_primary(primary)
+    , m_secondary(secondary)
+    , m_clock(clock)
+    , m_active(0)
+    , m_running(false)
+    , m_resumePending(false)
+    , m_failoverPending(false)
+    , m_failovers(0)
+    , m_midCallSwitches(0)
+    , m_failbacks(0)
+    , m_lastFailoverMs(0)
+{
+    m_primary.setConnectionCallback([this](bool connected) { onConnection(0, connected); });
+    m_secondary.setConnectionCallback([this](bool connected) { onConnection(1, connected); });
+    m_lanes.emplace_back(new Lane(*this, 0));
+}
+
+FNEFailover::~FNEFailover() {
+    stop();
+}
+
+bool FNEFailover::start() {
+    if (m_running) return true;
+
+    m_running = true;
+    if (!m_primary.start() || !m_secondary.start()) {
+        stop();
+        return false;
+    }
+
+    LOG_INFO("FNE: Hot standby enabled");
+    return true;
+}
+
+void FNEFailover::stop() {
+    // Sessions going down at shutdown are not failures
+    m_running = false;
+
+    m_primary.stop();
+    m_secondary.stop();
+}
+
+void FNEFailover::adopt(int active, const std::vector<uint32_t>& calls) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_active = active == 1 ? 1 : 0;
+    m_calls.insert(calls.begin(), calls.end());
+}
+
+VoiceSink& FNEFailover::lane(uint32_t index) {
+    while (m_lanes.size() <= index) {
+        m_lanes.emplace_back(new Lane(*this, static_cast<uint32_t>(m_lanes.size())));
+    }
+    return *m_lanes[index];
+}
+
+FNEFailover::Lane::Lane(FNEFailover& failover, uint32_t index)
+    : failover(failover)
+{
+    sessions[0] = &failover.m_primary.lane(index);
+    sessions[1] = &failover.m_secondary.lane(index);
+}
+
+void FNEFailover::onConnection(int index, bool connected) {
+    if (!m_running) return;
+
+    bool switched = false;
+    bool midCall = false;
+    int active;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        active = m_active;
+
+        if (!connected && index == active) {
+            m_lostAt = m_clock.now();
+
+            if (session(1 - index).isConnected()) {
+                active = 1 - index;
+                switched = true;
+            } else {
+                LOG_WARN(std::string("FNE: ") + sessionName(index) + " session lost and no standby is up");
+            }
+        } else if (connected && index != active && !session(active).isConnected()) {
+            // The standby came up while the active session is still down
+            active = index;
+            switched = true;
+        }
+
+        if (switched) {
+            // The call is reopened on the new session at its next LDU.
+            // Voice the old one held is for the wrong FNE by now.
+            session(1 - active).discardBuffered();
+            m_active = active;
+            m_failovers++;
+            midCall = !m_calls.empty();
+            m_resume = m_calls;
+            m_resumePending = !m_resume.empty();
+            m_failoverPending = true;
+            if (!midCall) {
+                recordFailover();
+            }
+            GW_TRACE2(fne_failover, active, midCall);
+        }
+    }
+
+    if (switched) {
+        std::stringstream ss;
+        ss << "FNE: Failing over to " << sessionName(active) << " session"
+           << (midCall ? ", moving calls at their next LDU" : "");
+        LOG_WARN(ss.str());
+
+        if (m_failoverCallback) {
+            m_failoverCallback(active, midCall);
+        }
+    }
+}
+
+void FNEFailover::recordFailover() {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(m_clock.now() - m_lostAt);
+    m_lastFailoverMs = static_cast<uint32_t>(elapsed.count());
+    m_failoverPending = false;
+}
+
+bool FNEFailover::resumeOnActive(Lane& lane, uint32_t call, uint32_t srcId, uint32_t dstId) {
+    if (m_resume.count(call) == 0) return false;
+    if (!session(m_active).isConnected()) return false;
+
+    // New stream with a grant demand, so the FNE treats the rest of the
+    // call as a fresh transmission
+    lane.sessions[m_active]->startStream(call, srcId, dstId);
+    m_resume.erase(call);
+    m_resumePending = !m_resume.empty();
+
+    if (m_failoverPending) {
+        recordFailover();
+        m_midCallSwitches++;
+
+        LOG_INFO(std::string("FNE: Call moved to ") + sessionName(m_active) + " session after " +
+                 std::to_string(m_lastFailoverMs) + " ms");
+    }
+    return true;
+}
+
+void FNEFailover::startStream(uint32_t call, uint32_t srcId, uint32_t dstId) {
+    m_lanes[0]->startStream(call, srcId, dstId);
+}
+
+void FNEFailover::endStream(uint32_t call, uint32_t srcId, uint32_t dstId) {
+    m_lanes[0]->endStream(call, srcId, dstId);
+}
+
+void FNEFailover::sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                           uint32_t srcId, uint32_t dstId, bool firstLDU) {
+    m_lanes[0]->sendLDU1(call, imbe, srcId, dstId, firstLDU);
+}
+
+void FNEFailover::sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                           uint32_t srcId, uint32_t dstId) {
+    m_lanes[0]->sendLDU2(call, imbe, srcId, dstId);
+}
+
+void FNEFailover::Lane::startStream(uint32_t call, uint32_t srcId, uint32_t dstId) {
+    std::lock_guard<std::mutex> lock(failover.m_mutex);
+
+    // New calls prefer the primary whenever it is up, unless other calls
+    // are still going out on the standby
+    FNEClient& primary = failover.m_primary;
+    FNEClient& secondary = failover.m_secondary;
+    int preferred = primary.isConnected() ? 0 : secondary.isConnected() ? 1 : failover.m_active.load();
+    if (preferred != failover.m_active && failover.m_calls.empty()) {
+        if (preferred == 0) {
+            failover.m_failbacks++;
+            LOG_INFO("FNE: Primary session is back, returning to it");
+        }
+        failover.m_active = preferred;
+    }
+
+    failover.m_calls.insert(call);
+    failover.m_resume.erase(call);
+    failover.m_resumePending = !failover.m_resume.empty();
+    if (failover.m_resume.empty()) {
+        failover.m_failoverPending = false;
+    }
+    sessions[failover.m_active]->startStream(call, srcId, dstId);
+}
+
+void FNEFailover::Lane::endStream(uint32_t call, uint32_t srcId, uint32_t dstId) {
+    std::lock_guard<std::mutex> lock(failover.m_mutex);
+
+    failover.m_calls.erase(call);
+    failover.m_resume.erase(call);
+    failover.m_resumePending = !failover.m_resume.empty();
+    sessions[failover.m_active]->endStream(call, srcId, dstId);
+}
+
+void FNEFailover::Lane::sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                                 uint32_t srcId, uint32_t dstId, bool firstLDU) {
+    // Only a call that has to move to the other session needs the lock;
+    // one the switch catches between the two is reopened by the session
+    // at this LDU, as it has no stream open for it
+    bool reopened = false;
+    int active;
+    if (failover.m_resumePending) {
+        std::lock_guard<std::mutex> lock(failover.m_mutex);
+        reopened = failover.resumeOnActive(*this, call, srcId, dstId);
+        active = failover.m_active;
+    } else {
+        active = failover.m_active;
+    }
+    sessions[active]->sendLDU1(call, imbe, srcId, dstId, firstLDU || reopened);
+}
+
+void FNEFailover::Lane::sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                                 uint32_t srcId, uint32_t dstId) {
+    int active;
+    if (failover.m_resumePending) {
+        std::lock_guard<std::mutex> lock(failover.m_mutex);
+        failover.resumeOnActive(*this, call, srcId, dstId);
+        active = failover.m_active;
+    } else {
+        active = failover.m_active;
+    }
+    sessions[active]->sendLDU2(call, imbe, srcId, dstId);
+}
+
+} // namespace op25gateway
@@ -0,0 +1,121 @@
+#ifndef FNEFAILOVER_H
+#define FNEFAILOVER_H
+
+#include "VoiceSink.h"
+#include "FNEClient.h"
+#include "Clock.h"
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace op25gateway {
+
+// Session switch callback: index of the now active session (0 = primary,
+// 1 = secondary) and whether a call in progress was moved
+using FNEFailoverCallback = std::function<void(int active, bool midCall)>;
+
+// Primary/secondary FNE pair with a hot standby
+//
+// Both sessions are started and stay logged in and pinging. Voice goes to
+// the active one. When it is declared lost, the standby takes over: each
+// call in progress moves at its next LDU, which opens a new stream on the
+// standby with a grant-demand TDU, so the call carries on. The primary is
+// preferred again once it is back and no call is up.
+//
+// Each sending thread's lane passes its voice to the same lane of the
+// active session. Only starting or ending a call, or moving one after a
+// failover, takes the pair's lock.
+class FNEFailover : public VoiceSink {
+public:
+    FNEFailover(FNEClient& primary, FNEClient& secondary, Clock& clock = Clock::system());
+    ~FNEFailover();
+
+    FNEFailover(const FNEFailover&) = delete;
+    FNEFailover& operator=(const FNEFailover&) = delete;
+
+    bool start();
+    void stop();
+
+    void setFailoverCallback(FNEFailoverCallback callback) { m_failoverCallback = callback; }
+
+    // Hot restart: carry on with the active session and the calls in
+    // progress in the previous process (before start())
+    void adopt(int active, const std::vector<uint32_t>& calls);
+
+    // Voice sink for sending thread index, on the same lane of each
+    // session (before start())
+    VoiceSink& lane(uint32_t index) override;
+
+    void startStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+    void endStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+    void sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                  uint32_t srcId, uint32_t dstId, bool firstLDU) override;
+    void sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                  uint32_t srcId, uint32_t dstId) override;
+
+    // Statistics
+    int getActive() const { return m_active; }
+    uint64_t getFailovers() const { return m_failovers; }
+    uint64_t getMidCallSwitches() const { return m_midCallSwitches; }
+    uint64_t getFailbacks() const { return m_failbacks; }
+
+    // Time from the active session being declared lost until voice went
+    // out on the other one (or the switch, if no call was up)
+    uint32_t getLastFailoverMs() const { return m_lastFailoverMs; }
+
+private:
+    // One sending thread's way in, to its lane of either session
+    struct Lane : public VoiceSink {
+        Lane(FNEFailover& failover, uint32_t index);
+
+        void startStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+        void endStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+        void sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                      uint32_t srcId, uint32_t dstId, bool firstLDU) override;
+        void sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                      uint32_t srcId, uint32_t dstId) override;
+
+        FNEFailover& failover;
+        VoiceSink* sessions[2];
+    };
+
+    void onConnection(int session, bool connected);
+    FNEClient& session(int index) { return index == 0 ? m_primary : m_secondary; }
+
+    // Moves a call in progress to the active session before its next LDU
+    // (call with m_mutex held); returns true if this LDU opens the stream
+    bool resumeOnActive(Lane& lane, uint32_t call, uint32_t srcId, uint32_t dstId);
+
+    void recordFailover();
+
+    FNEClient& m_primary;
+    FNEClient& m_secondary;
+    Clock& m_clock;
+
+    std::mutex m_mutex;
+    std::atomic<int> m_active;
+    std::atomic<bool> m_running;
+    std::set<uint32_t> m_calls;     // Calls in progress
+    std::set<uint32_t> m_resume;    // Calls to reopen on the active session
+    std::atomic<bool> m_resumePending;  // m_resume is not empty
+    bool m_failoverPending;         // Failover time not yet recorded
+    Clock::TimePoint m_lostAt;
+
+    FNEFailoverCallback m_failoverCallback;
+    std::vector<std::unique_ptr<Lane>> m_lanes;
+
+    // Statistics
+    std::atomic<uint64_t> m_failovers;
+    std::atomic<uint64_t> m_midCallSwitches;
+    std::atomic<uint64_t> m_failbacks;
+    std::atomic<uint32_t> m_lastFailoverMs;
+};
+
+} // namespace op25gateway
+
+#endif // FNEFAILOVER_H
@@ -0,0 +1,340 @@
+#include "FrameVoter.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+#include <arpa/inet.h>
+
+namespace op25gateway {
+
+namespace {
+
+// The same frame position comes round again every LDU1+LDU2 (360 ms):
+// copies within half of that are the same frame
+constexpr std::chrono::milliseconds SAME_FRAME_HORIZON(180);
+
+// Votes a site may miss in a row before it is no longer waited for
+constexpr uint8_t MAX_MISSES = 3;
+
+uint64_t elapsedUs(Clock::TimePoint from, Clock::TimePoint to) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+}
+
+} // namespace
+
+FrameVoter::FrameVoter(std::chrono::milliseconds window)
+    : m_window(window)
+    , m_logName("OP25")
+    , m_loop(nullptr)
+    , m_timer(0)
+    , m_siteCount(0)
+    , m_sitesFullWarned(false)
+    , m_votes(0)
+    , m_timeouts(0)
+    , m_holdTotalUs(0)
+    , m_holdMaxUs(0)
+{
+    for (Site& site : m_sites) {
+        site.address = 0;
+        site.port = 0;
+        site.frames = 0;
+        site.wins = 0;
+        site.losses = 0;
+        site.late = 0;
+    }
+}
+
+FrameVoter::~FrameVoter() {
+}
+
+VoterSiteStats FrameVoter::getSite(size_t index) const {
+    VoterSiteStats stats = {};
+    if (index >= getSiteCount()) return stats;
+
+    const Site& site = m_sites[index];
+    stats.address = site.address;
+    stats.port = site.port;
+    stats.frames = site.frames.load(std::memory_order_relaxed);
+    stats.wins = site.wins.load(std::memory_order_relaxed);
+    stats.losses = site.losses.load(std::memory_order_relaxed);
+    stats.late = site.late.load(std::memory_order_relaxed);
+    return stats;
+}
+
+uint32_t FrameVoter::getHoldAvgUs() const {
+    uint64_t votes = m_votes;
+    return votes ? static_cast<uint32_t>(m_holdTotalUs / votes) : 0;
+}
+
+size_t FrameVoter::findSite(const struct sockaddr_in& sender) {
+    uint32_t address = ntohl(sender.sin_addr.s_addr);
+    uint16_t port = ntohs(sender.sin_port);
+
+    size_t count = m_siteCount.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; i++) {
+        if (m_sites[i].address == address && m_sites[i].port == port) {
+            return i;
+        }
+    }
+
+    char text[INET_ADDRSTRLEN] = "";
+    inet_ntop(AF_INET, &sender.sin_addr, text, sizeof(text));
+    if (count == MAX_SITES) {
+        if (!m_sitesFullWarned) {
+            LOG_WARN(m_logName + ": More than " + std::to_string(MAX_SITES) + " OP25 sites, " + text + ":" +
+                     std::to_string(port) + " and later ones vote as one");
+            m_sitesFullWarned = true;
+        }
+        return MAX_SITES;
+    }
+
+    m_sites[count].address = address;
+    m_sites[count].port = port;
+    m_siteCount.store(count + 1, std::memory_order_release);
+    LOG_INFO(m_logName + ": Voting site " + std::to_string(count + 1) + " is " + text + ":" + std::to_string(port));
+    return count;
+}
+
+void FrameVoter::submit(const OP25Packet& packet, const struct sockaddr_in& sender) {
+    Clock::TimePoint now = m_loop->getClock().now();
+    size_t site = findSite(sender);
+    uint32_t bit = 1u << site;
+    if (site < MAX_SITES) {
+        m_sites[site].frames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (packet.frameType == OP25_FRAME_TDU) {
+        submitTerminator(packet, site, now);
+        return;
+    }
+
+    // The call has ended: a lagging site's copy must not start it again
+    if (isTerminated(packet, now)) {
+        if (site < MAX_SITES) {
+            m_sites[site].late.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    Stream& stream = m_streams[StreamKey(packet.nac, packet.talkgroup, packet.sourceId)];
+
+    Slot* slot = nullptr;
+    for (auto it = stream.slots.rbegin(); it != stream.slots.rend(); ++it) {
+        if (now - it->opened >= SAME_FRAME_HORIZON) break;
+        if (it->frameType == packet.frameType && it->voiceIndex == packet.voiceIndex) {
+            slot = &*it;
+            break;
+        }
+    }
+
+    if (slot && slot->state != SlotState::OPEN) {
+        // Too late to count. A site this close behind is waited for from
+        // now on; one further behind would hold every frame to the window.
+        if (site < MAX_SITES) {
+            m_sites[site].late.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (now - slot->opened <= m_window) {
+            stream.expected |= bit;
+            stream.misses[site] = 0;
+        }
+        return;
+    }
+
+    stream.expected |= bit;
+    stream.misses[site] = 0;
+
+    if (!slot) {
+        stream.slots.emplace_back();
+        slot = &stream.slots.back();
+        slot->frameType = packet.frameType;
+        slot->voiceIndex = packet.voiceIndex;
+        slot->state = SlotState::OPEN;
+        slot->opened = now;
+        slot->voters = bit;
+        slot->bestSite = static_cast<uint8_t>(site);
+        slot->best = packet;
+        scheduleTimer(now + m_window);
+    } else {
+        slot->voters |= bit;
+        if (packet.errors < slot->best.errors) {
+            slot->bestSite = static_cast<uint8_t>(site);
+            slot->best = packet;
+        }
+    }
+
+    if ((slot->voters & stream.expected) == stream.expected) {
+        decide(stream, *slot, now);
+        release(stream, now);
+    }
+
+    // Sent frames are forgotten on the timer too
+    scheduleTimer(now + SAME_FRAME_HORIZON);
+}
+
+bool FrameVoter::isTerminated(const OP25Packet& packet, Clock::TimePoint now) const {
+    // A terminator is the last slot of its stream, and one without a
+    // source ends every stream on the talkgroup
+    for (auto it = m_streams.lower_bound(StreamKey(packet.nac, packet.talkgroup, 0));
+         it != m_streams.end() && std::get<0>(it->first) == packet.nac &&
+         std::get<1>(it->first) == packet.talkgroup; ++it) {
+        const std::deque<Slot>& slots = it->second.slots;
+        if (slots.empty()) continue;
+
+        const Slot& last = slots.back();
+        if (last.frameType == OP25_FRAME_TDU && now - last.opened < SAME_FRAME_HORIZON &&
+            (last.best.sourceId == 0 || last.best.sourceId == packet.sourceId)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FrameVoter::submitTerminator(const OP25Packet& packet, size_t site, Clock::TimePoint now) {
+    // The call is over: its open votes close with what they have, so its
+    // last frames still go out ahead of the terminator
+    bool repeat = false;
+    for (auto it = m_streams.lower_bound(StreamKey(packet.nac, packet.talkgroup, 0));
+         it != m_streams.end() && std::get<0>(it->first) == packet.nac &&
+         std::get<1>(it->first) == packet.talkgroup; ++it) {
+        Stream& stream = it->second;
+        for (Slot& slot : stream.slots) {
+            if (slot.state == SlotState::OPEN) {
+                decide(stream, slot, now);
+            } else if (slot.frameType == OP25_FRAME_TDU) {
+                repeat = true;
+            }
+        }
+        release(stream, now);
+    }
+
+    // Every site that heard the end reports it; the first will do
+    if (repeat) return;
+
+    Stream& stream = m_streams[StreamKey(packet.nac, packet.talkgroup, packet.sourceId)];
+    stream.slots.emplace_back();
+    Slot& slot = stream.slots.back();
+    slot.frameType = packet.frameType;
+    slot.voiceIndex = packet.voiceIndex;
+    slot.state = SlotState::SENT;
+    slot.opened = now;
+    slot.voters = 1u << site;
+    slot.bestSite = static_cast<uint8_t>(site);
+    slot.best = packet;
+
+    if (m_frameCallback) {
+        m_frameCallback(packet);
+    }
+
+    // Remembered until the other sites' copies have had time to arrive
+    scheduleTimer(now + SAME_FRAME_HORIZON);
+}
+
+void FrameVoter::decide(Stream& stream, Slot& slot, Clock::TimePoint now) {
+    slot.state = SlotState::DECIDED;
+
+    uint64_t holdUs = elapsedUs(slot.opened, now);
+    m_votes.fetch_add(1, std::memory_order_relaxed);
+    m_holdTotalUs.fetch_add(holdUs, std::memory_order_relaxed);
+    if (holdUs > m_holdMaxUs) {
+        m_holdMaxUs = static_cast<uint32_t>(holdUs);
+    }
+
+    for (size_t site = 0; site <= MAX_SITES; site++) {
+        uint32_t bit = 1u << site;
+        if (slot.voters & bit) {
+            if (site < MAX_SITES) {
+                std::atomic<uint64_t>& counter = site == slot.bestSite ? m_sites[site].wins : m_sites[site].losses;
+                counter.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else if ((stream.expected & bit) && ++stream.misses[site] >= MAX_MISSES) {
+            stream.expected &= ~bit;
+        }
+    }
+}
+
+void FrameVoter::release(Stream& stream, Clock::TimePoint now) {
+    // In order: a decided frame waits for the ones before it
+    for (Slot& slot : stream.slots) {
+        if (slot.state == SlotState::OPEN) break;
+        if (slot.state == SlotState::DECIDED) {
+            slot.state = SlotState::SENT;
+            if (m_frameCallback) {
+                m_frameCallback(slot.best);
+            }
+        }
+    }
+
+    // Sent frames are kept a while to recognise late copies
+    while (!stream.slots.empty() && stream.slots.front().state == SlotState::SENT &&
+           now - stream.slots.front().opened >= SAME_FRAME_HORIZON) {
+        stream.slots.pop_front();
+    }
+}
+
+void FrameVoter::onTimer() {
+    m_timer = 0;
+    Clock::TimePoint now = m_loop->getClock().now();
+
+    for (auto it = m_streams.begin(); it != m_streams.end();) {
+        Stream& stream = it->second;
+        for (Slot& slot : stream.slots) {
+            if (slot.state == SlotState::OPEN && now - slot.opened >= m_window) {
+                m_timeouts.fetch_add(1, std::memory_order_relaxed);
+                decide(stream, slot, now);
+            }
+        }
+        release(stream, now);
+
+        if (stream.slots.empty()) {
+            it = m_streams.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (m_streams.empty()) return;
+
+    // The oldest open vote closes first; with none open, come back to
+    // forget sent frames
+    Clock::TimePoint due = now + SAME_FRAME_HORIZON;
+    for (const auto& entry : m_streams) {
+        for (const Slot& slot : entry.second.slots) {
+            if (slot.state == SlotState::OPEN) {
+                due = std::min(due, slot.opened + m_window);
+                break;
+            }
+        }
+    }
+    scheduleTimer(due);
+}
+
+void FrameVoter::scheduleTimer(Clock::TimePoint due) {
+    if (m_timer != 0) {
+        if (m_timerDue <= due) return;
+        m_loop->cancelTimer(m_timer);
+    }
+
+    Clock::TimePoint now = m_loop->getClock().now();
+    m_timerDue = due;
+    m_timer = m_loop->addTimer(due > now ? due - now : Clock::Duration::zero(), [this]() { onTimer(); });
+}
+
+void FrameVoter::flush() {
+    if (!m_loop) return;
+
+    m_loop->cancelTimer(m_timer);
+    m_timer = 0;
+
+    Clock::TimePoint now = m_loop->getClock().now();
+    for (auto& entry : m_streams) {
+        for (Slot& slot : entry.second.slots) {
+            if (slot.state == SlotState::OPEN) {
+                decide(entry.second, slot, now);
+            }
+        }
+        release(entry.second, now);
+    }
+    m_streams.clear();
+}
+
+} // namespace op25gateway
@@ -0,0 +1,141 @@
+#ifndef FRAMEVOTER_H
+#define FRAMEVOTER_H
+
+#include "P25Utils.h"
+#include "Reactor.h"
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <tuple>
+
+#include <netinet/in.h>
+
+namespace op25gateway {
+
+// Called on the event loop with the copy of each frame that won its vote
+using VoterFrameCallback = std::function<void(const OP25Packet& packet)>;
+
+// One OP25 receiver feeding the voter, as published in the stats
+struct VoterSiteStats {
+    uint32_t address;           // IPv4, host byte order
+    uint16_t port;
+    uint64_t frames;            // Copies received
+    uint64_t wins;              // Forwarded
+    uint64_t losses;            // Outvoted by a better or earlier copy
+    uint64_t late;              // Arrived after the vote had closed, or the call had ended
+};
+
+// Diversity voter for several OP25 receivers (sites) covering one system
+//
+// Each sender address is a site. Copies of a frame are matched by NAC,
+// talkgroup, source and position in the LDU, and only the best one goes
+// on: the fewest errors OP25 reported in the frame, the earliest on a
+// tie. A vote closes as soon as every site delivering the call has
+// voted, and after the window at the latest, so a site that misses a
+// frame adds at most the window to it. Frames of a call leave in order.
+//
+// A site that misses three votes in a row is not waited for again until
+// it sends a copy within the window. One site costs no latency at all.
+//
+// A terminator is not voted on. The first copy closes the call's open
+// votes, goes on behind its last frames, and the other sites' copies are
+// dropped, as are voice frames of the call that arrive after it.
+class FrameVoter {
+public:
+    static constexpr size_t MAX_SITES = 16;        // With statistics; more vote as one
+
+    explicit FrameVoter(std::chrono::milliseconds window);
+    ~FrameVoter();
+
+    FrameVoter(const FrameVoter&) = delete;
+    FrameVoter& operator=(const FrameVoter&) = delete;
+
+    // Before the first submit()
+    void attach(Reactor& loop) { m_loop = &loop; }
+    void setLogName(const std::string& name) { m_logName = name; }
+    void setFrameCallback(VoterFrameCallback callback) { m_frameCallback = callback; }
+
+    // A frame from sender, on the event loop
+    void submit(const OP25Packet& packet, const struct sockaddr_in& sender);
+
+    // Close every open vote with the best copy so far and forward it (on
+    // stop and hot restart)
+    void flush();
+
+    std::chrono::milliseconds getWindow() const { return m_window; }
+
+    // Statistics (any thread)
+    size_t getSiteCount() const { return m_siteCount.load(std::memory_order_acquire); }
+    VoterSiteStats getSite(size_t index) const;
+    uint64_t getVotes() const { return m_votes; }
+    uint64_t getTimeouts() const { return m_timeouts; }  // Closed by the window, a site missing
+    uint32_t getHoldAvgUs() const;                        // First copy to vote closed
+    uint32_t getHoldMaxUs() const { return m_holdMaxUs; }
+
+private:
+    enum class SlotState { OPEN, DECIDED, SENT };
+
+    // One frame position of a call and the copies of it seen so far
+    struct Slot {
+        uint8_t frameType;
+        uint8_t voiceIndex;
+        SlotState state;
+        Clock::TimePoint opened;
+        uint32_t voters;                // Site bits
+        uint8_t bestSite;
+        OP25Packet best;
+    };
+
+    // One call: NAC, talkgroup, source
+    struct Stream {
+        std::deque<Slot> slots;         // Oldest first
+        uint32_t expected;              // Sites delivering this call
+        uint8_t misses[MAX_SITES + 1];  // Votes missed in a row
+    };
+
+    using StreamKey = std::tuple<uint16_t, uint32_t, uint32_t>;
+
+    struct Site {
+        uint32_t address;
+        uint16_t port;
+        std::atomic<uint64_t> frames;
+        std::atomic<uint64_t> wins;
+        std::atomic<uint64_t> losses;
+        std::atomic<uint64_t> late;
+    };
+
+    size_t findSite(const struct sockaddr_in& sender);
+    bool isTerminated(const OP25Packet& packet, Clock::TimePoint now) const;
+    void submitTerminator(const OP25Packet& packet, size_t site, Clock::TimePoint now);
+    void decide(Stream& stream, Slot& slot, Clock::TimePoint now);
+    void release(Stream& stream, Clock::TimePoint now);
+    void onTimer();
+    void scheduleTimer(Clock::TimePoint due);
+
+    std::chrono::milliseconds m_window;
+    std::string m_logName;
+    Reactor* m_loop;
+    VoterFrameCallback m_frameCallback;
+
+    std::map<StreamKey, Stream> m_streams;
+    Reactor::TimerId m_timer;
+    Clock::TimePoint m_timerDue;
+
+    // Sites past MAX_SITES share the last bit and have no statistics
+    Site m_sites[MAX_SITES];
+    std::atomic<size_t> m_siteCount;
+    bool m_sitesFullWarned;
+
+    std::atomic<uint64_t> m_votes;
+    std::atomic<uint64_t> m_timeouts;
+    std::atomic<uint64_t> m_holdTotalUs;
+    std::atomic<uint32_t> m_holdMaxUs;
+};
+
+} // namespace op25gateway
+
+#endif // FRAMEVOTER_H
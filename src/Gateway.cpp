@@ -0,0 +1,228 @@
+#include "Gateway.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace op25gateway {
+
+Gateway::Gateway(const std::string& configFile, const Config& config, Clock::TimePoint processStart)
+    : m_configFile(configFile)
+    , m_config(config)
+    , m_processStart(processStart)
+    , m_injection(false)
+    , m_listenUdp(true)
+    , m_handedOff(0)
+    , m_configReloader(new ConfigReloader(configFile, std::make_shared<const Config>(config)))
+    , m_reloaderRunning(false)
+{
+}
+
+Gateway::~Gateway() {
+    stop();
+}
+
+void Gateway::enableInjection(bool listenUdp) {
+    m_injection = true;
+    m_listenUdp = listenUdp;
+}
+
+bool Gateway::setup() {
+    // Event loops shared by all pipelines: by default one per CPU, but
+    // never more than there are pipelines to run on them
+    const std::vector<PipelineConfig>& pipelineConfigs = m_config.getPipelines();
+    size_t workerThreads = m_config.getWorkerThreads();
+    if (workerThreads == 0) {
+        workerThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workerThreads = std::min(workerThreads, pipelineConfigs.size());
+
+    // Locked before the event loops and pipelines are set up, so their
+    // stacks and buffer pools are faulted in as they are allocated
+    if (m_config.getRealtimeLockMemory()) {
+        lockMemory();
+    }
+
+    m_eventLoops.setThreadTuning(m_config.getEventLoopTuning());
+    m_eventLoops.setIoBackend(m_config.getIoBackend());
+    if (!m_eventLoops.start(workerThreads)) {
+        LOG_ERROR("Failed to start event loops");
+        return false;
+    }
+
+    for (size_t i = 0; i < pipelineConfigs.size(); i++) {
+        m_pipelines.emplace_back(new Pipeline(pipelineConfigs[i], static_cast<uint32_t>(i),
+                                              m_eventLoops.get(i), m_resolver, m_processStart));
+        m_pipelines.back()->setCallWorkerTuning(m_config.getCallWorkerTuning(), m_config.getIoBackend());
+        if (m_injection) {
+            m_pipelines.back()->enableInjection(m_listenUdp);
+        }
+    }
+    return true;
+}
+
+bool Gateway::startPipelines(bool takeover) {
+    // Start each pipeline on its own, so one that cannot start (port in
+    // use, takeover refused) does not keep the rest down. With --takeover
+    // each is taken over from the running gateway as it stands (call,
+    // partial LDU and FNE stream included), one at a time.
+    for (auto& pipeline : m_pipelines) {
+        std::string name = pipeline->getName().empty() ? "" : " " + pipeline->getName();
+
+        if (takeover) {
+            HotRestartClient takeoverClient;
+            Handoff handoff;
+            if (takeoverClient.request(pipeline->getPeerId(), handoff, std::chrono::seconds(5))) {
+                pipeline->adopt(handoff);
+                bool started = pipeline->start();
+                if (started && takeoverClient.confirm(true)) {
+                    LOG_INFO("HotRestart: Took over pipeline" + name + " from the previous process");
+                    m_running.push_back(pipeline.get());
+                    continue;
+                }
+
+                // Leave the sockets to the process that is still running
+                LOG_ERROR(started ? "HotRestart: The running gateway stopped waiting for pipeline" + name +
+                                    " and resumed it"
+                                  : "HotRestart: Failed to start pipeline" + name + ", leaving it running there");
+                Handoff abandoned;
+                pipeline->handOff(abandoned);
+                abandoned.closeSockets();
+                if (!started) takeoverClient.confirm(false);
+                continue;
+            } else if (!takeoverClient.isAbsent()) {
+                LOG_ERROR("HotRestart: " + takeoverClient.getError());
+                continue;
+            }
+            LOG_WARN("HotRestart: " + takeoverClient.getError() + ", starting normally");
+        }
+
+        if (!pipeline->start()) {
+            LOG_ERROR("Pipeline" + name + " failed to start");
+            pipeline->stop();
+            continue;
+        }
+        m_running.push_back(pipeline.get());
+    }
+
+    if (m_running.empty()) {
+        LOG_ERROR("No pipeline could be started");
+        return false;
+    }
+    return true;
+}
+
+void Gateway::openStats() {
+    // Shared-memory stats pages for external monitoring, one per pipeline
+    if (m_config.getStatsSharedMemory()) {
+        for (Pipeline* pipeline : m_running) {
+            pipeline->openStats();
+        }
+    }
+}
+
+void Gateway::startControl(HandedOffCallback onHandedOff) {
+    // Accept a takeover by a future process in turn, pipeline by pipeline;
+    // this process exits once it has handed over all of them
+    for (Pipeline* pipeline : m_running) {
+        m_restartServer.addPipeline(pipeline->getPeerId(),
+            [pipeline](Handoff& handoff) { return pipeline->handOff(handoff); },
+            [this, pipeline, onHandedOff](bool taken, Handoff& handoff) {
+                if (taken) {
+                    if (++m_handedOff == m_running.size() && onHandedOff) {
+                        onHandedOff();
+                    }
+                    return;
+                }
+
+                pipeline->adopt(handoff);
+                if (!pipeline->start()) {
+                    LOG_ERROR("HotRestart: Failed to resume pipeline " + pipeline->getName() +
+                              " after an aborted takeover");
+                    pipeline->stop();
+                }
+            });
+    }
+    m_restartServer.start();
+
+    // Config reload: live settings are applied under running calls, FNE
+    // address and credential changes log in again once the call ends, and
+    // the rest (including added or removed pipelines) waits for a restart
+    m_configReloader->setWatchFile(m_config.getWatchConfig());
+    m_configReloader->setApplyCallback([this](const Config& previous, const Config& current,
+                                              const std::vector<ConfigChange>& changes) {
+        applyConfig(previous, current, changes);
+    });
+    m_reloaderRunning = m_configReloader->start();
+}
+
+void Gateway::stopControl() {
+    m_reloaderRunning = false;
+    m_configReloader->stop();
+    m_restartServer.stop();
+}
+
+void Gateway::applyConfig(const Config& previous, const Config& current,
+                          const std::vector<ConfigChange>& changes) {
+    Logger::instance().setLevel(static_cast<LogLevel>(current.getLogLevel()));
+    if (current.getLogFile() != previous.getLogFile()) {
+        Logger::instance().setLogFile(current.getLogFile());
+    }
+
+    const std::vector<PipelineConfig>& currentPipelines = current.getPipelines();
+    for (size_t i = 0; i < currentPipelines.size(); i++) {
+        const PipelineConfig* before = previous.findPipeline(currentPipelines[i].getName());
+        if (!before) continue;
+
+        std::vector<ConfigChange> pipelineChanges;
+        for (const ConfigChange& change : changes) {
+            if (change.pipeline == static_cast<int>(i)) {
+                pipelineChanges.push_back(change);
+            }
+        }
+        for (auto& pipeline : m_pipelines) {
+            if (pipeline->getName() == currentPipelines[i].getName()) {
+                pipeline->reconfigure(*before, currentPipelines[i], pipelineChanges);
+            }
+        }
+    }
+}
+
+void Gateway::update(bool logStats) {
+    for (auto& pipeline : m_pipelines) {
+        pipeline->update(*m_configReloader, static_cast<uint32_t>(m_pipelines.size()),
+                         static_cast<uint32_t>(m_eventLoops.size()));
+    }
+
+    if (logStats) {
+        for (auto& pipeline : m_pipelines) {
+            pipeline->logStats();
+        }
+    }
+}
+
+void Gateway::stop() {
+    // Each pipeline stops its receiver, sends the last of its calls and
+    // disconnects from its FNE
+    for (auto& pipeline : m_pipelines) {
+        pipeline->stop();
+    }
+    m_eventLoops.stop();
+}
+
+bool Gateway::inject(size_t index, const OP25Packet& packet) {
+    return index < m_pipelines.size() && m_pipelines[index]->inject(packet);
+}
+
+uint32_t Gateway::getReceiverReadyMs() const {
+    uint32_t receiverReadyMs = 0;
+    for (Pipeline* pipeline : m_running) {
+        uint32_t readyMs = pipeline->getStartupTimes().receiverReadyMs;
+        if (receiverReadyMs == 0 || readyMs < receiverReadyMs) {
+            receiverReadyMs = readyMs;
+        }
+    }
+    return receiverReadyMs;
+}
+
+} // namespace op25gateway
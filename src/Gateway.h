@@ -0,0 +1,101 @@
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include "Config.h"
+#include "EventLoop.h"
+#include "Pipeline.h"
+#include "HotRestart.h"
+#include "ConfigReloader.h"
+#include "Resolver.h"
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <functional>
+
+namespace op25gateway {
+
+// Called once every running pipeline has been taken over by a new process
+using HandedOffCallback = std::function<void()>;
+
+// The gateway as configured by one config file: its event loops, its
+// pipelines, and the hot restart and config reload that act on them.
+// op25-gateway runs one from main(); libop25gateway runs one inside the
+// process that embeds it. Startup is split into steps so the caller can
+// time each.
+class Gateway {
+public:
+    Gateway(const std::string& configFile, const Config& config, Clock::TimePoint processStart);
+    ~Gateway();
+
+    Gateway(const Gateway&) = delete;
+    Gateway& operator=(const Gateway&) = delete;
+
+    // Take frames through inject() as well as, or instead of, each
+    // pipeline's OP25 UDP port (before setup())
+    void enableInjection(bool listenUdp);
+
+    // Lock memory if configured, start the event loops and create the
+    // pipelines
+    bool setup();
+
+    // Start each pipeline on its own; with takeover, each is taken over
+    // from the running gateway. False if none could start.
+    bool startPipelines(bool takeover);
+
+    // Shared-memory stats pages, if configured
+    void openStats();
+
+    // Accept a takeover by a later process, and reload the config on
+    // request or (if configured) when the file changes
+    void startControl(HandedOffCallback onHandedOff);
+    void stopControl();
+
+    // Once a second: milestones and stats pages, plus the log line when
+    // logStats is set
+    void update(bool logStats);
+
+    void stop();
+
+    // Frame for the index'th pipeline, from one producer thread per
+    // pipeline; false if refused
+    bool inject(size_t index, const OP25Packet& packet);
+
+    // Null until startControl() has it running
+    ConfigReloader* getConfigReloader() { return m_reloaderRunning ? m_configReloader.get() : nullptr; }
+
+    bool isHandedOff() const { return !m_running.empty() && m_handedOff == m_running.size(); }
+    size_t getPipelineCount() const { return m_pipelines.size(); }
+    size_t getRunningCount() const { return m_running.size(); }
+    size_t getThreadCount() const { return m_eventLoops.size(); }
+    Pipeline& getPipeline(size_t index) { return *m_pipelines[index]; }
+
+    // Earliest a running pipeline's OP25 receiver was ready, ms after
+    // process start
+    uint32_t getReceiverReadyMs() const;
+
+private:
+    void applyConfig(const Config& previous, const Config& current, const std::vector<ConfigChange>& changes);
+
+    std::string m_configFile;
+    Config m_config;
+    Clock::TimePoint m_processStart;
+    bool m_injection;
+    bool m_listenUdp;
+
+    EventLoopPool m_eventLoops;
+    Resolver m_resolver;
+    std::vector<std::unique_ptr<Pipeline>> m_pipelines;
+    std::vector<Pipeline*> m_running;
+
+    std::atomic<size_t> m_handedOff;
+    HotRestartServer m_restartServer;
+    std::unique_ptr<ConfigReloader> m_configReloader;
+    bool m_reloaderRunning;
+};
+
+} // namespace op25gateway
+
+#endif // GATEWAY_H
@@ -0,0 +1,460 @@
+#include "HotRestart.h"
+#include "Logger.h"
+
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <cstddef>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace op25gateway {
+
+namespace {
+
+constexpr std::chrono::milliseconds DEFAULT_CONFIRM_TIMEOUT(5000);
+constexpr std::chrono::milliseconds LISTEN_RETRY_INTERVAL(200);
+constexpr std::chrono::milliseconds REQUEST_TIMEOUT(1000);
+
+constexpr int MAX_HANDOFF_FDS = 1 + HANDOFF_MAX_SESSIONS;
+
+// New -> old: asks for the sockets
+struct TakeoverRequest {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;      // sizeof(HandoffState) the new process expects
+    uint32_t pid;
+};
+
+// Old -> new: state, sent with the descriptors in fdMask order
+// (bit 0 = OP25 socket, bit 1 + i = FNE session i)
+struct TakeoverReply {
+    uint32_t fdMask;
+    HandoffState state;
+};
+
+// New -> old: whether the new process took over
+struct TakeoverConfirm {
+    uint32_t magic;
+    uint32_t taken;
+};
+
+socklen_t abstractAddress(const std::string& name, struct sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    // Abstract namespace: leading NUL, nothing on the filesystem to go stale
+    size_t len = std::min(name.size(), sizeof(addr.sun_path) - 1);
+    std::memcpy(addr.sun_path + 1, name.data(), len);
+    return static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + 1 + len);
+}
+
+void setReceiveTimeout(int fd, std::chrono::milliseconds timeout) {
+    struct timeval tv;
+    tv.tv_sec = timeout.count() / 1000;
+    tv.tv_usec = (timeout.count() % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+} // namespace
+
+Handoff::Handoff()
+    : op25Socket(-1)
+{
+    std::memset(&state, 0, sizeof(state));
+    for (int& fd : fneSockets) {
+        fd = -1;
+    }
+}
+
+void Handoff::closeSockets() {
+    if (op25Socket >= 0) {
+        close(op25Socket);
+        op25Socket = -1;
+    }
+    for (int& fd : fneSockets) {
+        if (fd >= 0) {
+            Reactor::closeSocket(fd);   // An io_uring may still hold sends for it
+            fd = -1;
+        }
+    }
+}
+
+std::string takeoverSocketName(uint32_t peerId) {
+    return "op25-gateway-" + std::to_string(peerId) + ".takeover";
+}
+
+HotRestartServer::HotRestartServer(Clock& clock)
+    : m_clock(clock)
+    , m_reactor(clock)
+    , m_confirmTimeout(DEFAULT_CONFIRM_TIMEOUT)
+{
+}
+
+HotRestartServer::~HotRestartServer() {
+    stop();
+}
+
+void HotRestartServer::addPipeline(uint32_t peerId, HandoffProvider provider, HandoffResultCallback callback) {
+    if (m_thread.joinable()) return;
+
+    std::unique_ptr<Listener> listener(new Listener());
+    listener->peerId = peerId;
+    listener->name = takeoverSocketName(peerId);
+    listener->fd = -1;
+    listener->bindWarned = false;
+    listener->retryTimer = 0;
+    listener->provider = provider;
+    listener->resultCallback = callback;
+    m_listeners.push_back(std::move(listener));
+}
+
+bool HotRestartServer::start() {
+    if (m_thread.joinable()) return true;
+
+    if (!m_reactor.open()) {
+        return false;
+    }
+
+    m_thread = std::thread(&HotRestartServer::serverThread, this);
+    return true;
+}
+
+void HotRestartServer::stop() {
+    if (!m_thread.joinable()) return;
+
+    m_reactor.stop();
+    m_thread.join();
+    m_reactor.close();
+}
+
+void HotRestartServer::serverThread() {
+    for (auto& listener : m_listeners) {
+        tryListen(*listener);
+    }
+    m_reactor.run();
+
+    for (auto& listener : m_listeners) {
+        m_reactor.cancelTimer(listener->retryTimer);
+        closeListener(*listener);
+    }
+}
+
+void HotRestartServer::tryListen(Listener& listener) {
+    listener.retryTimer = 0;
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("HotRestart: Failed to create socket: " + std::string(strerror(errno)));
+        return;
+    }
+
+    struct sockaddr_un addr;
+    socklen_t addrLen = abstractAddress(listener.name, addr);
+    if (bind(fd, (const struct sockaddr*)&addr, addrLen) < 0 || listen(fd, 1) < 0) {
+        int err = errno;
+        close(fd);
+
+        if (err != EADDRINUSE) {
+            LOG_ERROR("HotRestart: Cannot listen on @" + listener.name + ": " + strerror(err));
+            return;
+        }
+
+        // The process we took over holds the name until it exits
+        if (!listener.bindWarned) {
+            LOG_INFO("HotRestart: Waiting for the previous process to release @" + listener.name);
+            listener.bindWarned = true;
+        }
+        listener.retryTimer = m_reactor.addTimer(LISTEN_RETRY_INTERVAL, [this, &listener]() {
+            tryListen(listener);
+        });
+        return;
+    }
+
+    listener.fd = fd;
+    m_reactor.addFd(fd, EPOLLIN, [this, &listener](uint32_t) { onRequest(listener); });
+    LOG_INFO("HotRestart: Accepting takeover on @" + listener.name);
+}
+
+void HotRestartServer::closeListener(Listener& listener) {
+    if (listener.fd < 0) return;
+
+    m_reactor.removeFd(listener.fd);
+    close(listener.fd);
+    listener.fd = -1;
+}
+
+void HotRestartServer::onRequest(Listener& listener) {
+    int conn = accept4(listener.fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn < 0) return;
+
+    // Abstract sockets have no file permissions; only the same user may
+    // take the gateway's sockets
+    struct ucred cred;
+    socklen_t credLen = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) < 0 ||
+        (cred.uid != getuid() && cred.uid != 0)) {
+        LOG_WARN("HotRestart: Refused takeover request from uid " + std::to_string(cred.uid));
+        close(conn);
+        return;
+    }
+
+    setReceiveTimeout(conn, REQUEST_TIMEOUT);
+
+    TakeoverRequest request;
+    ssize_t len = recv(conn, &request, sizeof(request), 0);
+    if (len != (ssize_t)sizeof(request) || request.magic != HANDOFF_MAGIC) {
+        LOG_WARN("HotRestart: Ignoring malformed takeover request");
+        close(conn);
+        return;
+    }
+
+    if (request.version != HANDOFF_VERSION || request.size != sizeof(HandoffState)) {
+        std::stringstream ss;
+        ss << "HotRestart: Refused takeover by pid " << request.pid << " (handoff version "
+           << request.version << "/" << request.size << " bytes, this build "
+           << HANDOFF_VERSION << "/" << sizeof(HandoffState) << ")";
+        LOG_WARN(ss.str());
+        close(conn);
+        return;
+    }
+
+    LOG_INFO("HotRestart: Handing off peer " + std::to_string(listener.peerId) +
+             " to pid " + std::to_string(request.pid));
+
+    // Forwarding is paused from here until the new process confirms
+    Clock::TimePoint frozenAt = m_clock.now();
+    Handoff handoff;
+    if (!listener.provider || !listener.provider(handoff)) {
+        LOG_WARN("HotRestart: Nothing to hand off");
+        close(conn);
+        return;
+    }
+
+    handoff.state.magic = HANDOFF_MAGIC;
+    handoff.state.version = HANDOFF_VERSION;
+    handoff.state.size = sizeof(HandoffState);
+    handoff.state.peerId = listener.peerId;
+
+    bool taken = exchange(conn, handoff);
+    close(conn);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(m_clock.now() - frozenAt).count();
+    if (taken) {
+        // Free the name for the new process, and drop our copies of the
+        // sockets so it alone owns them
+        closeListener(listener);
+        handoff.closeSockets();
+        LOG_INFO("HotRestart: Peer " + std::to_string(listener.peerId) + " taken over by pid " +
+                 std::to_string(request.pid) + " after " + std::to_string(elapsed) + " ms");
+    } else {
+        LOG_WARN("HotRestart: Takeover of peer " + std::to_string(listener.peerId) + " by pid " +
+                 std::to_string(request.pid) + " not confirmed, resuming");
+    }
+
+    if (listener.resultCallback) {
+        listener.resultCallback(taken, handoff);
+    }
+}
+
+bool HotRestartServer::exchange(int conn, Handoff& handoff) {
+    TakeoverReply reply;
+    std::memset(&reply, 0, sizeof(reply));
+    reply.state = handoff.state;
+
+    int fds[MAX_HANDOFF_FDS];
+    int fdCount = 0;
+    if (handoff.op25Socket >= 0) {
+        reply.fdMask |= 1;
+        fds[fdCount++] = handoff.op25Socket;
+    }
+    for (int i = 0; i < HANDOFF_MAX_SESSIONS; i++) {
+        if (handoff.fneSockets[i] >= 0) {
+            reply.fdMask |= 1u << (1 + i);
+            fds[fdCount++] = handoff.fneSockets[i];
+        }
+    }
+
+    struct iovec iov;
+    iov.iov_base = &reply;
+    iov.iov_len = sizeof(reply);
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+        struct cmsghdr align;
+    } control;
+    std::memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (fdCount > 0) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fdCount);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fdCount);
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fdCount);
+    }
+
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(reply)) {
+        LOG_ERROR("HotRestart: Failed to send handoff: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    // The new process confirms once it is forwarding
+    setReceiveTimeout(conn, m_confirmTimeout);
+
+    TakeoverConfirm confirm;
+    ssize_t len = recv(conn, &confirm, sizeof(confirm), 0);
+    return len == (ssize_t)sizeof(confirm) && confirm.magic == HANDOFF_MAGIC && confirm.taken;
+}
+
+HotRestartClient::HotRestartClient()
+    : m_conn(-1)
+    , m_absent(false)
+{
+}
+
+HotRestartClient::~HotRestartClient() {
+    if (m_conn >= 0) {
+        close(m_conn);
+    }
+}
+
+bool HotRestartClient::request(uint32_t peerId, Handoff& handoff, std::chrono::milliseconds timeout) {
+    m_absent = false;
+    m_error.clear();
+
+    m_conn = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (m_conn < 0) {
+        m_error = "Failed to create socket: " + std::string(strerror(errno));
+        return false;
+    }
+
+    struct sockaddr_un addr;
+    socklen_t addrLen = abstractAddress(takeoverSocketName(peerId), addr);
+    if (::connect(m_conn, (const struct sockaddr*)&addr, addrLen) < 0) {
+        m_absent = errno == ECONNREFUSED || errno == ENOENT;
+        m_error = "No gateway to take over for peer " + std::to_string(peerId) +
+                  " (" + strerror(errno) + ")";
+        close(m_conn);
+        m_conn = -1;
+        return false;
+    }
+
+    setReceiveTimeout(m_conn, timeout);
+
+    TakeoverRequest request;
+    request.magic = HANDOFF_MAGIC;
+    request.version = HANDOFF_VERSION;
+    request.size = sizeof(HandoffState);
+    request.pid = static_cast<uint32_t>(getpid());
+
+    if (send(m_conn, &request, sizeof(request), MSG_NOSIGNAL) != (ssize_t)sizeof(request)) {
+        m_error = "Failed to send request: " + std::string(strerror(errno));
+        return false;
+    }
+
+    TakeoverReply reply;
+    struct iovec iov;
+    iov.iov_base = &reply;
+    iov.iov_len = sizeof(reply);
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t len = recvmsg(m_conn, &msg, MSG_CMSG_CLOEXEC);
+
+    // Take ownership of whatever arrived before judging the reply
+    int fds[MAX_HANDOFF_FDS];
+    int fdCount = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int count = static_cast<int>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            for (int i = 0; i < count; i++) {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                if (fdCount < MAX_HANDOFF_FDS) {
+                    fds[fdCount++] = fd;
+                } else {
+                    close(fd);
+                }
+            }
+        }
+    }
+
+    bool ok = true;
+    if (len < 0) {
+        m_error = "No handoff from the running gateway: " + std::string(strerror(errno));
+        ok = false;
+    } else if (len == 0) {
+        m_error = "The running gateway refused the takeover (see its log)";
+        ok = false;
+    } else if (len != (ssize_t)sizeof(reply) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+               reply.state.magic != HANDOFF_MAGIC || reply.state.version != HANDOFF_VERSION ||
+               reply.state.size != sizeof(HandoffState)) {
+        m_error = "Malformed handoff from the running gateway";
+        ok = false;
+    }
+
+    // Descriptors arrive in fdMask bit order
+    int next = 0;
+    if (ok && (reply.fdMask & 1) && next < fdCount) {
+        handoff.op25Socket = fds[next++];
+    }
+    for (int i = 0; ok && i < HANDOFF_MAX_SESSIONS; i++) {
+        if ((reply.fdMask & (1u << (1 + i))) && next < fdCount) {
+            handoff.fneSockets[i] = fds[next++];
+        }
+    }
+    for (int i = next; i < fdCount; i++) {
+        close(fds[i]);
+    }
+
+    if (ok && handoff.op25Socket < 0) {
+        m_error = "Handoff carried no OP25 socket";
+        handoff.closeSockets();
+        ok = false;
+    }
+
+    if (!ok) {
+        close(m_conn);
+        m_conn = -1;
+        return false;
+    }
+
+    handoff.state = reply.state;
+    return true;
+}
+
+bool HotRestartClient::confirm(bool taken) {
+    if (m_conn < 0) return false;
+
+    TakeoverConfirm confirm;
+    confirm.magic = HANDOFF_MAGIC;
+    confirm.taken = taken ? 1 : 0;
+    bool sent = send(m_conn, &confirm, sizeof(confirm), MSG_NOSIGNAL) == (ssize_t)sizeof(confirm);
+
+    close(m_conn);
+    m_conn = -1;
+    return sent;
+}
+
+} // namespace op25gateway
@@ -0,0 +1,150 @@
+#ifndef HOTRESTART_H
+#define HOTRESTART_H
+
+#include "CallManager.h"
+#include "FNEClient.h"
+#include "Reactor.h"
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <functional>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace op25gateway {
+
+constexpr uint32_t HANDOFF_MAGIC = 0x4F503248;     // "OP2H"
+constexpr uint32_t HANDOFF_VERSION = 4;
+constexpr int HANDOFF_MAX_SESSIONS = 2;
+constexpr int HANDOFF_MAX_CALLS = HANDOFF_MAX_STREAMS;   // Any more are ended at handoff
+
+// Everything the new process needs besides the sockets themselves. Both
+// ends must be built from the same layout; version and size are checked.
+struct HandoffState {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t peerId;
+    uint32_t op25DropCounter;   // SO_RXQ_OVFL counter of the OP25 socket
+    int32_t activeSession;      // Hot standby: 0 = primary, 1 = secondary
+    uint8_t sessionCount;
+    uint8_t reserved[3];
+    CallTotals callTotals;
+    uint32_t callCount;         // Calls in progress
+    uint32_t reserved2;
+    CallHandoff calls[HANDOFF_MAX_CALLS];
+    FNESessionHandoff sessions[HANDOFF_MAX_SESSIONS];
+};
+
+// A handoff as seen by either process: the state plus the descriptors
+// that travel with it (-1 = none)
+struct Handoff {
+    HandoffState state;
+    int op25Socket;
+    int fneSockets[HANDOFF_MAX_SESSIONS];
+
+    Handoff();
+
+    // Close whichever descriptors this process still holds
+    void closeSockets();
+};
+
+// Abstract Unix socket name the running gateway listens on
+std::string takeoverSocketName(uint32_t peerId);
+
+// Freezes the pipeline and fills in the handoff; false to refuse
+using HandoffProvider = std::function<bool(Handoff& handoff)>;
+
+// Outcome of a handoff: taken = the new process confirmed and this one
+// should exit; otherwise the descriptors are still this process's and the
+// pipeline must be resumed from the handoff
+using HandoffResultCallback = std::function<void(bool taken, Handoff& handoff)>;
+
+// Old process side of a hot restart
+//
+// Listens for a replacement started with --takeover, on one name per
+// pipeline so each is handed over on its own. On request, the pipeline's
+// provider stops it where it stands; the OP25 and FNE sockets go over
+// with SCM_RIGHTS next to the state snapshot, and the new process
+// confirms once it is forwarding. If it does not confirm in time, the
+// pipeline resumes here, so a failed upgrade never takes the gateway down.
+class HotRestartServer {
+public:
+    explicit HotRestartServer(Clock& clock = Clock::system());
+    ~HotRestartServer();
+
+    HotRestartServer(const HotRestartServer&) = delete;
+    HotRestartServer& operator=(const HotRestartServer&) = delete;
+
+    // Offer a pipeline for takeover under its peer ID (before start())
+    void addPipeline(uint32_t peerId, HandoffProvider provider, HandoffResultCallback callback);
+
+    // How long the new process has to confirm
+    void setConfirmTimeout(std::chrono::milliseconds timeout) { m_confirmTimeout = timeout; }
+
+    // Start listening; while the previous owner of a name is still
+    // exiting, binding is retried in the background
+    bool start();
+    void stop();
+
+private:
+    struct Listener {
+        uint32_t peerId;
+        std::string name;
+        int fd;
+        bool bindWarned;
+        Reactor::TimerId retryTimer;
+        HandoffProvider provider;
+        HandoffResultCallback resultCallback;
+    };
+
+    void serverThread();
+    void tryListen(Listener& listener);
+    void onRequest(Listener& listener);
+    bool exchange(int conn, Handoff& handoff);
+    void closeListener(Listener& listener);
+
+    Clock& m_clock;
+    Reactor m_reactor;
+    std::chrono::milliseconds m_confirmTimeout;
+
+    // Requests are served one at a time, so each pipeline's handoff is
+    // confirmed before the next one starts
+    std::vector<std::unique_ptr<Listener>> m_listeners;
+
+    std::thread m_thread;
+};
+
+// New process side of a hot restart
+class HotRestartClient {
+public:
+    HotRestartClient();
+    ~HotRestartClient();
+
+    HotRestartClient(const HotRestartClient&) = delete;
+    HotRestartClient& operator=(const HotRestartClient&) = delete;
+
+    // Ask the running gateway for its sockets and state. Fails at once if
+    // nothing is listening (see isAbsent()).
+    bool request(uint32_t peerId, Handoff& handoff, std::chrono::milliseconds timeout);
+
+    // True if the last request failed because no gateway was running
+    bool isAbsent() const { return m_absent; }
+    const std::string& getError() const { return m_error; }
+
+    // Tell the old process whether this one took over (it exits) or not
+    // (it resumes) and close the connection. False if the old process
+    // was no longer waiting, i.e. it has resumed on its own.
+    bool confirm(bool taken);
+
+private:
+    int m_conn;
+    bool m_absent;
+    std::string m_error;
+};
+
+} // namespace op25gateway
+
+#endif // HOTRESTART_H
@@ -0,0 +1,503 @@
+#include "IoUring.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+
+// Multishot receive arrived with the 6.0 headers; older ones build the
+// epoll backend only
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+namespace op25gateway {
+
+#ifdef IORING_RECV_MULTISHOT
+
+namespace {
+
+constexpr unsigned RING_ENTRIES = 256;
+
+// What a completion's user_data refers to: the low byte is the kind, the
+// rest a buffer group or send slot
+constexpr uint64_t KIND_RECEIVE = 1;
+constexpr uint64_t KIND_SEND = 2;
+constexpr uint64_t KIND_CANCEL = 3;
+
+uint64_t userData(uint64_t kind, uint64_t id) {
+    return (id << 8) | kind;
+}
+
+size_t pageAlign(size_t bytes) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (bytes + page - 1) & ~(page - 1);
+}
+
+template <typename T>
+T* at(void* base, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+}
+
+} // namespace
+
+IoUring::IoUring()
+    : m_fd(-1)
+    , m_sqMap(nullptr)
+    , m_sqMapBytes(0)
+    , m_sqes(nullptr)
+    , m_sqesBytes(0)
+    , m_sqHead(nullptr)
+    , m_sqTail(nullptr)
+    , m_sqArray(nullptr)
+    , m_sqMask(0)
+    , m_sqEntries(0)
+    , m_sqLocalTail(0)
+    , m_sqSubmitted(0)
+    , m_cqMap(nullptr)
+    , m_cqMapBytes(0)
+    , m_cqes(nullptr)
+    , m_cqHead(nullptr)
+    , m_cqTail(nullptr)
+    , m_cqMask(0)
+    , m_enters(0)
+{
+}
+
+IoUring::~IoUring() {
+    close();
+}
+
+bool IoUring::open(std::string& error) {
+    if (m_fd >= 0) return true;
+
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+
+    m_fd = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+    if (m_fd < 0) {
+        error = errno == ENOSYS ? "not in this kernel"
+              : errno == EPERM ? "not permitted (kernel.io_uring_disabled or a seccomp filter)"
+              : strerror(errno);
+        return false;
+    }
+
+    // One mapping for both rings, and completions never dropped: 5.5 on
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || (params.features & IORING_FEAT_NODROP) == 0) {
+        error = "kernel too old";
+        close();
+        return false;
+    }
+
+    m_sqMapBytes = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+                                    params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+    m_sqMap = mmap(nullptr, m_sqMapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                   IORING_OFF_SQ_RING);
+    if (m_sqMap == MAP_FAILED) {
+        m_sqMap = nullptr;
+        error = strerror(errno);
+        close();
+        return false;
+    }
+    m_cqMap = m_sqMap;
+
+    m_sqesBytes = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        error = strerror(errno);
+        close();
+        return false;
+    }
+    m_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    m_sqHead = at<std::atomic<uint32_t>>(m_sqMap, params.sq_off.head);
+    m_sqTail = at<std::atomic<uint32_t>>(m_sqMap, params.sq_off.tail);
+    m_sqArray = at<uint32_t>(m_sqMap, params.sq_off.array);
+    m_sqMask = *at<uint32_t>(m_sqMap, params.sq_off.ring_mask);
+    m_sqEntries = *at<uint32_t>(m_sqMap, params.sq_off.ring_entries);
+    m_sqLocalTail = m_sqTail->load(std::memory_order_relaxed);
+    m_sqSubmitted = m_sqLocalTail;
+
+    m_cqHead = at<std::atomic<uint32_t>>(m_cqMap, params.cq_off.head);
+    m_cqTail = at<std::atomic<uint32_t>>(m_cqMap, params.cq_off.tail);
+    m_cqMask = *at<uint32_t>(m_cqMap, params.cq_off.ring_mask);
+    m_cqes = at<struct io_uring_cqe>(m_cqMap, params.cq_off.cqes);
+
+    // Operations this backend needs
+    std::vector<uint8_t> probeBuffer(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+    struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(probeBuffer.data());
+    if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        error = "cannot probe operations (" + std::string(strerror(errno)) + ")";
+        close();
+        return false;
+    }
+    for (uint8_t op : { IORING_OP_RECVMSG, IORING_OP_SEND, IORING_OP_ASYNC_CANCEL }) {
+        if (op > probe->last_op || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+            error = "kernel lacks operation " + std::to_string(op);
+            close();
+            return false;
+        }
+    }
+
+    m_sendSlots.resize(SEND_SLOTS);
+    m_freeSendSlots.clear();
+    for (uint32_t i = 0; i < SEND_SLOTS; i++) {
+        m_freeSendSlots.push_back(SEND_SLOTS - 1 - i);
+    }
+    return true;
+}
+
+void IoUring::close() {
+    for (auto& receive : m_receives) {
+        if (receive) {
+            freeReceive(*receive);
+        }
+    }
+    m_receives.clear();
+    m_sendSlots.clear();
+    m_freeSendSlots.clear();
+
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesBytes);
+        m_sqes = nullptr;
+    }
+    if (m_sqMap) {
+        munmap(m_sqMap, m_sqMapBytes);
+        m_sqMap = nullptr;
+        m_cqMap = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+struct io_uring_sqe* IoUring::getSqe() {
+    if (m_sqLocalTail - m_sqHead->load(std::memory_order_acquire) >= m_sqEntries) {
+        return nullptr;
+    }
+
+    uint32_t index = m_sqLocalTail & m_sqMask;
+    struct io_uring_sqe* sqe = &m_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[index] = index;
+    m_sqLocalTail++;
+    return sqe;
+}
+
+int IoUring::enter(unsigned submit, unsigned wait) {
+    if (submit > 0) {
+        m_sqTail->store(m_sqLocalTail, std::memory_order_release);
+    }
+
+    int ret = static_cast<int>(syscall(__NR_io_uring_enter, m_fd, submit, wait,
+                                       wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+    m_enters.store(m_enters.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (ret > 0) {
+        m_sqSubmitted += static_cast<uint32_t>(ret);
+    }
+    return ret;
+}
+
+void IoUring::flush() {
+    if (m_fd < 0) return;
+
+    unsigned pending = m_sqLocalTail - m_sqSubmitted;
+    if (pending > 0 && enter(pending, 0) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        LOG_WARN("IoUring: Submit failed: " + std::string(strerror(errno)));
+    }
+
+    // Sends on a socket with room complete during the submit
+    reap();
+}
+
+void IoUring::reap() {
+    if (m_fd < 0) return;
+
+    uint32_t head = m_cqHead->load(std::memory_order_relaxed);
+    while (head != m_cqTail->load(std::memory_order_acquire)) {
+        struct io_uring_cqe cqe = m_cqes[head & m_cqMask];
+
+        // Released before handling: a callback may stop a receive, which
+        // reaps again
+        m_cqHead->store(++head, std::memory_order_release);
+        handleCompletion(cqe);
+        head = m_cqHead->load(std::memory_order_relaxed);
+    }
+}
+
+void IoUring::handleCompletion(const struct io_uring_cqe& cqe) {
+    uint64_t kind = cqe.user_data & 0xFF;
+    uint64_t id = cqe.user_data >> 8;
+
+    if (kind == KIND_RECEIVE) {
+        if (id < m_receives.size() && m_receives[id]) {
+            handleReceive(*m_receives[id], cqe);
+        }
+    } else if (kind == KIND_SEND) {
+        if (id >= m_sendSlots.size()) return;
+
+        SendSlot& slot = m_sendSlots[id];
+        if (slot.status) {
+            std::atomic<uint64_t>& counter = cqe.res == static_cast<int32_t>(slot.len) ? slot.status->sent
+                                                                                       : slot.status->errors;
+            counter.fetch_add(1, std::memory_order_relaxed);
+            slot.status.reset();
+        }
+        m_freeSendSlots.push_back(static_cast<uint32_t>(id));
+    }
+}
+
+bool IoUring::startReceive(int fd, size_t controlSize, IoReceiveCallback callback, IoFallbackCallback fallback) {
+    if (m_fd < 0) return false;
+
+    size_t group = 0;
+    while (group < m_receives.size() && m_receives[group]) group++;
+    if (group > UINT16_MAX) return false;
+    if (group == m_receives.size()) m_receives.emplace_back();
+
+    std::unique_ptr<Receive> receive(new Receive());
+    receive->fd = fd;
+    receive->group = static_cast<uint16_t>(group);
+    receive->armed = false;
+    receive->running = false;
+    receive->stopping = false;
+    receive->callback = callback;
+    receive->fallback = fallback;
+
+    // Each buffer holds the recvmsg header, the sender, the control
+    // messages and the datagram
+    std::memset(&receive->msg, 0, sizeof(receive->msg));
+    receive->msg.msg_namelen = (sizeof(struct sockaddr_in6) + 7) & ~size_t(7);   // Control messages aligned
+    receive->msg.msg_controllen = controlSize;
+    if (sizeof(struct io_uring_recvmsg_out) + receive->msg.msg_namelen + controlSize + 256 > RECEIVE_BUFFER_SIZE) {
+        return false;
+    }
+    receive->buffers.resize(RECEIVE_BUFFERS * RECEIVE_BUFFER_SIZE);
+
+    receive->bufferRingBytes = pageAlign(RECEIVE_BUFFERS * sizeof(struct io_uring_buf));
+    void* ring = mmap(nullptr, receive->bufferRingBytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED) return false;
+    receive->bufferRing = static_cast<struct io_uring_buf_ring*>(ring);
+    receive->bufferRing->tail = 0;
+    for (uint16_t id = 0; id < RECEIVE_BUFFERS; id++) {
+        recycleBuffer(*receive, id);
+    }
+
+    // Provided buffer rings: 5.19 on
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = RECEIVE_BUFFERS;
+    reg.bgid = receive->group;
+    if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, receive->bufferRingBytes);
+        return false;
+    }
+
+    Receive& started = *receive;
+    m_receives[group] = std::move(receive);
+
+    // A kernel without multishot recvmsg (6.0) refuses it at once
+    if (!armReceive(started)) {
+        freeReceive(started);
+        return false;
+    }
+    flush();
+    if (!started.armed) {
+        freeReceive(started);
+        return false;
+    }
+    started.running = true;
+    return true;
+}
+
+bool IoUring::armReceive(Receive& receive) {
+    struct io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        flush();
+        sqe = getSqe();
+        if (!sqe) return false;
+    }
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = receive.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&receive.msg);
+    sqe->len = 0;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = receive.group;
+    sqe->user_data = userData(KIND_RECEIVE, receive.group);
+    receive.armed = true;
+    return true;
+}
+
+void IoUring::handleReceive(Receive& receive, const struct io_uring_cqe& cqe) {
+    if (cqe.res >= 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+        uint16_t id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        uint8_t* buffer = &receive.buffers[static_cast<size_t>(id) * RECEIVE_BUFFER_SIZE];
+        const struct io_uring_recvmsg_out* out = reinterpret_cast<const struct io_uring_recvmsg_out*>(buffer);
+
+        size_t headerLen = sizeof(*out) + receive.msg.msg_namelen + receive.msg.msg_controllen;
+        if (static_cast<size_t>(cqe.res) >= headerLen) {
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_name = buffer + sizeof(*out);
+            msg.msg_namelen = std::min<socklen_t>(out->namelen, receive.msg.msg_namelen);
+            msg.msg_control = out->controllen > 0 ? buffer + sizeof(*out) + receive.msg.msg_namelen : nullptr;
+            msg.msg_controllen = out->controllen;
+            msg.msg_flags = static_cast<int>(out->flags);
+
+            receive.callback(buffer + headerLen, cqe.res - headerLen, msg);
+        }
+        recycleBuffer(receive, id);
+    }
+
+    if (cqe.flags & IORING_CQE_F_MORE) return;
+
+    // The receive has ended
+    receive.armed = false;
+    if (receive.stopping) return;
+
+    // Out of buffers, or the completion queue overflowed: the rest waits
+    // in the socket until the receive is armed again
+    if (cqe.res >= 0 || cqe.res == -ENOBUFS) {
+        armReceive(receive);
+        return;
+    }
+
+    // Refused (no multishot recvmsg here) or failed: back to polling;
+    // startReceive() reports a refusal itself
+    if (!receive.running) return;
+    IoFallbackCallback fallback = receive.fallback;
+    freeReceive(receive);
+    if (fallback) {
+        fallback(-cqe.res);
+    }
+}
+
+void IoUring::recycleBuffer(Receive& receive, uint16_t id) {
+    struct io_uring_buf_ring* ring = receive.bufferRing;
+    uint16_t tail = ring->tail;
+
+    // Not ring->bufs: compiled as C++ the header's flexible array starts
+    // 8 bytes in. The entries start at the ring, the first one's reserved
+    // field holding the tail.
+    struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(ring) + (tail & (RECEIVE_BUFFERS - 1));
+    buf->addr = reinterpret_cast<uint64_t>(&receive.buffers[static_cast<size_t>(id) * RECEIVE_BUFFER_SIZE]);
+    buf->len = RECEIVE_BUFFER_SIZE;
+    buf->bid = id;
+    __atomic_store_n(&ring->tail, static_cast<uint16_t>(tail + 1), __ATOMIC_RELEASE);
+}
+
+void IoUring::stopReceive(int fd) {
+    Receive* receive = findReceive(fd);
+    if (!receive) return;
+
+    receive->stopping = true;
+    if (receive->armed) {
+        struct io_uring_sqe* sqe = getSqe();
+        if (!sqe) {
+            flush();
+            sqe = getSqe();
+        }
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = userData(KIND_RECEIVE, receive->group);
+            sqe->user_data = userData(KIND_CANCEL, 0);
+        }
+
+        // Until its last completion; what it took before goes to the callback
+        while (sqe && receive->armed) {
+            if (enter(m_sqLocalTail - m_sqSubmitted, 1) < 0 && errno != EINTR) {
+                LOG_WARN("IoUring: Cannot cancel receive: " + std::string(strerror(errno)));
+                break;
+            }
+            reap();
+        }
+    }
+    freeReceive(*receive);
+}
+
+IoUring::Receive* IoUring::findReceive(int fd) {
+    for (auto& receive : m_receives) {
+        if (receive && receive->fd == fd) return receive.get();
+    }
+    return nullptr;
+}
+
+void IoUring::freeReceive(Receive& receive) {
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.bgid = receive.group;
+    syscall(__NR_io_uring_register, m_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    munmap(receive.bufferRing, receive.bufferRingBytes);
+
+    // Last: receive is one of these
+    m_receives[receive.group].reset();
+}
+
+bool IoUring::queueSend(int fd, const void* data, size_t len, const std::shared_ptr<IoSendStatus>& status) {
+    if (m_fd < 0 || len > SEND_SLOT_SIZE) {
+        return false;
+    }
+
+    // Full: what is queued goes now, and its slots come back
+    if (m_freeSendSlots.empty() || m_sqLocalTail - m_sqHead->load(std::memory_order_acquire) >= m_sqEntries) {
+        flush();
+    }
+    struct io_uring_sqe* sqe = m_freeSendSlots.empty() ? nullptr : getSqe();
+    if (!sqe) {
+        return false;
+    }
+
+    uint32_t id = m_freeSendSlots.back();
+    m_freeSendSlots.pop_back();
+    SendSlot& slot = m_sendSlots[id];
+    std::memcpy(slot.data, data, len);
+    slot.len = static_cast<uint32_t>(len);
+    slot.status = status;
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(slot.data);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = userData(KIND_SEND, id);
+    return true;
+}
+
+#else
+
+IoUring::IoUring()
+    : m_fd(-1), m_sqMap(nullptr), m_sqMapBytes(0), m_sqes(nullptr), m_sqesBytes(0), m_sqHead(nullptr),
+      m_sqTail(nullptr), m_sqArray(nullptr), m_sqMask(0), m_sqEntries(0), m_sqLocalTail(0), m_sqSubmitted(0),
+      m_cqMap(nullptr), m_cqMapBytes(0), m_cqes(nullptr), m_cqHead(nullptr), m_cqTail(nullptr), m_cqMask(0),
+      m_enters(0) {}
+IoUring::~IoUring() {}
+
+bool IoUring::open(std::string& error) {
+    error = "not built in (kernel headers older than 6.0)";
+    return false;
+}
+
+void IoUring::close() {}
+bool IoUring::startReceive(int, size_t, IoReceiveCallback, IoFallbackCallback) { return false; }
+void IoUring::stopReceive(int) {}
+bool IoUring::queueSend(int, const void*, size_t, const std::shared_ptr<IoSendStatus>&) { return false; }
+void IoUring::flush() {}
+void IoUring::reap() {}
+
+#endif // IORING_RECV_MULTISHOT
+
+} // namespace op25gateway
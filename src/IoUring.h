@@ -0,0 +1,146 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace op25gateway {
+
+// Called for each datagram a multishot receive takes: msg has the
+// sender's address and the control messages, as recvmsg() would fill
+// them (its iovec is not used)
+using IoReceiveCallback = std::function<void(const uint8_t* data, size_t len, struct msghdr& msg)>;
+
+// Called once if the kernel refuses multishot receive after all; the
+// socket is the caller's to poll again
+using IoFallbackCallback = std::function<void(int error)>;
+
+// Results of the sends one owner queued; shared, as sends may complete
+// after the owner has gone
+struct IoSendStatus {
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+// io_uring for one event loop, through the raw system calls
+//
+// Receives: a multishot recvmsg per socket into a ring of provided
+// buffers, so a datagram reaches its callback without a system call of
+// its own. Sends: queued as they are made and submitted together, one
+// io_uring_enter per loop iteration however many there were.
+//
+// The loop polls fd() and calls reap() when it is readable and flush()
+// before it waits. Not thread-safe: everything but open() runs on the
+// loop thread.
+class IoUring {
+public:
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // False, with the reason in error, if the kernel has no io_uring (or
+    // it is disabled) or lacks the operations used here
+    bool open(std::string& error);
+    void close();
+    int fd() const { return m_fd; }
+
+    // Start receiving on a datagram socket; false if the kernel cannot
+    // (the caller polls the socket instead)
+    bool startReceive(int fd, size_t controlSize, IoReceiveCallback callback, IoFallbackCallback fallback);
+
+    // Cancel the receive and hand what it already took to its callback;
+    // datagrams not yet taken stay in the socket
+    void stopReceive(int fd);
+
+    // Queue a send of a copy of data, false if it will not fit (send it
+    // directly then). status counts the result.
+    bool queueSend(int fd, const void* data, size_t len, const std::shared_ptr<IoSendStatus>& status);
+
+    // Submit what is queued, then take what has completed
+    void flush();
+    void reap();
+
+    // io_uring_enter calls so far (any thread)
+    uint64_t getEnters() const { return m_enters; }
+
+private:
+    static constexpr size_t SEND_SLOT_SIZE = 512;
+    static constexpr size_t SEND_SLOTS = 256;
+    static constexpr size_t RECEIVE_BUFFER_SIZE = 512;
+    static constexpr size_t RECEIVE_BUFFERS = 256;
+
+    struct Receive {
+        int fd;
+        uint16_t group;                 // Provided buffer group
+        bool armed;                     // Multishot request in flight
+        bool running;                   // startReceive() succeeded
+        bool stopping;
+        struct msghdr msg;              // Name and control sizes for the kernel
+        io_uring_buf_ring* bufferRing;
+        size_t bufferRingBytes;
+        std::vector<uint8_t> buffers;
+        IoReceiveCallback callback;
+        IoFallbackCallback fallback;
+    };
+
+    struct SendSlot {
+        uint8_t data[SEND_SLOT_SIZE];
+        std::shared_ptr<IoSendStatus> status;
+        uint32_t len;
+    };
+
+    io_uring_sqe* getSqe();
+    int enter(unsigned submit, unsigned wait);
+    bool armReceive(Receive& receive);
+    void handleCompletion(const io_uring_cqe& cqe);
+    void handleReceive(Receive& receive, const io_uring_cqe& cqe);
+    void recycleBuffer(Receive& receive, uint16_t id);
+    Receive* findReceive(int fd);
+    void freeReceive(Receive& receive);
+
+    int m_fd;
+
+    // Submission queue
+    void* m_sqMap;
+    size_t m_sqMapBytes;
+    io_uring_sqe* m_sqes;
+    size_t m_sqesBytes;
+    std::atomic<uint32_t>* m_sqHead;
+    std::atomic<uint32_t>* m_sqTail;
+    uint32_t* m_sqArray;
+    uint32_t m_sqMask;
+    uint32_t m_sqEntries;
+    uint32_t m_sqLocalTail;
+    uint32_t m_sqSubmitted;
+
+    // Completion queue
+    void* m_cqMap;
+    size_t m_cqMapBytes;
+    io_uring_cqe* m_cqes;
+    std::atomic<uint32_t>* m_cqHead;
+    std::atomic<uint32_t>* m_cqTail;
+    uint32_t m_cqMask;
+
+    std::vector<std::unique_ptr<Receive>> m_receives;   // Indexed by buffer group
+    std::vector<SendSlot> m_sendSlots;
+    std::vector<uint32_t> m_freeSendSlots;
+
+    std::atomic<uint64_t> m_enters;
+};
+
+} // namespace op25gateway
+
+#endif // IOURING_H
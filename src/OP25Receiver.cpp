@@ -1,42 +1,156 @@
 #include "OP25Receiver.h"
+#include "IoUring.h"
 #include "Logger.h"
 
 #include <sstream>
 #include <cstring>
+#include <algorithm>
+#include <cerrno>
 
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <linux/sock_diag.h>
 
 namespace op25gateway {
 
+// Sample the socket queue occupancy every this many datagrams
+constexpr uint64_t QUEUE_SAMPLE_INTERVAL = 64;
+
+// Datagrams read per wakeup on a shared event loop
+constexpr int RECEIVE_BATCH = 64;
+
+// ...and at least this often while idle
+constexpr std::chrono::seconds QUEUE_SAMPLE_PERIOD(1);
+
 OP25Receiver::OP25Receiver(uint16_t port)
     : m_port(port)
+    , m_logName("OP25")
+    , m_loop(nullptr)
+    , m_sampleTimer(0)
     , m_socket(-1)
+    , m_wakeFd(-1)
     , m_running(false)
+    , m_uringReceive(false)
     , m_packetsReceived(0)
     , m_packetsInvalid(0)
+    , m_listenUdp(true)
+    , m_injectDoorbell(-1)
+    , m_injecting(false)
+    , m_injectDrops(0)
+    , m_requestedRcvBuf(0)
+    , m_lastKernelDropCounter(0)
+    , m_kernelDrops(0)
+    , m_kernelDropEvents(0)
+    , m_rcvBufSize(0)
+    , m_queueBytes(0)
+    , m_queuePeakBytes(0)
 {
 }
 
 OP25Receiver::~OP25Receiver() {
     stop();
+
+    // Kept open until now: a producer may still be ringing it
+    if (m_injectDoorbell >= 0) {
+        close(m_injectDoorbell);
+    }
+}
+
+void OP25Receiver::setInjection(size_t capacity, bool listenUdp) {
+    if (m_running) return;
+
+    m_injectQueue.reset(capacity);
+    m_listenUdp = listenUdp || capacity == 0;
+}
+
+void OP25Receiver::setShmRing(uint32_t peerId, uint32_t capacity) {
+    if (m_running) return;
+
+    if (capacity == 0) {
+        m_shmRing.reset();
+        return;
+    }
+
+    m_shmRing.reset(new ShmRingServer(peerId, capacity));
+    m_shmRing->setRecordCallback([this](const ShmRingRecord& record) {
+        OP25Packet packet;
+        packet.magic = OP25_MAGIC;
+        packet.nac = record.nac;
+        packet.talkgroup = record.talkgroup;
+        packet.sourceId = record.sourceId;
+        packet.frameType = record.frameType;
+        packet.voiceIndex = record.voiceIndex;
+        packet.flags = record.flags;
+        packet.errors = 0;
+        std::memcpy(packet.imbe, record.imbe, sizeof(packet.imbe));
+        deliver(packet);
+    });
+}
+
+void OP25Receiver::setVoteWindow(std::chrono::milliseconds window) {
+    if (m_running) return;
+
+    if (window.count() == 0) {
+        m_voter.reset();
+        return;
+    }
+
+    m_voter.reset(new FrameVoter(window));
+    m_voter->setFrameCallback([this](const OP25Packet& packet) { forward(packet); });
 }
 
 bool OP25Receiver::start() {
     if (m_running) return true;
 
-    // Create UDP socket
-    m_socket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (m_socket < 0) {
-        LOG_ERROR("OP25: Failed to create socket");
-        return false;
+    if (m_voter) {
+        if (!m_loop) {
+            LOG_ERROR(m_logName + ": Voting needs an event loop");
+            return false;
+        }
+        m_voter->attach(*m_loop);
+        m_voter->setLogName(m_logName);
     }
 
-    // Allow socket reuse
-    int opt = 1;
-    setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (m_shmRing) {
+        if (m_loop) {
+            m_shmRing->attach(*m_loop);
+        }
+        m_shmRing->setLogName(m_logName);
+        if (!m_shmRing->start()) {
+            return false;
+        }
+    }
+
+    if (!m_listenUdp) {
+        if (!startInjection()) {
+            return false;
+        }
+        m_running = true;
+        LOG_INFO(m_logName + ": Taking frames in-process (UDP port not bound)");
+        return true;
+    }
+
+    bool adopted = m_socket >= 0;
+    if (!adopted) {
+        // Create UDP socket
+        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_socket < 0) {
+            LOG_ERROR(m_logName + ": Failed to create socket");
+            return false;
+        }
+
+        // Allow socket reuse
+        int opt = 1;
+        setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        m_lastKernelDropCounter = 0;
+    }
+
+    configureSocketBuffers();
 
     // Bind to port
     struct sockaddr_in addr;
@@ -45,24 +159,100 @@ bool OP25Receiver::start() {
     addr.sin_addr.s_addr = INADDR_ANY;
     addr.sin_port = htons(m_port);
 
-    if (bind(m_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        LOG_ERROR("OP25: Failed to bind to port " + std::to_string(m_port));
+    if (!adopted && bind(m_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        LOG_ERROR(m_logName + ": Failed to bind to port " + std::to_string(m_port));
+        close(m_socket);
+        m_socket = -1;
+        return false;
+    }
+
+    if (m_injectQueue.capacity() > 0 && !startInjection()) {
         close(m_socket);
         m_socket = -1;
         return false;
     }
 
     m_running = true;
-    m_receiveThread = std::thread(&OP25Receiver::receiveLoop, this);
+    if (m_loop) {
+        m_loop->invoke([this]() {
+            watchSocket();
+            scheduleQueueSample();
+        });
+    } else {
+        // Wakes the receive thread for release()
+        m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        m_receiveThread = std::thread(&OP25Receiver::receiveLoop, this);
+    }
 
-    LOG_INFO("OP25: Listening on UDP port " + std::to_string(m_port));
+    LOG_INFO(m_logName + ": Listening on UDP port " + std::to_string(m_port) +
+             (adopted ? " (socket handed over)" : "") + (m_uringReceive ? " with io_uring" : "") +
+             (m_injectQueue.capacity() > 0 ? ", also taking frames in-process" : ""));
     return true;
 }
 
+bool OP25Receiver::startInjection() {
+    if (!m_loop) {
+        LOG_ERROR(m_logName + ": In-process frames need an event loop");
+        return false;
+    }
+
+    if (m_injectDoorbell < 0) {
+        m_injectDoorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_injectDoorbell < 0) {
+            LOG_ERROR(m_logName + ": Failed to create doorbell: " + std::string(strerror(errno)));
+            return false;
+        }
+    }
+
+    m_loop->invoke([this]() {
+        m_loop->addFd(m_injectDoorbell, EPOLLIN, [this](uint32_t) {
+            uint64_t count;
+            ssize_t ignored = read(m_injectDoorbell, &count, sizeof(count));
+            (void)ignored;
+            Reactor::noteSyscall();
+            drainInjected();
+        });
+    });
+    m_injecting.store(true, std::memory_order_release);
+    return true;
+}
+
+bool OP25Receiver::inject(const OP25Packet& packet) {
+    if (!m_injecting.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    bool wake;
+    if (!m_injectQueue.push(packet, wake)) {
+        m_injectDrops.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (wake) {
+        uint64_t one = 1;
+        ssize_t ignored = write(m_injectDoorbell, &one, sizeof(one));
+        (void)ignored;
+    }
+    return true;
+}
+
+void OP25Receiver::drainInjected() {
+    // All of it: the producer only rings again once the queue is empty
+    OP25Packet packet;
+    while (m_injectQueue.pop(packet)) {
+        deliver(packet);
+    }
+}
+
 void OP25Receiver::stop() {
     if (!m_running) return;
 
     m_running = false;
+    m_injecting = false;
+    detachFromLoop();
+    if (m_shmRing) {
+        m_shmRing->stop();
+    }
 
     if (m_socket >= 0) {
         shutdown(m_socket, SHUT_RDWR);
@@ -74,76 +264,329 @@ void OP25Receiver::stop() {
         m_receiveThread.join();
     }
 
-    LOG_INFO("OP25: Receiver stopped");
+    if (m_wakeFd >= 0) {
+        close(m_wakeFd);
+        m_wakeFd = -1;
+    }
+
+    LOG_INFO(m_logName + ": Receiver stopped");
 }
 
-void OP25Receiver::receiveLoop() {
-    uint8_t buffer[256];
-    struct sockaddr_in senderAddr;
-    socklen_t senderLen = sizeof(senderAddr);
+int OP25Receiver::release(uint32_t& kernelDropCounter) {
+    if (!m_running) return -1;
+
+    // No shutdown(): that would stop the socket for the new owner too
+    m_running = false;
+    m_injecting = false;
+    detachFromLoop();
+    if (m_shmRing) {
+        m_shmRing->stop();  // The producer connects to the new process
+    }
+    uint64_t one = 1;
+    if (m_wakeFd >= 0 && write(m_wakeFd, &one, sizeof(one)) < 0) {
+        LOG_WARN(m_logName + ": Failed to wake receive thread");
+    }
+
+    if (m_receiveThread.joinable()) {
+        m_receiveThread.join();
+    }
+
+    if (m_wakeFd >= 0) {
+        close(m_wakeFd);
+        m_wakeFd = -1;
+    }
+
+    int fd = m_socket;
+    m_socket = -1;
+    kernelDropCounter = m_lastKernelDropCounter;
+
+    LOG_INFO(m_logName + ": Receiver socket released");
+    return fd;
+}
+
+void OP25Receiver::detachFromLoop() {
+    if (!m_loop) return;
+
+    m_loop->invoke([this]() {
+        m_loop->cancelTimer(m_sampleTimer);
+        if (m_socket >= 0 && m_uringReceive) {
+            // What the kernel already took for us goes on to its call
+            m_loop->getIoUring()->stopReceive(m_socket);
+            m_uringReceive = false;
+        } else if (m_socket >= 0) {
+            m_loop->removeFd(m_socket);
+        }
+
+        // Frames already queued in-process go on to their calls
+        if (m_injectDoorbell >= 0) {
+            m_loop->removeFd(m_injectDoorbell);
+            drainInjected();
+        }
+
+        // So do those held for a vote
+        if (m_voter) {
+            m_voter->flush();
+        }
+    });
+}
+
+void OP25Receiver::watchSocket() {
+    IoUring* uring = m_loop->getIoUring();
+    if (uring) {
+        auto onDatagram = [this](const uint8_t* data, size_t len, struct msghdr& msg) {
+            handleDatagram(data, len, msg);
+        };
+        auto onFallback = [this](int error) {
+            LOG_WARN(m_logName + ": io_uring receive failed (" + std::string(strerror(error)) + "), polling instead");
+            m_uringReceive = false;
+            m_loop->addFd(m_socket, EPOLLIN, [this](uint32_t) { onReadable(); });
+        };
+        if (uring->startReceive(m_socket, CMSG_SPACE(sizeof(uint32_t)), onDatagram, onFallback)) {
+            m_uringReceive = true;
+            return;
+        }
+        LOG_WARN(m_logName + ": Kernel cannot receive with io_uring (multishot recvmsg and provided buffers "
+                 "need Linux 6.0), polling instead");
+    }
+
+    m_loop->addFd(m_socket, EPOLLIN, [this](uint32_t) { onReadable(); });
+}
+
+void OP25Receiver::scheduleQueueSample() {
+    m_sampleTimer = m_loop->addTimer(QUEUE_SAMPLE_PERIOD, [this]() {
+        sampleQueueOccupancy();
+        scheduleQueueSample();
+    });
+}
+
+void OP25Receiver::adoptSocket(int fd, uint32_t kernelDropCounter) {
+    if (m_running) return;
+
+    m_socket = fd;
+
+    // SO_RXQ_OVFL counts over the socket's lifetime, not this process's
+    m_lastKernelDropCounter = kernelDropCounter;
+}
+
+void OP25Receiver::configureSocketBuffers() {
+    if (m_requestedRcvBuf > 0) {
+        int size = static_cast<int>(m_requestedRcvBuf);
+
+        // SO_RCVBUF is capped by net.core.rmem_max; SO_RCVBUFFORCE is not,
+        // but needs CAP_NET_ADMIN
+        if (setsockopt(m_socket, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+            setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+    }
 
+    // The kernel reports twice the usable size to account for bookkeeping
+    int actual = 0;
+    socklen_t actualLen = sizeof(actual);
+    if (getsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &actual, &actualLen) == 0) {
+        m_rcvBufSize = static_cast<uint32_t>(actual);
+    }
+
+    if (m_requestedRcvBuf > 0 && m_rcvBufSize < m_requestedRcvBuf) {
+        std::stringstream ss;
+        ss << m_logName << ": Receive buffer is " << m_rcvBufSize << " bytes, requested "
+           << m_requestedRcvBuf << " (raise net.core.rmem_max or grant CAP_NET_ADMIN)";
+        LOG_WARN(ss.str());
+    } else {
+        LOG_INFO(m_logName + ": Receive buffer " + std::to_string(m_rcvBufSize) + " bytes");
+    }
+
+    // Ask for the socket's cumulative drop counter as ancillary data
+    int enable = 1;
+    if (setsockopt(m_socket, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)) < 0) {
+        LOG_WARN(m_logName + ": SO_RXQ_OVFL not supported, kernel drops will not be counted");
+    }
+
+    m_queueBytes = 0;
+    m_queuePeakBytes = 0;
+}
+
+void OP25Receiver::handleKernelDrops(uint32_t kernelCounter) {
+    // The counter is cumulative for the socket and may wrap
+    uint32_t dropped = kernelCounter - m_lastKernelDropCounter;
+    if (dropped == 0) return;
+
+    m_lastKernelDropCounter = kernelCounter;
+    m_kernelDrops += dropped;
+
+    if (m_kernelDropEvents++ % 100 == 0) {
+        std::stringstream ss;
+        ss << m_logName << ": Kernel dropped " << dropped << " datagrams (total " << m_kernelDrops
+           << ", queue peak " << m_queuePeakBytes << "/" << m_rcvBufSize << " bytes)";
+        LOG_WARN(ss.str());
+    }
+
+    if (m_dropCallback) {
+        m_dropCallback(dropped);
+    }
+}
+
+void OP25Receiver::sampleQueueOccupancy() {
+    uint32_t queued = 0;
+
+#ifdef SO_MEMINFO
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t len = sizeof(meminfo);
+    if (getsockopt(m_socket, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0) {
+        queued = meminfo[SK_MEMINFO_RMEM_ALLOC];
+    }
+#else
+    // Only the size of the next datagram, but better than nothing
+    int pending = 0;
+    if (ioctl(m_socket, FIONREAD, &pending) == 0) {
+        queued = static_cast<uint32_t>(pending);
+    }
+#endif
+
+    m_queueBytes = queued;
+    if (queued > m_queuePeakBytes) {
+        m_queuePeakBytes = queued;
+    }
+}
+
+void OP25Receiver::receiveLoop() {
     while (m_running) {
         fd_set fds;
         FD_ZERO(&fds);
         FD_SET(m_socket, &fds);
+        if (m_wakeFd >= 0) {
+            FD_SET(m_wakeFd, &fds);
+        }
 
         struct timeval tv;
         tv.tv_sec = 1;
         tv.tv_usec = 0;
 
-        int selectResult = select(m_socket + 1, &fds, nullptr, nullptr, &tv);
+        int selectResult = select(std::max(m_socket, m_wakeFd) + 1, &fds, nullptr, nullptr, &tv);
         if (selectResult < 0) {
             if (m_running) {
-                LOG_ERROR("OP25: Select error");
+                LOG_ERROR(m_logName + ": Select error");
             }
             break;
         }
 
         if (selectResult == 0) {
+            sampleQueueOccupancy();
             continue;  // Timeout, check if still running
         }
 
-        ssize_t len = recvfrom(m_socket, buffer, sizeof(buffer), 0,
-                                (struct sockaddr*)&senderAddr, &senderLen);
+        if (!m_running) {
+            break;     // Woken by release()
+        }
+
+        receiveDatagram(0);
+    }
+}
 
-        if (len <= 0) {
-            if (m_running) {
-                LOG_ERROR("OP25: Receive error");
-            }
-            continue;
+void OP25Receiver::onReadable() {
+    // A bounded batch per wakeup: other pipelines share the loop, and
+    // whatever is left makes the socket readable again
+    for (int i = 0; i < RECEIVE_BATCH && m_running; i++) {
+        if (!receiveDatagram(MSG_DONTWAIT)) break;
+    }
+}
+
+bool OP25Receiver::receiveDatagram(int flags) {
+    uint8_t buffer[256];
+    struct sockaddr_in senderAddr;
+    uint8_t control[CMSG_SPACE(sizeof(uint32_t))];
+
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &senderAddr;
+    msg.msg_namelen = sizeof(senderAddr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t len = recvmsg(m_socket, &msg, flags);
+    Reactor::noteSyscall();
+
+    if (len <= 0) {
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return false;
+        }
+        if (m_running) {
+            LOG_ERROR(m_logName + ": Receive error");
         }
+        return false;
+    }
 
-        // Parse the OP25 packet
-        OP25Packet packet;
-        if (!P25Utils::parseOP25Packet(buffer, len, packet)) {
-            m_packetsInvalid++;
+    handleDatagram(buffer, static_cast<size_t>(len), msg);
+    return true;
+}
 
-            if (m_packetsInvalid % 100 == 1) {
-                std::stringstream ss;
-                ss << "OP25: Invalid packet (len=" << len << ", total invalid=" << m_packetsInvalid << ")";
-                LOG_WARN(ss.str());
-            }
-            continue;
+void OP25Receiver::handleDatagram(const uint8_t* data, size_t len, struct msghdr& msg) {
+    // SO_RXQ_OVFL: only present once the socket has dropped something
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t kernelCounter;
+            std::memcpy(&kernelCounter, CMSG_DATA(cmsg), sizeof(kernelCounter));
+            handleKernelDrops(kernelCounter);
         }
+    }
 
-        m_packetsReceived++;
+    if ((m_packetsReceived + m_packetsInvalid) % QUEUE_SAMPLE_INTERVAL == 0) {
+        sampleQueueOccupancy();
+    }
 
-        // Debug logging for first few packets
-        if (m_packetsReceived <= 5 || m_packetsReceived % 1000 == 0) {
+    // Parse the OP25 packet
+    OP25Packet packet;
+    if (!P25Utils::parseOP25Packet(data, len, packet)) {
+        m_packetsInvalid++;
+
+        if (m_packetsInvalid % 100 == 1) {
             std::stringstream ss;
-            ss << "OP25: Received packet #" << m_packetsReceived
-               << " - NAC=0x" << std::hex << packet.nac << std::dec
-               << " TG=" << packet.talkgroup
-               << " SRC=" << packet.sourceId
-               << " Type=" << (int)packet.frameType
-               << " Index=" << (int)packet.voiceIndex;
-            LOG_DEBUG(ss.str());
+            ss << m_logName << ": Invalid packet (len=" << len << ", total invalid=" << m_packetsInvalid << ")";
+            LOG_WARN(ss.str());
         }
+        return;
+    }
 
-        // Invoke callback
-        if (m_frameCallback) {
-            m_frameCallback(packet);
-        }
+    const struct sockaddr_in* sender = nullptr;
+    if (msg.msg_name && msg.msg_namelen >= sizeof(struct sockaddr_in) &&
+        static_cast<const struct sockaddr*>(msg.msg_name)->sa_family == AF_INET) {
+        sender = static_cast<const struct sockaddr_in*>(msg.msg_name);
+    }
+    deliver(packet, sender);
+}
+
+void OP25Receiver::deliver(const OP25Packet& packet, const struct sockaddr_in* sender) {
+    m_packetsReceived++;
+
+    // Debug logging for first few packets
+    if (m_packetsReceived <= 5 || m_packetsReceived % 1000 == 0) {
+        std::stringstream ss;
+        ss << m_logName << ": Received packet #" << m_packetsReceived
+           << " - NAC=0x" << std::hex << packet.nac << std::dec
+           << " TG=" << packet.talkgroup
+           << " SRC=" << packet.sourceId
+           << " Type=" << (int)packet.frameType
+           << " Index=" << (int)packet.voiceIndex;
+        LOG_DEBUG(ss.str());
+    }
+
+    // UDP copies from several sites are voted on; in-process frames have
+    // one source
+    if (m_voter && sender) {
+        m_voter->submit(packet, *sender);
+        return;
+    }
+    forward(packet);
+}
+
+void OP25Receiver::forward(const OP25Packet& packet) {
+    if (m_frameCallback) {
+        m_frameCallback(packet);
     }
 }
 
@@ -2,18 +2,26 @@
 #define OP25RECEIVER_H
 
 #include "P25Utils.h"
+#include "Reactor.h"
+#include "SpscQueue.h"
+#include "ShmRingServer.h"
+#include "FrameVoter.h"
 
 #include <cstdint>
 #include <string>
 #include <atomic>
 #include <thread>
 #include <functional>
+#include <memory>
 
 namespace op25gateway {
 
 // Callback for received IMBE frames
 using OP25FrameCallback = std::function<void(const OP25Packet& packet)>;
 
+// Callback for datagrams the kernel dropped since the last notification
+using OP25DropCallback = std::function<void(uint32_t dropped)>;
+
 class OP25Receiver {
 public:
     OP25Receiver(uint16_t port);
@@ -22,28 +30,116 @@ public:
     OP25Receiver(const OP25Receiver&) = delete;
     OP25Receiver& operator=(const OP25Receiver&) = delete;
 
+    // Receive on a shared event loop instead of a thread of its own
+    // (before start())
+    void attach(Reactor& loop) { m_loop = &loop; }
+
+    // Prefix for log lines (default "OP25")
+    void setLogName(const std::string& name) { m_logName = name; }
+
     bool start();
     void stop();
     bool isRunning() const { return m_running; }
 
+    // Hot restart: stop receiving and give up the bound socket without
+    // closing it (-1 if not running). Datagrams arriving meanwhile wait in
+    // the socket queue for the new owner.
+    int release(uint32_t& kernelDropCounter);
+
+    // Use a socket released by another process instead of binding one;
+    // call before start()
+    void adoptSocket(int fd, uint32_t kernelDropCounter);
+
     void setFrameCallback(OP25FrameCallback callback) { m_frameCallback = callback; }
+    void setDropCallback(OP25DropCallback callback) { m_dropCallback = callback; }
+
+    // Requested SO_RCVBUF size in bytes (0 = kernel default), applied on start()
+    void setReceiveBufferSize(uint32_t bytes) { m_requestedRcvBuf = bytes; }
+
+    // In-process source (before start(), on an event loop only): frames
+    // handed to inject() by one producer thread, beside the UDP port or
+    // instead of it
+    void setInjection(size_t capacity, bool listenUdp);
+
+    // Shared-memory ring for an OP25 on the same host, beside the UDP port
+    // (before start(), on an event loop only; 0 records = none)
+    void setShmRing(uint32_t peerId, uint32_t capacity);
+    const ShmRingServer* getShmRing() const { return m_shmRing.get(); }
+
+    // Vote between copies of each frame from several OP25 senders, holding
+    // a frame up to window for the slower ones (before start(), on an event
+    // loop only; 0 = forward every datagram as it comes)
+    void setVoteWindow(std::chrono::milliseconds window);
+    const FrameVoter* getVoter() const { return m_voter.get(); }
+
+    // Producer side: queue a frame for the event loop, false if the queue
+    // is full or the receiver is not running. No syscall unless the loop
+    // has drained everything and needs waking.
+    bool inject(const OP25Packet& packet);
 
     // Statistics
     uint64_t getPacketsReceived() const { return m_packetsReceived; }
     uint64_t getPacketsInvalid() const { return m_packetsInvalid; }
+    uint64_t getInjectDrops() const { return m_injectDrops; }
+
+    // Datagrams come through the event loop's io_uring rather than recvmsg()
+    bool isUsingIoUring() const { return m_uringReceive; }
+
+    // Kernel socket statistics
+    uint64_t getKernelDrops() const { return m_kernelDrops; }
+    uint32_t getReceiveBufferSize() const { return m_rcvBufSize; }
+    uint32_t getQueueBytes() const { return m_queueBytes; }
+    uint32_t getQueuePeakBytes() const { return m_queuePeakBytes; }
 
 private:
     void receiveLoop();
+    void onReadable();
+    bool receiveDatagram(int flags);
+    void handleDatagram(const uint8_t* data, size_t len, struct msghdr& msg);
+    void watchSocket();
+    void deliver(const OP25Packet& packet, const struct sockaddr_in* sender = nullptr);
+    void forward(const OP25Packet& packet);
+    bool startInjection();
+    void drainInjected();
+    void detachFromLoop();
+    void scheduleQueueSample();
+    void configureSocketBuffers();
+    void handleKernelDrops(uint32_t kernelCounter);
+    void sampleQueueOccupancy();
 
     uint16_t m_port;
+    std::string m_logName;
+    Reactor* m_loop;
+    Reactor::TimerId m_sampleTimer;
     int m_socket;
+    int m_wakeFd;
     std::atomic<bool> m_running;
     std::thread m_receiveThread;
+    std::atomic<bool> m_uringReceive;
 
     OP25FrameCallback m_frameCallback;
+    OP25DropCallback m_dropCallback;
 
     std::atomic<uint64_t> m_packetsReceived;
     std::atomic<uint64_t> m_packetsInvalid;
+
+    // In-process source
+    bool m_listenUdp;
+    SpscQueue<OP25Packet> m_injectQueue;
+    int m_injectDoorbell;
+    std::atomic<bool> m_injecting;
+    std::atomic<uint64_t> m_injectDrops;
+    std::unique_ptr<ShmRingServer> m_shmRing;
+    std::unique_ptr<FrameVoter> m_voter;
+
+    // Kernel socket state
+    uint32_t m_requestedRcvBuf;
+    uint32_t m_lastKernelDropCounter;
+    std::atomic<uint64_t> m_kernelDrops;
+    uint64_t m_kernelDropEvents;
+    std::atomic<uint32_t> m_rcvBufSize;
+    std::atomic<uint32_t> m_queueBytes;
+    std::atomic<uint32_t> m_queuePeakBytes;
 };
 
 } // namespace op25gateway
@@ -1,4 +1,6 @@
 #include "P25Utils.h"
+#include "Trace.h"
+
 #include <cstring>
 #include <arpa/inet.h>
 
@@ -163,6 +165,7 @@ void P25Utils::encodeLC(uint8_t* rsEncoded, uint32_t srcId, uint32_t dstId) {
 void P25Utils::buildLDU1(uint8_t* buffer, const uint8_t imbe[9][IMBE_FRAME_SIZE],
                           uint32_t srcId, uint32_t dstId,
                           uint32_t wacn, uint16_t sysId, bool firstLDU) {
+    GW_TRACE3(ldu1_build_start, srcId, dstId, firstLDU);
     std::memset(buffer, 0x00, P25_LDU1_LENGTH);
 
     // P25 message header (24 bytes)
@@ -249,11 +252,14 @@ void P25Utils::buildLDU1(uint8_t* buffer, const uint8_t imbe[9][IMBE_FRAME_SIZE]
         buffer[180] = 0x01;  // HDU_VALID flag - signals new call
         buffer[181] = 0x80;  // Algorithm ID (0x80 = unencrypted)
     }
+
+    GW_TRACE2(ldu1_build_done, srcId, dstId);
 }
 
 void P25Utils::buildLDU2(uint8_t* buffer, const uint8_t imbe[9][IMBE_FRAME_SIZE],
                           uint32_t srcId, uint32_t dstId,
                           uint32_t wacn, uint16_t sysId) {
+    GW_TRACE2(ldu2_build_start, srcId, dstId);
     std::memset(buffer, 0x00, P25_LDU2_LENGTH);
 
     // P25 message header (24 bytes)
@@ -334,6 +340,8 @@ void P25Utils::buildLDU2(uint8_t* buffer, const uint8_t imbe[9][IMBE_FRAME_SIZE]
 
     // Frame type at byte 180
     buffer[180] = 0x00;  // DATA_UNIT
+
+    GW_TRACE2(ldu2_build_done, srcId, dstId);
 }
 
 void P25Utils::buildTDU(uint8_t* buffer, uint32_t srcId, uint32_t dstId,
@@ -349,13 +357,15 @@ void P25Utils::buildTDU(uint8_t* buffer, uint32_t srcId, uint32_t dstId,
 }
 
 bool P25Utils::parseOP25Packet(const uint8_t* data, size_t len, OP25Packet& packet) {
-    if (len < OP25_PACKET_SIZE) {
+    if (len < OP25_TERMINATOR_SIZE || (len < OP25_PACKET_SIZE && data[12] != OP25_FRAME_TDU)) {
+        GW_TRACE2(packet_reject, len, 0);
         return false;
     }
 
     // Check magic bytes
     packet.magic = ((uint16_t)data[0] << 8) | data[1];
     if (packet.magic != OP25_MAGIC) {
+        GW_TRACE2(packet_reject, len, packet.magic);
         return false;
     }
 
@@ -368,10 +378,16 @@ bool P25Utils::parseOP25Packet(const uint8_t* data, size_t len, OP25Packet& pack
     packet.frameType = data[12];
     packet.voiceIndex = data[13];
     packet.flags = data[14];
-    packet.reserved = data[15];
+    packet.errors = data[15];
 
-    std::memcpy(packet.imbe, data + 16, 11);
+    if (len >= OP25_PACKET_SIZE) {
+        std::memcpy(packet.imbe, data + 16, 11);
+    } else {
+        std::memset(packet.imbe, 0, sizeof(packet.imbe));
+    }
 
+    GW_TRACE5(packet_accept, packet.nac, packet.talkgroup, packet.sourceId,
+              packet.frameType, packet.voiceIndex);
     return true;
 }
 
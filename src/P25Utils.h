@@ -10,6 +10,11 @@ namespace op25gateway {
 // IMBE frame size
 constexpr size_t IMBE_FRAME_SIZE = 11;
 
+// IMBE voice frame that decodes to silence (fills an LDU cut short)
+constexpr uint8_t IMBE_SILENCE[IMBE_FRAME_SIZE] = {
+    0x04, 0x0C, 0xFD, 0x7B, 0xFB, 0x7D, 0xF2, 0x7B, 0x3D, 0x9E, 0x45
+};
+
 // P25 LDU sizes
 constexpr size_t P25_LDU1_LENGTH = 201;
 constexpr size_t P25_LDU2_LENGTH = 189;
@@ -28,6 +33,17 @@ constexpr uint8_t NET_FUNC_NAK       = 0x7F;
 constexpr uint8_t NET_SUBFUNC_NOP    = 0xFF;
 constexpr uint8_t NET_SUBFUNC_P25    = 0x01;
 
+// NAK reason codes (16-bit, payload offset 4)
+constexpr uint16_t NET_CONN_NAK_GENERAL_FAILURE     = 0;
+constexpr uint16_t NET_CONN_NAK_MODE_NOT_ENABLED    = 1;
+constexpr uint16_t NET_CONN_NAK_ILLEGAL_PACKET      = 2;
+constexpr uint16_t NET_CONN_NAK_FNE_UNAUTHORIZED    = 3;
+constexpr uint16_t NET_CONN_NAK_BAD_CONN_STATE      = 4;
+constexpr uint16_t NET_CONN_NAK_INVALID_CONFIG_DATA = 5;
+constexpr uint16_t NET_CONN_NAK_PEER_RESET          = 6;
+constexpr uint16_t NET_CONN_NAK_PEER_ACL            = 7;
+constexpr uint16_t NET_CONN_NAK_FNE_MAX_CONN        = 8;
+
 // P25 DUIDs
 constexpr uint8_t P25_DUID_LDU1 = 0x05;
 constexpr uint8_t P25_DUID_LDU2 = 0x0A;
@@ -52,6 +68,7 @@ constexpr uint16_t OP25_MAGIC = 0x4F50;  // "OP"
 // OP25 frame types
 constexpr uint8_t OP25_FRAME_LDU1 = 1;
 constexpr uint8_t OP25_FRAME_LDU2 = 2;
+constexpr uint8_t OP25_FRAME_TDU  = 3;   // OP25 saw a TDU or TDULC: the call has ended
 
 // OP25 packet structure (27 bytes)
 struct OP25Packet {
@@ -59,14 +76,15 @@ struct OP25Packet {
     uint16_t nac;           // NAC (big-endian)
     uint32_t talkgroup;     // Talkgroup ID (big-endian)
     uint32_t sourceId;      // Source Radio ID (big-endian)
-    uint8_t  frameType;     // 1=LDU1, 2=LDU2
+    uint8_t  frameType;     // 1=LDU1, 2=LDU2, 3=terminator
     uint8_t  voiceIndex;    // Voice Frame Index (0-8)
     uint8_t  flags;         // Bit 0: encrypted
-    uint8_t  reserved;
-    uint8_t  imbe[11];      // IMBE Frame Data
+    uint8_t  errors;        // Bit errors OP25 counted in the frame (0 = none or not reported)
+    uint8_t  imbe[11];      // IMBE Frame Data (not needed for a terminator)
 };
 
 constexpr size_t OP25_PACKET_SIZE = 27;
+constexpr size_t OP25_TERMINATOR_SIZE = 16;     // A terminator may leave out the IMBE frame
 
 class P25Utils {
 public:
@@ -101,7 +119,8 @@ public:
     static void buildTDU(uint8_t* buffer, uint32_t srcId, uint32_t dstId,
                          uint32_t wacn, uint16_t sysId, bool grantDemand);
 
-    // Parse OP25 packet
+    // Parse OP25 packet: a voice frame, or a terminator of at least
+    // OP25_TERMINATOR_SIZE bytes
     static bool parseOP25Packet(const uint8_t* data, size_t len, OP25Packet& packet);
 
     // Reed-Solomon encoding for LC
@@ -0,0 +1,384 @@
+#include "Pcap.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+namespace op25gateway {
+
+namespace {
+
+// libpcap file format constants
+constexpr uint32_t PCAP_MAGIC_US = 0xA1B2C3D4;
+constexpr uint32_t PCAP_MAGIC_NS = 0xA1B23C4D;
+constexpr uint32_t PCAPNG_MAGIC = 0x0A0D0D0A;
+constexpr size_t PCAP_FILE_HEADER_SIZE = 24;
+constexpr size_t PCAP_RECORD_HEADER_SIZE = 16;
+
+// Link types
+constexpr uint32_t LINKTYPE_NULL = 0;
+constexpr uint32_t LINKTYPE_ETHERNET = 1;
+constexpr uint32_t LINKTYPE_RAW_BSD = 12;
+constexpr uint32_t LINKTYPE_RAW = 101;
+constexpr uint32_t LINKTYPE_LOOP = 108;
+constexpr uint32_t LINKTYPE_LINUX_SLL = 113;
+constexpr uint32_t LINKTYPE_IPV4 = 228;
+constexpr uint32_t LINKTYPE_IPV6 = 229;
+constexpr uint32_t LINKTYPE_LINUX_SLL2 = 276;
+
+constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+constexpr uint16_t ETHERTYPE_IPV6 = 0x86DD;
+constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+constexpr uint16_t ETHERTYPE_QINQ = 0x88A8;
+
+constexpr uint8_t IPPROTO_UDP_NUM = 17;
+
+uint32_t swap32(uint32_t v) {
+    return ((v & 0xFF) << 24) | ((v & 0xFF00) << 8) | ((v >> 8) & 0xFF00) | (v >> 24);
+}
+
+uint16_t be16(const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+void putLE32(uint8_t* p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+void putLE16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+} // namespace
+
+PcapReader::PcapReader()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_offset(0)
+    , m_swapped(false)
+    , m_nanosecond(false)
+    , m_linkType(0)
+    , m_recordsRead(0)
+    , m_recordsSkipped(0)
+{
+}
+
+PcapReader::~PcapReader() {
+    close();
+}
+
+bool PcapReader::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        m_error = "cannot open " + path;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < PCAP_FILE_HEADER_SIZE) {
+        ::close(fd);
+        m_error = "file too short for a pcap header";
+        return false;
+    }
+
+    void* mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        m_error = "mmap failed";
+        return false;
+    }
+
+    madvise(mem, st.st_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const uint8_t*>(mem);
+    m_size = st.st_size;
+
+    uint32_t magic;
+    std::memcpy(&magic, m_data, sizeof(magic));
+
+    if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS) {
+        m_swapped = false;
+    } else if (swap32(magic) == PCAP_MAGIC_US || swap32(magic) == PCAP_MAGIC_NS) {
+        m_swapped = true;
+        magic = swap32(magic);
+    } else if (magic == PCAPNG_MAGIC) {
+        m_error = "pcapng is not supported, convert with: editcap -F pcap in.pcapng out.pcap";
+        close();
+        return false;
+    } else {
+        m_error = "not a pcap file";
+        close();
+        return false;
+    }
+
+    m_nanosecond = (magic == PCAP_MAGIC_NS);
+    m_linkType = read32(m_data + 20) & 0x0FFFFFFF;
+
+    switch (m_linkType) {
+        case LINKTYPE_NULL:
+        case LINKTYPE_ETHERNET:
+        case LINKTYPE_RAW_BSD:
+        case LINKTYPE_RAW:
+        case LINKTYPE_LOOP:
+        case LINKTYPE_LINUX_SLL:
+        case LINKTYPE_IPV4:
+        case LINKTYPE_IPV6:
+        case LINKTYPE_LINUX_SLL2:
+            break;
+        default:
+            m_error = "unsupported link type " + std::to_string(m_linkType);
+            close();
+            return false;
+    }
+
+    m_offset = PCAP_FILE_HEADER_SIZE;
+    m_recordsRead = 0;
+    m_recordsSkipped = 0;
+    return true;
+}
+
+void PcapReader::close() {
+    if (m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+        m_data = nullptr;
+    }
+    m_size = 0;
+    m_offset = 0;
+}
+
+void PcapReader::rewind() {
+    m_offset = PCAP_FILE_HEADER_SIZE;
+}
+
+uint32_t PcapReader::read32(const uint8_t* p) const {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return m_swapped ? swap32(v) : v;
+}
+
+uint16_t PcapReader::read16(const uint8_t* p) const {
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return m_swapped ? static_cast<uint16_t>((v >> 8) | (v << 8)) : v;
+}
+
+bool PcapReader::next(PcapDatagram& datagram) {
+    if (!m_data) return false;
+
+    while (m_offset + PCAP_RECORD_HEADER_SIZE <= m_size) {
+        const uint8_t* rec = m_data + m_offset;
+        uint32_t tsSec = read32(rec);
+        uint32_t tsFrac = read32(rec + 4);
+        uint32_t capLen = read32(rec + 8);
+
+        if (m_offset + PCAP_RECORD_HEADER_SIZE + capLen > m_size) {
+            break;  // Truncated final record
+        }
+
+        const uint8_t* frame = rec + PCAP_RECORD_HEADER_SIZE;
+        m_offset += PCAP_RECORD_HEADER_SIZE + capLen;
+        m_recordsRead++;
+
+        datagram.timestampNs = static_cast<int64_t>(tsSec) * 1000000000LL +
+                               (m_nanosecond ? tsFrac : static_cast<int64_t>(tsFrac) * 1000);
+
+        if (decodeFrame(frame, capLen, datagram)) {
+            return true;
+        }
+        m_recordsSkipped++;
+    }
+
+    return false;
+}
+
+bool PcapReader::decodeFrame(const uint8_t* frame, size_t len, PcapDatagram& datagram) const {
+    switch (m_linkType) {
+        case LINKTYPE_ETHERNET: {
+            if (len < 14) return false;
+            size_t offset = 12;
+            uint16_t etherType = be16(frame + offset);
+            while ((etherType == ETHERTYPE_VLAN || etherType == ETHERTYPE_QINQ) && len >= offset + 6) {
+                offset += 4;
+                etherType = be16(frame + offset);
+            }
+            offset += 2;
+            if (etherType != ETHERTYPE_IPV4 && etherType != ETHERTYPE_IPV6) return false;
+            return decodeIP(frame + offset, len - offset, datagram);
+        }
+        case LINKTYPE_LINUX_SLL:
+            if (len < 16) return false;
+            return decodeIP(frame + 16, len - 16, datagram);
+        case LINKTYPE_LINUX_SLL2:
+            if (len < 20) return false;
+            return decodeIP(frame + 20, len - 20, datagram);
+        case LINKTYPE_NULL:
+        case LINKTYPE_LOOP:
+            if (len < 4) return false;
+            return decodeIP(frame + 4, len - 4, datagram);
+        default:
+            return decodeIP(frame, len, datagram);
+    }
+}
+
+bool PcapReader::decodeIP(const uint8_t* ip, size_t len, PcapDatagram& datagram) const {
+    if (len < 1) return false;
+
+    const uint8_t* udp = nullptr;
+    size_t udpLen = 0;
+    uint8_t version = ip[0] >> 4;
+
+    if (version == 4) {
+        if (len < 20) return false;
+        size_t headerLen = (ip[0] & 0x0F) * 4;
+        size_t totalLen = be16(ip + 2);
+        if (headerLen < 20 || totalLen < headerLen || len < headerLen) return false;
+        if (ip[9] != IPPROTO_UDP_NUM) return false;
+
+        // Only the first fragment carries the UDP header
+        if ((be16(ip + 6) & 0x1FFF) != 0) return false;
+
+        std::memcpy(&datagram.srcAddr, ip + 12, 4);
+        std::memcpy(&datagram.dstAddr, ip + 16, 4);
+        udp = ip + headerLen;
+        udpLen = std::min(len, totalLen) - headerLen;
+    } else if (version == 6) {
+        // No extension header walking; OP25 traffic does not use them
+        if (len < 40 || ip[6] != IPPROTO_UDP_NUM) return false;
+        datagram.srcAddr = 0;
+        datagram.dstAddr = 0;
+        udp = ip + 40;
+        udpLen = std::min<size_t>(len - 40, be16(ip + 4));
+    } else {
+        return false;
+    }
+
+    if (udpLen < 8) return false;
+
+    size_t declared = be16(udp + 4);
+    if (declared < 8) return false;
+
+    datagram.srcPort = be16(udp);
+    datagram.dstPort = be16(udp + 2);
+    datagram.payload = udp + 8;
+    datagram.length = std::min(udpLen, declared) - 8;
+    return true;
+}
+
+PcapWriter::PcapWriter()
+    : m_file(nullptr)
+    , m_ipId(0)
+    , m_packetsWritten(0)
+{
+}
+
+PcapWriter::~PcapWriter() {
+    close();
+}
+
+bool PcapWriter::open(const std::string& path) {
+    close();
+
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        return false;
+    }
+
+    // Nanosecond-resolution, little-endian, raw IPv4
+    uint8_t header[PCAP_FILE_HEADER_SIZE];
+    putLE32(header, PCAP_MAGIC_NS);
+    putLE16(header + 4, 2);         // Version 2.4
+    putLE16(header + 6, 4);
+    putLE32(header + 8, 0);         // Timezone
+    putLE32(header + 12, 0);        // Sigfigs
+    putLE32(header + 16, 65535);    // Snaplen
+    putLE32(header + 20, LINKTYPE_RAW);
+
+    if (std::fwrite(header, sizeof(header), 1, m_file) != 1) {
+        close();
+        return false;
+    }
+
+    m_packetsWritten = 0;
+    return true;
+}
+
+void PcapWriter::close() {
+    if (m_file) {
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+bool PcapWriter::writeUDP(int64_t timestampNs, uint32_t srcAddr, uint16_t srcPort,
+                          uint32_t dstAddr, uint16_t dstPort, const uint8_t* data, size_t len) {
+    if (!m_file || len > 65535 - 28) return false;
+
+    uint8_t record[PCAP_RECORD_HEADER_SIZE + 28];
+    size_t packetLen = 28 + len;
+
+    putLE32(record, static_cast<uint32_t>(timestampNs / 1000000000LL));
+    putLE32(record + 4, static_cast<uint32_t>(timestampNs % 1000000000LL));
+    putLE32(record + 8, static_cast<uint32_t>(packetLen));
+    putLE32(record + 12, static_cast<uint32_t>(packetLen));
+
+    // IPv4 header
+    uint8_t* ip = record + PCAP_RECORD_HEADER_SIZE;
+    ip[0] = 0x45;
+    ip[1] = 0x00;
+    ip[2] = (packetLen >> 8) & 0xFF;
+    ip[3] = packetLen & 0xFF;
+    ip[4] = (m_ipId >> 8) & 0xFF;
+    ip[5] = m_ipId & 0xFF;
+    ip[6] = 0x40;   // Don't fragment
+    ip[7] = 0x00;
+    ip[8] = 64;     // TTL
+    ip[9] = IPPROTO_UDP_NUM;
+    ip[10] = 0x00;
+    ip[11] = 0x00;
+    std::memcpy(ip + 12, &srcAddr, 4);
+    std::memcpy(ip + 16, &dstAddr, 4);
+    m_ipId++;
+
+    uint32_t sum = 0;
+    for (int i = 0; i < 20; i += 2) {
+        sum += be16(ip + i);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    uint16_t checksum = static_cast<uint16_t>(~sum);
+    ip[10] = (checksum >> 8) & 0xFF;
+    ip[11] = checksum & 0xFF;
+
+    // UDP header (checksum 0 = not computed, valid for IPv4)
+    uint8_t* udp = ip + 20;
+    uint16_t udpLen = static_cast<uint16_t>(8 + len);
+    udp[0] = (srcPort >> 8) & 0xFF;
+    udp[1] = srcPort & 0xFF;
+    udp[2] = (dstPort >> 8) & 0xFF;
+    udp[3] = dstPort & 0xFF;
+    udp[4] = (udpLen >> 8) & 0xFF;
+    udp[5] = udpLen & 0xFF;
+    udp[6] = 0x00;
+    udp[7] = 0x00;
+
+    if (std::fwrite(record, sizeof(record), 1, m_file) != 1 ||
+        std::fwrite(data, len, 1, m_file) != 1) {
+        return false;
+    }
+
+    m_packetsWritten++;
+    return true;
+}
+
+} // namespace op25gateway
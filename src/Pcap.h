@@ -0,0 +1,94 @@
+#ifndef PCAP_H
+#define PCAP_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace op25gateway {
+
+// A UDP datagram extracted from a capture
+struct PcapDatagram {
+    int64_t timestampNs;    // Capture time, nanoseconds since the Unix epoch
+    uint32_t srcAddr;       // IPv4 source (network byte order, 0 for IPv6)
+    uint32_t dstAddr;       // IPv4 destination (network byte order, 0 for IPv6)
+    uint16_t srcPort;
+    uint16_t dstPort;
+    const uint8_t* payload;
+    size_t length;
+};
+
+// Reads UDP datagrams from a classic libpcap file without libpcap
+//
+// The file is memory-mapped and payload pointers refer into the mapping,
+// so they stay valid until close(). Handles microsecond and nanosecond
+// captures in either byte order, and Ethernet (incl. 802.1Q), Linux
+// cooked (SLL/SLL2), raw IP and BSD loopback link types.
+class PcapReader {
+public:
+    PcapReader();
+    ~PcapReader();
+
+    PcapReader(const PcapReader&) = delete;
+    PcapReader& operator=(const PcapReader&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    // Next UDP datagram, skipping anything else; false at end of file
+    bool next(PcapDatagram& datagram);
+
+    // Restart from the first record
+    void rewind();
+
+    const std::string& getError() const { return m_error; }
+    uint64_t getRecordsRead() const { return m_recordsRead; }
+    uint64_t getRecordsSkipped() const { return m_recordsSkipped; }
+
+private:
+    uint32_t read32(const uint8_t* p) const;
+    uint16_t read16(const uint8_t* p) const;
+    bool decodeFrame(const uint8_t* frame, size_t len, PcapDatagram& datagram) const;
+    bool decodeIP(const uint8_t* ip, size_t len, PcapDatagram& datagram) const;
+
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_offset;
+    bool m_swapped;
+    bool m_nanosecond;
+    uint32_t m_linkType;
+    std::string m_error;
+
+    uint64_t m_recordsRead;
+    uint64_t m_recordsSkipped;
+};
+
+// Writes UDP datagrams to a classic libpcap file (raw IPv4 link type)
+class PcapWriter {
+public:
+    PcapWriter();
+    ~PcapWriter();
+
+    PcapWriter(const PcapWriter&) = delete;
+    PcapWriter& operator=(const PcapWriter&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return m_file != nullptr; }
+
+    // Addresses in network byte order, ports in host byte order
+    bool writeUDP(int64_t timestampNs, uint32_t srcAddr, uint16_t srcPort,
+                  uint32_t dstAddr, uint16_t dstPort, const uint8_t* data, size_t len);
+
+    uint64_t getPacketsWritten() const { return m_packetsWritten; }
+
+private:
+    std::FILE* m_file;
+    uint16_t m_ipId;
+    uint64_t m_packetsWritten;
+};
+
+} // namespace op25gateway
+
+#endif // PCAP_H
@@ -0,0 +1,112 @@
+#include "PcapReplay.h"
+#include "P25Utils.h"
+
+#include <ctime>
+#include <cerrno>
+
+namespace op25gateway {
+
+namespace {
+
+// Sleep most of the way, then spin, so paced replay keeps the 20ms IMBE
+// cadence without scheduler wakeup jitter
+constexpr int64_t SPIN_NS = 200000;
+
+int64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+void waitUntil(int64_t deadlineNs, const std::atomic<bool>& running) {
+    int64_t sleepUntil = deadlineNs - SPIN_NS;
+    if (monotonicNs() < sleepUntil) {
+        struct timespec ts;
+        ts.tv_sec = sleepUntil / 1000000000LL;
+        ts.tv_nsec = sleepUntil % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+            if (!running) return;
+        }
+    }
+
+    while (monotonicNs() < deadlineNs) {
+        // Spin
+    }
+}
+
+} // namespace
+
+PcapReplay::PcapReplay()
+    : m_port(0)
+    , m_speed(1.0)
+    , m_loops(1)
+    , m_captureTimeNs(0)
+    , m_recordsRead(0)
+    , m_recordsSkipped(0)
+    , m_packetsReceived(0)
+    , m_packetsInvalid(0)
+    , m_captureDurationNs(0)
+    , m_elapsedNs(0)
+    , m_maxLatenessNs(0)
+{
+}
+
+bool PcapReplay::open(const std::string& path) {
+    return m_reader.open(path);
+}
+
+void PcapReplay::run(const std::atomic<bool>& running) {
+    bool paced = m_speed > 0.0;
+    int64_t startNs = monotonicNs();
+    int64_t loopOffsetNs = 0;
+    int64_t firstTs = -1;
+    int64_t lastTs = 0;
+
+    for (uint32_t loop = 0; loop < m_loops && running; loop++) {
+        m_reader.rewind();
+        int64_t loopFirstTs = -1;
+
+        PcapDatagram datagram;
+        while (running && m_reader.next(datagram)) {
+            if (m_port != 0 && datagram.dstPort != m_port) {
+                m_recordsSkipped++;
+                continue;
+            }
+
+            if (firstTs < 0) firstTs = datagram.timestampNs;
+            if (loopFirstTs < 0) loopFirstTs = datagram.timestampNs;
+
+            // Later passes continue the timeline rather than jumping back
+            int64_t ts = datagram.timestampNs - loopFirstTs + loopOffsetNs + firstTs;
+            lastTs = ts;
+            m_captureTimeNs = ts;
+
+            if (paced) {
+                int64_t due = startNs + static_cast<int64_t>((ts - firstTs) / m_speed);
+                waitUntil(due, running);
+                int64_t late = monotonicNs() - due;
+                if (late > m_maxLatenessNs) m_maxLatenessNs = late;
+            }
+
+            OP25Packet packet;
+            if (P25Utils::parseOP25Packet(datagram.payload, datagram.length, packet)) {
+                m_packetsReceived++;
+                if (m_frameCallback) {
+                    m_frameCallback(packet);
+                }
+            } else {
+                m_packetsInvalid++;
+            }
+        }
+
+        // Leave one 20ms frame interval between passes
+        loopOffsetNs = lastTs - firstTs + 20000000LL;
+    }
+
+    m_recordsRead = m_reader.getRecordsRead();
+    m_recordsSkipped += m_reader.getRecordsSkipped();
+    m_captureDurationNs = firstTs < 0 ? 0 : lastTs - firstTs;
+    m_elapsedNs = monotonicNs() - startNs;
+}
+
+} // namespace op25gateway
@@ -0,0 +1,68 @@
+#ifndef PCAPREPLAY_H
+#define PCAPREPLAY_H
+
+#include "Pcap.h"
+#include "OP25Receiver.h"
+
+#include <cstdint>
+#include <atomic>
+#include <string>
+
+namespace op25gateway {
+
+// Feeds OP25 datagrams from a capture file through the same parse and
+// frame callback path as OP25Receiver, either at the captured pace or as
+// fast as possible, so the gateway can be profiled without a radio
+class PcapReplay {
+public:
+    PcapReplay();
+
+    bool open(const std::string& path);
+    const std::string& getError() const { return m_reader.getError(); }
+
+    void setFrameCallback(OP25FrameCallback callback) { m_frameCallback = callback; }
+
+    // Only replay datagrams to this UDP port (0 = any)
+    void setPortFilter(uint16_t port) { m_port = port; }
+
+    // Pace to capture timestamps scaled by speed; speed <= 0 = as fast as possible
+    void setSpeed(double speed) { m_speed = speed; }
+
+    // Number of passes over the file
+    void setLoops(uint32_t loops) { m_loops = loops ? loops : 1; }
+
+    // Replay until end of file or running goes false
+    void run(const std::atomic<bool>& running);
+
+    // Capture timestamp of the datagram being processed (ns since epoch)
+    int64_t getCaptureTime() const { return m_captureTimeNs; }
+
+    // Statistics
+    uint64_t getRecordsRead() const { return m_recordsRead; }
+    uint64_t getRecordsSkipped() const { return m_recordsSkipped; }
+    uint64_t getPacketsReceived() const { return m_packetsReceived; }
+    uint64_t getPacketsInvalid() const { return m_packetsInvalid; }
+    int64_t getCaptureDurationNs() const { return m_captureDurationNs; }
+    int64_t getElapsedNs() const { return m_elapsedNs; }
+    int64_t getMaxLatenessNs() const { return m_maxLatenessNs; }
+
+private:
+    PcapReader m_reader;
+    OP25FrameCallback m_frameCallback;
+    uint16_t m_port;
+    double m_speed;
+    uint32_t m_loops;
+
+    std::atomic<int64_t> m_captureTimeNs;
+    uint64_t m_recordsRead;
+    uint64_t m_recordsSkipped;
+    uint64_t m_packetsReceived;
+    uint64_t m_packetsInvalid;
+    int64_t m_captureDurationNs;
+    int64_t m_elapsedNs;
+    int64_t m_maxLatenessNs;
+};
+
+} // namespace op25gateway
+
+#endif // PCAPREPLAY_H
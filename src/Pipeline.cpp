@@ -0,0 +1,547 @@
+#include "Pipeline.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+
+namespace op25gateway {
+
+namespace {
+
+// In-process frames queued for the event loop: a second of 80 channels
+constexpr size_t INJECT_QUEUE_CAPACITY = 4096;
+
+uint64_t toUnixMs(std::chrono::system_clock::time_point tp) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count();
+}
+
+uint32_t statsFneState(FNEState state) {
+    switch (state) {
+        case FNEState::CONNECTED:  return STATS_FNE_CONNECTED;
+        case FNEState::CONNECTING: return STATS_FNE_CONNECTING;
+        default:                   return STATS_FNE_DISCONNECTED;
+    }
+}
+
+// Applies the reloadable fne.* settings to a running session
+void reconfigureFneClient(FNEClient& client, const PipelineConfig& previous, const PipelineConfig& current) {
+    client.reconfigure(std::chrono::milliseconds(current.getFneLoginTimeout()),
+                       std::chrono::milliseconds(current.getFneBackoffInitial()),
+                       std::chrono::milliseconds(current.getFneBackoffMax()),
+                       std::chrono::milliseconds(current.getFnePingInterval()),
+                       current.getFneMaxMissedPongs());
+
+    // Resizing drops held voice, so only when it actually changed
+    if (current.getFneOutageBuffer() != previous.getFneOutageBuffer() ||
+        current.getFneReplaySpeed() != previous.getFneReplaySpeed()) {
+        client.setOutageBuffer(std::chrono::milliseconds(current.getFneOutageBuffer()),
+                               current.getFneReplaySpeed());
+    }
+}
+
+} // namespace
+
+void configureFneClient(FNEClient& client, const PipelineConfig& config) {
+    client.setIdentity("OP25-Gateway");
+    client.setLoginTimeout(std::chrono::milliseconds(config.getFneLoginTimeout()));
+    client.setPingInterval(std::chrono::milliseconds(config.getFnePingInterval()));
+    client.setMaxMissedPongs(config.getFneMaxMissedPongs());
+    client.setBackoff(std::chrono::milliseconds(config.getFneBackoffInitial()),
+                      std::chrono::milliseconds(config.getFneBackoffMax()));
+    client.setOutageBuffer(std::chrono::milliseconds(config.getFneOutageBuffer()),
+                           config.getFneReplaySpeed());
+}
+
+Pipeline::Pipeline(const PipelineConfig& config, uint32_t index, Reactor& loop, Resolver& resolver,
+                   Clock::TimePoint processStart, Clock& clock)
+    : m_config(config)
+    , m_index(index)
+    , m_loop(loop)
+    , m_clock(clock)
+    , m_processStart(processStart)
+    , m_fneClient(config.getFneHost(), config.getFnePort(), config.getFnePeerId(),
+                  config.getFnePassword(), clock)
+    , m_fneStandby(config.getFneSecondaryHost().empty() ? nullptr :
+                   new FNEClient(config.getFneSecondaryHost(), config.getFneSecondaryPort(),
+                                 config.getFnePeerId(), config.getFnePassword(), clock))
+    , m_fneFailover(m_fneStandby ? new FNEFailover(m_fneClient, *m_fneStandby, clock) : nullptr)
+    , m_callWorkers(m_fneFailover ? static_cast<VoiceSink&>(*m_fneFailover) : m_fneClient,
+                    config.getCallWorkers(), clock)
+    , m_op25Receiver(config.getOP25ListenPort())
+    , m_running(false)
+    , m_fneStartMs(0)
+    , m_firstFrameAt(Clock::Duration::zero())
+{
+    configureFneClient(m_fneClient, config);
+    m_fneClient.attach(loop, resolver);
+
+    // Optional hot standby: a second session kept logged in to the backup
+    // FNE, taking over voice when the primary is lost
+    if (m_fneStandby) {
+        configureFneClient(*m_fneStandby, config);
+        m_fneStandby->attach(loop, resolver);
+        m_fneClient.setLogName(logName("FNE1"));
+        m_fneStandby->setLogName(logName("FNE2"));
+    } else {
+        m_fneClient.setLogName(logName("FNE"));
+        m_fneClient.setConnectionCallback([this](bool connected) {
+            if (connected) {
+                LOG_INFO(logName("FNE") + ": Connection established (time to auth " +
+                         std::to_string(m_fneClient.getTimeToAuthMs()) + " ms)");
+            } else if (m_running) {     // Not when closing it at shutdown
+                LOG_WARN(logName("FNE") + ": Connection lost");
+            }
+        });
+    }
+
+    m_callWorkers.setLogName(logName("CallManager"));
+    m_callWorkers.setTalkgroupOverride(config.getGatewayTalkgroup());
+    m_callWorkers.setSourceIdOverride(config.getGatewaySourceId());
+    m_callWorkers.setCallTimeout(config.getCallTimeout());
+    m_callWorkers.attach(loop);
+
+    m_op25Receiver.setLogName(logName("OP25"));
+    m_op25Receiver.setReceiveBufferSize(config.getOP25ReceiveBuffer());
+    m_op25Receiver.setShmRing(config.getFnePeerId(), config.getOP25ShmRing());
+    m_op25Receiver.setVoteWindow(std::chrono::milliseconds(config.getOP25VoteWindow()));
+    m_op25Receiver.attach(loop);
+
+    m_op25Receiver.setFrameCallback([this](const OP25Packet& packet) {
+        if (m_firstFrameAt.load(std::memory_order_relaxed) == Clock::Duration::zero()) {
+            m_firstFrameAt = m_clock.now().time_since_epoch();
+        }
+        m_callWorkers.submit(packet);
+    });
+
+    // Attribute kernel socket drops to the calls in progress
+    m_op25Receiver.setDropCallback([this](uint32_t dropped) {
+        m_callWorkers.noteKernelDrops(dropped);
+    });
+}
+
+Pipeline::~Pipeline() {
+    stop();
+}
+
+std::string Pipeline::logName(const std::string& base) const {
+    return getName().empty() ? base : base + "[" + getName() + "]";
+}
+
+void Pipeline::setCallWorkerTuning(const ThreadTuning& tuning, IoBackend backend) {
+    m_callWorkers.setThreadTuning(getName().empty() ? "op25-call" : "op25-p" + std::to_string(m_index) + "-call",
+                                  tuning);
+    m_callWorkers.setIoBackend(backend);
+}
+
+void Pipeline::enableInjection(bool listenUdp) {
+    m_op25Receiver.setInjection(INJECT_QUEUE_CAPACITY, listenUdp);
+}
+
+bool Pipeline::start() {
+    // Nothing here waits on another step: the OP25 port is bound first so
+    // OP25 is never refused, the FNE session resolves and logs in on the
+    // event loop, and voice that arrives before it is up is held in the
+    // store-and-forward buffer as pre-roll
+    if (!m_callWorkers.start()) {
+        LOG_ERROR(logName("Pipeline") + ": Failed to start call workers");
+        return false;
+    }
+
+    if (!m_op25Receiver.start()) {
+        LOG_ERROR(logName("Pipeline") + ": Failed to start OP25 receiver");
+        return false;
+    }
+    if (m_startupTimes.receiverReadyMs == 0) {
+        m_startupTimes.receiverReadyMs = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(m_clock.now() - m_processStart).count());
+    }
+
+    Clock::TimePoint fneStart = m_clock.now();
+    if (!startFne()) {
+        LOG_ERROR(logName("Pipeline") + ": Failed to start FNE client");
+        return false;
+    }
+    if (m_fneStartMs == 0) {
+        m_fneStartMs = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(fneStart - m_processStart).count());
+    }
+
+    m_running = true;
+    return true;
+}
+
+bool Pipeline::startFne() {
+    return m_fneFailover ? m_fneFailover->start() : m_fneClient.start();
+}
+
+void Pipeline::stop() {
+    m_running = false;
+
+    // After a handoff these are all stopped already, and the call and
+    // sessions carry on in the new process
+    m_op25Receiver.stop();
+    m_callWorkers.stop();
+    if (m_fneFailover) {
+        m_fneFailover->stop();
+    }
+    m_fneClient.stop();
+    m_statsPublisher.close();
+}
+
+bool Pipeline::handOff(Handoff& handoff) {
+    FNEClient* sessions[HANDOFF_MAX_SESSIONS] = { &m_fneClient, m_fneStandby.get() };
+
+    m_running = false;
+    handoff.op25Socket = m_op25Receiver.release(handoff.state.op25DropCounter);
+
+    std::vector<CallHandoff> calls;
+    m_callWorkers.handOff(calls, handoff.state.callTotals);
+    for (const CallHandoff& call : calls) {
+        if (handoff.state.callCount < HANDOFF_MAX_CALLS) {
+            handoff.state.calls[handoff.state.callCount++] = call;
+        } else {
+            // No room to carry it over; end it cleanly while the session
+            // is still ours
+            LOG_WARN(logName("Pipeline") + ": Ending call src=" + std::to_string(call.srcId) +
+                     " dst=" + std::to_string(call.dstId) + ", too many calls to hand off");
+            m_callWorkers.sinkFor(call.nac, call.talkgroup).endStream(call.call, call.srcId, call.dstId);
+        }
+    }
+
+    if (m_fneFailover) {
+        handoff.state.activeSession = m_fneFailover->getActive();
+    }
+    for (int i = 0; i < HANDOFF_MAX_SESSIONS; i++) {
+        if (sessions[i] && sessions[i]->handOff(handoff.state.sessions[i], handoff.fneSockets[i])) {
+            handoff.state.sessionCount = i + 1;
+        }
+    }
+    if (m_fneFailover) {
+        m_fneFailover->stop();
+    }
+    return handoff.op25Socket >= 0;
+}
+
+void Pipeline::adopt(Handoff& handoff) {
+    FNEClient* sessions[HANDOFF_MAX_SESSIONS] = { &m_fneClient, m_fneStandby.get() };
+
+    m_op25Receiver.adoptSocket(handoff.op25Socket, handoff.state.op25DropCounter);
+    handoff.op25Socket = -1;
+
+    uint32_t callCount = std::min<uint32_t>(handoff.state.callCount, HANDOFF_MAX_CALLS);
+    std::vector<CallHandoff> calls(handoff.state.calls, handoff.state.calls + callCount);
+
+    // Sessions first, so a call this configuration cannot carry on is
+    // ended on the stream it was using
+    for (int i = 0; i < HANDOFF_MAX_SESSIONS; i++) {
+        if (sessions[i] && i < handoff.state.sessionCount) {
+            sessions[i]->adopt(handoff.state.sessions[i], handoff.fneSockets[i]);
+            handoff.fneSockets[i] = -1;
+        }
+    }
+    if (m_fneFailover) {
+        std::vector<uint32_t> callIds;
+        for (const CallHandoff& call : calls) {
+            callIds.push_back(call.call);
+        }
+        m_fneFailover->adopt(handoff.state.activeSession, callIds);
+    }
+    m_callWorkers.adopt(calls, handoff.state.callTotals);
+
+    // A session this configuration no longer has
+    handoff.closeSockets();
+}
+
+void Pipeline::reconfigure(const PipelineConfig& previous, const PipelineConfig& current,
+                           const std::vector<ConfigChange>& changes) {
+    m_callWorkers.setTalkgroupOverride(current.getGatewayTalkgroup());
+    m_callWorkers.setSourceIdOverride(current.getGatewaySourceId());
+    m_callWorkers.setCallTimeout(current.getCallTimeout());
+
+    reconfigureFneClient(m_fneClient, previous, current);
+    if (m_fneStandby) {
+        reconfigureFneClient(*m_fneStandby, previous, current);
+    }
+
+    bool relogin = false;
+    for (const ConfigChange& change : changes) {
+        relogin |= change.apply == ConfigApply::RELOGIN;
+    }
+    if (relogin) {
+        m_fneClient.changeLogin(current.getFneHost(), current.getFnePort(), current.getFnePassword());
+    }
+    if (m_fneStandby && current.getFnePassword() != previous.getFnePassword()) {
+        // The standby's address is only read at startup
+        m_fneStandby->changeLogin(m_config.getFneSecondaryHost(), m_config.getFneSecondaryPort(),
+                                  current.getFnePassword());
+    }
+}
+
+bool Pipeline::openStats() {
+    if (!m_statsPublisher.open(getPeerId())) {
+        LOG_WARN(logName("Stats") + ": Failed to create shared-memory stats page");
+        return false;
+    }
+
+    LOG_INFO(logName("Stats") + ": Publishing to /dev/shm" + statsPageName(getPeerId()));
+    return true;
+}
+
+void Pipeline::update(const ConfigReloader& configReloader, uint32_t pipelineCount, uint32_t workerThreads) {
+    if (!m_running) return;
+
+    updateMilestones();
+    publishStats(configReloader, pipelineCount, workerThreads);
+}
+
+void Pipeline::updateMilestones() {
+    auto sinceStartMs = [this](Clock::TimePoint t) -> uint32_t {
+        if (t == Clock::TimePoint()) return 0;
+        return static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(t - m_processStart).count());
+    };
+
+    // Startup milestones that happen in the background
+    if (m_startupTimes.fneReadyMs == 0) {
+        FNEClient* sessions[] = { &m_fneClient, m_fneStandby.get() };
+        for (FNEClient* session : sessions) {
+            if (session && session->getLoginCount() > 0) {
+                // Time to auth of the first login runs from start()
+                uint32_t readyMs = m_fneStartMs + session->getTimeToAuthMs();
+                if (m_startupTimes.fneReadyMs == 0 || readyMs < m_startupTimes.fneReadyMs) {
+                    m_startupTimes.fneReadyMs = readyMs;
+                }
+            }
+        }
+        if (m_startupTimes.fneReadyMs != 0) {
+            LOG_INFO(logName("Startup") + ": FNE logged in after " +
+                     std::to_string(m_startupTimes.fneReadyMs) + " ms");
+        }
+    }
+    if (m_startupTimes.firstForwardMs == 0) {
+        Clock::TimePoint firstVoice = m_fneClient.getFirstVoiceAt();
+        if (m_fneStandby && firstVoice == Clock::TimePoint()) {
+            firstVoice = m_fneStandby->getFirstVoiceAt();
+        }
+        if (firstVoice != Clock::TimePoint()) {
+            m_startupTimes.firstFrameMs = sinceStartMs(Clock::TimePoint(m_firstFrameAt.load()));
+            m_startupTimes.firstForwardMs = sinceStartMs(firstVoice);
+            LOG_INFO(logName("Startup") + ": first OP25 frame after " +
+                     std::to_string(m_startupTimes.firstFrameMs) + " ms, first LDU forwarded after " +
+                     std::to_string(m_startupTimes.firstForwardMs) + " ms");
+        }
+    }
+}
+
+void Pipeline::publishStats(const ConfigReloader& configReloader, uint32_t pipelineCount,
+                            uint32_t workerThreads) {
+    if (!m_statsPublisher.isOpen()) return;
+
+    StatsPageData data;
+    std::memset(&data, 0, sizeof(data));
+
+    std::strncpy(data.pipelineName, getName().c_str(), sizeof(data.pipelineName) - 1);
+    data.pipelineIndex = m_index;
+    data.pipelineCount = pipelineCount;
+    data.workerThreads = workerThreads;
+
+    data.configReloads = configReloader.getReloads();
+    data.configReloadsRejected = configReloader.getRejected();
+    data.configLastReloadMs = configReloader.getLastReloadMs();
+    data.configPendingRestart = configReloader.getPendingRestart();
+
+    data.startupReceiverReadyMs = m_startupTimes.receiverReadyMs;
+    data.startupFneReadyMs = m_startupTimes.fneReadyMs;
+    data.startupFirstFrameMs = m_startupTimes.firstFrameMs;
+    data.startupFirstForwardMs = m_startupTimes.firstForwardMs;
+
+    data.op25PacketsReceived = m_op25Receiver.getPacketsReceived();
+    data.op25PacketsInvalid = m_op25Receiver.getPacketsInvalid();
+    data.op25KernelDrops = m_op25Receiver.getKernelDrops();
+    data.op25RcvBufBytes = m_op25Receiver.getReceiveBufferSize();
+    data.op25QueueBytes = m_op25Receiver.getQueueBytes();
+    data.op25QueuePeakBytes = m_op25Receiver.getQueuePeakBytes();
+
+    if (const ShmRingServer* ring = m_op25Receiver.getShmRing()) {
+        data.op25RingCapacity = ring->getCapacity();
+        data.op25RingAttached = ring->isConnected() ? 1 : 0;
+        data.op25RingFrames = ring->getRecords();
+        data.op25RingDoorbells = ring->getDoorbells();
+        data.op25RingDrops = ring->getDrops();
+        data.op25RingConnects = ring->getConnects();
+    }
+
+    if (const FrameVoter* voter = m_op25Receiver.getVoter()) {
+        data.op25VoteWindowMs = static_cast<uint32_t>(voter->getWindow().count());
+        data.op25Votes = voter->getVotes();
+        data.op25VoteTimeouts = voter->getTimeouts();
+        data.op25VoteHoldAvgUs = voter->getHoldAvgUs();
+        data.op25VoteHoldMaxUs = voter->getHoldMaxUs();
+        for (size_t i = 0; i < voter->getSiteCount() && i < STATS_MAX_VOTER_SITES; i++) {
+            VoterSiteStats site = voter->getSite(i);
+            StatsVoterSite& entry = data.op25VoterSites[data.op25VoterSiteCount++];
+            entry.address = site.address;
+            entry.port = site.port;
+            entry.frames = site.frames;
+            entry.wins = site.wins;
+            entry.losses = site.losses;
+            entry.late = site.late;
+        }
+    }
+
+    data.callsTotal = m_callWorkers.getCallCount();
+    data.ldu1Total = m_callWorkers.getLDU1Count();
+    data.ldu2Total = m_callWorkers.getLDU2Count();
+    data.framesMissingTotal = m_callWorkers.getFramesMissing();
+    CallEndStats ends = m_callWorkers.getEndStats();
+    data.callsTerminated = ends.terminated;
+    data.callsTimedOut = ends.timedOut;
+    data.teardownTerminatedAvgUs = ends.terminated ? static_cast<uint32_t>(ends.terminatedTotalUs / ends.terminated) : 0;
+    data.teardownTerminatedMaxUs = ends.terminatedMaxUs;
+    data.teardownTimedOutAvgUs = ends.timedOut ? static_cast<uint32_t>(ends.timedOutTotalUs / ends.timedOut) : 0;
+    data.teardownTimedOutMaxUs = ends.timedOutMaxUs;
+    data.callWorkers = m_callWorkers.getWorkers();
+    data.callQueuePeak = m_callWorkers.getQueuePeak();
+    data.callQueueDrops = m_callWorkers.getQueueDrops();
+
+    const FNEClient& fneClient = m_fneClient;
+    data.fneState = statsFneState(fneClient.getState());
+    data.fnePeerId = fneClient.getPeerId();
+    data.fneFramesSent = fneClient.getFramesSent();
+    data.fneSendErrors = fneClient.getSendErrors();
+    data.fneLogins = fneClient.getLoginCount();
+    data.fneLoginAttempts = fneClient.getLoginAttempts();
+    data.fneLoginFailures = fneClient.getLoginFailures();
+    data.fneLastLoginMs = fneClient.getLastLoginMs();
+    data.fneTimeToAuthMs = fneClient.getTimeToAuthMs();
+    data.fneLinkLosses = fneClient.getLinkLosses();
+    data.fneNaksReceived = fneClient.getNaksReceived();
+    data.fneRecoveryMs = fneClient.getLastRecoveryMs();
+    data.fneMissedPongs = fneClient.getMissedPongs();
+    data.fneRttUs = fneClient.getLastRttUs();
+    data.fneSrttUs = fneClient.getSmoothedRttUs();
+    data.fneBufferLdus = fneClient.getBufferLDUs();
+    data.fneBufferPeakLdus = fneClient.getBufferPeakLDUs();
+    data.fneBufferCapacity = fneClient.getBufferCapacity();
+    data.fneBufferBudgetMs = fneClient.getBufferBudgetMs();
+    data.fneLdusBuffered = fneClient.getLDUsBuffered();
+    data.fneLdusReplayed = fneClient.getLDUsReplayed();
+    data.fneLdusDiscarded = fneClient.getLDUsDiscarded();
+    if (fneClient.isConnected()) {
+        data.fneConnectedSinceMs = toUnixMs(fneClient.getConnectedSince());
+    }
+
+    if (m_fneStandby && m_fneFailover) {
+        data.fneStandbyEnabled = 1;
+        data.fneActiveSession = m_fneFailover->getActive();
+        data.fneStandbyState = statsFneState(m_fneStandby->getState());
+        data.fneStandbyRttUs = m_fneStandby->getLastRttUs();
+        data.fneStandbyLogins = m_fneStandby->getLoginCount();
+        data.fneStandbyLinkLosses = m_fneStandby->getLinkLosses();
+        data.fneFailovers = m_fneFailover->getFailovers();
+        data.fneMidCallSwitches = m_fneFailover->getMidCallSwitches();
+        data.fneFailbacks = m_fneFailover->getFailbacks();
+        data.fneLastFailoverMs = m_fneFailover->getLastFailoverMs();
+    }
+
+    data.memoryLocked = isMemoryLocked() ? 1 : 0;
+    data.memoryLockedKb = lockedMemoryKb();
+    for (const ThreadReport& report : threadReports()) {
+        if (data.threadCount >= STATS_MAX_THREADS) break;
+
+        StatsThreadEntry& entry = data.threads[data.threadCount++];
+        std::strncpy(entry.name, report.name.c_str(), sizeof(entry.name) - 1);
+        entry.tid = static_cast<uint32_t>(report.tid);
+        entry.policy = static_cast<uint32_t>(report.policy);
+        entry.priority = static_cast<uint32_t>(report.priority);
+        entry.cpuMask = report.cpuMask;
+        entry.wakes = report.wake.wakes;
+        entry.wakeAvgUs = report.wake.wakes ? static_cast<uint32_t>(report.wake.totalNs / report.wake.wakes / 1000) : 0;
+        entry.wakeP99Us = static_cast<uint32_t>(report.wake.p99Ns / 1000);
+        entry.wakeMaxUs = static_cast<uint32_t>(report.wake.maxNs / 1000);
+        entry.voluntarySwitches = report.voluntarySwitches;
+        entry.involuntarySwitches = report.involuntarySwitches;
+        entry.ioUring = report.ioUring ? 1 : 0;
+        entry.syscalls = report.syscalls;
+    }
+
+    std::vector<CallInfo> calls = m_callWorkers.getActiveCalls();
+    data.callsActive = static_cast<uint32_t>(calls.size());
+    for (const auto& call : calls) {
+        if (data.activeCallCount >= STATS_MAX_CALLS) break;
+
+        StatsCallEntry& entry = data.calls[data.activeCallCount++];
+        entry.srcId = call.srcId;
+        entry.dstId = call.dstId;
+        entry.nac = call.nac;
+        entry.frames = call.frames;
+        entry.startTimeMs = toUnixMs(call.startTime);
+        entry.lastFrameTimeMs = toUnixMs(call.lastFrameTime);
+        entry.ldu1 = call.ldu1;
+        entry.ldu2 = call.ldu2;
+        entry.framesMissing = call.framesMissing;
+        entry.kernelDrops = call.kernelDrops;
+    }
+
+    m_statsPublisher.publish(data);
+}
+
+std::vector<ThreadReport> Pipeline::threadReports() const {
+    std::vector<const Reactor*> loops = m_callWorkers.getLoops();
+    loops.insert(loops.begin(), &m_loop);
+
+    std::vector<ThreadReport> reports;
+    for (const Reactor* loop : loops) {
+        ThreadReport report;
+        if (loop->getThreadId() == 0 || !readThreadReport(loop->getThreadId(), report)) continue;
+
+        report.wake = loop->getWakeLatency().snapshot();
+        report.ioUring = loop->getIoUring() != nullptr;
+        report.syscalls = loop->getSyscalls();
+        reports.push_back(report);
+    }
+    return reports;
+}
+
+void Pipeline::logStats() {
+    if (!m_running) return;
+
+    std::stringstream ss;
+    ss << logName("Stats") << ": OP25 packets=" << m_op25Receiver.getPacketsReceived()
+       << " drops=" << m_op25Receiver.getKernelDrops()
+       << " queuePeak=" << m_op25Receiver.getQueuePeakBytes()
+       << " injectDrops=" << m_op25Receiver.getInjectDrops()
+       << " calls=" << m_callWorkers.getCallCount()
+       << " LDU1=" << m_callWorkers.getLDU1Count()
+       << " LDU2=" << m_callWorkers.getLDU2Count()
+       << " FNE=" << (m_fneClient.isConnected() ? "connected" : "disconnected");
+    LOG_INFO(ss.str());
+
+    // Scheduling: how late each thread woke, and how often it was preempted
+    std::stringstream threads;
+    threads << logName("Stats") << ": Threads";
+    for (const ThreadReport& report : threadReports()) {
+        threads << " " << report.name
+                << " wakeP99=" << report.wake.p99Ns / 1000 << "us"
+                << " wakeMax=" << report.wake.maxNs / 1000 << "us"
+                << " involuntary=" << report.involuntarySwitches;
+    }
+    LOG_INFO(threads.str());
+}
+
+PipelineCounters Pipeline::getCounters() {
+    PipelineCounters counters;
+    counters.framesReceived = m_op25Receiver.getPacketsReceived();
+    counters.framesInvalid = m_op25Receiver.getPacketsInvalid();
+    counters.injectDrops = m_op25Receiver.getInjectDrops();
+    counters.calls = m_callWorkers.getCallCount();
+    counters.activeCalls = m_callWorkers.getActiveCallCount();
+    counters.ldu1 = m_callWorkers.getLDU1Count();
+    counters.ldu2 = m_callWorkers.getLDU2Count();
+    counters.framesMissing = m_callWorkers.getFramesMissing();
+    counters.fneConnected = m_fneClient.isConnected() || (m_fneStandby && m_fneStandby->isConnected());
+    return counters;
+}
+
+} // namespace op25gateway
@@ -0,0 +1,140 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "Config.h"
+#include "OP25Receiver.h"
+#include "FNEClient.h"
+#include "FNEFailover.h"
+#include "CallWorkers.h"
+#include "HotRestart.h"
+#include "ConfigReloader.h"
+#include "StatsPage.h"
+#include "Reactor.h"
+#include "Resolver.h"
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <vector>
+
+namespace op25gateway {
+
+// Startup milestones published to the stats page, ms after process start
+// (0 = not reached yet)
+struct StartupTimes {
+    uint32_t receiverReadyMs = 0;
+    uint32_t fneReadyMs = 0;
+    uint32_t firstFrameMs = 0;
+    uint32_t firstForwardMs = 0;
+};
+
+// Counters for an application embedding the gateway (libop25gateway)
+struct PipelineCounters {
+    uint64_t framesReceived;
+    uint64_t framesInvalid;
+    uint64_t injectDrops;       // In-process frames refused, queue full
+    uint64_t calls;
+    uint64_t activeCalls;
+    uint64_t ldu1;
+    uint64_t ldu2;
+    uint64_t framesMissing;
+    bool fneConnected;
+};
+
+// Applies the fne.* session settings shared by the primary and secondary
+void configureFneClient(FNEClient& client, const PipelineConfig& config);
+
+// One OP25 source forwarding to one FNE (plus an optional hot standby)
+//
+// A pipeline's receiver and FNE sessions run on the event loop it is
+// given, which it may share with other pipelines, and so do its calls
+// unless gateway.callWorkers gives them threads of their own. It shares
+// nothing else: sockets, call state, sessions, counters and the stats
+// page are its own, so one pipeline failing to start or losing its FNE
+// leaves the others running.
+class Pipeline {
+public:
+    Pipeline(const PipelineConfig& config, uint32_t index, Reactor& loop, Resolver& resolver,
+             Clock::TimePoint processStart, Clock& clock = Clock::system());
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    const std::string& getName() const { return m_config.getName(); }
+    uint32_t getPeerId() const { return m_config.getFnePeerId(); }
+
+    // CPU affinity, priority and socket I/O for the call worker threads
+    // (before start())
+    void setCallWorkerTuning(const ThreadTuning& tuning, IoBackend backend);
+
+    // Take frames through inject() as well as, or instead of, the OP25
+    // UDP port (before start())
+    void enableInjection(bool listenUdp);
+
+    // From one producer thread at a time; false if the frame was refused
+    bool inject(const OP25Packet& packet) { return m_op25Receiver.inject(packet); }
+
+    // Bind the OP25 port (unless adopted) and start the FNE session(s).
+    // On failure the pipeline is left as it stands for stop() or handOff().
+    bool start();
+    void stop();
+    bool isRunning() const { return m_running; }
+
+    // Hot restart: freeze the pipeline into a handoff, or carry on from
+    // one (before start())
+    bool handOff(Handoff& handoff);
+    void adopt(Handoff& handoff);
+
+    // Config reload: changes holds this pipeline's changed settings
+    void reconfigure(const PipelineConfig& previous, const PipelineConfig& current,
+                     const std::vector<ConfigChange>& changes);
+
+    // Shared-memory stats page under the pipeline's peer ID
+    bool openStats();
+
+    // Once a second: note startup milestones and publish the stats page
+    void update(const ConfigReloader& configReloader, uint32_t pipelineCount, uint32_t workerThreads);
+
+    // Counters for the periodic log line
+    void logStats();
+    PipelineCounters getCounters();
+
+    const StartupTimes& getStartupTimes() const { return m_startupTimes; }
+
+private:
+    bool startFne();
+    void updateMilestones();
+    void publishStats(const ConfigReloader& configReloader, uint32_t pipelineCount, uint32_t workerThreads);
+
+    // Scheduling reports for the pipeline's event loop and call workers
+    std::vector<ThreadReport> threadReports() const;
+
+    // Log prefix: base, tagged with the pipeline name if it has one
+    std::string logName(const std::string& base) const;
+
+    PipelineConfig m_config;    // As started; restart-only settings stay as they were
+    uint32_t m_index;
+    Reactor& m_loop;
+    Clock& m_clock;
+    Clock::TimePoint m_processStart;
+
+    FNEClient m_fneClient;
+    std::unique_ptr<FNEClient> m_fneStandby;
+    std::unique_ptr<FNEFailover> m_fneFailover;
+    CallWorkers m_callWorkers;
+    OP25Receiver m_op25Receiver;
+    StatsPublisher m_statsPublisher;
+
+    std::atomic<bool> m_running;
+
+    // Startup milestones
+    StartupTimes m_startupTimes;
+    uint32_t m_fneStartMs;
+    std::atomic<Clock::Duration> m_firstFrameAt;
+};
+
+} // namespace op25gateway
+
+#endif // PIPELINE_H
@@ -0,0 +1,383 @@
+#include "Reactor.h"
+#include "IoUring.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <future>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace op25gateway {
+
+namespace {
+
+constexpr int MAX_EVENTS = 32;
+
+thread_local Reactor* t_current = nullptr;
+
+// Running loops with an io_uring, for closeSocket()
+std::mutex g_uringLoopsMutex;
+std::vector<Reactor*> g_uringLoops;
+
+std::atomic<bool> g_uringWarned(false);
+
+} // namespace
+
+Reactor::Reactor(Clock& clock)
+    : m_clock(clock)
+    , m_backend(IoBackend::EPOLL)
+    , m_syscalls(0)
+    , m_epoll(-1)
+    , m_wakeFd(-1)
+    , m_running(false)
+    , m_threadId(0)
+    , m_nextTimerId(1)
+    , m_postsRun(false)
+{
+}
+
+Reactor::~Reactor() {
+    close();
+}
+
+bool Reactor::open() {
+    if (m_epoll >= 0) return true;
+
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll < 0) {
+        LOG_ERROR("Reactor: epoll_create1 failed: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd < 0) {
+        LOG_ERROR("Reactor: eventfd failed: " + std::string(strerror(errno)));
+        close();
+        return false;
+    }
+
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakeFd;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeFd, &ev);
+
+    if (m_backend == IoBackend::IO_URING) {
+        openIoUring();
+    }
+
+    // Armed here rather than in run(), so a stop() that comes before the
+    // loop thread gets to run() is not lost
+    m_running = true;
+    m_loopThread = std::this_thread::get_id();
+    return true;
+}
+
+void Reactor::openIoUring() {
+    std::unique_ptr<IoUring> uring(new IoUring());
+    std::string error;
+    if (!uring->open(error)) {
+        if (!g_uringWarned.exchange(true)) {
+            LOG_WARN("Reactor: io_uring unavailable (" + error + "), using epoll");
+        }
+        return;
+    }
+
+    // Readable while completions wait
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = uring->fd();
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, uring->fd(), &ev) < 0) {
+        LOG_WARN("Reactor: Cannot poll io_uring (" + std::string(strerror(errno)) + "), using epoll");
+        return;
+    }
+    m_uring = std::move(uring);
+}
+
+void Reactor::close() {
+    m_uring.reset();
+    if (m_wakeFd >= 0) {
+        ::close(m_wakeFd);
+        m_wakeFd = -1;
+    }
+    if (m_epoll >= 0) {
+        ::close(m_epoll);
+        m_epoll = -1;
+    }
+    m_fds.clear();
+    m_timers.clear();
+    m_timerIndex.clear();
+}
+
+bool Reactor::addFd(int fd, uint32_t events, FdCallback callback) {
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    int op = m_fds.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(m_epoll, op, fd, &ev) < 0) {
+        LOG_ERROR("Reactor: epoll_ctl failed: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    m_fds[fd] = std::move(callback);
+    return true;
+}
+
+void Reactor::removeFd(int fd) {
+    if (m_fds.erase(fd)) {
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+Reactor::TimerId Reactor::addTimer(Clock::Duration delay, Callback callback) {
+    TimerId id = m_nextTimerId++;
+    auto it = m_timers.emplace(m_clock.now() + delay, Timer{id, std::move(callback)});
+    m_timerIndex[id] = it;
+    return id;
+}
+
+void Reactor::cancelTimer(TimerId& id) {
+    auto it = m_timerIndex.find(id);
+    if (it != m_timerIndex.end()) {
+        m_timers.erase(it->second);
+        m_timerIndex.erase(it);
+    }
+    id = 0;
+}
+
+void Reactor::post(Callback callback) {
+    {
+        std::lock_guard<std::mutex> lock(m_postMutex);
+        m_posted.push_back(std::move(callback));
+    }
+    wake();
+}
+
+void Reactor::wake() {
+    uint64_t one = 1;
+    if (m_wakeFd >= 0) {
+        ssize_t ignored = write(m_wakeFd, &one, sizeof(one));
+        (void)ignored;
+        noteSyscall();
+    }
+}
+
+void Reactor::invoke(Callback callback) {
+    if (isLoopThread()) {
+        callback();
+        return;
+    }
+
+    std::promise<void> done;
+    std::future<void> finished = done.get_future();
+    bool posted = false;
+    {
+        // Decided under the lock run() drains under, so the loop cannot
+        // finish between the check and the post
+        std::lock_guard<std::mutex> lock(m_postMutex);
+        if (m_postsRun) {
+            m_posted.push_back([&callback, &done]() {
+                callback();
+                done.set_value();
+            });
+            posted = true;
+        }
+    }
+
+    if (!posted) {
+        callback();
+        return;
+    }
+    wake();
+    finished.wait();
+}
+
+void Reactor::run() {
+    m_loopThread = std::this_thread::get_id();
+    m_threadId = static_cast<int>(syscall(SYS_gettid));
+    t_current = this;
+    if (m_uring) {
+        std::lock_guard<std::mutex> lock(g_uringLoopsMutex);
+        g_uringLoops.push_back(this);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_postMutex);
+        m_postsRun = true;
+    }
+
+    while (m_running) {
+        runOnce(std::chrono::seconds(1));
+    }
+
+    // Anything posted during shutdown still runs, closeSocket()'s included
+    if (m_uring) {
+        std::lock_guard<std::mutex> lock(g_uringLoopsMutex);
+        g_uringLoops.erase(std::find(g_uringLoops.begin(), g_uringLoops.end(), this));
+    }
+    for (;;) {
+        std::vector<Callback> posted;
+        {
+            std::lock_guard<std::mutex> lock(m_postMutex);
+            if (m_posted.empty()) {
+                // From here invoke() runs callbacks on the calling thread
+                m_postsRun = false;
+                break;
+            }
+            posted.swap(m_posted);
+        }
+        for (auto& callback : posted) {
+            callback();
+        }
+    }
+    if (m_uring) {
+        m_uring->flush();
+    }
+    t_current = nullptr;
+}
+
+void Reactor::stop() {
+    m_running = false;
+    post([]() {});
+}
+
+int Reactor::waitTimeoutMs(Clock::Duration maxWait) const {
+    Clock::Duration wait = maxWait;
+    if (!m_timers.empty()) {
+        wait = std::min(wait, m_timers.begin()->first - m_clock.now());
+    }
+    if (wait <= Clock::Duration::zero()) return 0;
+
+    // Round up so a timer is never polled a millisecond early
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wait + std::chrono::milliseconds(1) -
+                                                                    Clock::Duration(1));
+    return static_cast<int>(ms.count());
+}
+
+void Reactor::runOnce(Clock::Duration maxWait) {
+    struct epoll_event events[MAX_EVENTS];
+
+    // Wake latency is measured in real time, whatever clock the timers use
+    int timeoutMs = waitTimeoutMs(maxWait);
+    auto waitStart = std::chrono::steady_clock::now();
+
+    int n = epoll_wait(m_epoll, events, MAX_EVENTS, timeoutMs);
+    m_syscalls.store(m_syscalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (n < 0 && errno != EINTR) {
+        LOG_ERROR("Reactor: epoll_wait failed: " + std::string(strerror(errno)));
+    }
+
+    // Whether or not its fd was reported: a completion's task work can
+    // interrupt the wait (EINTR) and post the completion on the way out
+    if (m_uring) {
+        m_uring->reap();
+    }
+
+    if (n == 0 && timeoutMs > 0) {
+        auto late = std::chrono::steady_clock::now() - waitStart - std::chrono::milliseconds(timeoutMs);
+        m_wakeLatency.record(late > std::chrono::steady_clock::duration::zero()
+                             ? std::chrono::duration_cast<std::chrono::nanoseconds>(late).count() : 0);
+    }
+
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+
+        if (fd == m_wakeFd) {
+            uint64_t count;
+            while (read(m_wakeFd, &count, sizeof(count)) > 0) {
+                noteSyscall();
+            }
+            noteSyscall();
+            continue;
+        }
+        if (m_uring && fd == m_uring->fd()) {
+            continue;
+        }
+
+        // Copy: the callback may remove or replace its own registration
+        auto it = m_fds.find(fd);
+        if (it != m_fds.end()) {
+            FdCallback callback = it->second;
+            callback(events[i].events);
+        }
+    }
+
+    runPosted();
+    runTimers();
+
+    // Everything the iteration queued, in one submission
+    if (m_uring) {
+        m_uring->flush();
+    }
+}
+
+uint64_t Reactor::getSyscalls() const {
+    uint64_t syscalls = m_syscalls.load(std::memory_order_relaxed);
+    if (m_uring) {
+        syscalls += m_uring->getEnters();
+    }
+    return syscalls;
+}
+
+Reactor* Reactor::current() {
+    return t_current;
+}
+
+void Reactor::noteSyscall() {
+    if (t_current) {
+        t_current->m_syscalls.store(t_current->m_syscalls.load(std::memory_order_relaxed) + 1,
+                                    std::memory_order_relaxed);
+    }
+}
+
+void Reactor::closeSocket(int fd) {
+    std::lock_guard<std::mutex> lock(g_uringLoopsMutex);
+    if (g_uringLoops.empty()) {
+        ::close(fd);
+        return;
+    }
+
+    // Each loop submits what it has queued, then the last one closes. A
+    // loop that stops meanwhile still runs what was posted to it.
+    std::shared_ptr<std::atomic<size_t>> remaining(new std::atomic<size_t>(g_uringLoops.size()));
+    for (Reactor* loop : g_uringLoops) {
+        loop->post([loop, fd, remaining]() {
+            loop->m_uring->flush();
+            if (remaining->fetch_sub(1) == 1) {
+                ::close(fd);
+            }
+        });
+    }
+}
+
+void Reactor::runPosted() {
+    std::vector<Callback> posted;
+    {
+        std::lock_guard<std::mutex> lock(m_postMutex);
+        posted.swap(m_posted);
+    }
+
+    for (auto& callback : posted) {
+        callback();
+    }
+}
+
+void Reactor::runTimers() {
+    Clock::TimePoint now = m_clock.now();
+
+    while (!m_timers.empty() && m_timers.begin()->first <= now) {
+        Callback callback = std::move(m_timers.begin()->second.callback);
+        m_timerIndex.erase(m_timers.begin()->second.id);
+        m_timers.erase(m_timers.begin());
+        callback();
+    }
+}
+
+} // namespace op25gateway
@@ -0,0 +1,137 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "Clock.h"
+#include "Realtime.h"
+
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace op25gateway {
+
+class IoUring;
+
+// How a loop's sockets are read and written
+enum class IoBackend {
+    EPOLL,          // Readiness, then recvmsg()/send() per datagram
+    IO_URING        // Multishot receives and batched sends; epoll if unavailable
+};
+
+// Single-threaded epoll event loop with one-shot timers
+//
+// File descriptors and timers are managed from the loop thread (i.e. from
+// inside callbacks, or before run() starts). Other threads hand work to the
+// loop with post(), which wakes it through an eventfd.
+//
+// With the io_uring backend the loop also owns an io_uring, polled like
+// any other fd. Sends queued on it go out together once the loop's
+// callbacks and timers have run, before it waits again.
+class Reactor {
+public:
+    using Callback = std::function<void()>;
+    using FdCallback = std::function<void(uint32_t events)>;
+    using TimerId = uint64_t;
+
+    explicit Reactor(Clock& clock = Clock::system());
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    // Before open()
+    void setIoBackend(IoBackend backend) { m_backend = backend; }
+
+    bool open();
+    void close();
+
+    // The loop's io_uring; null with epoll, or if the kernel refused it
+    IoUring* getIoUring() const { return m_uring.get(); }
+
+    // Watch fd for epoll events (EPOLLIN etc.)
+    bool addFd(int fd, uint32_t events, FdCallback callback);
+    void removeFd(int fd);
+
+    // One-shot timer; returns an ID for cancelTimer()
+    TimerId addTimer(Clock::Duration delay, Callback callback);
+    void cancelTimer(TimerId& id);
+
+    // Run callback on the loop thread (thread-safe)
+    void post(Callback callback);
+
+    // Run callback on the loop thread and wait for it; runs inline on the
+    // loop thread itself or while the loop is not running
+    void invoke(Callback callback);
+
+    // Loop until stop() (at once if stopped since open()); or a single
+    // iteration waiting at most maxWait
+    void run();
+    void runOnce(Clock::Duration maxWait);
+    void stop();
+
+    bool isLoopThread() const { return std::this_thread::get_id() == m_loopThread; }
+    Clock& getClock() const { return m_clock; }
+
+    // Kernel thread ID of the loop thread (0 until run())
+    int getThreadId() const { return m_threadId.load(std::memory_order_relaxed); }
+
+    // How late the loop thread wakes for its timers
+    const WakeLatency& getWakeLatency() const { return m_wakeLatency; }
+
+    // System calls for I/O made on the loop thread: its waits and those
+    // its sockets, eventfds and io_uring counted with noteSyscall()
+    uint64_t getSyscalls() const;
+
+    // The loop running on the calling thread, if any
+    static Reactor* current();
+
+    // Count a system call against the calling thread's loop
+    static void noteSyscall();
+
+    // Close a socket that loops' io_urings may still hold queued sends
+    // for: once each has submitted them, so its number is not reused
+    // under them. Any thread.
+    static void closeSocket(int fd);
+
+private:
+    void runTimers();
+    void runPosted();
+    void wake();
+    void openIoUring();
+    int waitTimeoutMs(Clock::Duration maxWait) const;
+
+    Clock& m_clock;
+    IoBackend m_backend;
+    std::unique_ptr<IoUring> m_uring;
+    std::atomic<uint64_t> m_syscalls;
+    int m_epoll;
+    int m_wakeFd;
+    std::atomic<bool> m_running;
+    std::thread::id m_loopThread;
+    std::atomic<int> m_threadId;
+    WakeLatency m_wakeLatency;
+
+    std::unordered_map<int, FdCallback> m_fds;
+
+    struct Timer {
+        TimerId id;
+        Callback callback;
+    };
+    std::multimap<Clock::TimePoint, Timer> m_timers;
+    std::unordered_map<TimerId, std::multimap<Clock::TimePoint, Timer>::iterator> m_timerIndex;
+    TimerId m_nextTimerId;
+
+    std::mutex m_postMutex;
+    std::vector<Callback> m_posted;
+    bool m_postsRun;        // run() will still run what is posted (under m_postMutex)
+};
+
+} // namespace op25gateway
+
+#endif // REACTOR_H
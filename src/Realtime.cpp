@@ -0,0 +1,252 @@
+#include "Realtime.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+namespace op25gateway {
+
+namespace {
+
+// Stack each tuned thread touches up front once memory is locked
+constexpr size_t STACK_PREFAULT = 256 * 1024;
+
+std::atomic<bool> g_memoryLocked(false);
+
+void prefaultStack() {
+    char stack[STACK_PREFAULT];
+    std::memset(stack, 0, sizeof(stack));
+    // Keep the stores: the compiler may not drop them as dead
+    asm volatile("" : : "r"(stack) : "memory");
+}
+
+// Value of a "Key:  value" line in a /proc status file
+bool readStatusField(const std::string& path, const char* key, uint64_t& value) {
+    std::ifstream file(path);
+    std::string line;
+    size_t keyLen = std::strlen(key);
+    while (std::getline(file, line)) {
+        if (line.compare(0, keyLen, key) == 0 && line.size() > keyLen && line[keyLen] == ':') {
+            value = std::strtoull(line.c_str() + keyLen + 1, nullptr, 10);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+bool parseCpuList(const std::string& text, std::vector<int>& cpus) {
+    cpus.clear();
+
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (item.empty()) {
+            if (text.find_first_not_of(" \t") == std::string::npos) break;
+            return false;
+        }
+
+        char* end = nullptr;
+        long first = std::strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (end == item.c_str()) return false;
+        if (*end == '-') {
+            const char* second = end + 1;
+            last = std::strtol(second, &end, 10);
+            if (end == second) return false;
+        }
+        if (*end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) return false;
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return true;
+}
+
+std::string formatCpuList(const std::vector<int>& cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        // Collapse runs back into ranges
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) j++;
+
+        if (!text.empty()) text += ",";
+        text += std::to_string(cpus[i]);
+        if (j > i) text += "-" + std::to_string(cpus[j]);
+        i = j;
+    }
+    return text;
+}
+
+std::string describeTuning(const ThreadTuning& tuning) {
+    std::string text;
+    if (!tuning.cpus.empty()) {
+        text += " on CPUs " + formatCpuList(tuning.cpus);
+    }
+    if (tuning.priority > 0) {
+        text += " at SCHED_FIFO " + std::to_string(tuning.priority);
+    }
+    return text;
+}
+
+bool tuneThread(const std::string& name, const ThreadTuning& tuning) {
+    // The kernel keeps 15 characters of a thread name
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+    bool ok = true;
+    if (!tuning.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : tuning.cpus) {
+            CPU_SET(cpu, &set);
+        }
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            LOG_WARN("Realtime: Cannot pin " + name + " to CPUs " + formatCpuList(tuning.cpus) +
+                     ": " + std::string(strerror(err)));
+            ok = false;
+        }
+    }
+
+    if (tuning.priority > 0) {
+        struct sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = tuning.priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0) {
+            LOG_WARN("Realtime: Cannot run " + name + " at SCHED_FIFO priority " +
+                     std::to_string(tuning.priority) + ": " + std::string(strerror(err)) +
+                     (err == EPERM ? " (needs CAP_SYS_NICE or an RLIMIT_RTPRIO)" : ""));
+            ok = false;
+        }
+    }
+
+    if (g_memoryLocked) {
+        prefaultStack();
+    }
+    return ok;
+}
+
+bool lockMemory() {
+    // Freed heap stays with the process, and large blocks come from the
+    // (locked) heap rather than mappings of their own
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        LOG_WARN("Realtime: Cannot lock memory: " + std::string(strerror(errno)) +
+                 (errno == EPERM || errno == ENOMEM ? " (needs CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK)" : ""));
+        return false;
+    }
+
+    g_memoryLocked = true;
+    prefaultStack();
+    LOG_INFO("Realtime: Memory locked (" + std::to_string(lockedMemoryKb()) + " kB)");
+    return true;
+}
+
+bool isMemoryLocked() {
+    return g_memoryLocked;
+}
+
+uint32_t lockedMemoryKb() {
+    // VmLck counts address space reserved but never mapped in (malloc
+    // arenas), so prefer what is actually resident
+    uint64_t kb = 0;
+    if (!readStatusField("/proc/self/smaps_rollup", "Locked", kb)) {
+        readStatusField("/proc/self/status", "VmLck", kb);
+    }
+    return static_cast<uint32_t>(kb);
+}
+
+WakeLatency::WakeLatency()
+    : m_wakes(0)
+    , m_totalNs(0)
+    , m_maxNs(0)
+{
+    for (auto& bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void WakeLatency::record(uint64_t ns) {
+    // Single writer: plain load/store pairs, no locked instructions
+    int bucket = 0;
+    for (uint64_t us = ns / 1000; us > 0 && bucket < BUCKETS - 1; us >>= 1) {
+        bucket++;
+    }
+
+    m_wakes.store(m_wakes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_totalNs.store(m_totalNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    if (ns > m_maxNs.load(std::memory_order_relaxed)) {
+        m_maxNs.store(ns, std::memory_order_relaxed);
+    }
+    m_buckets[bucket].store(m_buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+WakeLatency::Snapshot WakeLatency::snapshot() const {
+    Snapshot snap;
+    snap.wakes = m_wakes.load(std::memory_order_relaxed);
+    snap.totalNs = m_totalNs.load(std::memory_order_relaxed);
+    snap.maxNs = m_maxNs.load(std::memory_order_relaxed);
+    snap.p99Ns = 0;
+
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    // Bucket i holds [2^(i-1), 2^i) us
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS && total > 0; i++) {
+        seen += counts[i];
+        if (seen * 100 >= total * 99) {
+            snap.p99Ns = std::min<uint64_t>((1ULL << i) * 1000, snap.maxNs);
+            break;
+        }
+    }
+    return snap;
+}
+
+bool readThreadReport(int tid, ThreadReport& report) {
+    std::string status = "/proc/self/task/" + std::to_string(tid) + "/status";
+    if (!readStatusField(status, "voluntary_ctxt_switches", report.voluntarySwitches) ||
+        !readStatusField(status, "nonvoluntary_ctxt_switches", report.involuntarySwitches)) {
+        return false;
+    }
+
+    std::ifstream comm("/proc/self/task/" + std::to_string(tid) + "/comm");
+    std::getline(comm, report.name);
+
+    report.tid = tid;
+    report.policy = sched_getscheduler(tid);
+    struct sched_param param;
+    report.priority = sched_getparam(tid, &param) == 0 ? param.sched_priority : 0;
+
+    report.cpuMask = 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(tid, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < 64; cpu++) {
+            if (CPU_ISSET(cpu, &set)) report.cpuMask |= 1ULL << cpu;
+        }
+    }
+    return true;
+}
+
+} // namespace op25gateway
@@ -0,0 +1,89 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace op25gateway {
+
+// Scheduling for one class of latency-critical threads (realtime.* in
+// config.yml)
+struct ThreadTuning {
+    std::vector<int> cpus;      // CPUs the threads may run on (empty = any)
+    int priority = 0;           // SCHED_FIFO priority 1-99 (0 = normal scheduling)
+};
+
+// Parses a CPU list such as "2,3" or "4-7" (as taskset -c takes);
+// false if it is malformed or names a CPU beyond CPU_SETSIZE
+bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+std::string formatCpuList(const std::vector<int>& cpus);
+
+// " on CPUs 2-3 at SCHED_FIFO 50" and the like, for log lines ("" untuned)
+std::string describeTuning(const ThreadTuning& tuning);
+
+// Names the calling thread (as ps and top show it) and applies tuning to
+// it. A setting the kernel refuses (no CAP_SYS_NICE, CPU offline) is
+// logged and the thread carries on without it.
+bool tuneThread(const std::string& name, const ThreadTuning& tuning);
+
+// Locks the process's memory, current and future, so the voice path never
+// takes a page fault: buffer pools and thread stacks are faulted in when
+// they are mapped, and freed heap is kept rather than given back to the
+// kernel to fault in again later.
+bool lockMemory();
+bool isMemoryLocked();
+
+// Kilobytes of memory locked in RAM, 0 if unknown
+uint32_t lockedMemoryKb();
+
+// How late an event loop thread wakes for its timers: the time from the
+// end of an epoll_wait timeout to the thread running again. That is
+// scheduler latency plus timer slack (none for SCHED_FIFO threads).
+// Written by the loop thread only, readable from any thread.
+class WakeLatency {
+public:
+    static constexpr int BUCKETS = 24;  // Powers of two from 1 us
+
+    struct Snapshot {
+        uint64_t wakes;
+        uint64_t totalNs;
+        uint64_t maxNs;
+        uint64_t p99Ns;     // Upper bound of the bucket holding the 99th percentile
+    };
+
+    WakeLatency();
+
+    void record(uint64_t ns);
+    Snapshot snapshot() const;
+
+private:
+    std::atomic<uint64_t> m_wakes;
+    std::atomic<uint64_t> m_totalNs;
+    std::atomic<uint64_t> m_maxNs;
+    std::atomic<uint64_t> m_buckets[BUCKETS];
+};
+
+// Scheduling report for one thread, from the kernel's view of it
+struct ThreadReport {
+    std::string name;
+    int tid;
+    int policy;                     // SCHED_OTHER, SCHED_FIFO, ...
+    int priority;
+    uint64_t cpuMask;               // CPUs 0-63 it may run on
+    uint64_t voluntarySwitches;     // Blocked (waiting for work)
+    uint64_t involuntarySwitches;   // Preempted while runnable
+    WakeLatency::Snapshot wake;
+    bool ioUring;                   // Its event loop uses io_uring
+    uint64_t syscalls;              // Made by its event loop
+};
+
+// Fills in report for thread tid of this process, all but the wake
+// latency; false if it has exited
+bool readThreadReport(int tid, ThreadReport& report);
+
+} // namespace op25gateway
+
+#endif // REALTIME_H
@@ -0,0 +1,151 @@
+#include "Resolver.h"
+#include "Logger.h"
+
+#include <cstring>
+
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+namespace op25gateway {
+
+namespace {
+
+constexpr std::chrono::minutes DEFAULT_CACHE_TTL(5);
+
+struct sockaddr_in makeAddr(const struct in_addr& addr, uint16_t port) {
+    struct sockaddr_in sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr = addr;
+    return sa;
+}
+
+} // namespace
+
+Resolver::Resolver(Clock& clock)
+    : m_state(std::make_shared<State>(clock))
+{
+    m_state->ttl = DEFAULT_CACHE_TTL;
+}
+
+Resolver::~Resolver() {
+    bool inLookup;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->stopping = true;
+        inLookup = m_state->inLookup;
+    }
+    m_state->cond.notify_all();
+
+    if (!m_worker.joinable()) return;
+
+    // A lookup can take as long as the DNS timeout; the worker drops its
+    // answer and exits on its own. Otherwise it may be in a callback,
+    // which must finish first.
+    if (inLookup) {
+        m_worker.detach();
+    } else {
+        m_worker.join();
+    }
+}
+
+void Resolver::setCacheTtl(Clock::Duration ttl) {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->ttl = ttl;
+}
+
+void Resolver::resolve(const std::string& host, uint16_t port, Callback callback) {
+    struct in_addr numeric;
+    if (inet_pton(AF_INET, host.c_str(), &numeric) == 1) {
+        callback(true, makeAddr(numeric, port));
+        return;
+    }
+
+    State& state = *m_state;
+    std::unique_lock<std::mutex> lock(state.mutex);
+
+    auto it = state.cache.find(host);
+    if (it != state.cache.end() && state.clock.now() < it->second.expires) {
+        state.cacheHits++;
+        struct in_addr addr = it->second.addr;
+        lock.unlock();
+        callback(true, makeAddr(addr, port));
+        return;
+    }
+
+    state.queue.push_back(Request{host, port, std::move(callback)});
+
+    if (!m_worker.joinable()) {
+        m_worker = std::thread(&Resolver::workerLoop, m_state);
+    }
+
+    lock.unlock();
+    state.cond.notify_one();
+}
+
+void Resolver::workerLoop(std::shared_ptr<State> shared) {
+    State& state = *shared;
+    std::unique_lock<std::mutex> lock(state.mutex);
+
+    while (true) {
+        state.cond.wait(lock, [&state]() { return state.stopping || !state.queue.empty(); });
+        if (state.stopping) break;
+
+        Request request = std::move(state.queue.front());
+        state.queue.pop_front();
+        state.inLookup = true;
+        lock.unlock();
+
+        struct addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        struct addrinfo* result = nullptr;
+        int rc = getaddrinfo(request.host.c_str(), nullptr, &hints, &result);
+
+        lock.lock();
+        state.inLookup = false;
+        if (state.stopping) {
+            // The resolver has gone, and whoever asked with it
+            if (result) {
+                freeaddrinfo(result);
+            }
+            break;
+        }
+        state.lookups++;
+
+        bool ok = false;
+        struct in_addr addr;
+        std::memset(&addr, 0, sizeof(addr));
+
+        if (rc == 0 && result) {
+            addr = reinterpret_cast<struct sockaddr_in*>(result->ai_addr)->sin_addr;
+            state.cache[request.host] = CacheEntry{addr, state.clock.now() + state.ttl};
+            ok = true;
+        } else {
+            state.failures++;
+            auto it = state.cache.find(request.host);
+            if (it != state.cache.end()) {
+                LOG_WARN("Resolver: Lookup of " + request.host + " failed (" + gai_strerror(rc) +
+                         "), using cached address");
+                addr = it->second.addr;
+                ok = true;
+            } else {
+                LOG_ERROR("Resolver: Lookup of " + request.host + " failed: " + gai_strerror(rc));
+            }
+        }
+        lock.unlock();
+
+        if (result) {
+            freeaddrinfo(result);
+        }
+
+        request.callback(ok, makeAddr(addr, request.port));
+        lock.lock();
+    }
+}
+
+} // namespace op25gateway
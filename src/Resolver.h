@@ -0,0 +1,89 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "Clock.h"
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <netinet/in.h>
+
+namespace op25gateway {
+
+// Resolves host names on a worker thread and caches the answers
+//
+// getaddrinfo() can block for seconds on a slow or unreachable DNS server,
+// so lookups never run on the caller's thread. Numeric addresses and fresh
+// cache entries complete inline. If a refresh fails, the last good answer
+// is used rather than taking the FNE link down over a DNS outage.
+//
+// Destroying the resolver does not wait for a lookup in progress: the
+// worker is left to finish it alone and drop the answer, so shutdown is
+// not held up by an unreachable DNS server.
+class Resolver {
+public:
+    // Called inline or on the worker thread
+    using Callback = std::function<void(bool ok, const struct sockaddr_in& addr)>;
+
+    explicit Resolver(Clock& clock = Clock::system());
+    ~Resolver();
+
+    Resolver(const Resolver&) = delete;
+    Resolver& operator=(const Resolver&) = delete;
+
+    void resolve(const std::string& host, uint16_t port, Callback callback);
+
+    void setCacheTtl(Clock::Duration ttl);
+
+    // Statistics
+    uint64_t getLookups() const { return m_state->lookups; }
+    uint64_t getCacheHits() const { return m_state->cacheHits; }
+    uint64_t getFailures() const { return m_state->failures; }
+
+private:
+    struct Request {
+        std::string host;
+        uint16_t port;
+        Callback callback;
+    };
+
+    struct CacheEntry {
+        struct in_addr addr;
+        Clock::TimePoint expires;
+    };
+
+    // Shared with the worker, which may outlive the resolver
+    struct State {
+        explicit State(Clock& c) : clock(c) {}
+
+        Clock& clock;
+        Clock::Duration ttl;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<Request> queue;
+        std::map<std::string, CacheEntry> cache;
+        bool stopping = false;
+        bool inLookup = false;      // In getaddrinfo(), touching nothing else
+
+        std::atomic<uint64_t> lookups{0};
+        std::atomic<uint64_t> cacheHits{0};
+        std::atomic<uint64_t> failures{0};
+    };
+
+    static void workerLoop(std::shared_ptr<State> state);
+
+    std::shared_ptr<State> m_state;
+    std::thread m_worker;
+};
+
+} // namespace op25gateway
+
+#endif // RESOLVER_H
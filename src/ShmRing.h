@@ -0,0 +1,283 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+// Shared-memory frame ring between OP25 and the gateway on one host
+//
+// Self-contained and header-only, so OP25 can include it without the rest
+// of the gateway. The gateway (consumer) listens on the abstract Unix
+// socket @op25-gateway-<peerId>.ring. A producer connects and is handed a
+// memfd holding the ring plus an eventfd doorbell. From then on a frame is
+// a copy into the ring and one atomic store: the producer rings the
+// doorbell only when the gateway has drained everything and gone to
+// sleep, so while frames keep it busy they cost no system call at all.
+//
+// One producer at a time: the gateway refuses a second connection while
+// one is attached, and gives each new connection a fresh ring.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace op25gateway {
+
+constexpr uint32_t SHM_RING_MAGIC = 0x4F505247;     // "OPRG"
+constexpr uint32_t SHM_RING_VERSION = 1;
+
+// One IMBE frame, as in the OP25 UDP packet but in host byte order
+struct ShmRingRecord {
+    uint16_t nac;
+    uint8_t  frameType;         // 1=LDU1, 2=LDU2, 3=terminator
+    uint8_t  voiceIndex;        // 0-8
+    uint32_t talkgroup;
+    uint32_t sourceId;
+    uint8_t  flags;             // Bit 0: encrypted
+    uint8_t  imbe[11];
+    uint8_t  reserved[8];
+};
+
+static_assert(sizeof(ShmRingRecord) == 32, "ShmRingRecord must stay 32 bytes");
+
+// Start of the shared mapping; the records follow it
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;          // Records, a power of two
+    uint32_t recordSize;
+
+    // Consumer side
+    alignas(64) std::atomic<uint64_t> head;         // Next record to read
+    std::atomic<uint32_t> sleeping;                 // Waiting on the doorbell
+    std::atomic<uint32_t> closed;                   // Gone; connect again
+
+    // Producer side
+    alignas(64) std::atomic<uint64_t> tail;         // Next record to write
+    std::atomic<uint64_t> drops;                    // Refused, ring full
+    std::atomic<uint64_t> doorbells;                // Wakeups rung
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring counters must be lock-free to share");
+
+constexpr size_t SHM_RING_RECORDS_OFFSET = (sizeof(ShmRingHeader) + 63) & ~size_t(63);
+
+inline size_t shmRingBytes(uint32_t capacity) {
+    return SHM_RING_RECORDS_OFFSET + static_cast<size_t>(capacity) * sizeof(ShmRingRecord);
+}
+
+inline ShmRingRecord* shmRingRecords(ShmRingHeader* header) {
+    return reinterpret_cast<ShmRingRecord*>(reinterpret_cast<uint8_t*>(header) + SHM_RING_RECORDS_OFFSET);
+}
+
+// Abstract socket address for a gateway pipeline's ring
+inline socklen_t shmRingAddress(uint32_t peerId, struct sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::string name = "op25-gateway-" + std::to_string(peerId) + ".ring";
+    std::memcpy(addr.sun_path + 1, name.data(), name.size());
+    return static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + 1 + name.size());
+}
+
+// Producer side, for OP25
+//
+// push() from one thread. It never blocks; while the gateway is not
+// there it returns false and tries to connect again, soon after the ring
+// is closed (a restart hands over within milliseconds) and then backing
+// off to once a second.
+class ShmRingProducer {
+public:
+    explicit ShmRingProducer(uint32_t peerId)
+        : m_peerId(peerId), m_socket(-1), m_doorbell(-1), m_header(nullptr), m_records(nullptr),
+          m_mask(0), m_mapBytes(0), m_retryDelay(RETRY_MIN) {}
+
+    ~ShmRingProducer() { disconnect(); }
+
+    ShmRingProducer(const ShmRingProducer&) = delete;
+    ShmRingProducer& operator=(const ShmRingProducer&) = delete;
+
+    bool connect() {
+        disconnect();
+        m_lastAttempt = std::chrono::steady_clock::now();
+        m_lastCheck = m_lastAttempt;
+
+        m_socket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (m_socket < 0) return false;
+
+        struct sockaddr_un addr;
+        socklen_t len = shmRingAddress(m_peerId, addr);
+        if (::connect(m_socket, reinterpret_cast<struct sockaddr*>(&addr), len) < 0) {
+            disconnect();
+            return false;
+        }
+
+        // The gateway answers with its ring version, the memfd and the doorbell
+        uint32_t version = 0;
+        struct iovec iov = { &version, sizeof(version) };
+        alignas(struct cmsghdr) uint8_t control[CMSG_SPACE(2 * sizeof(int))];
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t got = recvmsg(m_socket, &msg, MSG_CMSG_CLOEXEC);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (got != sizeof(version) || !cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+            disconnect();
+            return false;
+        }
+        int fds[2];
+        std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        m_doorbell = fds[1];
+
+        bool ok = version == SHM_RING_VERSION && map(fds[0]);
+        close(fds[0]);
+        if (!ok) {
+            disconnect();
+            return false;
+        }
+        return true;
+    }
+
+    void disconnect() {
+        if (m_header) {
+            munmap(m_header, m_mapBytes);
+            m_header = nullptr;
+            m_records = nullptr;
+        }
+        if (m_doorbell >= 0) {
+            close(m_doorbell);
+            m_doorbell = -1;
+        }
+        if (m_socket >= 0) {
+            close(m_socket);
+            m_socket = -1;
+        }
+    }
+
+    bool isConnected() const { return m_header && !m_header->closed.load(std::memory_order_acquire); }
+
+    // False if the frame was not queued (no gateway, or the ring is full)
+    bool push(const ShmRingRecord& record) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!isConnected()) {
+            if (m_header) {
+                // Closed by the gateway: its successor is listening, or
+                // about to be
+                disconnect();
+                m_retryDelay = RETRY_MIN;
+                m_lastAttempt = std::chrono::steady_clock::time_point();
+            }
+            if (now - m_lastAttempt < m_retryDelay) {
+                return false;
+            }
+            if (!connect()) {
+                m_retryDelay = std::min(m_retryDelay * 2, RETRY_MAX);
+                return false;
+            }
+            m_retryDelay = RETRY_MIN;
+        }
+
+        // A gateway that died never marked the ring closed: look for the
+        // socket closing, once a second rather than per frame
+        if (now - m_lastCheck >= std::chrono::seconds(1)) {
+            m_lastCheck = now;
+            if (isPeerGone()) {
+                disconnect();
+                return false;
+            }
+        }
+
+        uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+        if (tail - m_header->head.load(std::memory_order_acquire) > m_mask) {
+            m_header->drops.store(m_header->drops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_records[tail & m_mask] = record;
+
+        // Publish, then look at the consumer: it sets sleeping before
+        // checking the tail one last time, so at least one of the two
+        // sees the other
+        m_header->tail.store(tail + 1, std::memory_order_seq_cst);
+        if (m_header->sleeping.load(std::memory_order_seq_cst) != 0 &&
+            m_header->sleeping.exchange(0, std::memory_order_seq_cst) != 0) {
+            uint64_t one = 1;
+            ssize_t ignored = write(m_doorbell, &one, sizeof(one));
+            (void)ignored;
+            m_header->doorbells.store(m_header->doorbells.load(std::memory_order_relaxed) + 1,
+                                      std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    bool push(uint16_t nac, uint32_t talkgroup, uint32_t sourceId, uint8_t frameType,
+              uint8_t voiceIndex, uint8_t flags, const uint8_t* imbe) {
+        ShmRingRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.nac = nac;
+        record.frameType = frameType;
+        record.voiceIndex = voiceIndex;
+        record.talkgroup = talkgroup;
+        record.sourceId = sourceId;
+        record.flags = flags;
+        if (imbe) {
+            std::memcpy(record.imbe, imbe, sizeof(record.imbe));    // None for a terminator
+        }
+        return push(record);
+    }
+
+private:
+    static constexpr std::chrono::milliseconds RETRY_MIN{10};
+    static constexpr std::chrono::milliseconds RETRY_MAX{1000};
+
+    // The gateway sends nothing after the handshake, so anything readable
+    // is end-of-file
+    bool isPeerGone() const {
+        struct pollfd pfd = { m_socket, POLLIN, 0 };
+        return poll(&pfd, 1, 0) > 0;
+    }
+
+    bool map(int memfd) {
+        ShmRingHeader probe;
+        if (pread(memfd, &probe, offsetof(ShmRingHeader, head), 0) != static_cast<ssize_t>(offsetof(ShmRingHeader, head)) ||
+            probe.magic != SHM_RING_MAGIC || probe.recordSize != sizeof(ShmRingRecord) ||
+            probe.capacity == 0 || (probe.capacity & (probe.capacity - 1)) != 0) {
+            return false;
+        }
+
+        m_mapBytes = shmRingBytes(probe.capacity);
+        void* mem = mmap(nullptr, m_mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, memfd, 0);
+        if (mem == MAP_FAILED) return false;
+
+        m_header = static_cast<ShmRingHeader*>(mem);
+        m_records = shmRingRecords(m_header);
+        m_mask = probe.capacity - 1;
+        return true;
+    }
+
+    uint32_t m_peerId;
+    int m_socket;
+    int m_doorbell;
+    ShmRingHeader* m_header;
+    ShmRingRecord* m_records;
+    uint64_t m_mask;
+    size_t m_mapBytes;
+    std::chrono::milliseconds m_retryDelay;
+    std::chrono::steady_clock::time_point m_lastAttempt;
+    std::chrono::steady_clock::time_point m_lastCheck;
+};
+
+} // namespace op25gateway
+
+#endif // SHMRING_H
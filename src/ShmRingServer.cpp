@@ -0,0 +1,290 @@
+#include "ShmRingServer.h"
+#include "Logger.h"
+
+#include <cstring>
+#include <cerrno>
+#include <new>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace op25gateway {
+
+namespace {
+
+constexpr std::chrono::milliseconds LISTEN_RETRY_INTERVAL(250);
+
+} // namespace
+
+ShmRingServer::ShmRingServer(uint32_t peerId, uint32_t capacity)
+    : m_peerId(peerId)
+    , m_capacity(1)
+    , m_logName("OP25")
+    , m_loop(nullptr)
+    , m_listenFd(-1)
+    , m_bindWarned(false)
+    , m_retryTimer(0)
+    , m_running(false)
+    , m_connFd(-1)
+    , m_memFd(-1)
+    , m_doorbell(-1)
+    , m_header(nullptr)
+    , m_ring(nullptr)
+    , m_head(0)
+    , m_connected(false)
+    , m_records(0)
+    , m_connects(0)
+    , m_doorbells(0)
+    , m_drops(0)
+    , m_doorbellsBefore(0)
+    , m_dropsBefore(0)
+{
+    while (m_capacity < capacity) m_capacity <<= 1;
+}
+
+ShmRingServer::~ShmRingServer() {
+    stop();
+}
+
+bool ShmRingServer::start() {
+    if (m_running) return true;
+    if (!m_loop) {
+        LOG_ERROR(m_logName + ": The shared-memory ring needs an event loop");
+        return false;
+    }
+
+    m_running = true;
+    m_bindWarned = false;
+    m_loop->invoke([this]() { tryListen(); });
+    return true;
+}
+
+void ShmRingServer::stop() {
+    if (!m_running) return;
+
+    m_loop->invoke([this]() {
+        m_loop->cancelTimer(m_retryTimer);
+        m_retryTimer = 0;
+        if (m_listenFd >= 0) {
+            m_loop->removeFd(m_listenFd);
+            close(m_listenFd);
+            m_listenFd = -1;
+        }
+        closeRing();
+    });
+    m_running = false;
+}
+
+void ShmRingServer::tryListen() {
+    m_retryTimer = 0;
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        LOG_ERROR(m_logName + ": Failed to create ring socket: " + std::string(strerror(errno)));
+        return;
+    }
+
+    struct sockaddr_un addr;
+    socklen_t addrLen = shmRingAddress(m_peerId, addr);
+    std::string name(addr.sun_path + 1, addrLen - offsetof(struct sockaddr_un, sun_path) - 1);
+    if (bind(fd, (const struct sockaddr*)&addr, addrLen) < 0 || listen(fd, 1) < 0) {
+        int err = errno;
+        close(fd);
+
+        if (err != EADDRINUSE) {
+            LOG_ERROR(m_logName + ": Cannot listen on @" + name + ": " + strerror(err));
+            return;
+        }
+
+        // A gateway we are taking over holds the name until it lets go
+        if (!m_bindWarned) {
+            LOG_INFO(m_logName + ": Waiting for @" + name + " to be released");
+            m_bindWarned = true;
+        }
+        m_retryTimer = m_loop->addTimer(LISTEN_RETRY_INTERVAL, [this]() { tryListen(); });
+        return;
+    }
+
+    m_listenFd = fd;
+    m_loop->addFd(fd, EPOLLIN, [this](uint32_t) { onConnect(); });
+    LOG_INFO(m_logName + ": Shared-memory ring of " + std::to_string(m_capacity) + " frames on @" + name);
+}
+
+void ShmRingServer::onConnect() {
+    int conn = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (conn < 0) return;
+
+    // Abstract sockets have no file permissions
+    struct ucred cred;
+    socklen_t credLen = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) < 0 ||
+        (cred.uid != getuid() && cred.uid != 0)) {
+        LOG_WARN(m_logName + ": Refused ring producer with uid " + std::to_string(cred.uid));
+        close(conn);
+        return;
+    }
+
+    if (m_connFd >= 0) {
+        LOG_WARN(m_logName + ": Refused ring producer pid " + std::to_string(cred.pid) +
+                 ", one is already attached");
+        close(conn);
+        return;
+    }
+
+    if (!createRing()) {
+        close(conn);
+        return;
+    }
+
+    uint32_t version = SHM_RING_VERSION;
+    struct iovec iov = { &version, sizeof(version) };
+    alignas(struct cmsghdr) uint8_t control[CMSG_SPACE(2 * sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    int fds[2] = { m_memFd, m_doorbell };
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) != sizeof(version)) {
+        LOG_WARN(m_logName + ": Failed to hand the ring to pid " + std::to_string(cred.pid) + ": " +
+                 std::string(strerror(errno)));
+        close(conn);
+        closeRing();
+        return;
+    }
+
+    // Readable from now on means the producer has gone
+    m_connFd = conn;
+    m_loop->addFd(m_connFd, EPOLLIN, [this](uint32_t) {
+        LOG_INFO(m_logName + ": Ring producer disconnected");
+        closeRing();
+    });
+    m_loop->addFd(m_doorbell, EPOLLIN, [this](uint32_t) { onDoorbell(); });
+
+    m_connects++;
+    m_connected = true;
+    LOG_INFO(m_logName + ": Ring producer attached (pid " + std::to_string(cred.pid) + ")");
+}
+
+bool ShmRingServer::createRing() {
+    size_t bytes = shmRingBytes(m_capacity);
+
+    m_memFd = memfd_create("op25-gateway-ring", MFD_CLOEXEC);
+    m_doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    void* mem = MAP_FAILED;
+    if (m_memFd >= 0 && m_doorbell >= 0 && ftruncate(m_memFd, static_cast<off_t>(bytes)) == 0) {
+        mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_memFd, 0);
+    }
+    if (mem == MAP_FAILED) {
+        LOG_ERROR(m_logName + ": Failed to create the shared-memory ring: " + std::string(strerror(errno)));
+        closeRing();
+        return false;
+    }
+
+    m_header = new (mem) ShmRingHeader();
+    m_header->magic = SHM_RING_MAGIC;
+    m_header->version = SHM_RING_VERSION;
+    m_header->capacity = m_capacity;
+    m_header->recordSize = sizeof(ShmRingRecord);
+    m_header->head.store(0, std::memory_order_relaxed);
+    m_header->closed.store(0, std::memory_order_relaxed);
+    m_header->tail.store(0, std::memory_order_relaxed);
+    m_header->drops.store(0, std::memory_order_relaxed);
+    m_header->doorbells.store(0, std::memory_order_relaxed);
+
+    // Asleep until the first frame rings
+    m_header->sleeping.store(1, std::memory_order_release);
+    m_ring = shmRingRecords(m_header);
+    m_head = 0;
+    return true;
+}
+
+void ShmRingServer::closeRing() {
+    if (m_header) {
+        // What is already queued still goes to its call
+        drain();
+        m_header->closed.store(1, std::memory_order_release);
+        m_doorbellsBefore = m_doorbells;
+        m_dropsBefore = m_drops;
+        munmap(m_header, shmRingBytes(m_capacity));
+        m_header = nullptr;
+        m_ring = nullptr;
+    }
+    if (m_connFd >= 0) {
+        m_loop->removeFd(m_connFd);
+        close(m_connFd);
+        m_connFd = -1;
+    }
+    if (m_doorbell >= 0) {
+        m_loop->removeFd(m_doorbell);
+        close(m_doorbell);
+        m_doorbell = -1;
+    }
+    if (m_memFd >= 0) {
+        close(m_memFd);
+        m_memFd = -1;
+    }
+    m_connected = false;
+}
+
+void ShmRingServer::onDoorbell() {
+    uint64_t count;
+    ssize_t ignored = read(m_doorbell, &count, sizeof(count));
+    (void)ignored;
+    if (!drain()) {
+        LOG_WARN(m_logName + ": Ring producer moved the tail past the ring, closing it");
+        closeRing();
+    }
+}
+
+bool ShmRingServer::drain() {
+    uint64_t mask = m_capacity - 1;
+    uint64_t& head = m_head;
+
+    for (;;) {
+        // The producer owns the tail; never trust it further than a ring
+        uint64_t tail = m_header->tail.load(std::memory_order_acquire);
+        if (tail - head > m_capacity) {
+            publishCounters();
+            return false;
+        }
+        while (head != tail) {
+            ShmRingRecord record = m_ring[head & mask];
+            m_header->head.store(++head, std::memory_order_release);
+            m_records.store(m_records.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (m_recordCallback) {
+                m_recordCallback(record);
+            }
+        }
+
+        // Going to sleep: say so, then look once more, so a frame
+        // published meanwhile either is seen here or rings the doorbell
+        m_header->sleeping.store(1, std::memory_order_seq_cst);
+        if (m_header->tail.load(std::memory_order_seq_cst) == head) {
+            break;
+        }
+        m_header->sleeping.store(0, std::memory_order_relaxed);
+    }
+    publishCounters();
+    return true;
+}
+
+void ShmRingServer::publishCounters() {
+    m_doorbells = m_doorbellsBefore + m_header->doorbells.load(std::memory_order_relaxed);
+    m_drops = m_dropsBefore + m_header->drops.load(std::memory_order_relaxed);
+}
+
+} // namespace op25gateway
@@ -0,0 +1,93 @@
+#ifndef SHMRINGSERVER_H
+#define SHMRINGSERVER_H
+
+#include "ShmRing.h"
+#include "Reactor.h"
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <functional>
+
+namespace op25gateway {
+
+// Called on the event loop for each frame taken from the ring
+using ShmRingRecordCallback = std::function<void(const ShmRingRecord& record)>;
+
+// Gateway side of the shared-memory ring (ShmRing.h)
+//
+// Listens on @op25-gateway-<peerId>.ring, hands each producer that
+// connects a fresh ring and doorbell, and drains the ring on the event
+// loop. Only the same user (or root) may connect, one producer at a time.
+class ShmRingServer {
+public:
+    ShmRingServer(uint32_t peerId, uint32_t capacity);
+    ~ShmRingServer();
+
+    ShmRingServer(const ShmRingServer&) = delete;
+    ShmRingServer& operator=(const ShmRingServer&) = delete;
+
+    // Before start()
+    void attach(Reactor& loop) { m_loop = &loop; }
+    void setLogName(const std::string& name) { m_logName = name; }
+    void setRecordCallback(ShmRingRecordCallback callback) { m_recordCallback = callback; }
+
+    // Listen; while another process still holds the name (a takeover in
+    // progress), binding is retried in the background
+    bool start();
+
+    // Take what the producer has queued, mark the ring closed so it
+    // connects again, and stop listening
+    void stop();
+
+    bool isConnected() const { return m_connected; }
+    uint32_t getCapacity() const { return m_capacity; }
+
+    // Statistics
+    uint64_t getRecords() const { return m_records; }
+    uint64_t getConnects() const { return m_connects; }
+    uint64_t getDoorbells() const { return m_doorbells; }  // Rung by producers
+    uint64_t getDrops() const { return m_drops; }          // Refused by producers, ring full
+
+private:
+    void tryListen();
+    void onConnect();
+    void onDoorbell();
+    bool drain();       // False if the producer broke the ring
+    void publishCounters();
+    bool createRing();
+    void closeRing();
+
+    uint32_t m_peerId;
+    uint32_t m_capacity;
+    std::string m_logName;
+    Reactor* m_loop;
+    ShmRingRecordCallback m_recordCallback;
+
+    int m_listenFd;
+    bool m_bindWarned;
+    Reactor::TimerId m_retryTimer;
+    bool m_running;
+
+    // The attached producer
+    int m_connFd;
+    int m_memFd;
+    int m_doorbell;
+    ShmRingHeader* m_header;
+    ShmRingRecord* m_ring;
+    uint64_t m_head;                // Ours; the shared copy only tells the producer
+    std::atomic<bool> m_connected;
+
+    std::atomic<uint64_t> m_records;
+    std::atomic<uint64_t> m_connects;
+
+    // Producer counters from the ring header, plus those of earlier rings
+    std::atomic<uint64_t> m_doorbells;
+    std::atomic<uint64_t> m_drops;
+    uint64_t m_doorbellsBefore;
+    uint64_t m_dropsBefore;
+};
+
+} // namespace op25gateway
+
+#endif // SHMRINGSERVER_H
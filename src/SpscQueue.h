@@ -0,0 +1,83 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+
+namespace op25gateway {
+
+// Bounded single-producer, single-consumer queue
+//
+// One thread pushes and one thread pops, with no lock between them: each
+// side owns one index and publishes it to the other. The indexes sit on
+// separate cache lines so the two threads do not bounce a line between
+// them on every item.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity = 0) { reset(capacity); }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Drops everything and reallocates, rounding capacity up to a power
+    // of two (neither side may be running)
+    void reset(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        m_slots.assign(capacity > 0 ? size : 0, T());
+        m_mask = size - 1;
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+    }
+
+    // Producer: append item, or return false if full. wake is set when the
+    // consumer had already caught up, so it may be waiting and needs a
+    // doorbell; otherwise it is still draining and will see the item.
+    bool push(const T& item, bool& wake) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) >= m_slots.size()) {
+            wake = false;
+            return false;
+        }
+
+        m_slots[tail & m_mask] = item;
+
+        // Publish, then look at the consumer: it stores its index before
+        // checking ours, so at least one of the two sees the other
+        m_tail.store(tail + 1, std::memory_order_seq_cst);
+        wake = m_head.load(std::memory_order_seq_cst) == tail;
+        return true;
+    }
+
+    // Consumer: take the oldest item, or return false if empty
+    bool pop(T& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_seq_cst)) {
+            return false;
+        }
+
+        item = m_slots[head & m_mask];
+        m_head.store(head + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    // Either side; a snapshot that may be stale by the time it returns
+    size_t size() const {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+    size_t capacity() const { return m_slots.size(); }
+
+private:
+    std::vector<T> m_slots;
+    size_t m_mask;
+
+    alignas(64) std::atomic<size_t> m_head;     // Next to pop (consumer)
+    alignas(64) std::atomic<size_t> m_tail;     // Next to push (producer)
+};
+
+} // namespace op25gateway
+
+#endif // SPSCQUEUE_H
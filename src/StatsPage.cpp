@@ -0,0 +1,179 @@
+#include "StatsPage.h"
+
+#include <cstring>
+#include <chrono>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace op25gateway {
+
+namespace {
+
+constexpr int STATS_READ_RETRIES = 64;
+
+uint64_t unixTimeMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+std::string statsPageName(uint32_t peerId) {
+    return "/op25-gateway-" + std::to_string(peerId);
+}
+
+StatsPublisher::StatsPublisher()
+    : m_page(nullptr)
+    , m_pid(0)
+{
+}
+
+StatsPublisher::~StatsPublisher() {
+    close();
+}
+
+bool StatsPublisher::open(uint32_t peerId) {
+    if (m_page) return true;
+
+    m_name = statsPageName(peerId);
+
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(StatsPage)) < 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mem = mmap(nullptr, sizeof(StatsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+
+    m_page = static_cast<StatsPage*>(mem);
+    m_pid = static_cast<uint32_t>(getpid());
+
+    // Mark the page busy while the header is (re)initialized so a reader
+    // attached to a stale segment from a previous run never sees a mix
+    m_page->seq.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_page->magic = STATS_PAGE_MAGIC;
+    m_page->version = STATS_PAGE_VERSION;
+    m_page->size = sizeof(StatsPage);
+    m_page->pid = m_pid;
+    m_page->updateTimeMs = unixTimeMs();
+    std::memset(&m_page->data, 0, sizeof(m_page->data));
+
+    m_page->seq.store(2, std::memory_order_release);
+    return true;
+}
+
+void StatsPublisher::close() {
+    if (!m_page) return;
+
+    // After a hot restart the page belongs to the new process
+    bool owner = isOwner();
+    munmap(m_page, sizeof(StatsPage));
+    if (owner) {
+        shm_unlink(m_name.c_str());
+    }
+    m_page = nullptr;
+}
+
+bool StatsPublisher::isOwner() const {
+    return m_page->pid == m_pid;
+}
+
+void StatsPublisher::publish(const StatsPageData& data) {
+    if (!m_page || !isOwner()) return;
+
+    uint32_t seq = m_page->seq.load(std::memory_order_relaxed);
+    m_page->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_page->updateTimeMs = unixTimeMs();
+    std::memcpy(&m_page->data, &data, sizeof(data));
+
+    m_page->seq.store(seq + 2, std::memory_order_release);
+}
+
+StatsReader::StatsReader()
+    : m_page(nullptr)
+{
+}
+
+StatsReader::~StatsReader() {
+    close();
+}
+
+bool StatsReader::open(uint32_t peerId) {
+    if (m_page) return true;
+
+    std::string name = statsPageName(peerId);
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(StatsPage)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mem = mmap(nullptr, sizeof(StatsPage), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+
+    m_page = static_cast<const StatsPage*>(mem);
+    return true;
+}
+
+void StatsReader::close() {
+    if (!m_page) return;
+
+    munmap(const_cast<StatsPage*>(m_page), sizeof(StatsPage));
+    m_page = nullptr;
+}
+
+bool StatsReader::read(StatsPageData& data, uint64_t* updateTimeMs, uint32_t* pid) const {
+    if (!m_page) return false;
+
+    for (int i = 0; i < STATS_READ_RETRIES; i++) {
+        uint32_t seq1 = m_page->seq.load(std::memory_order_acquire);
+        if (seq1 & 1) {
+            continue;  // Writer in progress
+        }
+
+        if (m_page->magic != STATS_PAGE_MAGIC ||
+            m_page->version != STATS_PAGE_VERSION ||
+            m_page->size != sizeof(StatsPage)) {
+            return false;
+        }
+
+        uint64_t updated = m_page->updateTimeMs;
+        uint32_t writerPid = m_page->pid;
+        std::memcpy(&data, &m_page->data, sizeof(data));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t seq2 = m_page->seq.load(std::memory_order_relaxed);
+        if (seq1 == seq2) {
+            if (updateTimeMs) *updateTimeMs = updated;
+            if (pid) *pid = writerPid;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace op25gateway
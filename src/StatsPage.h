@@ -0,0 +1,262 @@
+#ifndef STATSPAGE_H
+#define STATSPAGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <string>
+
+namespace op25gateway {
+
+// Shared-memory stats page layout
+//
+// The gateway publishes a fixed-layout StatsPage in a POSIX shared-memory
+// segment named "/op25-gateway-<peerId>" (visible as /dev/shm/op25-gateway-<peerId>).
+// Updates are done under a seqlock: the writer makes `seq` odd, writes the
+// data block, then makes `seq` even again. Readers copy the data block and
+// retry if `seq` was odd or changed while copying, so they never block the
+// gateway and the gateway never waits for them.
+//
+// Bump STATS_PAGE_VERSION whenever the layout below changes.
+
+constexpr uint32_t STATS_PAGE_MAGIC = 0x4F503253;  // "OP2S"
+constexpr uint32_t STATS_PAGE_VERSION = 15;
+constexpr size_t STATS_MAX_CALLS = 32;
+constexpr size_t STATS_PIPELINE_NAME_SIZE = 32;
+constexpr size_t STATS_MAX_THREADS = 16;
+constexpr size_t STATS_THREAD_NAME_SIZE = 16;
+constexpr size_t STATS_MAX_VOTER_SITES = 16;
+
+// FNE session states as published in the stats page
+constexpr uint32_t STATS_FNE_DISCONNECTED = 0;
+constexpr uint32_t STATS_FNE_CONNECTING   = 1;
+constexpr uint32_t STATS_FNE_CONNECTED    = 2;
+
+struct StatsCallEntry {
+    uint32_t srcId;
+    uint32_t dstId;
+    uint16_t nac;
+    uint16_t reserved;
+    uint32_t frames;            // IMBE frames received for this call
+    uint64_t startTimeMs;       // Unix epoch milliseconds
+    uint64_t lastFrameTimeMs;   // Unix epoch milliseconds
+    uint64_t ldu1;
+    uint64_t ldu2;
+    uint32_t framesMissing;     // IMBE frames absent from sent LDUs
+    uint32_t kernelDrops;       // Datagrams dropped by the kernel during the call
+};
+
+// One thread as the kernel schedules it
+struct StatsThreadEntry {
+    char name[STATS_THREAD_NAME_SIZE];  // NUL-terminated
+    uint32_t tid;
+    uint32_t policy;                // SCHED_OTHER = 0, SCHED_FIFO = 1, ...
+    uint32_t priority;
+    uint32_t ioUring;               // Its event loop uses io_uring (gateway.ioBackend)
+    uint64_t cpuMask;               // CPUs 0-63 it may run on
+    uint64_t wakes;                 // Timer wakeups measured
+    uint32_t wakeAvgUs;             // Timer expiry to running again
+    uint32_t wakeP99Us;
+    uint32_t wakeMaxUs;
+    uint32_t reserved2;
+    uint64_t voluntarySwitches;     // Blocked waiting for work
+    uint64_t involuntarySwitches;   // Preempted while runnable
+    uint64_t syscalls;              // Made by its event loop for I/O and waiting
+};
+
+// One OP25 site feeding the frame voter
+struct StatsVoterSite {
+    uint32_t address;               // IPv4, host byte order
+    uint16_t port;
+    uint16_t reserved;
+    uint64_t frames;                // Copies received
+    uint64_t wins;                  // Forwarded
+    uint64_t losses;                // Outvoted
+    uint64_t late;                  // Arrived after the vote closed or the call ended
+};
+
+struct StatsPageData {
+    // OP25Receiver
+    uint64_t op25PacketsReceived;
+    uint64_t op25PacketsInvalid;
+    uint64_t op25KernelDrops;
+    uint32_t op25RcvBufBytes;
+    uint32_t op25QueueBytes;
+    uint32_t op25QueuePeakBytes;
+    uint32_t reserved0;
+
+    // Shared-memory ring (op25.shmRing)
+    uint32_t op25RingCapacity;      // Frames (0 = off)
+    uint32_t op25RingAttached;      // A producer is connected
+    uint64_t op25RingFrames;
+    uint64_t op25RingDoorbells;     // Wakeups the producer paid a syscall for
+    uint64_t op25RingDrops;         // Refused by the producer, ring full
+    uint64_t op25RingConnects;
+
+    // Frame voter (op25.voteWindow)
+    uint32_t op25VoteWindowMs;      // 0 = off
+    uint32_t op25VoterSiteCount;
+    uint64_t op25Votes;
+    uint64_t op25VoteTimeouts;      // Closed by the window, a site missing
+    uint32_t op25VoteHoldAvgUs;     // First copy to forwarded
+    uint32_t op25VoteHoldMaxUs;
+    StatsVoterSite op25VoterSites[STATS_MAX_VOTER_SITES];
+
+    // CallManager
+    uint64_t callsTotal;
+    uint64_t ldu1Total;
+    uint64_t ldu2Total;
+    uint64_t framesMissingTotal;
+    uint64_t callsTerminated;       // Ended by a terminator from OP25
+    uint64_t callsTimedOut;         // Ended by gateway.callTimeout
+    uint32_t teardownTerminatedAvgUs;   // Last voice frame to TDU sent
+    uint32_t teardownTerminatedMaxUs;
+    uint32_t teardownTimedOutAvgUs;
+    uint32_t teardownTimedOutMaxUs;
+
+    // FNEClient
+    uint32_t fneState;
+    uint32_t fnePeerId;
+    uint64_t fneFramesSent;
+    uint64_t fneSendErrors;
+    uint64_t fneLogins;
+    uint64_t fneConnectedSinceMs;   // Unix epoch milliseconds, 0 if not connected
+    uint64_t fneLoginAttempts;
+    uint64_t fneLoginFailures;
+    uint32_t fneLastLoginMs;        // Duration of the last successful handshake
+    uint32_t fneTimeToAuthMs;       // Outage (or startup) to logged in, last time round
+    uint64_t fneLinkLosses;         // Sessions lost to missed PONGs, RPT_DISC or NAK
+    uint64_t fneNaksReceived;
+    uint32_t fneRecoveryMs;         // Last link loss to logged in again
+    uint32_t fneMissedPongs;        // Current run of unanswered PINGs
+    uint32_t fneRttUs;              // Last PING/PONG round trip
+    uint32_t fneSrttUs;             // Smoothed round trip
+
+    // Store-and-forward during outages (primary session)
+    uint32_t fneBufferLdus;         // LDUs held for replay now, over all streams
+    uint32_t fneBufferPeakLdus;
+    uint32_t fneBufferCapacity;     // Slots per held stream, LDUs plus its start and end
+    uint32_t fneBufferBudgetMs;
+    uint64_t fneLdusBuffered;
+    uint64_t fneLdusReplayed;
+    uint64_t fneLdusDiscarded;      // Too old for the budget, or buffering disabled
+
+    // Hot standby (fields above describe the primary session)
+    uint32_t fneStandbyEnabled;     // 1 if a secondary FNE is configured
+    uint32_t fneActiveSession;      // Session carrying voice: 0 = primary, 1 = secondary
+    uint32_t fneStandbyState;
+    uint32_t fneStandbyRttUs;
+    uint64_t fneStandbyLogins;
+    uint64_t fneStandbyLinkLosses;
+    uint64_t fneFailovers;
+    uint64_t fneMidCallSwitches;    // Failovers that moved a call in progress
+    uint64_t fneFailbacks;
+    uint32_t fneLastFailoverMs;     // Active session lost to voice on the other one
+    uint32_t reserved1;
+
+    // Startup milestones, ms after process start (0 = not reached yet)
+    uint32_t startupReceiverReadyMs;    // OP25 port bound
+    uint32_t startupFneReadyMs;         // First FNE login
+    uint32_t startupFirstFrameMs;       // First OP25 frame received
+    uint32_t startupFirstForwardMs;     // First LDU sent to the FNE
+
+    // Config reload
+    uint64_t configReloads;             // Applied
+    uint64_t configReloadsRejected;     // Failed to parse or validate
+    uint64_t configLastReloadMs;        // Unix time of the last applied reload (0 = none)
+    uint32_t configPendingRestart;      // Changed settings waiting for a restart
+    uint32_t reserved2;
+
+    // Pipeline; a process may run several, each with a page of its own
+    char pipelineName[STATS_PIPELINE_NAME_SIZE];  // NUL-terminated, "" for a single unnamed pipeline
+    uint32_t pipelineIndex;             // Position in config.yml
+    uint32_t pipelineCount;             // Pipelines in the process
+    uint32_t workerThreads;             // Event loop threads the pipelines share
+    uint32_t reserved3;
+
+    // Call workers (gateway.callWorkers; 0 = calls handled on the event loop)
+    uint32_t callWorkers;
+    uint32_t callQueuePeak;             // Deepest any worker's queue has been, in frames
+    uint64_t callQueueDrops;            // Frames dropped because a worker's queue was full
+    uint32_t callsActive;               // Calls in progress; the table lists at most STATS_MAX_CALLS
+    uint32_t reserved4;
+
+    // Realtime: the pipeline's event loop, then its call workers
+    uint32_t memoryLocked;              // 1 if realtime.lockMemory took effect
+    uint32_t memoryLockedKb;
+    uint32_t threadCount;
+    uint32_t reserved5;
+    StatsThreadEntry threads[STATS_MAX_THREADS];
+
+    // Active call table
+    uint32_t activeCallCount;
+    uint32_t reserved;
+    StatsCallEntry calls[STATS_MAX_CALLS];
+};
+
+struct StatsPage {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;              // sizeof(StatsPage)
+    uint32_t pid;               // Writer process ID
+    std::atomic<uint32_t> seq;  // Seqlock sequence (odd = update in progress)
+    uint32_t reserved;
+    uint64_t updateTimeMs;      // Unix epoch milliseconds of last publish
+    StatsPageData data;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "Stats page seqlock requires a lock-free 32-bit atomic");
+
+// Returns the shared-memory object name for a gateway peer ID
+std::string statsPageName(uint32_t peerId);
+
+// Writer side, owned by the gateway process
+class StatsPublisher {
+public:
+    StatsPublisher();
+    ~StatsPublisher();
+
+    StatsPublisher(const StatsPublisher&) = delete;
+    StatsPublisher& operator=(const StatsPublisher&) = delete;
+
+    bool open(uint32_t peerId);
+    void close();
+    bool isOpen() const { return m_page != nullptr; }
+
+    // Publish a new snapshot (single writer only). Stops once another
+    // process has taken the page over (hot restart).
+    void publish(const StatsPageData& data);
+
+private:
+    bool isOwner() const;
+
+    std::string m_name;
+    StatsPage* m_page;
+    uint32_t m_pid;
+};
+
+// Reader side, used by monitoring tools; never writes to the segment
+class StatsReader {
+public:
+    StatsReader();
+    ~StatsReader();
+
+    StatsReader(const StatsReader&) = delete;
+    StatsReader& operator=(const StatsReader&) = delete;
+
+    bool open(uint32_t peerId);
+    void close();
+    bool isOpen() const { return m_page != nullptr; }
+
+    // Copy a consistent snapshot; returns false if the writer kept the page
+    // busy for every retry or the layout is not one we understand
+    bool read(StatsPageData& data, uint64_t* updateTimeMs = nullptr, uint32_t* pid = nullptr) const;
+
+private:
+    const StatsPage* m_page;
+};
+
+} // namespace op25gateway
+
+#endif // STATSPAGE_H
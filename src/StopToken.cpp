@@ -0,0 +1,57 @@
+#include "StopToken.h"
+
+#include <cerrno>
+#include <ctime>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+namespace op25gateway {
+
+StopToken::StopToken()
+    : m_running(true)
+    , m_requestedNs(0)
+    , m_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+}
+
+StopToken::~StopToken() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+void StopToken::request() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t expected = 0;
+    m_requestedNs.compare_exchange_strong(expected, ts.tv_sec * 1000000000LL + ts.tv_nsec);
+
+    m_running.store(false, std::memory_order_release);
+
+    // Level-triggered: stays readable for every waiter
+    int saved = errno;
+    uint64_t one = 1;
+    ssize_t ignored = write(m_fd, &one, sizeof(one));
+    (void)ignored;
+    errno = saved;
+}
+
+bool StopToken::waitUntil(Clock::TimePoint deadline) const {
+    while (!isRequested()) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - Clock::system().now() + std::chrono::milliseconds(1) - Clock::Duration(1));
+        if (remaining.count() <= 0) break;
+
+        struct pollfd pfd = { m_fd, POLLIN, 0 };
+        poll(&pfd, 1, static_cast<int>(remaining.count()));
+    }
+    return isRequested();
+}
+
+Clock::TimePoint StopToken::requestedAt() const {
+    return Clock::TimePoint(std::chrono::nanoseconds(m_requestedNs.load(std::memory_order_acquire)));
+}
+
+} // namespace op25gateway
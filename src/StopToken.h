@@ -0,0 +1,50 @@
+#ifndef STOPTOKEN_H
+#define STOPTOKEN_H
+
+#include "Clock.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace op25gateway {
+
+// Process-wide stop request
+//
+// request() only stores to atomics and writes an eventfd, so a signal
+// handler may call it: the thread waiting in waitUntil() (or polling fd())
+// wakes at once rather than at the end of its sleep. The time of the
+// first request is kept so shutdown can be timed from the signal.
+class StopToken {
+public:
+    StopToken();
+    ~StopToken();
+
+    StopToken(const StopToken&) = delete;
+    StopToken& operator=(const StopToken&) = delete;
+
+    // Async-signal-safe
+    void request();
+
+    bool isRequested() const { return !m_running.load(std::memory_order_acquire); }
+
+    // True until request(), for loops that poll a flag
+    const std::atomic<bool>& running() const { return m_running; }
+
+    // Readable once a stop is requested
+    int fd() const { return m_fd; }
+
+    // Block until deadline (system clock) or a request; true if requested
+    bool waitUntil(Clock::TimePoint deadline) const;
+
+    // When the stop was first requested (epoch if not yet)
+    Clock::TimePoint requestedAt() const;
+
+private:
+    std::atomic<bool> m_running;
+    std::atomic<int64_t> m_requestedNs;     // CLOCK_MONOTONIC, as steady_clock
+    int m_fd;
+};
+
+} // namespace op25gateway
+
+#endif // STOPTOKEN_H
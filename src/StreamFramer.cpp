@@ -0,0 +1,63 @@
+#include "StreamFramer.h"
+
+#include <cstdlib>
+
+namespace op25gateway {
+
+StreamFramer::StreamFramer(uint32_t peerId, uint32_t wacn, uint16_t sysId)
+    : m_peerId(peerId)
+    , m_wacn(wacn)
+    , m_sysId(sysId)
+    , m_streamId(0)
+    , m_seq(0)
+    , m_timestamp(0)
+{
+}
+
+uint32_t StreamFramer::newStream() {
+    m_streamId = (rand() & 0x7FFFFFFF) | 0x00000001;
+    m_seq = 0;
+    return m_streamId;
+}
+
+void StreamFramer::resumeStream(uint32_t streamId, uint16_t seq, uint32_t timestamp) {
+    m_streamId = streamId;
+    m_seq = seq;
+    m_timestamp = timestamp;
+}
+
+size_t StreamFramer::frameLDU1(uint8_t* buffer, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                               uint32_t srcId, uint32_t dstId, bool firstLDU) {
+    P25Utils::buildLDU1(buffer + DVM_HEADER_LENGTH, imbe, srcId, dstId, m_wacn, m_sysId, firstLDU);
+    P25Utils::buildDVMHeader(buffer, NET_FUNC_PROTOCOL, NET_SUBFUNC_P25,
+                              m_streamId, m_peerId, m_seq, m_timestamp, P25_LDU1_LENGTH);
+
+    size_t totalLen = DVM_HEADER_LENGTH + P25_LDU1_LENGTH;
+    P25Utils::insertDVMCrc(buffer, totalLen);
+    return totalLen;
+}
+
+size_t StreamFramer::frameLDU2(uint8_t* buffer, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                               uint32_t srcId, uint32_t dstId) {
+    P25Utils::buildLDU2(buffer + DVM_HEADER_LENGTH, imbe, srcId, dstId, m_wacn, m_sysId);
+    P25Utils::buildDVMHeader(buffer, NET_FUNC_PROTOCOL, NET_SUBFUNC_P25,
+                              m_streamId, m_peerId, m_seq, m_timestamp, P25_LDU2_LENGTH);
+
+    size_t totalLen = DVM_HEADER_LENGTH + P25_LDU2_LENGTH;
+    P25Utils::insertDVMCrc(buffer, totalLen);
+    return totalLen;
+}
+
+size_t StreamFramer::frameTDU(uint8_t* buffer, uint32_t srcId, uint32_t dstId, bool grantDemand) {
+    P25Utils::buildTDU(buffer + DVM_HEADER_LENGTH, srcId, dstId, m_wacn, m_sysId, grantDemand);
+
+    bool endOfCall = !grantDemand;
+    P25Utils::buildDVMHeader(buffer, NET_FUNC_PROTOCOL, NET_SUBFUNC_P25,
+                              m_streamId, m_peerId, m_seq, m_timestamp, P25_TDU_LENGTH, endOfCall);
+
+    size_t totalLen = DVM_HEADER_LENGTH + P25_TDU_LENGTH;
+    P25Utils::insertDVMCrc(buffer, totalLen);
+    return totalLen;
+}
+
+} // namespace op25gateway
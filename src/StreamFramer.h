@@ -0,0 +1,56 @@
+#ifndef STREAMFRAMER_H
+#define STREAMFRAMER_H
+
+#include "P25Utils.h"
+
+#include <cstdint>
+#include <cstddef>
+
+namespace op25gateway {
+
+// DVM/RTP header length
+constexpr size_t DVM_HEADER_LENGTH = 32;
+
+// Largest voice frame on the wire (header + LDU1)
+constexpr size_t DVM_MAX_VOICE_FRAME = DVM_HEADER_LENGTH + P25_LDU1_LENGTH;
+
+// Builds complete DVM voice frames (header + P25 payload + CRC) for one
+// voice stream at a time, tracking the stream ID and RTP sequence
+class StreamFramer {
+public:
+    StreamFramer(uint32_t peerId, uint32_t wacn, uint16_t sysId);
+
+    void setPeerId(uint32_t peerId) { m_peerId = peerId; }
+    void setWACN(uint32_t wacn) { m_wacn = wacn; }
+    void setSystemId(uint16_t sysId) { m_sysId = sysId; }
+
+    // Begin a new stream with a fresh stream ID and sequence
+    uint32_t newStream();
+    uint32_t getStreamId() const { return m_streamId; }
+    uint16_t getSeq() const { return m_seq; }
+    uint32_t getTimestamp() const { return m_timestamp; }
+
+    // Carry on a stream started elsewhere (hot restart)
+    void resumeStream(uint32_t streamId, uint16_t seq, uint32_t timestamp);
+
+    // Each writes a full frame into buffer (at least DVM_MAX_VOICE_FRAME
+    // bytes) and returns its length
+    size_t frameLDU1(uint8_t* buffer, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                     uint32_t srcId, uint32_t dstId, bool firstLDU);
+    size_t frameLDU2(uint8_t* buffer, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                     uint32_t srcId, uint32_t dstId);
+    size_t frameTDU(uint8_t* buffer, uint32_t srcId, uint32_t dstId, bool grantDemand);
+
+private:
+    uint32_t m_peerId;
+    uint32_t m_wacn;
+    uint16_t m_sysId;
+
+    uint32_t m_streamId;
+    uint16_t m_seq;
+    uint32_t m_timestamp;
+};
+
+} // namespace op25gateway
+
+#endif // STREAMFRAMER_H
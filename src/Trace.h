@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// USDT static tracepoints
+//
+// When built with OP25_GATEWAY_USDT and <sys/sdt.h> is available, each
+// GW_TRACE* site compiles to a single nop plus an ELF note describing the
+// probe, so there is no cost until perf/bpftrace attaches. Otherwise the
+// macros only mark their arguments used.
+//
+// All probes live in the "op25gw" provider, e.g.
+//   sudo bpftrace -p $(pidof op25-gateway) scripts/bpftrace/call-lifecycle.bt
+// Keep probe arguments to plain integers that are already computed, since
+// they are evaluated even when no tracer is attached.
+
+#if defined(OP25_GATEWAY_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define OP25_GATEWAY_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef OP25_GATEWAY_HAVE_SDT
+
+#define GW_TRACE0(name)                         DTRACE_PROBE(op25gw, name)
+#define GW_TRACE1(name, a1)                     DTRACE_PROBE1(op25gw, name, a1)
+#define GW_TRACE2(name, a1, a2)                 DTRACE_PROBE2(op25gw, name, a1, a2)
+#define GW_TRACE3(name, a1, a2, a3)             DTRACE_PROBE3(op25gw, name, a1, a2, a3)
+#define GW_TRACE4(name, a1, a2, a3, a4)         DTRACE_PROBE4(op25gw, name, a1, a2, a3, a4)
+#define GW_TRACE5(name, a1, a2, a3, a4, a5)     DTRACE_PROBE5(op25gw, name, a1, a2, a3, a4, a5)
+
+#else
+
+#define GW_TRACE0(name)                         do {} while (0)
+#define GW_TRACE1(name, a1)                     do { (void)(a1); } while (0)
+#define GW_TRACE2(name, a1, a2)                 do { (void)(a1); (void)(a2); } while (0)
+#define GW_TRACE3(name, a1, a2, a3)             do { (void)(a1); (void)(a2); (void)(a3); } while (0)
+#define GW_TRACE4(name, a1, a2, a3, a4)         do { (void)(a1); (void)(a2); (void)(a3); (void)(a4); } while (0)
+#define GW_TRACE5(name, a1, a2, a3, a4, a5) \
+    do { (void)(a1); (void)(a2); (void)(a3); (void)(a4); (void)(a5); } while (0)
+
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,35 @@
+#include "VoiceBuffer.h"
+
+namespace op25gateway {
+
+VoiceBuffer::VoiceBuffer(size_t capacity)
+    : m_slots(capacity)
+    , m_head(0)
+    , m_count(0)
+{
+}
+
+void VoiceBuffer::reset(size_t capacity) {
+    m_slots.assign(capacity, VoiceEvent());
+    m_head = 0;
+    m_count = 0;
+}
+
+VoiceEvent& VoiceBuffer::push() {
+    if (m_count == m_slots.size()) {
+        pop();
+    }
+
+    size_t tail = (m_head + m_count) % m_slots.size();
+    m_count++;
+    return m_slots[tail];
+}
+
+void VoiceBuffer::pop() {
+    if (m_count == 0) return;
+
+    m_head = (m_head + 1) % m_slots.size();
+    m_count--;
+}
+
+} // namespace op25gateway
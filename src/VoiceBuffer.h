@@ -0,0 +1,65 @@
+#ifndef VOICEBUFFER_H
+#define VOICEBUFFER_H
+
+#include "P25Utils.h"
+#include "Clock.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <chrono>
+
+namespace op25gateway {
+
+// Air time of one LDU (9 IMBE frames at 20 ms)
+constexpr std::chrono::milliseconds LDU_DURATION{180};
+
+// One buffered voice event
+struct VoiceEvent {
+    enum class Type : uint8_t {
+        START,          // Stream start (grant demand)
+        LDU1,
+        LDU2,
+        END             // Stream end (terminator)
+    };
+
+    Type type;
+    bool firstLDU;
+    uint32_t stream;    // Caller's call ID, to keep streams apart
+    uint32_t srcId;
+    uint32_t dstId;
+    Clock::TimePoint queuedAt;
+    uint8_t imbe[9][IMBE_FRAME_SIZE];
+};
+
+// Fixed-capacity FIFO of voice events
+//
+// All slots are allocated up front so buffering during an outage never
+// allocates. When full, the oldest event is overwritten.
+class VoiceBuffer {
+public:
+    explicit VoiceBuffer(size_t capacity = 0);
+
+    // Drops everything and reallocates for a new capacity
+    void reset(size_t capacity);
+
+    // Appends an event slot and returns it for the caller to fill,
+    // overwriting the oldest event if full (capacity must be non-zero)
+    VoiceEvent& push();
+
+    VoiceEvent& front() { return m_slots[m_head]; }
+    void pop();
+
+    size_t size() const { return m_count; }
+    size_t capacity() const { return m_slots.size(); }
+    bool empty() const { return m_count == 0; }
+
+private:
+    std::vector<VoiceEvent> m_slots;
+    size_t m_head;
+    size_t m_count;
+};
+
+} // namespace op25gateway
+
+#endif // VOICEBUFFER_H
@@ -0,0 +1,45 @@
+#ifndef VOICESINK_H
+#define VOICESINK_H
+
+#include "P25Utils.h"
+
+#include <cstdint>
+
+namespace op25gateway {
+
+// Destination for assembled voice streams
+//
+// CallManager hands finished LDUs to a VoiceSink. FNEClient is the
+// production implementation; benchmarks and tools provide their own.
+//
+// Calls may overlap. Each carries a call ID, unique to the sink for the
+// life of the process (and across a hot restart), and goes out as a
+// voice stream of its own. Methods may be called from several threads.
+class VoiceSink {
+public:
+    virtual ~VoiceSink() = default;
+
+    // Sink for sending thread index (before any voice is sent). Each such
+    // thread sends only through its own lane, so a sink can keep its state
+    // per lane with no lock between them; by default every lane is the
+    // sink itself.
+    virtual VoiceSink& lane(uint32_t index) { (void)index; return *this; }
+
+    // Start new voice stream
+    virtual void startStream(uint32_t call, uint32_t srcId, uint32_t dstId) = 0;
+
+    // End voice stream
+    virtual void endStream(uint32_t call, uint32_t srcId, uint32_t dstId) = 0;
+
+    // Send LDU1 (9 IMBE frames)
+    virtual void sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                          uint32_t srcId, uint32_t dstId, bool firstLDU) = 0;
+
+    // Send LDU2 (9 IMBE frames)
+    virtual void sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                          uint32_t srcId, uint32_t dstId) = 0;
+};
+
+} // namespace op25gateway
+
+#endif // VOICESINK_H
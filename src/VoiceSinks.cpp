@@ -0,0 +1,103 @@
+#include "VoiceSinks.h"
+
+#include <chrono>
+
+#include <arpa/inet.h>
+
+namespace op25gateway {
+
+NullVoiceSink::NullVoiceSink()
+    : m_streams(0)
+    , m_framesSent(0)
+{
+}
+
+void NullVoiceSink::startStream(uint32_t, uint32_t, uint32_t) {
+    m_streams++;
+    m_framesSent++;     // Grant demand TDU
+}
+
+void NullVoiceSink::endStream(uint32_t, uint32_t, uint32_t) {
+    m_framesSent++;     // TDU
+}
+
+void NullVoiceSink::sendLDU1(uint32_t, const uint8_t[9][IMBE_FRAME_SIZE], uint32_t, uint32_t, bool) {
+    m_framesSent++;
+}
+
+void NullVoiceSink::sendLDU2(uint32_t, const uint8_t[9][IMBE_FRAME_SIZE], uint32_t, uint32_t) {
+    m_framesSent++;
+}
+
+PcapVoiceSink::PcapVoiceSink(uint32_t peerId, uint32_t fneAddr, uint16_t fnePort)
+    : m_framer(peerId, 0x92C19, 0x50E)
+    , m_localAddr(htonl(INADDR_LOOPBACK))
+    , m_localPort(50000)
+    , m_fneAddr(fneAddr)
+    , m_fnePort(fnePort)
+    , m_streams(0)
+{
+    m_timeSource = []() {
+        return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    };
+}
+
+bool PcapVoiceSink::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_writer.open(path);
+}
+
+void PcapVoiceSink::close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writer.close();
+}
+
+void PcapVoiceSink::write(const uint8_t* packet, size_t len) {
+    m_writer.writeUDP(m_timeSource(), m_localAddr, m_localPort, m_fneAddr, m_fnePort, packet, len);
+}
+
+StreamFramer& PcapVoiceSink::stream(uint32_t call) {
+    auto it = m_open.find(call);
+    if (it == m_open.end()) {
+        it = m_open.emplace(call, m_framer).first;
+        it->second.newStream();
+    }
+    return it->second;
+}
+
+void PcapVoiceSink::startStream(uint32_t call, uint32_t srcId, uint32_t dstId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_open.erase(call);
+    m_streams++;
+
+    uint8_t packet[DVM_MAX_VOICE_FRAME];
+    size_t len = stream(call).frameTDU(packet, srcId, dstId, true);
+    write(packet, len);
+}
+
+void PcapVoiceSink::endStream(uint32_t call, uint32_t srcId, uint32_t dstId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint8_t packet[DVM_MAX_VOICE_FRAME];
+    size_t len = stream(call).frameTDU(packet, srcId, dstId, false);
+    write(packet, len);
+    m_open.erase(call);
+}
+
+void PcapVoiceSink::sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                             uint32_t srcId, uint32_t dstId, bool firstLDU) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint8_t packet[DVM_MAX_VOICE_FRAME];
+    size_t len = stream(call).frameLDU1(packet, imbe, srcId, dstId, firstLDU);
+    write(packet, len);
+}
+
+void PcapVoiceSink::sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                             uint32_t srcId, uint32_t dstId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint8_t packet[DVM_MAX_VOICE_FRAME];
+    size_t len = stream(call).frameLDU2(packet, imbe, srcId, dstId);
+    write(packet, len);
+}
+
+} // namespace op25gateway
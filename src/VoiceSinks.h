@@ -0,0 +1,83 @@
+#ifndef VOICESINKS_H
+#define VOICESINKS_H
+
+#include "VoiceSink.h"
+#include "StreamFramer.h"
+#include "Pcap.h"
+
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace op25gateway {
+
+// Discards voice, counting what would have been sent
+class NullVoiceSink : public VoiceSink {
+public:
+    NullVoiceSink();
+
+    void startStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+    void endStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+    void sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                  uint32_t srcId, uint32_t dstId, bool firstLDU) override;
+    void sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                  uint32_t srcId, uint32_t dstId) override;
+
+    uint64_t getStreams() const { return m_streams; }
+    uint64_t getFramesSent() const { return m_framesSent; }
+
+private:
+    std::atomic<uint64_t> m_streams;
+    std::atomic<uint64_t> m_framesSent;
+};
+
+// Frames voice exactly as FNEClient would and writes the DVM datagrams
+// to a pcap file, for offline inspection in Wireshark or diffing runs
+class PcapVoiceSink : public VoiceSink {
+public:
+    // Timestamp source for written packets, nanoseconds since the epoch
+    using TimeSource = std::function<int64_t()>;
+
+    PcapVoiceSink(uint32_t peerId, uint32_t fneAddr, uint16_t fnePort);
+
+    bool open(const std::string& path);
+    void close();
+
+    void setTimeSource(TimeSource source) { m_timeSource = source; }
+
+    void startStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+    void endStream(uint32_t call, uint32_t srcId, uint32_t dstId) override;
+    void sendLDU1(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                  uint32_t srcId, uint32_t dstId, bool firstLDU) override;
+    void sendLDU2(uint32_t call, const uint8_t imbe[9][IMBE_FRAME_SIZE],
+                  uint32_t srcId, uint32_t dstId) override;
+
+    uint64_t getStreams() const { return m_streams; }
+    uint64_t getFramesSent() const { return m_writer.getPacketsWritten(); }
+
+private:
+    void write(const uint8_t* packet, size_t len);
+
+    // Stream of a call, started on first use
+    StreamFramer& stream(uint32_t call);
+
+    StreamFramer m_framer;      // Identity each new stream starts from
+    std::unordered_map<uint32_t, StreamFramer> m_open;    // By call
+    PcapWriter m_writer;
+    TimeSource m_timeSource;
+    std::mutex m_mutex;
+
+    uint32_t m_localAddr;
+    uint16_t m_localPort;
+    uint32_t m_fneAddr;
+    uint16_t m_fnePort;
+
+    uint64_t m_streams;
+};
+
+} // namespace op25gateway
+
+#endif // VOICESINKS_H
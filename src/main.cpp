@@ -1,22 +1,41 @@
 #include "Config.h"
 #include "Logger.h"
-#include "OP25Receiver.h"
-#include "FNEClient.h"
+#include "Gateway.h"
 #include "CallManager.h"
+#include "PcapReplay.h"
+#include "VoiceSinks.h"
+#include "StopToken.h"
 
 #include <iostream>
 #include <sstream>
 #include <csignal>
 #include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <iomanip>
+#include <memory>
+#include <vector>
+
+#include <unistd.h>
+#include <arpa/inet.h>
 
 using namespace op25gateway;
 
-std::atomic<bool> g_running(true);
+StopToken g_stop;
+std::atomic<ConfigReloader*> g_configReloader(nullptr);
 
 void signalHandler(int signal) {
     if (signal == SIGINT || signal == SIGTERM) {
-        std::cout << "\nShutdown requested..." << std::endl;
-        g_running = false;
+        static const char message[] = "\nShutdown requested...\n";
+        ssize_t ignored = write(STDOUT_FILENO, message, sizeof(message) - 1);
+        (void)ignored;
+        g_stop.request();
+    } else if (signal == SIGHUP) {
+        ConfigReloader* reloader = g_configReloader.load();
+        if (reloader) {
+            reloader->requestReload();
+        }
     }
 }
 
@@ -34,13 +53,201 @@ void printUsage(const char* program) {
     std::cout << "Options:" << std::endl;
     std::cout << "  -c <file>  Configuration file (default: config.yml)" << std::endl;
     std::cout << "  -h         Show this help message" << std::endl;
+    std::cout << "  --takeover Take over sockets and calls from the running gateway (hot restart)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Send SIGHUP to reload the configuration file." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Offline replay:" << std::endl;
+    std::cout << "  --replay <file.pcap>      Feed OP25 datagrams from a capture instead of the socket" << std::endl;
+    std::cout << "  --replay-speed <x>        Pace at x times capture speed (default: 1)" << std::endl;
+    std::cout << "  --replay-afap             Replay as fast as possible" << std::endl;
+    std::cout << "  --replay-loops <n>        Passes over the capture (default: 1)" << std::endl;
+    std::cout << "  --replay-port <port>      Only replay datagrams to this port (default: op25.listenPort, 0 = any)" << std::endl;
+    std::cout << "  --replay-sink <sink>      fne (default), null, or pcap:<out.pcap>" << std::endl;
+    std::cout << "  --replay-pipeline <name>  Pipeline whose settings to use (default: the first)" << std::endl;
+}
+
+// Numeric option values: the whole argument, within range
+bool parseNumber(const char* text, double min, double max, double& value) {
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtod(text, &end);
+    return errno == 0 && end != text && *end == '\0' && value >= min && value <= max;
+}
+
+bool parseNumber(const char* text, unsigned long min, unsigned long max, unsigned long& value) {
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoul(text, &end, 10);
+    return errno == 0 && end != text && *end == '\0' && text[0] != '-' && value >= min && value <= max;
+}
+
+struct ReplayOptions {
+    std::string file;
+    double speed = 1.0;
+    uint32_t loops = 1;
+    int32_t port = -1;
+    std::string sink = "fne";
+    std::string pipeline;
+};
+
+// Startup and shutdown phase timing, relative to the start of either
+class PhaseTimeline {
+public:
+    explicit PhaseTimeline(Clock& clock)
+        : m_clock(clock), m_start(clock.now()), m_last(m_start) {}
+    PhaseTimeline(Clock& clock, Clock::TimePoint start)
+        : m_clock(clock), m_start(start), m_last(start) {}
+
+    // Ends the current phase
+    void phase(const char* name) {
+        Clock::TimePoint now = m_clock.now();
+        if (!m_phases.empty()) m_phases += " ";
+        m_phases += std::string(name) + "=" + formatMs(now - m_last);
+        m_last = now;
+    }
+
+    // Milliseconds from the start to t (0 if t is unset)
+    uint32_t sinceStartMs(Clock::TimePoint t) const {
+        if (t == Clock::TimePoint()) return 0;
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(t - m_start).count());
+    }
+
+    Clock::TimePoint start() const { return m_start; }
+    const std::string& phases() const { return m_phases; }
+    std::string total() const { return formatMs(m_last - m_start); }
+
+private:
+    static std::string formatMs(Clock::Duration d) {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2)
+           << std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0 << "ms";
+        return ss.str();
+    }
+
+    Clock& m_clock;
+    Clock::TimePoint m_start;
+    Clock::TimePoint m_last;
+    std::string m_phases;
+};
+
+int runReplay(const PipelineConfig& config, const ReplayOptions& options) {
+    PcapReplay replay;
+    if (!replay.open(options.file)) {
+        LOG_ERROR("Replay: " + options.file + ": " + replay.getError());
+        return 1;
+    }
+
+    replay.setSpeed(options.speed);
+    replay.setLoops(options.loops);
+    replay.setPortFilter(options.port >= 0 ? options.port : config.getOP25ListenPort());
+
+    // Pick the voice sink
+    std::unique_ptr<FNEClient> fneClient;
+    std::unique_ptr<NullVoiceSink> nullSink;
+    std::unique_ptr<PcapVoiceSink> pcapSink;
+    VoiceSink* sink = nullptr;
+
+    if (options.sink == "fne") {
+        fneClient.reset(new FNEClient(config.getFneHost(), config.getFnePort(),
+                                      config.getFnePeerId(), config.getFnePassword()));
+        configureFneClient(*fneClient, config);
+        // Replay has no live source to protect, so it may wait for the login
+        if (!fneClient->start() || !fneClient->waitForConnection(std::chrono::seconds(15))) {
+            LOG_ERROR("Replay: Could not connect to FNE");
+            return 1;
+        }
+        sink = fneClient.get();
+    } else if (options.sink == "null") {
+        nullSink.reset(new NullVoiceSink());
+        sink = nullSink.get();
+    } else if (options.sink.compare(0, 5, "pcap:") == 0) {
+        in_addr fneAddr;
+        if (inet_pton(AF_INET, config.getFneHost().c_str(), &fneAddr) != 1) {
+            fneAddr.s_addr = htonl(INADDR_LOOPBACK);
+        }
+        pcapSink.reset(new PcapVoiceSink(config.getFnePeerId(), fneAddr.s_addr, config.getFnePort()));
+        if (!pcapSink->open(options.sink.substr(5))) {
+            LOG_ERROR("Replay: Cannot write " + options.sink.substr(5));
+            return 1;
+        }
+        // Stamp output with capture time so it lines up with the input
+        pcapSink->setTimeSource([&replay]() { return replay.getCaptureTime(); });
+        sink = pcapSink.get();
+    } else {
+        LOG_ERROR("Replay: Unknown sink " + options.sink);
+        return 1;
+    }
+
+    // One thread keeps the output deterministic; a multi-channel source
+    // still gets its calls kept apart
+    CallManager callManager(*sink);
+    callManager.setConcurrentCalls(config.getCallWorkers() > 0);
+    callManager.setTalkgroupOverride(config.getGatewayTalkgroup());
+    callManager.setSourceIdOverride(config.getGatewaySourceId());
+    callManager.setCallTimeout(config.getCallTimeout());
+    callManager.start();
+
+    replay.setFrameCallback([&callManager](const OP25Packet& packet) {
+        callManager.processIMBEFrame(packet);
+    });
+
+    LOG_INFO("Replay: " + options.file + (options.speed > 0 ? "" : " (as fast as possible)"));
+    replay.run(g_stop.running());
+
+    // Ends any call still open, so the last stream gets its TDU
+    callManager.stop();
+
+    double elapsed = replay.getElapsedNs() / 1e9;
+    double captured = replay.getCaptureDurationNs() / 1e9;
+    uint64_t packets = replay.getPacketsReceived();
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(3)
+       << "Replay: records=" << replay.getRecordsRead()
+       << " skipped=" << replay.getRecordsSkipped()
+       << " packets=" << packets
+       << " invalid=" << replay.getPacketsInvalid()
+       << " calls=" << callManager.getCallCount()
+       << " LDU1=" << callManager.getLDU1Count()
+       << " LDU2=" << callManager.getLDU2Count()
+       << " missing=" << callManager.getFramesMissing()
+       << " capture=" << captured << "s"
+       << " elapsed=" << elapsed << "s"
+       << std::setprecision(0)
+       << " rate=" << (elapsed > 0 ? packets / elapsed : 0) << " frames/s"
+       << std::setprecision(1)
+       << " speedup=" << (elapsed > 0 ? captured / elapsed : 0) << "x";
+    if (options.speed > 0) {
+        ss << " maxLate=" << replay.getMaxLatenessNs() / 1000 << "us";
+    }
+    LOG_INFO(ss.str());
+
+    if (fneClient) {
+        LOG_INFO("Replay: FNE frames sent=" + std::to_string(fneClient->getFramesSent()) +
+                 " errors=" + std::to_string(fneClient->getSendErrors()));
+        fneClient->stop();
+    } else if (nullSink) {
+        LOG_INFO("Replay: Null sink streams=" + std::to_string(nullSink->getStreams()) +
+                 " frames=" + std::to_string(nullSink->getFramesSent()));
+    } else if (pcapSink) {
+        LOG_INFO("Replay: Wrote " + std::to_string(pcapSink->getFramesSent()) +
+                 " frames to " + options.sink.substr(5));
+        pcapSink->close();
+    }
+
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
+    PhaseTimeline startup(Clock::system());
+
     printBanner();
 
     // Parse command line arguments
     std::string configFile = "config.yml";
+    ReplayOptions replayOptions;
+    bool takeover = false;
 
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
@@ -50,6 +257,38 @@ int main(int argc, char* argv[]) {
             return 0;
         } else if (arg == "-c" && i + 1 < argc) {
             configFile = argv[++i];
+        } else if (arg == "--takeover") {
+            takeover = true;
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayOptions.file = argv[++i];
+        } else if (arg == "--replay-speed" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], 0.001, 1000.0, replayOptions.speed)) {
+                std::cerr << "Invalid --replay-speed: " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--replay-afap") {
+            replayOptions.speed = 0;
+        } else if (arg == "--replay-loops" && i + 1 < argc) {
+            unsigned long loops;
+            if (!parseNumber(argv[++i], 1UL, 1000000UL, loops)) {
+                std::cerr << "Invalid --replay-loops: " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+            replayOptions.loops = static_cast<uint32_t>(loops);
+        } else if (arg == "--replay-port" && i + 1 < argc) {
+            unsigned long port;
+            if (!parseNumber(argv[++i], 0UL, 65535UL, port)) {
+                std::cerr << "Invalid --replay-port: " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+            replayOptions.port = static_cast<int32_t>(port);
+        } else if (arg == "--replay-sink" && i + 1 < argc) {
+            replayOptions.sink = argv[++i];
+        } else if (arg == "--replay-pipeline" && i + 1 < argc) {
+            replayOptions.pipeline = argv[++i];
         }
     }
 
@@ -64,97 +303,85 @@ int main(int argc, char* argv[]) {
     }
 
     LOG_INFO("Configuration loaded");
+    std::string configError;
+    if (!config.validate(configError)) {
+        // The same checks refuse a reload; a restart must not get past them
+        LOG_ERROR("Config: " + configError);
+        return 1;
+    }
+    startup.phase("config");
 
     // Setup signal handlers
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
-
-    // Create FNE client
-    FNEClient fneClient(
-        config.getFneHost(),
-        config.getFnePort(),
-        config.getFnePeerId(),
-        config.getFnePassword()
-    );
-
-    fneClient.setIdentity("OP25-Gateway");
-
-    // Set connection callback
-    fneClient.setConnectionCallback([](bool connected) {
-        if (connected) {
-            LOG_INFO("FNE connection established");
-        } else {
-            LOG_WARN("FNE connection lost");
+    signal(SIGHUP, signalHandler);
+
+    if (!replayOptions.file.empty()) {
+        const PipelineConfig* pipeline = replayOptions.pipeline.empty() ? &config.getPipelines().front()
+                                                                        : config.findPipeline(replayOptions.pipeline);
+        if (!pipeline) {
+            LOG_ERROR("Replay: No pipeline named " + replayOptions.pipeline);
+            return 1;
         }
-    });
-
-    // Create call manager
-    CallManager callManager(fneClient);
-    callManager.setTalkgroupOverride(config.getGatewayTalkgroup());
-    callManager.setSourceIdOverride(config.getGatewaySourceId());
-    callManager.setCallTimeout(config.getCallTimeout());
-
-    // Create OP25 receiver
-    OP25Receiver op25Receiver(config.getOP25ListenPort());
-
-    // Set frame callback
-    op25Receiver.setFrameCallback([&callManager](const OP25Packet& packet) {
-        callManager.processIMBEFrame(packet);
-    });
-
-    // Connect to FNE with auto-reconnect
-    fneClient.enableAutoReconnect(true);
-    fneClient.setReconnectInterval(10);
-
-    LOG_INFO("Waiting for FNE connection...");
-
-    // Wait for initial connection (or timeout after 30 seconds)
-    for (int i = 0; i < 30 && g_running && !fneClient.isConnected(); i++) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        return runReplay(*pipeline, replayOptions);
     }
 
-    if (!fneClient.isConnected()) {
-        LOG_WARN("Could not connect to FNE, continuing anyway (will auto-reconnect)");
+    Gateway gateway(configFile, config, startup.start());
+    if (!gateway.setup()) {
+        return 1;
     }
+    startup.phase("setup");
 
-    // Start call manager
-    callManager.start();
-
-    // Start OP25 receiver
-    if (!op25Receiver.start()) {
-        LOG_ERROR("Failed to start OP25 receiver");
+    bool started = gateway.startPipelines(takeover);
+    startup.phase(takeover ? "takeover" : "start");
+    if (!started) {
         return 1;
     }
 
-    LOG_INFO("Gateway running - Press Ctrl+C to stop");
+    gateway.openStats();
+    startup.phase("stats");
+
+    gateway.startControl([]() { g_stop.request(); });
+    g_configReloader = gateway.getConfigReloader();
+
+    LOG_INFO("Startup: " + startup.phases() + ", receiving after " +
+             std::to_string(gateway.getReceiverReadyMs()) + " ms");
+
+    LOG_INFO("Gateway running " + std::to_string(gateway.getRunningCount()) + " of " +
+             std::to_string(gateway.getPipelineCount()) + " pipeline(s) on " +
+             std::to_string(gateway.getThreadCount()) + " thread(s) - Press Ctrl+C to stop");
 
     // Main loop
-    while (g_running) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+    Clock& clock = Clock::system();
+    auto nextStats = clock.now();
+    int statCounter = 0;
+
+    while (!g_stop.isRequested()) {
+        nextStats += std::chrono::seconds(1);
+        if (g_stop.waitUntil(nextStats)) {
+            break;
+        }
 
-        // Periodic stats logging
-        static int statCounter = 0;
-        if (++statCounter >= 60) {
+        // Stats pages every second, the log line every minute
+        bool logStats = ++statCounter >= 60;
+        if (logStats) {
             statCounter = 0;
-
-            std::stringstream ss;
-            ss << "Stats: OP25 packets=" << op25Receiver.getPacketsReceived()
-               << " calls=" << callManager.getCallCount()
-               << " LDU1=" << callManager.getLDU1Count()
-               << " LDU2=" << callManager.getLDU2Count()
-               << " FNE=" << (fneClient.isConnected() ? "connected" : "disconnected");
-            LOG_INFO(ss.str());
         }
+        gateway.update(logStats);
     }
 
-    // Shutdown
-    LOG_INFO("Shutting down...");
+    // Shutdown, timed from the signal (or the handoff completing)
+    PhaseTimeline shutdown(clock, g_stop.requestedAt());
+    shutdown.phase("wake");
+    g_configReloader = nullptr;
+    gateway.stopControl();
+    shutdown.phase("control");
+    LOG_INFO(gateway.isHandedOff() ? "Handed off, exiting" : "Shutting down...");
 
-    op25Receiver.stop();
-    callManager.stop();
-    fneClient.disconnect();
+    gateway.stop();
+    shutdown.phase("pipelines");
 
-    LOG_INFO("Shutdown complete");
+    LOG_INFO("Shutdown complete in " + shutdown.total() + " (" + shutdown.phases() + ")");
 
     return 0;
 }
@@ -0,0 +1,106 @@
+#ifndef OP25GATEWAY_H
+#define OP25GATEWAY_H
+
+/*
+ * libop25gateway: the OP25-to-DVM gateway inside another process
+ *
+ * The library runs the same gateway as op25-gateway (pipelines, calls, FNE
+ * sessions, stats pages) from a config.yml, but takes IMBE frames through
+ * gw_push_imbe() instead of the OP25 UDP port. A push copies the frame
+ * into a lock-free queue read by the pipeline's event loop; it makes no
+ * system call unless the loop has caught up and is asleep.
+ *
+ * Each pipeline's queue has a single producer: push to one pipeline from
+ * one thread at a time. Other calls may come from any thread.
+ *
+ * The ABI is plain C and only grows; GW_ABI_VERSION changes if a function
+ * or struct below ever changes incompatibly.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define GW_API __attribute__((visibility("default")))
+#else
+#define GW_API
+#endif
+
+#define GW_ABI_VERSION 2
+
+/* gw_open() flags */
+#define GW_OPEN_LISTEN_UDP  0x01    /* Keep the OP25 UDP port(s) open too */
+
+/* Frame types and flags, as in the OP25 UDP packet */
+#define GW_FRAME_LDU1       1
+#define GW_FRAME_LDU2       2
+#define GW_FRAME_TDU        3       /* The call has ended (TDU or TDULC seen) */
+#define GW_FLAG_ENCRYPTED   0x01
+
+#define GW_IMBE_SIZE        11
+
+/* Results */
+#define GW_OK               0
+#define GW_ERR_INVALID      (-1)    /* Bad handle, pipeline, type or index */
+#define GW_ERR_FULL         (-2)    /* Queue full, frame dropped */
+#define GW_ERR_STOPPED      (-3)    /* Pipeline not running */
+
+typedef struct gw_handle gw_handle;
+
+/*
+ * Set struct_size to sizeof(gw_stats) before calling gw_get_stats(). The
+ * library writes only that many bytes, so a caller built against an older,
+ * shorter gw_stats keeps working when fields are added at the end.
+ */
+typedef struct gw_stats {
+    size_t struct_size;             /* Filled in by the caller */
+    uint64_t frames_received;       /* Pushed and UDP frames taken */
+    uint64_t frames_invalid;        /* UDP datagrams that did not parse */
+    uint64_t frames_refused;        /* Pushes refused with GW_ERR_FULL */
+    uint64_t calls;
+    uint64_t active_calls;
+    uint64_t ldu1;
+    uint64_t ldu2;
+    uint64_t frames_missing;        /* Voice frames never received, sent as silence */
+    int32_t fne_connected;
+} gw_stats;
+
+/* GW_ABI_VERSION the library was built with */
+GW_API int gw_abi_version(void);
+
+/*
+ * Load config_path and start every pipeline in it. Logging goes where the
+ * config's log settings say. NULL if the config cannot be read or is
+ * invalid, or if no pipeline starts.
+ */
+GW_API gw_handle* gw_open(const char* config_path, unsigned flags);
+
+/* End active calls, disconnect from the FNE and free the handle */
+GW_API void gw_close(gw_handle* handle);
+
+GW_API unsigned gw_pipeline_count(const gw_handle* handle);
+
+/*
+ * One IMBE voice frame for the first pipeline: type is GW_FRAME_LDU1 or
+ * GW_FRAME_LDU2, idx its position 0-8 in the LDU, imbe GW_IMBE_SIZE bytes.
+ * GW_FRAME_TDU ends the call on tg at once; idx is 0 and imbe may be NULL.
+ */
+GW_API int gw_push_imbe(gw_handle* handle, uint16_t nac, uint32_t tg, uint32_t src,
+                        uint8_t type, uint8_t idx, uint8_t flags, const uint8_t* imbe);
+
+/* The same for the pipeline'th pipeline, in config order */
+GW_API int gw_push_imbe_to(gw_handle* handle, unsigned pipeline, uint16_t nac, uint32_t tg,
+                           uint32_t src, uint8_t type, uint8_t idx, uint8_t flags,
+                           const uint8_t* imbe);
+
+GW_API int gw_get_stats(gw_handle* handle, unsigned pipeline, gw_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OP25GATEWAY_H */
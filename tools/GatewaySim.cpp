@@ -0,0 +1,512 @@
+// op25-gateway-sim - discrete-event simulation of a day of traffic
+//
+// Drives CallManager with a VirtualClock instead of real time, so a full
+// busy-day traffic pattern on one conventional channel runs in seconds.
+// Calls arrive as a Poisson process whose rate follows an hourly load
+// profile, frames are delivered every 20 ms of virtual time, and the call
+// timeout check runs on its normal 100 ms cadence. A checking sink
+// verifies that every stream ends either on a source/talkgroup change or
+// within one check interval after the call timeout, and the run reports
+// the CPU cost per frame of the real gateway code.
+
+#include "CallManager.h"
+#include "Clock.h"
+#include "Logger.h"
+#include "P25Utils.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <cmath>
+#include <atomic>
+
+#include <time.h>
+
+using namespace op25gateway;
+
+namespace {
+
+std::atomic<bool> g_running(true);
+
+void signalHandler(int) {
+    g_running = false;
+}
+
+using Ms = std::chrono::milliseconds;
+
+constexpr Ms FRAME_INTERVAL(20);            // One IMBE frame every 20 ms
+constexpr int FRAMES_PER_SUPERFRAME = 18;   // LDU1 + LDU2
+
+// Relative call load per hour of day, normalised to a peak of 1.0
+const double BUSY_DAY_PROFILE[24] = {
+    0.15, 0.10, 0.08, 0.08, 0.10, 0.20, 0.45, 0.75, 0.90, 0.95, 1.00, 1.00,
+    0.95, 0.95, 1.00, 1.00, 0.95, 0.90, 0.75, 0.60, 0.50, 0.40, 0.30, 0.20
+};
+
+struct Options {
+    double hours = 24.0;
+    bool busyDay = true;
+    double callsPerHour = 120.0;    // At peak load
+    double callMeanSec = 8.0;
+    double callMinSec = 1.0;
+    double callMaxSec = 60.0;
+    uint32_t timeoutMs = 1000;
+    uint16_t nac = 0x293;
+    uint32_t tgBase = 1000;
+    uint32_t tgPool = 4;
+    uint32_t srcBase = 1000000;
+    uint32_t srcPool = 50;
+    double lossPct = 0.0;
+    uint32_t seed = 1;
+    bool verbose = false;
+    std::string reportFile;
+};
+
+int64_t cpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+int64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Sink that checks stream boundaries against the simulated timeline
+class CheckingSink : public VoiceSink {
+public:
+    CheckingSink(const Clock& clock, uint32_t timeoutMs)
+        : m_clock(clock)
+        , m_timeout(timeoutMs)
+    {
+    }
+
+    // Set by the simulator around processIMBEFrame, so a stream ended by
+    // a source/talkgroup change can be told apart from a timeout
+    void setInFrame(bool inFrame) { m_inFrame = inFrame; }
+    void setLastFrameTime(Clock::TimePoint time) { m_lastFrame = time; }
+
+    void startStream(uint32_t, uint32_t, uint32_t) override {
+        if (m_open) m_violations++;     // Start without end
+        m_open = true;
+        m_streams++;
+    }
+
+    void endStream(uint32_t, uint32_t, uint32_t) override {
+        if (!m_open) m_violations++;
+        m_open = false;
+        m_tdus++;
+
+        if (m_inFrame) {
+            m_changeEnds++;
+            return;
+        }
+
+        // The timeout check ends a call once it has been idle for more than
+        // the timeout, on the next 100 ms tick
+        Ms hang = std::chrono::duration_cast<Ms>(m_clock.now() - m_lastFrame);
+        m_timeoutEnds++;
+        m_maxHang = std::max(m_maxHang, hang);
+        if (hang <= m_timeout || hang > m_timeout + CallManager::TIMEOUT_CHECK_INTERVAL + FRAME_INTERVAL) {
+            m_violations++;
+        }
+    }
+
+    void sendLDU1(uint32_t, const uint8_t[9][IMBE_FRAME_SIZE], uint32_t, uint32_t, bool) override {
+        if (!m_open) m_violations++;
+        m_ldu1++;
+    }
+
+    void sendLDU2(uint32_t, const uint8_t[9][IMBE_FRAME_SIZE], uint32_t, uint32_t) override {
+        if (!m_open) m_violations++;
+        m_ldu2++;
+    }
+
+    bool isOpen() const { return m_open; }
+
+    uint64_t m_streams = 0;
+    uint64_t m_tdus = 0;
+    uint64_t m_ldu1 = 0;
+    uint64_t m_ldu2 = 0;
+    uint64_t m_timeoutEnds = 0;
+    uint64_t m_changeEnds = 0;
+    uint64_t m_violations = 0;
+    Ms m_maxHang{0};
+
+private:
+    const Clock& m_clock;
+    Ms m_timeout;
+    Clock::TimePoint m_lastFrame;
+    bool m_inFrame = false;
+    bool m_open = false;
+};
+
+struct Call {
+    Clock::TimePoint start;
+    uint32_t frames;
+    uint32_t srcId;
+    uint32_t dstId;
+};
+
+class Simulator {
+public:
+    explicit Simulator(const Options& opts)
+        : m_opts(opts)
+        , m_rng(opts.seed)
+        , m_sink(m_clock, opts.timeoutMs)
+        , m_callManager(m_sink, m_clock)
+    {
+        m_callManager.setCallTimeout(opts.timeoutMs);
+    }
+
+    bool run() {
+        generateCalls();
+
+        int64_t wallStart = monotonicNs();
+        int64_t cpuStart = cpuTimeNs();
+
+        Clock::TimePoint end = m_clock.now() + std::chrono::duration_cast<Clock::Duration>(
+            std::chrono::duration<double, std::ratio<3600>>(m_opts.hours));
+        m_nextTick = m_clock.now() + CallManager::TIMEOUT_CHECK_INTERVAL;
+
+        std::bernoulli_distribution loss(m_opts.lossPct / 100.0);
+        Clock::TimePoint lastDelivered;
+        uint32_t lastSrc = 0;
+        uint32_t lastDst = 0;
+
+        for (const Call& call : m_calls) {
+            if (!g_running) break;
+
+            for (uint32_t f = 0; f < call.frames; f++) {
+                Clock::TimePoint due = call.start + FRAME_INTERVAL * f;
+                advanceTo(due);
+
+                m_framesScheduled++;
+                if (loss(m_rng)) {
+                    m_framesLost++;
+                    continue;
+                }
+
+                // A frame opens a new stream on new IDs or once the previous
+                // stream has timed out; close to the boundary it depends on
+                // where the 100 ms check falls
+                Ms gap = std::chrono::duration_cast<Ms>(due - lastDelivered);
+                if (m_framesDelivered == 0 || call.srcId != lastSrc || call.dstId != lastDst ||
+                    gap > Ms(m_opts.timeoutMs) + CallManager::TIMEOUT_CHECK_INTERVAL) {
+                    m_expectedStreams++;
+                } else if (gap > Ms(m_opts.timeoutMs)) {
+                    m_ambiguous++;
+                } else if (f == 0) {
+                    m_mergedCalls++;
+                }
+
+                OP25Packet packet;
+                buildPacket(packet, call, f);
+
+                m_sink.setInFrame(true);
+                m_callManager.processIMBEFrame(packet);
+                m_sink.setInFrame(false);
+                m_sink.setLastFrameTime(due);
+
+                m_framesDelivered++;
+                lastDelivered = due;
+                lastSrc = call.srcId;
+                lastDst = call.dstId;
+            }
+        }
+
+        // Let the last call time out
+        advanceTo(std::max(end, m_clock.now() + Ms(m_opts.timeoutMs) +
+                                    2 * CallManager::TIMEOUT_CHECK_INTERVAL));
+
+        m_cpuNs = cpuTimeNs() - cpuStart;
+        m_wallNs = monotonicNs() - wallStart;
+        m_simulatedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            m_clock.now().time_since_epoch()).count();
+
+        return checkResults();
+    }
+
+    void printReport(std::ostream& out) const {
+        double wall = m_wallNs / 1e9;
+        double simulated = m_simulatedNs / 1e9;
+
+        out << "op25-gateway-sim: " << std::fixed << std::setprecision(1)
+            << simulated / 3600.0 << " h simulated in " << std::setprecision(3) << wall << " s ("
+            << std::setprecision(0) << (wall > 0 ? simulated / wall : 0) << "x)" << std::endl;
+        out << "  calls=" << m_calls.size()
+            << " merged=" << m_mergedCalls
+            << " streams=" << m_sink.m_streams
+            << " timeoutEnds=" << m_sink.m_timeoutEnds
+            << " changeEnds=" << m_sink.m_changeEnds
+            << " maxHang=" << m_sink.m_maxHang.count() << "ms" << std::endl;
+        out << "  frames=" << m_framesScheduled
+            << " lost=" << m_framesLost
+            << " LDU1=" << m_sink.m_ldu1
+            << " LDU2=" << m_sink.m_ldu2
+            << " missing=" << m_callManager.getFramesMissing()
+            << " timeoutChecks=" << m_ticks << std::endl;
+        out << "  cpu=" << std::setprecision(3) << m_cpuNs / 1e9 << " s"
+            << std::setprecision(0) << " perFrame=" << cpuPerFrameNs() << " ns"
+            << " violations=" << m_sink.m_violations + m_checkFailures
+            << (passed() ? "  PASS" : "  FAIL") << std::endl;
+    }
+
+    bool writeJsonReport(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out.good()) {
+            std::cerr << "Failed to write report to " << path << std::endl;
+            return false;
+        }
+
+        out << std::fixed << std::setprecision(3);
+        out << "{\n";
+        out << "  \"simulatedSec\": " << m_simulatedNs / 1e9 << ",\n";
+        out << "  \"wallSec\": " << m_wallNs / 1e9 << ",\n";
+        out << "  \"cpuSec\": " << m_cpuNs / 1e9 << ",\n";
+        out << "  \"cpuPerFrameNs\": " << cpuPerFrameNs() << ",\n";
+        out << "  \"calls\": " << m_calls.size() << ",\n";
+        out << "  \"mergedCalls\": " << m_mergedCalls << ",\n";
+        out << "  \"streams\": " << m_sink.m_streams << ",\n";
+        out << "  \"timeoutEnds\": " << m_sink.m_timeoutEnds << ",\n";
+        out << "  \"changeEnds\": " << m_sink.m_changeEnds << ",\n";
+        out << "  \"maxHangMs\": " << m_sink.m_maxHang.count() << ",\n";
+        out << "  \"framesScheduled\": " << m_framesScheduled << ",\n";
+        out << "  \"framesLost\": " << m_framesLost << ",\n";
+        out << "  \"ldu1\": " << m_sink.m_ldu1 << ",\n";
+        out << "  \"ldu2\": " << m_sink.m_ldu2 << ",\n";
+        out << "  \"framesMissing\": " << m_callManager.getFramesMissing() << ",\n";
+        out << "  \"violations\": " << m_sink.m_violations + m_checkFailures << ",\n";
+        out << "  \"passed\": " << (passed() ? "true" : "false") << "\n";
+        out << "}\n";
+        return true;
+    }
+
+    bool passed() const {
+        return m_sink.m_violations == 0 && m_checkFailures == 0;
+    }
+
+private:
+    // Non-homogeneous Poisson arrivals by thinning, queued onto one channel
+    void generateCalls() {
+        std::exponential_distribution<double> interarrival(m_opts.callsPerHour / 3600.0);
+        std::exponential_distribution<double> length(1.0 / m_opts.callMeanSec);
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::uniform_int_distribution<uint32_t> tg(0, m_opts.tgPool ? m_opts.tgPool - 1 : 0);
+        std::uniform_int_distribution<uint32_t> src(0, m_opts.srcPool ? m_opts.srcPool - 1 : 0);
+
+        double horizon = m_opts.hours * 3600.0;
+        double t = 0.0;
+        Clock::TimePoint channelFree = m_clock.now();
+
+        while (true) {
+            t += interarrival(m_rng);
+            if (t >= horizon) break;
+
+            double load = m_opts.busyDay ? BUSY_DAY_PROFILE[static_cast<int>(t / 3600.0) % 24] : 1.0;
+            if (unit(m_rng) > load) continue;
+
+            double seconds = std::min(std::max(length(m_rng), m_opts.callMinSec), m_opts.callMaxSec);
+            uint32_t superframes = std::max<uint32_t>(1, static_cast<uint32_t>(
+                std::lround(seconds * 1000.0 / (FRAMES_PER_SUPERFRAME * FRAME_INTERVAL.count()))));
+
+            Call call;
+            call.start = std::max(Clock::TimePoint(std::chrono::duration_cast<Clock::Duration>(
+                                      std::chrono::duration<double>(t))),
+                                  channelFree);
+            // Align to the frame grid
+            call.start = Clock::TimePoint(FRAME_INTERVAL * ((call.start.time_since_epoch() +
+                                          FRAME_INTERVAL - Clock::Duration(1)) / FRAME_INTERVAL));
+            call.frames = superframes * FRAMES_PER_SUPERFRAME;
+            call.srcId = m_opts.srcBase + src(m_rng);
+            call.dstId = m_opts.tgBase + tg(m_rng);
+
+            channelFree = call.start + FRAME_INTERVAL * call.frames;
+            if (channelFree.time_since_epoch() > std::chrono::duration<double>(horizon)) break;
+
+            m_calls.push_back(call);
+        }
+    }
+
+    // Move virtual time forward, running the timeout check at each tick
+    void advanceTo(Clock::TimePoint time) {
+        while (m_nextTick <= time) {
+            m_clock.advanceTo(m_nextTick);
+            m_callManager.checkTimeout();
+            m_nextTick += CallManager::TIMEOUT_CHECK_INTERVAL;
+            m_ticks++;
+        }
+        m_clock.advanceTo(time);
+    }
+
+    void buildPacket(OP25Packet& packet, const Call& call, uint32_t frame) const {
+        std::memset(&packet, 0, sizeof(packet));
+        packet.magic = OP25_MAGIC;
+        packet.nac = m_opts.nac;
+        packet.talkgroup = call.dstId;
+        packet.sourceId = call.srcId;
+        packet.voiceIndex = frame % 9;
+        packet.frameType = (frame / 9) % 2 == 0 ? 0x01 : 0x02;
+        packet.imbe[0] = frame & 0xFF;
+    }
+
+    bool checkResults() {
+        m_checkFailures = 0;
+
+        if (m_sink.isOpen()) {
+            std::cerr << "Stream still open at end of simulation" << std::endl;
+            m_checkFailures++;
+        }
+
+        uint64_t expectedMin = m_expectedStreams;
+        uint64_t expectedMax = m_expectedStreams + m_ambiguous;
+        if (m_sink.m_streams < expectedMin || m_sink.m_streams > expectedMax) {
+            std::cerr << "Expected " << expectedMin << "-" << expectedMax
+                      << " streams, gateway produced " << m_sink.m_streams << std::endl;
+            m_checkFailures++;
+        }
+
+        // Every call is whole superframes, so without loss each LDU is complete
+        if (m_framesLost == 0) {
+            uint64_t ldus = m_framesScheduled / 9;
+            if (m_sink.m_ldu1 + m_sink.m_ldu2 != ldus || m_callManager.getFramesMissing() != 0) {
+                std::cerr << "Expected " << ldus << " LDUs, gateway sent "
+                          << m_sink.m_ldu1 + m_sink.m_ldu2 << std::endl;
+                m_checkFailures++;
+            }
+        }
+
+        return passed();
+    }
+
+    double cpuPerFrameNs() const {
+        return m_framesDelivered ? static_cast<double>(m_cpuNs) / m_framesDelivered : 0.0;
+    }
+
+    Options m_opts;
+    std::mt19937 m_rng;
+    VirtualClock m_clock;
+    CheckingSink m_sink;
+    CallManager m_callManager;
+
+    std::vector<Call> m_calls;
+    Clock::TimePoint m_nextTick;
+
+    uint64_t m_framesScheduled = 0;
+    uint64_t m_framesDelivered = 0;
+    uint64_t m_framesLost = 0;
+    uint64_t m_ticks = 0;
+    uint64_t m_expectedStreams = 0;
+    uint64_t m_mergedCalls = 0;
+    uint64_t m_ambiguous = 0;
+    uint64_t m_checkFailures = 0;
+
+    int64_t m_cpuNs = 0;
+    int64_t m_wallNs = 0;
+    int64_t m_simulatedNs = 0;
+};
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -d <hours>             Simulated duration (default: 24)" << std::endl;
+    std::cout << "  --profile <p>          busy-day (default) or flat" << std::endl;
+    std::cout << "  --calls-per-hour <n>   Call arrival rate at peak (default: 120)" << std::endl;
+    std::cout << "  --call-mean <s>        Mean call length, exponential (default: 8)" << std::endl;
+    std::cout << "  --call-min <s>         Shortest call (default: 1)" << std::endl;
+    std::cout << "  --call-max <s>         Longest call (default: 60)" << std::endl;
+    std::cout << "  --timeout <ms>         Gateway call timeout (default: 1000)" << std::endl;
+    std::cout << "  --tg-pool <n>          Talkgroups in use (default: 4)" << std::endl;
+    std::cout << "  --src-pool <n>         Radios in use (default: 50)" << std::endl;
+    std::cout << "  --loss <pct>           Drop this percentage of frames (default: 0)" << std::endl;
+    std::cout << "  --seed <n>             Random seed (default: 1)" << std::endl;
+    std::cout << "  -o <file>              Write a JSON report" << std::endl;
+    std::cout << "  -v                     Show gateway log output" << std::endl;
+    std::cout << "  -h                     Show this help message" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+
+            if (arg == "-h" || arg == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            } else if (arg == "-d" && i + 1 < argc) {
+                opts.hours = std::stod(argv[++i]);
+            } else if (arg == "--profile" && i + 1 < argc) {
+                std::string profile = argv[++i];
+                if (profile != "busy-day" && profile != "flat") {
+                    std::cerr << "Unknown profile: " << profile << std::endl;
+                    return 1;
+                }
+                opts.busyDay = (profile == "busy-day");
+            } else if (arg == "--calls-per-hour" && i + 1 < argc) {
+                opts.callsPerHour = std::stod(argv[++i]);
+            } else if (arg == "--call-mean" && i + 1 < argc) {
+                opts.callMeanSec = std::stod(argv[++i]);
+            } else if (arg == "--call-min" && i + 1 < argc) {
+                opts.callMinSec = std::stod(argv[++i]);
+            } else if (arg == "--call-max" && i + 1 < argc) {
+                opts.callMaxSec = std::stod(argv[++i]);
+            } else if (arg == "--timeout" && i + 1 < argc) {
+                opts.timeoutMs = std::stoul(argv[++i]);
+            } else if (arg == "--tg-pool" && i + 1 < argc) {
+                opts.tgPool = std::stoul(argv[++i]);
+            } else if (arg == "--src-pool" && i + 1 < argc) {
+                opts.srcPool = std::stoul(argv[++i]);
+            } else if (arg == "--loss" && i + 1 < argc) {
+                opts.lossPct = std::stod(argv[++i]);
+            } else if (arg == "--seed" && i + 1 < argc) {
+                opts.seed = std::stoul(argv[++i]);
+            } else if (arg == "-o" && i + 1 < argc) {
+                opts.reportFile = argv[++i];
+            } else if (arg == "-v") {
+                opts.verbose = true;
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Invalid option value" << std::endl;
+        return 1;
+    }
+
+    if (opts.callsPerHour <= 0 || opts.callMeanSec <= 0 || opts.hours <= 0) {
+        std::cerr << "Duration, call rate and call length must be positive" << std::endl;
+        return 1;
+    }
+
+    Logger::instance().setLevel(opts.verbose ? LogLevel::INFO : LogLevel::WARN);
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    Simulator sim(opts);
+    bool ok = sim.run();
+    sim.printReport(std::cout);
+
+    if (!opts.reportFile.empty() && !sim.writeJsonReport(opts.reportFile)) {
+        return 1;
+    }
+
+    return ok ? 0 : 1;
+}
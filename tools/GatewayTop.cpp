@@ -0,0 +1,450 @@
+// op25-gateway-top - live view of a running gateway's shared-memory stats page
+//
+// Reads /dev/shm/op25-gateway-<peerId> without any coordination with the
+// gateway process, so it can be run as often as needed on production hosts.
+
+#include "StatsPage.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+
+#include <sched.h>
+
+using namespace op25gateway;
+
+static std::atomic<bool> g_running(true);
+
+static void signalHandler(int) {
+    g_running = false;
+}
+
+static void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -p <peerId>  Gateway peer ID (default: 9000999)" << std::endl;
+    std::cout << "  -i <ms>      Refresh interval in milliseconds (default: 1000)" << std::endl;
+    std::cout << "  -1           Print one snapshot and exit" << std::endl;
+    std::cout << "  -j           Print one snapshot as JSON and exit" << std::endl;
+    std::cout << "  -h           Show this help message" << std::endl;
+}
+
+static uint64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static const char* fneStateName(uint32_t state) {
+    switch (state) {
+        case STATS_FNE_CONNECTED:  return "CONNECTED";
+        case STATS_FNE_CONNECTING: return "CONNECTING";
+        default:                   return "DISCONNECTED";
+    }
+}
+
+static std::string formatDuration(uint64_t ms) {
+    uint64_t secs = ms / 1000;
+    std::ostringstream oss;
+    oss << secs / 3600 << ":" << std::setfill('0') << std::setw(2) << (secs / 60) % 60
+        << ":" << std::setw(2) << secs % 60;
+    return oss.str();
+}
+
+// The name as published, never trusting the writer to have terminated it
+static std::string pipelineName(const StatsPageData& data) {
+    return std::string(data.pipelineName, strnlen(data.pipelineName, sizeof(data.pipelineName)));
+}
+
+// "fifo:50", "other", ...
+static std::string schedName(uint32_t policy, uint32_t priority) {
+    switch (policy) {
+        case SCHED_FIFO: return "fifo:" + std::to_string(priority);
+        case SCHED_RR:   return "rr:" + std::to_string(priority);
+        case SCHED_OTHER: return "other";
+        case SCHED_BATCH: return "batch";
+        case SCHED_IDLE:  return "idle";
+        default:          return std::to_string(policy);
+    }
+}
+
+// CPU mask as a list such as "2-3", "all" when unpinned
+static std::string cpuList(uint64_t mask) {
+    uint32_t online = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t all = online >= 64 ? ~0ULL : (1ULL << online) - 1;
+    if ((mask & all) == all) return "all";
+
+    std::string list;
+    for (int cpu = 0; cpu < 64; cpu++) {
+        if (!(mask & (1ULL << cpu))) continue;
+
+        int last = cpu;
+        while (last + 1 < 64 && (mask & (1ULL << (last + 1)))) last++;
+        if (!list.empty()) list += ",";
+        list += std::to_string(cpu);
+        if (last > cpu) list += "-" + std::to_string(last);
+        cpu = last;
+    }
+    return list;
+}
+
+// Host-order IPv4 address as dotted quad
+static std::string ipv4Text(uint32_t address) {
+    return std::to_string(address >> 24) + "." + std::to_string((address >> 16) & 0xFF) + "." +
+           std::to_string((address >> 8) & 0xFF) + "." + std::to_string(address & 0xFF);
+}
+
+static void render(const StatsPageData& data, uint64_t updateTimeMs, uint32_t pid, bool clear) {
+    uint64_t now = nowMs();
+    std::ostringstream out;
+
+    if (clear) {
+        out << "\033[H\033[2J";
+    }
+
+    out << "OP25-to-DVM Gateway  peer " << data.fnePeerId << "  pid " << pid
+        << "  (updated " << (now > updateTimeMs ? now - updateTimeMs : 0) << " ms ago)\n\n";
+
+    out << "OP25   packets=" << data.op25PacketsReceived
+        << " invalid=" << data.op25PacketsInvalid
+        << " kernelDrops=" << data.op25KernelDrops
+        << " queue=" << data.op25QueueBytes << "/" << data.op25RcvBufBytes
+        << " peak=" << data.op25QueuePeakBytes << "\n";
+    if (data.op25RingCapacity > 0) {
+        out << "Ring   " << (data.op25RingAttached ? "attached" : "waiting")
+            << " frames=" << data.op25RingFrames
+            << " doorbells=" << data.op25RingDoorbells
+            << " drops=" << data.op25RingDrops
+            << " size=" << data.op25RingCapacity
+            << " connects=" << data.op25RingConnects << "\n";
+    }
+    if (data.op25VoteWindowMs > 0) {
+        out << "Vote   window=" << data.op25VoteWindowMs << "ms"
+            << " votes=" << data.op25Votes
+            << " timeouts=" << data.op25VoteTimeouts
+            << " hold=" << data.op25VoteHoldAvgUs << "us"
+            << " holdMax=" << data.op25VoteHoldMaxUs << "us\n";
+        for (uint32_t i = 0; i < data.op25VoterSiteCount && i < STATS_MAX_VOTER_SITES; i++) {
+            const StatsVoterSite& site = data.op25VoterSites[i];
+            out << "       site" << i + 1 << " " << ipv4Text(site.address) << ":" << site.port
+                << " frames=" << site.frames
+                << " wins=" << site.wins
+                << " losses=" << site.losses
+                << " late=" << site.late << "\n";
+        }
+    }
+    out << "Calls  total=" << data.callsTotal
+        << " active=" << data.callsActive
+        << " LDU1=" << data.ldu1Total
+        << " LDU2=" << data.ldu2Total
+        << " missing=" << data.framesMissingTotal << "\n";
+    out << "       ended by terminator=" << data.callsTerminated
+        << " (teardown " << data.teardownTerminatedAvgUs << "us max " << data.teardownTerminatedMaxUs << "us)"
+        << " timeout=" << data.callsTimedOut
+        << " (teardown " << data.teardownTimedOutAvgUs / 1000 << "ms max " << data.teardownTimedOutMaxUs / 1000 << "ms)\n";
+    if (data.callWorkers > 0) {
+        out << "       workers=" << data.callWorkers
+            << " queuePeak=" << data.callQueuePeak
+            << " queueDrops=" << data.callQueueDrops << "\n";
+    }
+    out << "FNE    " << fneStateName(data.fneState);
+    if (data.fneConnectedSinceMs != 0 && now > data.fneConnectedSinceMs) {
+        out << " for " << formatDuration(now - data.fneConnectedSinceMs);
+    }
+    out << " logins=" << data.fneLogins
+        << " attempts=" << data.fneLoginAttempts
+        << " failures=" << data.fneLoginFailures
+        << " login=" << data.fneLastLoginMs << "ms"
+        << " auth=" << data.fneTimeToAuthMs << "ms"
+        << " sent=" << data.fneFramesSent
+        << " errors=" << data.fneSendErrors << "\n";
+    out << "       rtt=" << data.fneRttUs << "us"
+        << " srtt=" << data.fneSrttUs << "us"
+        << " missed=" << data.fneMissedPongs
+        << " losses=" << data.fneLinkLosses
+        << " recovery=" << data.fneRecoveryMs << "ms"
+        << " naks=" << data.fneNaksReceived << "\n";
+    out << "       buffer=" << data.fneBufferLdus << " (" << data.fneBufferCapacity << "/stream)"
+        << " peak=" << data.fneBufferPeakLdus
+        << " budget=" << data.fneBufferBudgetMs << "ms"
+        << " buffered=" << data.fneLdusBuffered
+        << " replayed=" << data.fneLdusReplayed
+        << " discarded=" << data.fneLdusDiscarded << "\n";
+    if (data.fneStandbyEnabled) {
+        out << "FNE2   " << fneStateName(data.fneStandbyState)
+            << " rtt=" << data.fneStandbyRttUs << "us"
+            << " logins=" << data.fneStandbyLogins
+            << " losses=" << data.fneStandbyLinkLosses
+            << "  active=" << (data.fneActiveSession == 0 ? "primary" : "secondary")
+            << " failovers=" << data.fneFailovers
+            << " moved=" << data.fneMidCallSwitches
+            << " failbacks=" << data.fneFailbacks
+            << " last=" << data.fneLastFailoverMs << "ms\n";
+    }
+    out << "Start  receiver=" << data.startupReceiverReadyMs << "ms"
+        << " fne=" << data.startupFneReadyMs << "ms"
+        << " firstFrame=" << data.startupFirstFrameMs << "ms"
+        << " firstForward=" << data.startupFirstForwardMs << "ms\n";
+    out << "Config reloads=" << data.configReloads
+        << " rejected=" << data.configReloadsRejected
+        << " last=" << (data.configLastReloadMs ? formatDuration(now > data.configLastReloadMs ? now - data.configLastReloadMs : 0) + " ago" : std::string("never"))
+        << " pendingRestart=" << data.configPendingRestart << "\n";
+    if (data.pipelineCount > 1) {
+        out << "Pipe   " << pipelineName(data)
+            << " (" << data.pipelineIndex + 1 << " of " << data.pipelineCount << ")"
+            << " workers=" << data.workerThreads << "\n";
+    }
+    out << "Memory " << (data.memoryLocked ? "locked " + std::to_string(data.memoryLockedKb) + " kB"
+                                           : std::string("not locked")) << "\n";
+    out << "\n";
+
+    out << std::left
+        << std::setw(16) << "THREAD"
+        << std::setw(8) << "TID"
+        << std::setw(8) << "SCHED"
+        << std::setw(10) << "CPUS"
+        << std::setw(10) << "WAKES"
+        << std::setw(10) << "AVG(us)"
+        << std::setw(10) << "P99(us)"
+        << std::setw(10) << "MAX(us)"
+        << std::setw(10) << "VOLCSW"
+        << std::setw(10) << "INVOLCSW"
+        << std::setw(10) << "IO"
+        << "SYSCALLS\n";
+
+    for (uint32_t i = 0; i < data.threadCount && i < STATS_MAX_THREADS; i++) {
+        const StatsThreadEntry& thread = data.threads[i];
+        out << std::setw(16) << std::string(thread.name, strnlen(thread.name, sizeof(thread.name)))
+            << std::setw(8) << thread.tid
+            << std::setw(8) << schedName(thread.policy, thread.priority)
+            << std::setw(10) << cpuList(thread.cpuMask)
+            << std::setw(10) << thread.wakes
+            << std::setw(10) << thread.wakeAvgUs
+            << std::setw(10) << thread.wakeP99Us
+            << std::setw(10) << thread.wakeMaxUs
+            << std::setw(10) << thread.voluntarySwitches
+            << std::setw(10) << thread.involuntarySwitches
+            << std::setw(10) << (thread.ioUring ? "io_uring" : "epoll")
+            << thread.syscalls << "\n";
+    }
+    out << "\n";
+
+    out << std::left
+        << std::setw(8) << "NAC"
+        << std::setw(10) << "TG"
+        << std::setw(10) << "SRC"
+        << std::setw(10) << "DURATION"
+        << std::setw(8) << "FRAMES"
+        << std::setw(8) << "LDU1"
+        << std::setw(8) << "LDU2"
+        << std::setw(8) << "MISS"
+        << std::setw(8) << "KDROP"
+        << "IDLE(ms)\n";
+
+    for (uint32_t i = 0; i < data.activeCallCount && i < STATS_MAX_CALLS; i++) {
+        const StatsCallEntry& call = data.calls[i];
+        std::ostringstream nac;
+        nac << "0x" << std::hex << call.nac;
+
+        out << std::setw(8) << nac.str()
+            << std::setw(10) << call.dstId
+            << std::setw(10) << call.srcId
+            << std::setw(10) << formatDuration(now > call.startTimeMs ? now - call.startTimeMs : 0)
+            << std::setw(8) << call.frames
+            << std::setw(8) << call.ldu1
+            << std::setw(8) << call.ldu2
+            << std::setw(8) << call.framesMissing
+            << std::setw(8) << call.kernelDrops
+            << (now > call.lastFrameTimeMs ? now - call.lastFrameTimeMs : 0) << "\n";
+    }
+
+    std::cout << out.str() << std::flush;
+}
+
+static void renderJson(const StatsPageData& data, uint64_t updateTimeMs, uint32_t pid) {
+    std::ostringstream out;
+
+    out << "{\n";
+    out << "  \"pid\": " << pid << ",\n";
+    out << "  \"updateTimeMs\": " << updateTimeMs << ",\n";
+    out << "  \"op25PacketsReceived\": " << data.op25PacketsReceived << ",\n";
+    out << "  \"op25PacketsInvalid\": " << data.op25PacketsInvalid << ",\n";
+    out << "  \"op25KernelDrops\": " << data.op25KernelDrops << ",\n";
+    out << "  \"op25RcvBufBytes\": " << data.op25RcvBufBytes << ",\n";
+    out << "  \"op25QueueBytes\": " << data.op25QueueBytes << ",\n";
+    out << "  \"op25QueuePeakBytes\": " << data.op25QueuePeakBytes << ",\n";
+    out << "  \"op25RingCapacity\": " << data.op25RingCapacity << ",\n";
+    out << "  \"op25RingAttached\": " << (data.op25RingAttached ? "true" : "false") << ",\n";
+    out << "  \"op25RingFrames\": " << data.op25RingFrames << ",\n";
+    out << "  \"op25RingDoorbells\": " << data.op25RingDoorbells << ",\n";
+    out << "  \"op25RingDrops\": " << data.op25RingDrops << ",\n";
+    out << "  \"op25RingConnects\": " << data.op25RingConnects << ",\n";
+    out << "  \"op25VoteWindowMs\": " << data.op25VoteWindowMs << ",\n";
+    out << "  \"op25Votes\": " << data.op25Votes << ",\n";
+    out << "  \"op25VoteTimeouts\": " << data.op25VoteTimeouts << ",\n";
+    out << "  \"op25VoteHoldAvgUs\": " << data.op25VoteHoldAvgUs << ",\n";
+    out << "  \"op25VoteHoldMaxUs\": " << data.op25VoteHoldMaxUs << ",\n";
+    out << "  \"op25VoterSites\": [";
+    for (uint32_t i = 0; i < data.op25VoterSiteCount && i < STATS_MAX_VOTER_SITES; i++) {
+        const StatsVoterSite& site = data.op25VoterSites[i];
+        out << (i ? ",\n" : "\n")
+            << "    {\"address\": \"" << ipv4Text(site.address) << ":" << site.port << "\""
+            << ", \"frames\": " << site.frames
+            << ", \"wins\": " << site.wins
+            << ", \"losses\": " << site.losses
+            << ", \"late\": " << site.late << "}";
+    }
+    out << (data.op25VoterSiteCount ? "\n  ],\n" : "],\n");
+    out << "  \"callsTotal\": " << data.callsTotal << ",\n";
+    out << "  \"ldu1Total\": " << data.ldu1Total << ",\n";
+    out << "  \"ldu2Total\": " << data.ldu2Total << ",\n";
+    out << "  \"framesMissingTotal\": " << data.framesMissingTotal << ",\n";
+    out << "  \"callsTerminated\": " << data.callsTerminated << ",\n";
+    out << "  \"callsTimedOut\": " << data.callsTimedOut << ",\n";
+    out << "  \"teardownTerminatedAvgUs\": " << data.teardownTerminatedAvgUs << ",\n";
+    out << "  \"teardownTerminatedMaxUs\": " << data.teardownTerminatedMaxUs << ",\n";
+    out << "  \"teardownTimedOutAvgUs\": " << data.teardownTimedOutAvgUs << ",\n";
+    out << "  \"teardownTimedOutMaxUs\": " << data.teardownTimedOutMaxUs << ",\n";
+    out << "  \"fneState\": \"" << fneStateName(data.fneState) << "\",\n";
+    out << "  \"fnePeerId\": " << data.fnePeerId << ",\n";
+    out << "  \"fneFramesSent\": " << data.fneFramesSent << ",\n";
+    out << "  \"fneSendErrors\": " << data.fneSendErrors << ",\n";
+    out << "  \"fneLogins\": " << data.fneLogins << ",\n";
+    out << "  \"fneLoginAttempts\": " << data.fneLoginAttempts << ",\n";
+    out << "  \"fneLoginFailures\": " << data.fneLoginFailures << ",\n";
+    out << "  \"fneLastLoginMs\": " << data.fneLastLoginMs << ",\n";
+    out << "  \"fneTimeToAuthMs\": " << data.fneTimeToAuthMs << ",\n";
+    out << "  \"fneLinkLosses\": " << data.fneLinkLosses << ",\n";
+    out << "  \"fneNaksReceived\": " << data.fneNaksReceived << ",\n";
+    out << "  \"fneRecoveryMs\": " << data.fneRecoveryMs << ",\n";
+    out << "  \"fneMissedPongs\": " << data.fneMissedPongs << ",\n";
+    out << "  \"fneRttUs\": " << data.fneRttUs << ",\n";
+    out << "  \"fneSrttUs\": " << data.fneSrttUs << ",\n";
+    out << "  \"fneBufferLdus\": " << data.fneBufferLdus << ",\n";
+    out << "  \"fneBufferPeakLdus\": " << data.fneBufferPeakLdus << ",\n";
+    out << "  \"fneBufferCapacity\": " << data.fneBufferCapacity << ",\n";
+    out << "  \"fneBufferBudgetMs\": " << data.fneBufferBudgetMs << ",\n";
+    out << "  \"fneLdusBuffered\": " << data.fneLdusBuffered << ",\n";
+    out << "  \"fneLdusReplayed\": " << data.fneLdusReplayed << ",\n";
+    out << "  \"fneLdusDiscarded\": " << data.fneLdusDiscarded << ",\n";
+    out << "  \"fneStandbyEnabled\": " << (data.fneStandbyEnabled ? "true" : "false") << ",\n";
+    out << "  \"fneActiveSession\": " << data.fneActiveSession << ",\n";
+    out << "  \"fneStandbyState\": \"" << fneStateName(data.fneStandbyState) << "\",\n";
+    out << "  \"fneStandbyRttUs\": " << data.fneStandbyRttUs << ",\n";
+    out << "  \"fneStandbyLogins\": " << data.fneStandbyLogins << ",\n";
+    out << "  \"fneStandbyLinkLosses\": " << data.fneStandbyLinkLosses << ",\n";
+    out << "  \"fneFailovers\": " << data.fneFailovers << ",\n";
+    out << "  \"fneMidCallSwitches\": " << data.fneMidCallSwitches << ",\n";
+    out << "  \"fneFailbacks\": " << data.fneFailbacks << ",\n";
+    out << "  \"fneLastFailoverMs\": " << data.fneLastFailoverMs << ",\n";
+    out << "  \"startupReceiverReadyMs\": " << data.startupReceiverReadyMs << ",\n";
+    out << "  \"startupFneReadyMs\": " << data.startupFneReadyMs << ",\n";
+    out << "  \"startupFirstFrameMs\": " << data.startupFirstFrameMs << ",\n";
+    out << "  \"startupFirstForwardMs\": " << data.startupFirstForwardMs << ",\n";
+    out << "  \"configReloads\": " << data.configReloads << ",\n";
+    out << "  \"configReloadsRejected\": " << data.configReloadsRejected << ",\n";
+    out << "  \"configLastReloadMs\": " << data.configLastReloadMs << ",\n";
+    out << "  \"configPendingRestart\": " << data.configPendingRestart << ",\n";
+    out << "  \"pipelineName\": \"" << pipelineName(data) << "\",\n";
+    out << "  \"pipelineIndex\": " << data.pipelineIndex << ",\n";
+    out << "  \"pipelineCount\": " << data.pipelineCount << ",\n";
+    out << "  \"workerThreads\": " << data.workerThreads << ",\n";
+    out << "  \"callWorkers\": " << data.callWorkers << ",\n";
+    out << "  \"callQueuePeak\": " << data.callQueuePeak << ",\n";
+    out << "  \"callQueueDrops\": " << data.callQueueDrops << ",\n";
+    out << "  \"memoryLocked\": " << (data.memoryLocked ? "true" : "false") << ",\n";
+    out << "  \"memoryLockedKb\": " << data.memoryLockedKb << ",\n";
+    out << "  \"threads\": [";
+    for (uint32_t i = 0; i < data.threadCount && i < STATS_MAX_THREADS; i++) {
+        const StatsThreadEntry& thread = data.threads[i];
+        out << (i ? ",\n" : "\n")
+            << "    {\"name\": \"" << std::string(thread.name, strnlen(thread.name, sizeof(thread.name))) << "\""
+            << ", \"tid\": " << thread.tid
+            << ", \"sched\": \"" << schedName(thread.policy, thread.priority) << "\""
+            << ", \"cpus\": \"" << cpuList(thread.cpuMask) << "\""
+            << ", \"wakes\": " << thread.wakes
+            << ", \"wakeAvgUs\": " << thread.wakeAvgUs
+            << ", \"wakeP99Us\": " << thread.wakeP99Us
+            << ", \"wakeMaxUs\": " << thread.wakeMaxUs
+            << ", \"voluntarySwitches\": " << thread.voluntarySwitches
+            << ", \"involuntarySwitches\": " << thread.involuntarySwitches
+            << ", \"ioBackend\": \"" << (thread.ioUring ? "io_uring" : "epoll") << "\""
+            << ", \"syscalls\": " << thread.syscalls << "}";
+    }
+    out << (data.threadCount ? "\n  ],\n" : "],\n");
+    out << "  \"activeCalls\": " << data.callsActive << "\n";
+    out << "}\n";
+
+    std::cout << out.str() << std::flush;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t peerId = 9000999;
+    int intervalMs = 1000;
+    bool once = false;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "-p" && i + 1 < argc) {
+            peerId = std::stoul(argv[++i]);
+        } else if (arg == "-i" && i + 1 < argc) {
+            intervalMs = std::stoi(argv[++i]);
+        } else if (arg == "-1") {
+            once = true;
+        } else if (arg == "-j") {
+            once = true;
+            json = true;
+        }
+    }
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    StatsReader reader;
+
+    while (g_running) {
+        if (!reader.isOpen() && !reader.open(peerId)) {
+            if (once) {
+                std::cerr << "No stats page at /dev/shm" << statsPageName(peerId) << std::endl;
+                return 1;
+            }
+        } else {
+            StatsPageData data;
+            uint64_t updateTimeMs = 0;
+            uint32_t pid = 0;
+
+            if (reader.read(data, &updateTimeMs, &pid)) {
+                if (json) {
+                    renderJson(data, updateTimeMs, pid);
+                } else {
+                    render(data, updateTimeMs, pid, !once);
+                }
+
+                // A restarted gateway recreates the segment; drop a stale mapping
+                if (nowMs() > updateTimeMs + 5000) {
+                    reader.close();
+                }
+            } else if (once) {
+                std::cerr << "Stats page busy or incompatible version" << std::endl;
+                return 1;
+            }
+        }
+
+        if (once) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef LATENCYSTAMP_H
+#define LATENCYSTAMP_H
+
+// Send-time stamp carried inside IMBE payload for end-to-end latency tests
+//
+// op25-loadgen --stamp writes CLOCK_MONOTONIC at send time into the last
+// IMBE frame of each LDU. The gateway copies IMBE bytes through untouched,
+// so mock-fne can read the stamp back out of the voice 9 slot when the LDU
+// arrives and compute the latency the gateway added on the same host.
+
+#include "P25Utils.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <time.h>
+
+namespace op25gateway {
+
+// IMBE byte 2 normally echoes the voice index (0-8); this value marks a stamp
+constexpr uint8_t LATENCY_STAMP_MARKER = 0xE5;
+
+// Voice 9 IMBE offset within LDU1/LDU2 P25 payloads
+constexpr size_t LATENCY_STAMP_LDU_OFFSET = 166;
+
+inline int64_t latencyStampNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// imbe points at an 11-byte IMBE frame
+inline void writeLatencyStamp(uint8_t* imbe, int64_t ns) {
+    imbe[2] = LATENCY_STAMP_MARKER;
+    for (int i = 0; i < 8; i++) {
+        imbe[3 + i] = static_cast<uint8_t>(static_cast<uint64_t>(ns) >> (56 - 8 * i));
+    }
+}
+
+inline bool readLatencyStamp(const uint8_t* imbe, int64_t& ns) {
+    if (imbe[2] != LATENCY_STAMP_MARKER) return false;
+
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | imbe[3 + i];
+    }
+    ns = static_cast<int64_t>(value);
+    return true;
+}
+
+} // namespace op25gateway
+
+#endif // LATENCYSTAMP_H
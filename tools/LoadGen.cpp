@@ -0,0 +1,680 @@
+// op25-loadgen - synthetic OP25 traffic generator for capacity planning
+//
+// Simulates N concurrent talkgroup channels, each alternating between
+// calls and idle gaps drawn from configurable distributions, and emits
+// OP25 UDP datagrams in the layout parseOP25Packet expects. In real-time
+// mode every channel sends one IMBE frame per 20 ms using a hybrid
+// sleep/spin clock; in as-fast-as-possible mode the same schedule is
+// replayed without pacing to measure raw throughput. A summary of what
+// was sent is printed (and optionally written as JSON) so it can be
+// reconciled with the gateway's counters. With --embed the frames go to a
+// gateway running in this process through libop25gateway instead of UDP,
+// and with --ring through a gateway's shared-memory ring. With --sites
+// each frame is sent from several sockets, as from several OP25 sites,
+// each copy with its own error count, for the gateway's frame voter.
+// With --terminate calls end with a terminator, as OP25 reports a TDU.
+
+#include "P25Utils.h"
+#include "LatencyStamp.h"
+#include "op25gateway.h"
+#include "ShmRing.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <queue>
+#include <map>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <atomic>
+#include <memory>
+
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+using namespace op25gateway;
+
+namespace {
+
+std::atomic<bool> g_running(true);
+
+void signalHandler(int) {
+    g_running = false;
+}
+
+constexpr int64_t FRAME_INTERVAL_NS = 20000000;    // One IMBE frame every 20 ms
+constexpr int FRAMES_PER_LDU = 9;
+
+enum class Distribution {
+    FIXED,
+    UNIFORM,
+    EXPONENTIAL
+};
+
+struct DistSpec {
+    Distribution type;
+    double mean;    // Seconds (FIXED/EXPONENTIAL)
+    double min;     // Seconds (UNIFORM, also lower clamp for EXPONENTIAL)
+    double max;     // Seconds (UNIFORM, also upper clamp for EXPONENTIAL)
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    uint16_t port = 9999;
+    uint32_t channels = 1;
+    double durationSec = 60.0;
+    DistSpec callLength = {Distribution::EXPONENTIAL, 8.0, 1.0, 60.0};
+    DistSpec callGap = {Distribution::EXPONENTIAL, 4.0, 0.5, 60.0};
+    uint16_t nac = 0x293;
+    uint32_t tgBase = 1000;
+    uint32_t tgPool = 0;        // 0 = one fixed talkgroup per channel
+    uint32_t srcBase = 1000000;
+    uint32_t srcPool = 500;
+    double lossPct = 0.0;
+    double reorderPct = 0.0;
+    uint32_t sites = 1;         // Copies of each frame, one per source socket
+    double siteLossPct = 0.0;   // Drop this share of copies, independently per site
+    double terminatePct = 0.0;  // End this share of calls with a terminator
+    bool afap = false;
+    bool stamp = false;         // Send-time stamps for mock-fne latency measurement
+    int64_t spinNs = 200000;    // Spin for the last 200 us before each send
+    uint32_t seed = 1;
+    std::string reportFile;
+    std::string embedConfig;    // Push to an in-process gateway with this config
+    uint32_t ringPeerId = 0;    // Push to this gateway pipeline's shared-memory ring
+};
+
+// One simulated talkgroup channel
+struct Channel {
+    uint32_t id;
+    bool active;
+    uint32_t talkgroup;
+    uint32_t sourceId;
+    uint32_t framesLeft;        // Frames remaining in the current call
+    uint32_t frameIndex;        // Frames sent in the current call
+    bool held;                  // A frame is being held back for reordering
+    uint8_t heldFrame[OP25_PACKET_SIZE];
+};
+
+struct Event {
+    int64_t due;                // Nanoseconds since start of schedule
+    uint32_t channel;
+
+    bool operator>(const Event& other) const { return due > other.due; }
+};
+
+struct Totals {
+    uint64_t calls = 0;
+    uint64_t framesScheduled = 0;
+    uint64_t framesSent = 0;
+    uint64_t framesLost = 0;
+    uint64_t framesReordered = 0;
+    uint64_t sendErrors = 0;
+    uint64_t ldusStarted = 0;   // LDUs with at least their first frame sent
+    uint64_t ldusComplete = 0;  // LDUs whose frames were all sent
+    uint64_t copiesSent = 0;    // With --sites
+    uint64_t copiesLost = 0;
+    uint64_t terminators = 0;   // Calls ended with a terminator
+    std::map<uint32_t, uint64_t> callsPerTalkgroup;
+    std::vector<float> latenessUs;
+};
+
+int64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Sleep until shortly before the deadline, then spin the rest of the way:
+// nanosleep alone overshoots by tens of microseconds or more on a busy box
+void waitUntil(int64_t deadlineNs, int64_t spinNs) {
+    int64_t sleepUntil = deadlineNs - spinNs;
+    if (monotonicNs() < sleepUntil) {
+        struct timespec ts;
+        ts.tv_sec = sleepUntil / 1000000000LL;
+        ts.tv_nsec = sleepUntil % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+            if (!g_running) return;
+        }
+    }
+
+    while (monotonicNs() < deadlineNs) {
+        // Spin
+    }
+}
+
+bool parseDist(const std::string& text, DistSpec& spec) {
+    // exp:<mean>[:<min>:<max>] | uniform:<min>:<max> | fixed:<value>
+    std::vector<std::string> parts;
+    std::stringstream ss(text);
+    std::string part;
+    while (std::getline(ss, part, ':')) {
+        parts.push_back(part);
+    }
+    if (parts.size() < 2) return false;
+
+    try {
+        if (parts[0] == "fixed") {
+            spec.type = Distribution::FIXED;
+            spec.mean = std::stod(parts[1]);
+        } else if (parts[0] == "uniform" && parts.size() == 3) {
+            spec.type = Distribution::UNIFORM;
+            spec.min = std::stod(parts[1]);
+            spec.max = std::stod(parts[2]);
+        } else if (parts[0] == "exp") {
+            spec.type = Distribution::EXPONENTIAL;
+            spec.mean = std::stod(parts[1]);
+            if (parts.size() == 4) {
+                spec.min = std::stod(parts[2]);
+                spec.max = std::stod(parts[3]);
+            }
+        } else {
+            return false;
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+double percentile(std::vector<float> values, double pct) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t idx = static_cast<size_t>(std::ceil(pct / 100.0 * values.size())) - 1;
+    return values[std::min(idx, values.size() - 1)];
+}
+
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const Options& opts)
+        : m_opts(opts)
+        , m_rng(opts.seed)
+        , m_socket(-1)
+        , m_gateway(nullptr)
+    {
+        std::memset(&m_dest, 0, sizeof(m_dest));
+    }
+
+    ~LoadGenerator() {
+        for (int fd : m_siteSockets) {
+            close(fd);
+        }
+        if (m_gateway) {
+            gw_close(m_gateway);
+        }
+    }
+
+    bool open() {
+        if (!m_opts.embedConfig.empty()) {
+            m_gateway = gw_open(m_opts.embedConfig.c_str(), 0);
+            if (!m_gateway) {
+                std::cerr << "Failed to start embedded gateway from " << m_opts.embedConfig << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        if (m_opts.ringPeerId != 0) {
+            m_ring.reset(new ShmRingProducer(m_opts.ringPeerId));
+            if (!m_ring->connect()) {
+                std::cerr << "Failed to attach to the ring of gateway peer " << m_opts.ringPeerId << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        struct hostent* host = gethostbyname(m_opts.host.c_str());
+        if (!host) {
+            std::cerr << "Failed to resolve " << m_opts.host << std::endl;
+            return false;
+        }
+
+        m_dest.sin_family = AF_INET;
+        m_dest.sin_port = htons(m_opts.port);
+        std::memcpy(&m_dest.sin_addr, host->h_addr, host->h_length);
+
+        // One socket, and so one source port, per site
+        for (uint32_t i = 0; i < std::max(1u, m_opts.sites); i++) {
+            int fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (fd < 0) {
+                std::cerr << "Failed to create socket" << std::endl;
+                return false;
+            }
+
+            int sndbuf = 4 * 1024 * 1024;
+            setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+            m_siteSockets.push_back(fd);
+        }
+        m_socket = m_siteSockets[0];
+        return true;
+    }
+
+    void run() {
+        const int64_t endNs = static_cast<int64_t>(m_opts.durationSec * 1e9);
+
+        m_channels.resize(m_opts.channels);
+        for (uint32_t i = 0; i < m_opts.channels; i++) {
+            Channel& ch = m_channels[i];
+            std::memset(&ch, 0, sizeof(ch));
+            ch.id = i;
+
+            // Stagger channels so they do not all start on the same tick
+            int64_t firstStart = static_cast<int64_t>(sample(m_opts.callGap) * 1e9 *
+                std::uniform_real_distribution<double>(0.0, 1.0)(m_rng));
+            firstStart += std::uniform_int_distribution<int64_t>(0, FRAME_INTERVAL_NS - 1)(m_rng);
+            m_events.push({firstStart, i});
+        }
+
+        m_startNs = monotonicNs();
+
+        while (g_running && !m_events.empty()) {
+            Event ev = m_events.top();
+            if (ev.due >= endNs) break;
+            m_events.pop();
+
+            if (!m_opts.afap) {
+                waitUntil(m_startNs + ev.due, m_opts.spinNs);
+                int64_t late = monotonicNs() - (m_startNs + ev.due);
+                if (m_totals.latenessUs.size() < 5000000) {
+                    m_totals.latenessUs.push_back(static_cast<float>(late / 1000.0));
+                }
+            }
+
+            step(m_channels[ev.channel], ev.due);
+        }
+
+        m_elapsedNs = monotonicNs() - m_startNs;
+    }
+
+    void printReport(std::ostream& out) const {
+        double elapsed = m_elapsedNs / 1e9;
+
+        out << "op25-loadgen: " << (m_opts.afap ? "as-fast-as-possible" : "real-time")
+            << " run, " << m_opts.channels << " channels, " << std::fixed << std::setprecision(2)
+            << elapsed << " s" << std::endl;
+        out << "  calls=" << m_totals.calls
+            << " scheduled=" << m_totals.framesScheduled
+            << " sent=" << m_totals.framesSent
+            << " lost=" << m_totals.framesLost
+            << " reordered=" << m_totals.framesReordered
+            << " sendErrors=" << m_totals.sendErrors
+            << " completeLDUs=" << m_totals.ldusComplete
+            << " terminators=" << m_totals.terminators << std::endl;
+        if (m_siteSockets.size() > 1) {
+            out << "  sites=" << m_siteSockets.size()
+                << " copiesSent=" << m_totals.copiesSent
+                << " copiesLost=" << m_totals.copiesLost << std::endl;
+        }
+        out << "  rate=" << std::setprecision(0) << (elapsed > 0 ? m_totals.framesSent / elapsed : 0)
+            << " frames/s";
+        if (!m_opts.afap) {
+            out << std::setprecision(1)
+                << " lateness p50=" << percentile(m_totals.latenessUs, 50.0) << "us"
+                << " p99=" << percentile(m_totals.latenessUs, 99.0) << "us"
+                << " max=" << percentile(m_totals.latenessUs, 100.0) << "us";
+        }
+        out << std::endl;
+    }
+
+    bool writeJsonReport(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out.good()) {
+            std::cerr << "Failed to write report to " << path << std::endl;
+            return false;
+        }
+
+        out << std::fixed << std::setprecision(3);
+        out << "{\n";
+        out << "  \"mode\": \"" << (m_opts.afap ? "afap" : "realtime") << "\",\n";
+        out << "  \"channels\": " << m_opts.channels << ",\n";
+        out << "  \"elapsedSec\": " << m_elapsedNs / 1e9 << ",\n";
+        out << "  \"calls\": " << m_totals.calls << ",\n";
+        out << "  \"framesScheduled\": " << m_totals.framesScheduled << ",\n";
+        out << "  \"framesSent\": " << m_totals.framesSent << ",\n";
+        out << "  \"framesLost\": " << m_totals.framesLost << ",\n";
+        out << "  \"framesReordered\": " << m_totals.framesReordered << ",\n";
+        out << "  \"sendErrors\": " << m_totals.sendErrors << ",\n";
+        out << "  \"startedLDUs\": " << m_totals.ldusStarted << ",\n";
+        out << "  \"completeLDUs\": " << m_totals.ldusComplete << ",\n";
+        out << "  \"terminators\": " << m_totals.terminators << ",\n";
+        out << "  \"sites\": " << std::max<size_t>(1, m_siteSockets.size()) << ",\n";
+        out << "  \"copiesSent\": " << m_totals.copiesSent << ",\n";
+        out << "  \"copiesLost\": " << m_totals.copiesLost << ",\n";
+        out << "  \"latenessP50Us\": " << percentile(m_totals.latenessUs, 50.0) << ",\n";
+        out << "  \"latenessP99Us\": " << percentile(m_totals.latenessUs, 99.0) << ",\n";
+        out << "  \"latenessMaxUs\": " << percentile(m_totals.latenessUs, 100.0) << ",\n";
+        out << "  \"callsPerTalkgroup\": {";
+
+        bool first = true;
+        for (const auto& entry : m_totals.callsPerTalkgroup) {
+            out << (first ? "" : ", ") << "\"" << entry.first << "\": " << entry.second;
+            first = false;
+        }
+        out << "}\n}\n";
+        return true;
+    }
+
+private:
+    double sample(const DistSpec& spec) {
+        switch (spec.type) {
+            case Distribution::FIXED:
+                return spec.mean;
+            case Distribution::UNIFORM:
+                return std::uniform_real_distribution<double>(spec.min, spec.max)(m_rng);
+            case Distribution::EXPONENTIAL:
+            default: {
+                double v = std::exponential_distribution<double>(1.0 / spec.mean)(m_rng);
+                return std::min(std::max(v, spec.min), spec.max);
+            }
+        }
+    }
+
+    bool chance(double pct) {
+        if (pct <= 0.0) return false;
+        return std::uniform_real_distribution<double>(0.0, 100.0)(m_rng) < pct;
+    }
+
+    void startCall(Channel& ch) {
+        // Talkgroup churn: draw from the pool, or stick to the channel's own TG
+        if (m_opts.tgPool > 0) {
+            ch.talkgroup = m_opts.tgBase +
+                std::uniform_int_distribution<uint32_t>(0, m_opts.tgPool - 1)(m_rng);
+        } else {
+            ch.talkgroup = m_opts.tgBase + ch.id;
+        }
+        ch.sourceId = m_opts.srcBase +
+            std::uniform_int_distribution<uint32_t>(0, std::max<uint32_t>(m_opts.srcPool, 1) - 1)(m_rng);
+
+        // Calls are made of whole superframes (LDU1 + LDU2)
+        uint32_t frames = static_cast<uint32_t>(sample(m_opts.callLength) * 1e9 / FRAME_INTERVAL_NS);
+        uint32_t superframe = FRAMES_PER_LDU * 2;
+        ch.framesLeft = std::max(superframe, (frames + superframe - 1) / superframe * superframe);
+        ch.frameIndex = 0;
+        ch.active = true;
+        ch.held = false;
+
+        m_totals.calls++;
+        m_totals.callsPerTalkgroup[ch.talkgroup]++;
+    }
+
+    void step(Channel& ch, int64_t now) {
+        if (!ch.active) {
+            startCall(ch);
+        }
+
+        uint8_t frame[OP25_PACKET_SIZE];
+        buildFrame(ch, frame);
+        ch.frameIndex++;
+        ch.framesLeft--;
+        m_totals.framesScheduled++;
+
+        if (chance(m_opts.lossPct)) {
+            m_totals.framesLost++;
+        } else if (!ch.held && ch.framesLeft > 0 && chance(m_opts.reorderPct)) {
+            // Hold this frame and send it right after the next one
+            std::memcpy(ch.heldFrame, frame, sizeof(frame));
+            ch.held = true;
+            m_totals.framesReordered++;
+        } else {
+            transmit(frame);
+            if (ch.held) {
+                transmit(ch.heldFrame);
+                ch.held = false;
+            }
+        }
+
+        if (ch.framesLeft == 0) {
+            if (ch.held) {
+                transmit(ch.heldFrame);
+                ch.held = false;
+            }
+            if (chance(m_opts.terminatePct)) {
+                // OP25 saw the TDU or TDULC that follows the last LDU
+                buildFrame(ch, frame);
+                frame[12] = OP25_FRAME_TDU;
+                frame[13] = 0;
+                std::memset(frame + 16, 0, IMBE_FRAME_SIZE);
+                transmit(frame);
+            }
+            ch.active = false;
+            int64_t gap = static_cast<int64_t>(sample(m_opts.callGap) * 1e9);
+            m_events.push({now + FRAME_INTERVAL_NS + gap, ch.id});
+        } else {
+            m_events.push({now + FRAME_INTERVAL_NS, ch.id});
+        }
+    }
+
+    void buildFrame(const Channel& ch, uint8_t* data) {
+        uint32_t lduNumber = ch.frameIndex / FRAMES_PER_LDU;
+        uint8_t voiceIndex = ch.frameIndex % FRAMES_PER_LDU;
+
+        std::memset(data, 0, OP25_PACKET_SIZE);
+        data[0] = OP25_MAGIC >> 8;
+        data[1] = OP25_MAGIC & 0xFF;
+        data[2] = (m_opts.nac >> 8) & 0xFF;
+        data[3] = m_opts.nac & 0xFF;
+        data[4] = (ch.talkgroup >> 24) & 0xFF;
+        data[5] = (ch.talkgroup >> 16) & 0xFF;
+        data[6] = (ch.talkgroup >> 8) & 0xFF;
+        data[7] = ch.talkgroup & 0xFF;
+        data[8] = (ch.sourceId >> 24) & 0xFF;
+        data[9] = (ch.sourceId >> 16) & 0xFF;
+        data[10] = (ch.sourceId >> 8) & 0xFF;
+        data[11] = ch.sourceId & 0xFF;
+        data[12] = (lduNumber % 2 == 0) ? OP25_FRAME_LDU1 : OP25_FRAME_LDU2;
+        data[13] = voiceIndex;
+        data[14] = 0x00;    // Flags: clear
+        data[15] = 0x00;
+
+        // Recognizable, non-silent IMBE payload: channel, LDU and index
+        data[16] = static_cast<uint8_t>(ch.id);
+        data[17] = static_cast<uint8_t>(lduNumber);
+        data[18] = voiceIndex;
+        for (size_t i = 3; i < IMBE_FRAME_SIZE; i++) {
+            data[16 + i] = static_cast<uint8_t>(0xA5 ^ (i * 17));
+        }
+    }
+
+    void transmit(uint8_t* frame) {
+        if (m_opts.stamp && frame[13] == FRAMES_PER_LDU - 1) {
+            writeLatencyStamp(frame + 16, latencyStampNow());
+        }
+
+        if (m_gateway) {
+            uint32_t tg = (uint32_t)frame[4] << 24 | (uint32_t)frame[5] << 16 | (uint32_t)frame[6] << 8 | frame[7];
+            uint32_t src = (uint32_t)frame[8] << 24 | (uint32_t)frame[9] << 16 | (uint32_t)frame[10] << 8 | frame[11];
+            if (gw_push_imbe(m_gateway, m_opts.nac, tg, src, frame[12], frame[13], frame[14], frame + 16) != GW_OK) {
+                m_totals.sendErrors++;
+                return;
+            }
+        } else if (m_ring) {
+            uint32_t tg = (uint32_t)frame[4] << 24 | (uint32_t)frame[5] << 16 | (uint32_t)frame[6] << 8 | frame[7];
+            uint32_t src = (uint32_t)frame[8] << 24 | (uint32_t)frame[9] << 16 | (uint32_t)frame[10] << 8 | frame[11];
+            if (!m_ring->push(m_opts.nac, tg, src, frame[12], frame[13], frame[14], frame + 16)) {
+                m_totals.sendErrors++;
+                return;
+            }
+        } else if (m_siteSockets.size() > 1) {
+            // Each site heard the frame with its own bit errors, or not at all
+            for (int fd : m_siteSockets) {
+                if (chance(m_opts.siteLossPct)) {
+                    m_totals.copiesLost++;
+                    continue;
+                }
+                frame[15] = static_cast<uint8_t>(std::uniform_int_distribution<int>(0, 7)(m_rng));
+                if (sendto(fd, frame, OP25_PACKET_SIZE, 0, (const struct sockaddr*)&m_dest,
+                           sizeof(m_dest)) != (ssize_t)OP25_PACKET_SIZE) {
+                    m_totals.sendErrors++;
+                    continue;
+                }
+                m_totals.copiesSent++;
+            }
+        } else {
+            ssize_t sent = sendto(m_socket, frame, OP25_PACKET_SIZE, 0,
+                                  (const struct sockaddr*)&m_dest, sizeof(m_dest));
+            if (sent != (ssize_t)OP25_PACKET_SIZE) {
+                m_totals.sendErrors++;
+                return;
+            }
+        }
+
+        if (frame[12] == OP25_FRAME_TDU) {
+            m_totals.terminators++;
+            return;
+        }
+        m_totals.framesSent++;
+        if (frame[13] == 0) {
+            m_totals.ldusStarted++;
+        }
+        if (frame[13] == FRAMES_PER_LDU - 1) {
+            m_totals.ldusComplete++;
+        }
+    }
+
+    Options m_opts;
+    std::mt19937 m_rng;
+    int m_socket;
+    std::vector<int> m_siteSockets;
+    struct sockaddr_in m_dest;
+    gw_handle* m_gateway;
+    std::unique_ptr<ShmRingProducer> m_ring;
+
+    std::vector<Channel> m_channels;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> m_events;
+
+    int64_t m_startNs = 0;
+    int64_t m_elapsedNs = 0;
+    Totals m_totals;
+};
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -H <host>            Gateway host (default: 127.0.0.1)" << std::endl;
+    std::cout << "  -p <port>            Gateway OP25 port (default: 9999)" << std::endl;
+    std::cout << "  -n <channels>        Concurrent talkgroup channels (default: 1)" << std::endl;
+    std::cout << "  -d <seconds>         Run time, in schedule time (default: 60)" << std::endl;
+    std::cout << "  --call <dist>        Call length distribution (default: exp:8:1:60)" << std::endl;
+    std::cout << "  --gap <dist>         Idle gap between calls (default: exp:4:0.5:60)" << std::endl;
+    std::cout << "  --nac <hex>          NAC (default: 293)" << std::endl;
+    std::cout << "  --tg-base <id>       First talkgroup ID (default: 1000)" << std::endl;
+    std::cout << "  --tg-pool <n>        Pick each call's TG from <n> TGs (default: one per channel)" << std::endl;
+    std::cout << "  --src-base <id>      First source ID (default: 1000000)" << std::endl;
+    std::cout << "  --src-pool <n>       Number of distinct source IDs (default: 500)" << std::endl;
+    std::cout << "  --loss <pct>         Drop this share of frames" << std::endl;
+    std::cout << "  --reorder <pct>      Swap this share of frames with the next one" << std::endl;
+    std::cout << "  --sites <n>          Send each frame from <n> sockets, as <n> OP25 sites (default: 1)" << std::endl;
+    std::cout << "  --site-loss <pct>    With --sites, drop this share of copies, per site" << std::endl;
+    std::cout << "  --terminate <pct>    End this share of calls with a terminator (TDU) packet" << std::endl;
+    std::cout << "  --afap               Send as fast as possible instead of every 20 ms" << std::endl;
+    std::cout << "  --spin-us <us>       Spin-wait window before each send (default: 200)" << std::endl;
+    std::cout << "  --stamp              Embed send timestamps for mock-fne latency measurement" << std::endl;
+    std::cout << "  --seed <n>           Random seed (default: 1)" << std::endl;
+    std::cout << "  --embed <config>     Run a gateway in-process from <config> and push frames to it" << std::endl;
+    std::cout << "  --ring <peerId>      Push frames to that gateway pipeline's shared-memory ring" << std::endl;
+    std::cout << "  -o <file>            Write a JSON report" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Distributions (seconds): fixed:<v>  uniform:<min>:<max>  exp:<mean>[:<min>:<max>]" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "-H" && hasValue) {
+            opts.host = argv[++i];
+        } else if (arg == "-p" && hasValue) {
+            opts.port = static_cast<uint16_t>(std::stoul(argv[++i]));
+        } else if (arg == "-n" && hasValue) {
+            opts.channels = std::max<uint32_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "-d" && hasValue) {
+            opts.durationSec = std::stod(argv[++i]);
+        } else if (arg == "--call" && hasValue) {
+            if (!parseDist(argv[++i], opts.callLength)) {
+                std::cerr << "Invalid call length distribution" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--gap" && hasValue) {
+            if (!parseDist(argv[++i], opts.callGap)) {
+                std::cerr << "Invalid gap distribution" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--nac" && hasValue) {
+            opts.nac = static_cast<uint16_t>(std::stoul(argv[++i], nullptr, 16));
+        } else if (arg == "--tg-base" && hasValue) {
+            opts.tgBase = std::stoul(argv[++i]);
+        } else if (arg == "--tg-pool" && hasValue) {
+            opts.tgPool = std::stoul(argv[++i]);
+        } else if (arg == "--src-base" && hasValue) {
+            opts.srcBase = std::stoul(argv[++i]);
+        } else if (arg == "--src-pool" && hasValue) {
+            opts.srcPool = std::stoul(argv[++i]);
+        } else if (arg == "--loss" && hasValue) {
+            opts.lossPct = std::stod(argv[++i]);
+        } else if (arg == "--reorder" && hasValue) {
+            opts.reorderPct = std::stod(argv[++i]);
+        } else if (arg == "--sites" && hasValue) {
+            opts.sites = std::stoul(argv[++i]);
+        } else if (arg == "--site-loss" && hasValue) {
+            opts.siteLossPct = std::stod(argv[++i]);
+        } else if (arg == "--terminate" && hasValue) {
+            opts.terminatePct = std::stod(argv[++i]);
+        } else if (arg == "--afap") {
+            opts.afap = true;
+        } else if (arg == "--stamp") {
+            opts.stamp = true;
+        } else if (arg == "--spin-us" && hasValue) {
+            opts.spinNs = std::stoll(argv[++i]) * 1000;
+        } else if (arg == "--seed" && hasValue) {
+            opts.seed = std::stoul(argv[++i]);
+        } else if (arg == "-o" && hasValue) {
+            opts.reportFile = argv[++i];
+        } else if (arg == "--embed" && hasValue) {
+            opts.embedConfig = argv[++i];
+        } else if (arg == "--ring" && hasValue) {
+            opts.ringPeerId = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    LoadGenerator gen(opts);
+    if (!gen.open()) {
+        return 1;
+    }
+
+    gen.run();
+    gen.printReport(std::cout);
+
+    if (!opts.reportFile.empty() && !gen.writeJsonReport(opts.reportFile)) {
+        return 1;
+    }
+
+    return 0;
+}
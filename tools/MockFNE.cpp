@@ -0,0 +1,856 @@
+// mock-fne - local stand-in for a DVM FNE for load and soak testing
+//
+// Implements the peer side of the FNE protocol the gateway speaks: the
+// RPTL/RPTK/RPTC login with salted SHA256 verification, PING/PONG, and P25
+// voice frames. Every frame's DVM CRC and P25 layout is checked, and each
+// stream's sequence gaps and LDU arrival jitter are recorded. Link
+// impairments (loss, delay, duplication, NAK, forced disconnect) can be
+// injected to exercise the gateway's recovery paths.
+
+#include "P25Utils.h"
+#include "Logger.h"
+#include "LatencyStamp.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <cmath>
+#include <atomic>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <openssl/sha.h>
+
+using namespace op25gateway;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<bool> g_running(true);
+
+void signalHandler(int) {
+    g_running = false;
+}
+
+// Nominal spacing of LDUs in a voice stream (9 x 20 ms IMBE frames)
+constexpr double LDU_INTERVAL_MS = 180.0;
+
+struct Impairments {
+    double lossPct = 0.0;           // Drop this share of datagrams (both directions)
+    double dupPct = 0.0;            // Duplicate this share of datagrams (both directions)
+    uint32_t delayMs = 0;           // Fixed one-way delay
+    uint32_t jitterMs = 0;          // Uniform extra delay 0..jitterMs
+    uint32_t nakLogins = 0;         // NAK this many login attempts before accepting
+    double nakPct = 0.0;            // NAK this share of voice frames
+    uint32_t disconnectEverySec = 0;// Drop the peer session periodically (0 = never)
+    uint32_t blackoutMs = 0;        // Ignore all traffic this long after a forced disconnect
+};
+
+struct StreamStats {
+    uint32_t streamId = 0;
+    uint32_t srcId = 0;
+    uint32_t dstId = 0;
+    uint64_t ldu1 = 0;
+    uint64_t ldu2 = 0;
+    uint64_t tdu = 0;
+    uint64_t grantDemands = 0;
+    uint64_t seqGaps = 0;           // Frames missing according to the RTP sequence
+    uint64_t seqDuplicates = 0;
+    uint64_t seqReordered = 0;
+    uint64_t layoutErrors = 0;
+    bool haveSeq = false;
+    uint16_t lastSeq = 0;
+    bool ended = false;
+
+    // LDU arrival timing
+    bool haveArrival = false;
+    Clock::time_point firstArrival;
+    Clock::time_point lastArrival;
+    double jitterMs = 0.0;          // RFC 3550 style smoothed deviation from 180 ms
+    double maxInterarrivalMs = 0.0;
+    std::vector<float> interarrivalMs;
+};
+
+struct PeerSession {
+    enum class State { NONE, CHALLENGED, AUTHENTICATED, CONFIGURED };
+
+    State state = State::NONE;
+    uint32_t peerId = 0;
+    uint32_t salt = 0;
+    struct sockaddr_in addr;
+    Clock::time_point lastSeen;
+};
+
+struct Pending {
+    Clock::time_point due;
+    bool inbound;
+    std::vector<uint8_t> data;
+    struct sockaddr_in addr;
+};
+
+double percentile(std::vector<float> values, double pct) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t idx = static_cast<size_t>(std::ceil(pct / 100.0 * values.size())) - 1;
+    return values[std::min(idx, values.size() - 1)];
+}
+
+uint32_t readU32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+class MockFNE {
+public:
+    MockFNE(uint16_t port, const std::string& password, const Impairments& impairments, uint32_t seed)
+        : m_port(port)
+        , m_password(password)
+        , m_impairments(impairments)
+        , m_rng(seed)
+        , m_socket(-1)
+        , m_seq(0)
+        , m_timestamp(0)
+        , m_loginAttempts(0)
+        , m_blackoutUntil(Clock::time_point::min())
+    {
+    }
+
+    ~MockFNE() {
+        if (m_socket >= 0) {
+            close(m_socket);
+        }
+    }
+
+    bool start() {
+        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_socket < 0) {
+            LOG_ERROR("MockFNE: Failed to create socket");
+            return false;
+        }
+
+        int opt = 1;
+        setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(m_port);
+
+        if (bind(m_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            LOG_ERROR("MockFNE: Failed to bind to port " + std::to_string(m_port));
+            return false;
+        }
+
+        m_started = Clock::now();
+        m_nextDisconnect = m_started + std::chrono::seconds(m_impairments.disconnectEverySec);
+
+        LOG_INFO("MockFNE: Listening on UDP port " + std::to_string(m_port));
+        return true;
+    }
+
+    void run(uint32_t reportIntervalSec) {
+        uint8_t buffer[2048];
+        Clock::time_point nextReport = Clock::now() + std::chrono::seconds(reportIntervalSec);
+
+        while (g_running) {
+            Clock::time_point now = Clock::now();
+
+            // Deliver anything whose injected delay has expired
+            while (!m_pending.empty() && m_pending.begin()->first <= now) {
+                Pending item = std::move(m_pending.begin()->second);
+                m_pending.erase(m_pending.begin());
+                if (item.inbound) {
+                    handleDatagram(item.data.data(), item.data.size(), item.addr, now);
+                } else {
+                    transmit(item.data.data(), item.data.size(), item.addr);
+                }
+            }
+
+            if (m_impairments.disconnectEverySec > 0 && now >= m_nextDisconnect) {
+                forceDisconnect(now);
+                m_nextDisconnect = now + std::chrono::seconds(m_impairments.disconnectEverySec);
+            }
+
+            if (reportIntervalSec > 0 && now >= nextReport) {
+                printReport(false);
+                nextReport = now + std::chrono::seconds(reportIntervalSec);
+            }
+
+            int timeoutMs = 100;
+            if (!m_pending.empty()) {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    m_pending.begin()->first - now).count();
+                timeoutMs = std::max<int>(0, std::min<int>(timeoutMs, static_cast<int>(wait)));
+            }
+
+            struct pollfd pfd;
+            pfd.fd = m_socket;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, timeoutMs) <= 0) {
+                continue;
+            }
+
+            struct sockaddr_in from;
+            socklen_t fromLen = sizeof(from);
+            ssize_t len = recvfrom(m_socket, buffer, sizeof(buffer), 0,
+                                   (struct sockaddr*)&from, &fromLen);
+            if (len <= 0) continue;
+
+            m_datagramsIn++;
+            now = Clock::now();
+
+            if (now < m_blackoutUntil) {
+                m_blackoutDropped++;
+                continue;
+            }
+
+            // Link impairments on the way in
+            if (chance(m_impairments.lossPct)) {
+                m_impairedLost++;
+                continue;
+            }
+
+            int copies = chance(m_impairments.dupPct) ? 2 : 1;
+            if (copies > 1) m_impairedDuplicated++;
+
+            for (int i = 0; i < copies; i++) {
+                uint32_t delay = linkDelayMs();
+                if (delay == 0) {
+                    handleDatagram(buffer, len, from, now);
+                } else {
+                    Pending item;
+                    item.due = now + std::chrono::milliseconds(delay);
+                    item.inbound = true;
+                    item.data.assign(buffer, buffer + len);
+                    item.addr = from;
+                    m_pending.emplace(item.due, std::move(item));
+                }
+            }
+        }
+    }
+
+    void printReport(bool final) {
+        std::stringstream ss;
+        ss << "MockFNE: " << (final ? "Final report" : "Report")
+           << " - datagrams=" << m_datagramsIn
+           << " logins=" << m_logins
+           << " pings=" << m_pings
+           << " crcErrors=" << m_crcErrors
+           << " malformed=" << m_malformed
+           << " naks=" << m_naksSent
+           << " lost=" << m_impairedLost
+           << " dup=" << m_impairedDuplicated
+           << " streams=" << m_streams.size();
+        if (!m_latencyUs.empty()) {
+            ss << std::fixed << std::setprecision(1)
+               << " latency p50=" << percentile(m_latencyUs, 50.0) << "us"
+               << " p99=" << percentile(m_latencyUs, 99.0) << "us"
+               << " max=" << percentile(m_latencyUs, 100.0) << "us";
+        }
+        LOG_INFO(ss.str());
+
+        for (const auto& entry : m_streams) {
+            const StreamStats& st = entry.second;
+            if (!final && st.ended) continue;
+
+            std::stringstream line;
+            line << "MockFNE:   stream 0x" << std::hex << st.streamId << std::dec
+                 << " src=" << st.srcId << " dst=" << st.dstId
+                 << " LDU1=" << st.ldu1 << " LDU2=" << st.ldu2 << " TDU=" << st.tdu
+                 << " gaps=" << st.seqGaps << " dups=" << st.seqDuplicates
+                 << " reordered=" << st.seqReordered << " layoutErrors=" << st.layoutErrors
+                 << std::fixed << std::setprecision(2)
+                 << " jitter=" << st.jitterMs << "ms"
+                 << " p99=" << percentile(st.interarrivalMs, 99.0) << "ms"
+                 << " max=" << st.maxInterarrivalMs << "ms"
+                 << (st.ended ? " (ended)" : "");
+            LOG_INFO(line.str());
+        }
+    }
+
+    bool writeJsonReport(const std::string& path) {
+        std::ofstream out(path);
+        if (!out.good()) {
+            LOG_ERROR("MockFNE: Failed to write report to " + path);
+            return false;
+        }
+
+        out << std::fixed << std::setprecision(3);
+        out << "{\n";
+        out << "  \"datagrams\": " << m_datagramsIn << ",\n";
+        out << "  \"logins\": " << m_logins << ",\n";
+        out << "  \"loginRejects\": " << m_loginRejects << ",\n";
+        out << "  \"pings\": " << m_pings << ",\n";
+        out << "  \"crcErrors\": " << m_crcErrors << ",\n";
+        out << "  \"malformed\": " << m_malformed << ",\n";
+        out << "  \"naksSent\": " << m_naksSent << ",\n";
+        out << "  \"forcedDisconnects\": " << m_forcedDisconnects << ",\n";
+        out << "  \"impaired\": {\"lost\": " << m_impairedLost
+            << ", \"duplicated\": " << m_impairedDuplicated
+            << ", \"blackout\": " << m_blackoutDropped << "},\n";
+        out << "  \"latency\": {\"samples\": " << m_latencyUs.size()
+            << ", \"p50Us\": " << percentile(m_latencyUs, 50.0)
+            << ", \"p90Us\": " << percentile(m_latencyUs, 90.0)
+            << ", \"p99Us\": " << percentile(m_latencyUs, 99.0)
+            << ", \"p999Us\": " << percentile(m_latencyUs, 99.9)
+            << ", \"maxUs\": " << percentile(m_latencyUs, 100.0) << "},\n";
+        out << "  \"streams\": [";
+
+        bool first = true;
+        for (const auto& entry : m_streams) {
+            const StreamStats& st = entry.second;
+            out << (first ? "\n" : ",\n");
+            first = false;
+            out << "    {\"streamId\": " << st.streamId
+                << ", \"srcId\": " << st.srcId
+                << ", \"dstId\": " << st.dstId
+                << ", \"ldu1\": " << st.ldu1
+                << ", \"ldu2\": " << st.ldu2
+                << ", \"tdu\": " << st.tdu
+                << ", \"grantDemands\": " << st.grantDemands
+                << ", \"seqGaps\": " << st.seqGaps
+                << ", \"seqDuplicates\": " << st.seqDuplicates
+                << ", \"seqReordered\": " << st.seqReordered
+                << ", \"layoutErrors\": " << st.layoutErrors
+                << ", \"jitterMs\": " << st.jitterMs
+                << ", \"interarrivalP50Ms\": " << percentile(st.interarrivalMs, 50.0)
+                << ", \"interarrivalP99Ms\": " << percentile(st.interarrivalMs, 99.0)
+                << ", \"interarrivalMaxMs\": " << st.maxInterarrivalMs
+                << ", \"ended\": " << (st.ended ? "true" : "false") << "}";
+        }
+
+        out << (first ? "]\n" : "\n  ]\n");
+        out << "}\n";
+        return true;
+    }
+
+private:
+    bool chance(double pct) {
+        if (pct <= 0.0) return false;
+        return std::uniform_real_distribution<double>(0.0, 100.0)(m_rng) < pct;
+    }
+
+    uint32_t linkDelayMs() {
+        uint32_t delay = m_impairments.delayMs;
+        if (m_impairments.jitterMs > 0) {
+            delay += std::uniform_int_distribution<uint32_t>(0, m_impairments.jitterMs)(m_rng);
+        }
+        return delay;
+    }
+
+    std::string peerKey(const struct sockaddr_in& addr) const {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+    }
+
+    void transmit(const uint8_t* data, size_t len, const struct sockaddr_in& addr) {
+        sendto(m_socket, data, len, 0, (const struct sockaddr*)&addr, sizeof(addr));
+    }
+
+    // Outbound datagrams go through the same impairments as inbound ones
+    void reply(const std::vector<uint8_t>& data, const struct sockaddr_in& addr) {
+        if (chance(m_impairments.lossPct)) {
+            m_impairedLost++;
+            return;
+        }
+
+        int copies = chance(m_impairments.dupPct) ? 2 : 1;
+        if (copies > 1) m_impairedDuplicated++;
+
+        for (int i = 0; i < copies; i++) {
+            uint32_t delay = linkDelayMs();
+            if (delay == 0) {
+                transmit(data.data(), data.size(), addr);
+            } else {
+                Pending item;
+                item.due = Clock::now() + std::chrono::milliseconds(delay);
+                item.inbound = false;
+                item.data = data;
+                item.addr = addr;
+                m_pending.emplace(item.due, std::move(item));
+            }
+        }
+    }
+
+    std::vector<uint8_t> buildFrame(uint8_t func, uint32_t streamId, uint32_t peerId,
+                                    const uint8_t* payload, size_t payloadLen) {
+        std::vector<uint8_t> frame(32 + payloadLen);
+        P25Utils::buildDVMHeader(frame.data(), func, NET_SUBFUNC_NOP, streamId, peerId,
+                                  m_seq, m_timestamp, payloadLen);
+        if (payloadLen > 0) {
+            std::memcpy(frame.data() + 32, payload, payloadLen);
+        }
+        P25Utils::insertDVMCrc(frame.data(), frame.size());
+        return frame;
+    }
+
+    void sendAck(PeerSession& peer, uint32_t streamId, const uint8_t* data, size_t dataLen) {
+        // ACK payload: peer ID, two reserved bytes, then message data
+        uint8_t payload[64];
+        std::memset(payload, 0, sizeof(payload));
+        payload[0] = (peer.peerId >> 24) & 0xFF;
+        payload[1] = (peer.peerId >> 16) & 0xFF;
+        payload[2] = (peer.peerId >> 8) & 0xFF;
+        payload[3] = peer.peerId & 0xFF;
+        if (dataLen > 0) {
+            std::memcpy(payload + 6, data, dataLen);
+        }
+        reply(buildFrame(NET_FUNC_ACK, streamId, peer.peerId, payload, 6 + dataLen), peer.addr);
+    }
+
+    void sendNak(uint32_t peerId, uint32_t streamId, const struct sockaddr_in& addr,
+                 uint16_t reason = NET_CONN_NAK_GENERAL_FAILURE) {
+        uint8_t payload[6];
+        payload[0] = (peerId >> 24) & 0xFF;
+        payload[1] = (peerId >> 16) & 0xFF;
+        payload[2] = (peerId >> 8) & 0xFF;
+        payload[3] = peerId & 0xFF;
+        payload[4] = (reason >> 8) & 0xFF;
+        payload[5] = reason & 0xFF;
+        reply(buildFrame(NET_FUNC_NAK, streamId, peerId, payload, sizeof(payload)), addr);
+        m_naksSent++;
+    }
+
+    void forceDisconnect(Clock::time_point now) {
+        for (auto& entry : m_peers) {
+            PeerSession& peer = entry.second;
+            if (peer.state == PeerSession::State::NONE) continue;
+
+            LOG_WARN("MockFNE: Forcing disconnect of peer " + std::to_string(peer.peerId));
+            std::vector<uint8_t> disc = buildFrame(NET_FUNC_RPT_DISC, 0, peer.peerId, nullptr, 0);
+            transmit(disc.data(), disc.size(), peer.addr);
+            peer.state = PeerSession::State::NONE;
+        }
+
+        m_forcedDisconnects++;
+        if (m_impairments.blackoutMs > 0) {
+            m_blackoutUntil = now + std::chrono::milliseconds(m_impairments.blackoutMs);
+        }
+    }
+
+    void handleDatagram(const uint8_t* data, size_t len, const struct sockaddr_in& from,
+                        Clock::time_point now) {
+        if (len < 32 || data[0] != 0x90 || data[13] != DVM_FRAME_START) {
+            m_malformed++;
+            return;
+        }
+
+        uint32_t messageLen = readU32(data + 28);
+        if (messageLen != len - 32) {
+            m_malformed++;
+            LOG_WARN("MockFNE: Length mismatch (header=" + std::to_string(messageLen) +
+                     " actual=" + std::to_string(len - 32) + ")");
+            return;
+        }
+
+        uint16_t crc = ((uint16_t)data[16] << 8) | data[17];
+        if (crc != P25Utils::crc16_ccitt(data + 32, len - 32)) {
+            m_crcErrors++;
+            LOG_WARN("MockFNE: CRC error on function 0x" + hex(data[18]));
+            return;
+        }
+
+        uint8_t func = data[18];
+        uint32_t streamId = readU32(data + 20);
+        uint32_t peerId = readU32(data + 24);
+
+        PeerSession& peer = m_peers[peerKey(from)];
+        peer.addr = from;
+        peer.lastSeen = now;
+
+        switch (func) {
+            case NET_FUNC_RPTL:
+                handleLogin(peer, data, len, streamId);
+                break;
+            case NET_FUNC_RPTK:
+                handleAuth(peer, data, len, streamId);
+                break;
+            case NET_FUNC_RPTC:
+                handleConfig(peer, data, len, streamId);
+                break;
+            case NET_FUNC_PING:
+                m_pings++;
+                if (peer.state != PeerSession::State::CONFIGURED) {
+                    sendNak(peerId, streamId, from, NET_CONN_NAK_FNE_UNAUTHORIZED);
+                } else {
+                    reply(buildFrame(NET_FUNC_PONG, streamId, peer.peerId, nullptr, 0), from);
+                }
+                break;
+            case NET_FUNC_RPT_DISC:
+                LOG_INFO("MockFNE: Peer " + std::to_string(peerId) + " disconnected");
+                peer.state = PeerSession::State::NONE;
+                break;
+            case NET_FUNC_PROTOCOL:
+                if (peer.state != PeerSession::State::CONFIGURED) {
+                    sendNak(peerId, streamId, from, NET_CONN_NAK_FNE_UNAUTHORIZED);
+                    return;
+                }
+                if (chance(m_impairments.nakPct)) {
+                    sendNak(peerId, streamId, from);
+                    return;
+                }
+                if (data[19] == NET_SUBFUNC_P25) {
+                    handleP25(data, len, streamId, now);
+                } else {
+                    m_malformed++;
+                }
+                break;
+            default:
+                LOG_WARN("MockFNE: Unexpected function 0x" + hex(func));
+                m_malformed++;
+                break;
+        }
+    }
+
+    void handleLogin(PeerSession& peer, const uint8_t* data, size_t len, uint32_t streamId) {
+        if (len < 40 || std::memcmp(data + 32, "RPTL", 4) != 0) {
+            m_malformed++;
+            return;
+        }
+
+        peer.peerId = readU32(data + 36);
+        m_loginAttempts++;
+
+        if (m_loginAttempts <= m_impairments.nakLogins) {
+            LOG_WARN("MockFNE: NAK login from peer " + std::to_string(peer.peerId) + " (impairment)");
+            m_loginRejects++;
+            sendNak(peer.peerId, streamId, peer.addr);
+            return;
+        }
+
+        peer.salt = static_cast<uint32_t>(m_rng());
+        peer.state = PeerSession::State::CHALLENGED;
+
+        uint8_t salt[4];
+        salt[0] = (peer.salt >> 24) & 0xFF;
+        salt[1] = (peer.salt >> 16) & 0xFF;
+        salt[2] = (peer.salt >> 8) & 0xFF;
+        salt[3] = peer.salt & 0xFF;
+        sendAck(peer, streamId, salt, sizeof(salt));
+
+        LOG_INFO("MockFNE: Login from peer " + std::to_string(peer.peerId) + ", challenge sent");
+    }
+
+    void handleAuth(PeerSession& peer, const uint8_t* data, size_t len, uint32_t streamId) {
+        if (len < 72 || std::memcmp(data + 32, "RPTK", 4) != 0) {
+            m_malformed++;
+            return;
+        }
+
+        if (peer.state != PeerSession::State::CHALLENGED || readU32(data + 36) != peer.peerId) {
+            m_loginRejects++;
+            sendNak(peer.peerId, streamId, peer.addr);
+            return;
+        }
+
+        std::vector<uint8_t> hashData;
+        hashData.push_back((peer.salt >> 24) & 0xFF);
+        hashData.push_back((peer.salt >> 16) & 0xFF);
+        hashData.push_back((peer.salt >> 8) & 0xFF);
+        hashData.push_back(peer.salt & 0xFF);
+        hashData.insert(hashData.end(), m_password.begin(), m_password.end());
+
+        uint8_t expected[32];
+        SHA256(hashData.data(), hashData.size(), expected);
+
+        if (std::memcmp(expected, data + 40, sizeof(expected)) != 0) {
+            LOG_WARN("MockFNE: Bad password hash from peer " + std::to_string(peer.peerId));
+            m_loginRejects++;
+            peer.state = PeerSession::State::NONE;
+            sendNak(peer.peerId, streamId, peer.addr);
+            return;
+        }
+
+        peer.state = PeerSession::State::AUTHENTICATED;
+        sendAck(peer, streamId, nullptr, 0);
+    }
+
+    void handleConfig(PeerSession& peer, const uint8_t* data, size_t len, uint32_t streamId) {
+        if (len < 40 || std::memcmp(data + 32, "RPTC", 4) != 0) {
+            m_malformed++;
+            return;
+        }
+
+        if (peer.state != PeerSession::State::AUTHENTICATED) {
+            m_loginRejects++;
+            sendNak(peer.peerId, streamId, peer.addr);
+            return;
+        }
+
+        peer.state = PeerSession::State::CONFIGURED;
+        m_logins++;
+        sendAck(peer, streamId, nullptr, 0);
+
+        std::string config(reinterpret_cast<const char*>(data + 40), len - 40);
+        LOG_INFO("MockFNE: Peer " + std::to_string(peer.peerId) + " configured: " + config);
+    }
+
+    void handleP25(const uint8_t* data, size_t len, uint32_t streamId, Clock::time_point now) {
+        const uint8_t* p25 = data + 32;
+        size_t p25Len = len - 32;
+
+        StreamStats& st = m_streams[streamId];
+        st.streamId = streamId;
+
+        if (p25Len < 24 || std::memcmp(p25, "P25D", 4) != 0) {
+            st.layoutErrors++;
+            return;
+        }
+
+        uint8_t duid = p25[22];
+        size_t expectedLen = 0;
+        switch (duid) {
+            case P25_DUID_LDU1: expectedLen = P25_LDU1_LENGTH; break;
+            case P25_DUID_LDU2: expectedLen = P25_LDU2_LENGTH; break;
+            case P25_DUID_TDU:  expectedLen = P25_TDU_LENGTH; break;
+            default: break;
+        }
+
+        if (expectedLen == 0 || p25Len != expectedLen) {
+            st.layoutErrors++;
+            LOG_WARN("MockFNE: Bad P25 layout on stream 0x" + hex(streamId) +
+                     " (DUID=0x" + hex(duid) + " len=" + std::to_string(p25Len) + ")");
+            return;
+        }
+
+        st.srcId = ((uint32_t)p25[5] << 16) | ((uint32_t)p25[6] << 8) | p25[7];
+        st.dstId = ((uint32_t)p25[8] << 16) | ((uint32_t)p25[9] << 8) | p25[10];
+
+        // Voice frame markers must be where the DFSI layout puts them
+        if (duid == P25_DUID_LDU1 || duid == P25_DUID_LDU2) {
+            static const size_t offsets[9] = {24, 46, 60, 77, 94, 111, 128, 145, 162};
+            uint8_t firstType = (duid == P25_DUID_LDU1) ? 0x62 : 0x6B;
+            for (int i = 0; i < 9; i++) {
+                if (p25[offsets[i]] != firstType + i) {
+                    st.layoutErrors++;
+                    return;
+                }
+            }
+        }
+
+        uint16_t seq = ((uint16_t)data[2] << 8) | data[3];
+        if (seq != RTP_END_OF_CALL_SEQ) {
+            trackSequence(st, seq);
+        }
+
+        switch (duid) {
+            case P25_DUID_LDU1:
+                st.ldu1++;
+                trackArrival(st, now);
+                trackLatency(p25, now);
+                break;
+            case P25_DUID_LDU2:
+                st.ldu2++;
+                trackArrival(st, now);
+                trackLatency(p25, now);
+                break;
+            case P25_DUID_TDU:
+                st.tdu++;
+                if (p25[14] & NET_CTRL_GRANT_DEMAND) {
+                    st.grantDemands++;
+                } else {
+                    st.ended = true;
+                }
+                break;
+        }
+    }
+
+    void trackSequence(StreamStats& st, uint16_t seq) {
+        if (!st.haveSeq) {
+            st.haveSeq = true;
+            st.lastSeq = seq;
+            return;
+        }
+
+        int16_t delta = static_cast<int16_t>(seq - st.lastSeq);
+        if (delta == 1) {
+            st.lastSeq = seq;
+        } else if (delta == 0) {
+            st.seqDuplicates++;
+        } else if (delta > 1) {
+            st.seqGaps += delta - 1;
+            st.lastSeq = seq;
+        } else {
+            // Arrived after a later frame; it was counted as a gap then
+            st.seqReordered++;
+            if (st.seqGaps > 0) st.seqGaps--;
+        }
+    }
+
+    void trackArrival(StreamStats& st, Clock::time_point now) {
+        if (st.haveArrival) {
+            double deltaMs = std::chrono::duration<double, std::milli>(now - st.lastArrival).count();
+            double deviation = std::fabs(deltaMs - LDU_INTERVAL_MS);
+            st.jitterMs += (deviation - st.jitterMs) / 16.0;
+            st.maxInterarrivalMs = std::max(st.maxInterarrivalMs, deltaMs);
+            st.interarrivalMs.push_back(static_cast<float>(deltaMs));
+        } else {
+            st.haveArrival = true;
+            st.firstArrival = now;
+        }
+        st.lastArrival = now;
+    }
+
+    // Gateway-added latency from op25-loadgen --stamp send times
+    void trackLatency(const uint8_t* p25, Clock::time_point now) {
+        int64_t sentNs;
+        if (!readLatencyStamp(p25 + LATENCY_STAMP_LDU_OFFSET, sentNs)) return;
+
+        // steady_clock is CLOCK_MONOTONIC, the clock the stamp was taken on
+        int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now.time_since_epoch()).count();
+        int64_t latencyNs = nowNs - sentNs;
+        if (latencyNs < 0 || latencyNs > 10000000000LL) return;   // Not a stamp from this host
+
+        if (m_latencyUs.size() < 5000000) {
+            m_latencyUs.push_back(static_cast<float>(latencyNs / 1000.0));
+        }
+    }
+
+    static std::string hex(uint32_t value) {
+        std::stringstream ss;
+        ss << std::hex << value;
+        return ss.str();
+    }
+
+    uint16_t m_port;
+    std::string m_password;
+    Impairments m_impairments;
+    std::mt19937 m_rng;
+    int m_socket;
+
+    uint16_t m_seq;
+    uint32_t m_timestamp;
+
+    std::map<std::string, PeerSession> m_peers;
+    std::map<uint32_t, StreamStats> m_streams;
+    std::vector<float> m_latencyUs;     // Per-LDU gateway latency (stamped traffic only)
+    std::multimap<Clock::time_point, Pending> m_pending;
+
+    uint32_t m_loginAttempts;
+    Clock::time_point m_started;
+    Clock::time_point m_nextDisconnect;
+    Clock::time_point m_blackoutUntil;
+
+    // Statistics
+    uint64_t m_datagramsIn = 0;
+    uint64_t m_logins = 0;
+    uint64_t m_loginRejects = 0;
+    uint64_t m_pings = 0;
+    uint64_t m_crcErrors = 0;
+    uint64_t m_malformed = 0;
+    uint64_t m_naksSent = 0;
+    uint64_t m_forcedDisconnects = 0;
+    uint64_t m_impairedLost = 0;
+    uint64_t m_impairedDuplicated = 0;
+    uint64_t m_blackoutDropped = 0;
+};
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -p <port>              UDP port to listen on (default: 62031)" << std::endl;
+    std::cout << "  -w <password>          Peer password (default: PASSWORD)" << std::endl;
+    std::cout << "  -r <seconds>           Report interval, 0 to disable (default: 10)" << std::endl;
+    std::cout << "  -o <file>              Write a JSON report on exit" << std::endl;
+    std::cout << "  -l <file>              Log file (console output needs a terminal)" << std::endl;
+    std::cout << "  -v                     Debug logging" << std::endl;
+    std::cout << "  --seed <n>             Random seed for impairments (default: 1)" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Impairments:" << std::endl;
+    std::cout << "  --loss <pct>           Drop datagrams in both directions" << std::endl;
+    std::cout << "  --dup <pct>            Duplicate datagrams in both directions" << std::endl;
+    std::cout << "  --delay <ms>           Fixed one-way delay" << std::endl;
+    std::cout << "  --jitter <ms>          Random extra delay up to <ms>" << std::endl;
+    std::cout << "  --nak-logins <n>       NAK the first <n> login attempts" << std::endl;
+    std::cout << "  --nak <pct>            NAK this share of voice frames" << std::endl;
+    std::cout << "  --disconnect-every <s> Drop the peer session every <s> seconds" << std::endl;
+    std::cout << "  --blackout <ms>        Ignore all traffic for <ms> after a forced disconnect" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    uint16_t port = 62031;
+    std::string password = "PASSWORD";
+    uint32_t reportInterval = 10;
+    std::string reportFile;
+    uint32_t seed = 1;
+    Impairments impairments;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "-p" && hasValue) {
+            port = static_cast<uint16_t>(std::stoul(argv[++i]));
+        } else if (arg == "-w" && hasValue) {
+            password = argv[++i];
+        } else if (arg == "-r" && hasValue) {
+            reportInterval = std::stoul(argv[++i]);
+        } else if (arg == "-o" && hasValue) {
+            reportFile = argv[++i];
+        } else if (arg == "-l" && hasValue) {
+            Logger::instance().setLogFile(argv[++i]);
+        } else if (arg == "-v") {
+            Logger::instance().setLevel(LogLevel::DEBUG);
+        } else if (arg == "--seed" && hasValue) {
+            seed = std::stoul(argv[++i]);
+        } else if (arg == "--loss" && hasValue) {
+            impairments.lossPct = std::stod(argv[++i]);
+        } else if (arg == "--dup" && hasValue) {
+            impairments.dupPct = std::stod(argv[++i]);
+        } else if (arg == "--delay" && hasValue) {
+            impairments.delayMs = std::stoul(argv[++i]);
+        } else if (arg == "--jitter" && hasValue) {
+            impairments.jitterMs = std::stoul(argv[++i]);
+        } else if (arg == "--nak-logins" && hasValue) {
+            impairments.nakLogins = std::stoul(argv[++i]);
+        } else if (arg == "--nak" && hasValue) {
+            impairments.nakPct = std::stod(argv[++i]);
+        } else if (arg == "--disconnect-every" && hasValue) {
+            impairments.disconnectEverySec = std::stoul(argv[++i]);
+        } else if (arg == "--blackout" && hasValue) {
+            impairments.blackoutMs = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    MockFNE fne(port, password, impairments, seed);
+    if (!fne.start()) {
+        return 1;
+    }
+
+    fne.run(reportInterval);
+    fne.printReport(true);
+
+    if (!reportFile.empty() && !fne.writeJsonReport(reportFile)) {
+        return 1;
+    }
+
+    return 0;
+}